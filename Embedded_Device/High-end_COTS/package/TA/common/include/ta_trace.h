@@ -0,0 +1,123 @@
+#ifndef TA_TRACE_H
+#define TA_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Tracing of the TA, in two parts:
+ *  - Hex dumps (TA_TRACE_HEX) filtered at compile time against
+ *    TA_TRACE_LEVEL, the calls above it are removed from the build. Each
+ *    dump is a single trace line instead of one printf per byte
+ *  - A ring of binary events (command failures and whatever the TA records
+ *    with ta_trace_record) and per command latency counters, kept in memory
+ *    and read by the host with the drain and stats commands of the TA
+ *
+ * The state is per TA instance: a session of the dpabc TA on OP-TEE (it is
+ * multi instance), every session of the security_api TA (single instance)
+ * and every session of the process under TEE_EMULATION.
+ *
+ * This header is shared with the host for the layout of ta_trace_event and
+ * ta_cmd_stats, it only depends on stdint. The dpabc and the security_api TAs
+ * both build this module from package/TA/common.
+ */
+
+/* Levels of OP-TEE's trace macros */
+#define TA_TRACE_ERROR			1
+#define TA_TRACE_INFO			2
+#define TA_TRACE_DEBUG			3
+
+/* Defaults to the level of EMSG/IMSG/DMSG, errors only if it is not set */
+#ifndef TA_TRACE_LEVEL
+#if defined(TRACE_LEVEL)
+#define TA_TRACE_LEVEL			TRACE_LEVEL
+#elif defined(CFG_TEE_TA_LOG_LEVEL)
+#define TA_TRACE_LEVEL			CFG_TEE_TA_LOG_LEVEL
+#else
+#define TA_TRACE_LEVEL			TA_TRACE_ERROR
+#endif
+#endif
+
+/* Bytes printed by a hex dump, longer buffers are cut */
+#define TA_TRACE_HEX_MAX		64
+
+#define TA_TRACE_HEX(level, label, buf, sz) \
+	do { \
+		if ((level) <= TA_TRACE_LEVEL) \
+			ta_trace_hex((level), (label), (buf), (sz)); \
+	} while (0)
+
+/* Events kept in the ring, the oldest are overwritten (power of two) */
+#define TA_TRACE_RING_SIZE		64
+
+/* Commands with latency counters, ids 0 to TA_TRACE_MAX_CMDS - 1 */
+#define TA_TRACE_MAX_CMDS		32
+
+/* Events recorded by every TA, the TA specific ones start at TA_TRACE_EV_TA */
+#define TA_TRACE_EV_SESSION_OPEN	1	/* value: 0 */
+#define TA_TRACE_EV_SESSION_CLOSE	2	/* value: 0 */
+#define TA_TRACE_EV_CMD_FAILED		3	/* value: TEE_Result of the command */
+#define TA_TRACE_EV_TA			0x100
+
+typedef struct {
+	uint32_t time_ms;		/* TEE_GetSystemTime, wraps after ~49 days */
+	uint16_t cmd;			/* Command running, 0xFFFF outside commands */
+	uint16_t event;			/* TA_TRACE_EV_* */
+	uint32_t value;
+} ta_trace_event;
+
+/* Times in ms, the resolution of TEE_GetSystemTime */
+typedef struct {
+	uint32_t cmd;
+	uint32_t calls;
+	uint32_t errors;		/* Calls not returning TEE_SUCCESS */
+	uint32_t max_ms;
+	uint64_t total_ms;
+} ta_cmd_stats;
+
+/**
+ * @brief Prints sz bytes of buf as one trace line, use TA_TRACE_HEX
+ */
+void ta_trace_hex(int level, const char * label, const void * buf, size_t sz);
+
+/**
+ * @brief Appends an event to the ring, overwriting the oldest one if it is
+ * full
+ */
+void ta_trace_record(uint16_t event, uint32_t value);
+
+/**
+ * @brief Starts timing a command, call it before dispatching it
+ */
+void ta_trace_cmd_begin(uint32_t cmd);
+
+/**
+ * @brief Accounts the command started with ta_trace_cmd_begin, recording a
+ * TA_TRACE_EV_CMD_FAILED event if res is not TEE_SUCCESS
+ */
+void ta_trace_cmd_end(uint32_t res);
+
+/**
+ * @brief Moves the oldest events of the ring to events, as many as fit in
+ * max_events
+ *
+ * @param dropped events overwritten before being drained since the last call
+ * @return number of events written
+ */
+uint32_t ta_trace_drain(ta_trace_event * events, uint32_t max_events, uint32_t * dropped);
+
+/**
+ * @brief Copies the counters of the commands called at least once
+ *
+ * @param stats NULL to only count them
+ * @return number of commands with counters, which may exceed max_stats (only
+ * max_stats are written then)
+ */
+uint32_t ta_trace_stats(ta_cmd_stats * stats, uint32_t max_stats);
+
+/**
+ * @brief Zeroes the command counters
+ */
+void ta_trace_stats_reset(void);
+
+#endif /* TA_TRACE_H */
@@ -0,0 +1,123 @@
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include <ta_trace.h>
+
+#define NO_CMD				0xFFFF
+
+static struct {
+	ta_trace_event ring[TA_TRACE_RING_SIZE];
+	uint32_t head;			/* Next event written */
+	uint32_t tail;			/* Oldest event not drained */
+	uint32_t dropped;
+	uint16_t cmd;
+	uint32_t cmd_start;
+	ta_cmd_stats cmds[TA_TRACE_MAX_CMDS];
+} trace = { .cmd = NO_CMD };
+
+static uint32_t now_ms(void)
+{
+	TEE_Time t;
+
+	TEE_GetSystemTime(&t);
+	return t.seconds * 1000 + t.millis;
+}
+
+void ta_trace_hex(int level, const char *label, const void *buf, size_t sz)
+{
+	static const char digits[] = "0123456789abcdef";
+	const uint8_t *b = buf;
+	char line[2 * TA_TRACE_HEX_MAX + 1];
+	size_t n = sz < TA_TRACE_HEX_MAX ? sz : TA_TRACE_HEX_MAX;
+
+	for (size_t i = 0; i < n; i++) {
+		line[2 * i] = digits[b[i] >> 4];
+		line[2 * i + 1] = digits[b[i] & 0xF];
+	}
+	line[2 * n] = '\0';
+
+	if (level <= TA_TRACE_ERROR)
+		EMSG("%s (%zu bytes): %s%s", label, sz, line, n < sz ? "..." : "");
+	else if (level == TA_TRACE_INFO)
+		IMSG("%s (%zu bytes): %s%s", label, sz, line, n < sz ? "..." : "");
+	else
+		DMSG("%s (%zu bytes): %s%s", label, sz, line, n < sz ? "..." : "");
+}
+
+void ta_trace_record(uint16_t event, uint32_t value)
+{
+	ta_trace_event *ev = &trace.ring[trace.head % TA_TRACE_RING_SIZE];
+
+	if (trace.head - trace.tail == TA_TRACE_RING_SIZE) {
+		trace.tail++;
+		trace.dropped++;
+	}
+
+	ev->time_ms = now_ms();
+	ev->cmd = trace.cmd;
+	ev->event = event;
+	ev->value = value;
+	trace.head++;
+}
+
+void ta_trace_cmd_begin(uint32_t cmd)
+{
+	trace.cmd = cmd < NO_CMD ? cmd : NO_CMD;
+	trace.cmd_start = now_ms();
+}
+
+void ta_trace_cmd_end(uint32_t res)
+{
+	uint32_t elapsed = now_ms() - trace.cmd_start;
+
+	if (trace.cmd < TA_TRACE_MAX_CMDS) {
+		ta_cmd_stats *s = &trace.cmds[trace.cmd];
+
+		s->cmd = trace.cmd;
+		s->calls++;
+		s->total_ms += elapsed;
+		if (elapsed > s->max_ms)
+			s->max_ms = elapsed;
+		if (res != TEE_SUCCESS)
+			s->errors++;
+	}
+
+	if (res != TEE_SUCCESS)
+		ta_trace_record(TA_TRACE_EV_CMD_FAILED, res);
+	trace.cmd = NO_CMD;
+}
+
+uint32_t ta_trace_drain(ta_trace_event *events, uint32_t max_events,
+			uint32_t *dropped)
+{
+	uint32_t n = 0;
+
+	while (n < max_events && trace.tail != trace.head) {
+		events[n++] = trace.ring[trace.tail % TA_TRACE_RING_SIZE];
+		trace.tail++;
+	}
+
+	*dropped = trace.dropped;
+	trace.dropped = 0;
+	return n;
+}
+
+uint32_t ta_trace_stats(ta_cmd_stats *stats, uint32_t max_stats)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < TA_TRACE_MAX_CMDS; i++) {
+		if (!trace.cmds[i].calls)
+			continue;
+		if (stats && n < max_stats)
+			stats[n] = trace.cmds[i];
+		n++;
+	}
+
+	return n;
+}
+
+void ta_trace_stats_reset(void)
+{
+	TEE_MemFill(trace.cmds, 0, sizeof(trace.cmds));
+}
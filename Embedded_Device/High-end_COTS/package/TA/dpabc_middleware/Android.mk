@@ -7,7 +7,8 @@ LOCAL_CFLAGS += -Wall
 
 LOCAL_SRC_FILES += host/main.c
 
-LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include \
+                    $(LOCAL_PATH)/../common/include
 
 LOCAL_SHARED_LIBRARIES := libteec
 LOCAL_MODULE := optee_example_myexample
@@ -0,0 +1,155 @@
+#include <Zp.h>
+#include <Dpabc.h>
+#include <dpabc_middleware.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Compares operations per second of one TA invocation per operation against the batched commands
+// Usage: batch_benchmark [n operations] [nattr]
+
+static double elapsed(struct timespec * start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char * name, int n, double percall, double batch) {
+	printf("%-8s x%d  per-call %8.1f ops/s  batch %8.1f ops/s  (%.2fx)\n",
+	       name, n, n / percall, n / batch, percall / batch);
+}
+
+int main(int argc, char ** argv) {
+
+	DPABC_session session;
+	int n = argc > 1 ? atoi(argv[1]) : 32;
+	int nattr = argc > 2 ? atoi(argv[2]) : 6;
+	char * key_id = "batch_benchmark_key";
+	char * msg = "benchmarkMessage";
+	int indexReveal[] = {0};
+	char * pk;
+	size_t pk_sz;
+	char * sig;
+	size_t sig_sz;
+	char * token;
+	size_t token_sz;
+	char (*sig_ids)[32] = malloc(n * sizeof(*sig_ids));
+	DPABC_signRequest * sign_requests = malloc(n * sizeof(DPABC_signRequest));
+	DPABC_verifyRequest * verify_requests = malloc(n * sizeof(DPABC_verifyRequest));
+	DPABC_zkTokenRequest * zk_requests = malloc(n * sizeof(DPABC_zkTokenRequest));
+	char * attr = malloc(nattr * zpByteSize());
+	char * epoch = malloc(zpByteSize());
+	struct timespec start;
+	double percall, batch;
+	int ok = 1;
+
+	for (int i = 0; i < nattr; i++) {
+		Zp * a = zpFromInt(i + 1);
+		zpToBytes(attr + i * zpByteSize(), a);
+		zpFree(a);
+	}
+	Zp * e = zpFromInt(12034);
+	zpToBytes(epoch, e);
+	zpFree(e);
+
+	if (DPABC_initialize(&session) != STATUS_OK)
+		return 1;
+	DPABC_generate_key(&session, key_id, nattr);	// Already generated in previous runs
+	if (DPABC_get_key(&session, key_id, &pk, &pk_sz) != STATUS_OK)
+		return 1;
+
+	// Sign
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < n; i++) {
+		ok &= DPABC_sign(&session, key_id, epoch, zpByteSize(), attr, nattr * zpByteSize(), &sig, &sig_sz) == STATUS_OK;
+		free(sig);
+	}
+	percall = elapsed(&start);
+
+	for (int i = 0; i < n; i++) {
+		sign_requests[i].key_id = key_id;
+		sign_requests[i].epoch = epoch;
+		sign_requests[i].epoch_sz = zpByteSize();
+		sign_requests[i].attr = attr;
+		sign_requests[i].attr_sz = nattr * zpByteSize();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ok &= DPABC_signBatch(&session, sign_requests, n) == STATUS_OK;
+	batch = elapsed(&start);
+	report("sign", n, percall, batch);
+
+	for (int i = 0; i < n; i++) {
+		snprintf(sig_ids[i], sizeof(sig_ids[i]), "batch_benchmark_sig_%d", i);
+		ok &= sign_requests[i].status == STATUS_OK;
+		ok &= DPABC_storeSignature(&session, sig_ids[i], sign_requests[i].sig, sign_requests[i].sig_sz) == STATUS_OK;
+		free(sign_requests[i].sig);
+	}
+
+	// Verify stored
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < n; i++)
+		ok &= DPABC_verifyStored(&session, pk, pk_sz, epoch, zpByteSize(), attr, nattr * zpByteSize(), sig_ids[i]) == STATUS_OK;
+	percall = elapsed(&start);
+
+	for (int i = 0; i < n; i++) {
+		verify_requests[i].pk = pk;
+		verify_requests[i].pk_sz = pk_sz;
+		verify_requests[i].epoch = epoch;
+		verify_requests[i].epoch_sz = zpByteSize();
+		verify_requests[i].attr = attr;
+		verify_requests[i].attr_sz = nattr * zpByteSize();
+		verify_requests[i].sig_id = sig_ids[i];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ok &= DPABC_verifyBatch(&session, verify_requests, n) == STATUS_OK;
+	batch = elapsed(&start);
+	for (int i = 0; i < n; i++)
+		ok &= verify_requests[i].status == STATUS_OK;
+	report("verify", n, percall, batch);
+
+	// Zero-knowledge tokens
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < n; i++) {
+		ok &= DPABC_generateZKtoken(&session, pk, pk_sz, sig_ids[i], epoch, zpByteSize(), attr, nattr * zpByteSize(),
+					    indexReveal, sizeof(indexReveal), msg, strlen(msg), &token, &token_sz) == STATUS_OK;
+		free(token);
+	}
+	percall = elapsed(&start);
+
+	for (int i = 0; i < n; i++) {
+		zk_requests[i].pk = pk;
+		zk_requests[i].pk_sz = pk_sz;
+		zk_requests[i].sign_id = sig_ids[i];
+		zk_requests[i].epoch = epoch;
+		zk_requests[i].epoch_sz = zpByteSize();
+		zk_requests[i].attr = attr;
+		zk_requests[i].attr_sz = nattr * zpByteSize();
+		zk_requests[i].indexReveal = indexReveal;
+		zk_requests[i].indexReveal_sz = sizeof(indexReveal);
+		zk_requests[i].msg = msg;
+		zk_requests[i].msg_sz = strlen(msg);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ok &= DPABC_generateZKtokenBatch(&session, zk_requests, n) == STATUS_OK;
+	batch = elapsed(&start);
+	for (int i = 0; i < n; i++) {
+		ok &= zk_requests[i].status == STATUS_OK;
+		free(zk_requests[i].zkToken);
+	}
+	report("zktoken", n, percall, batch);
+
+	printf("All operations succeeded: %d\n", ok);
+
+	DPABC_finalize(&session);
+	free(pk);
+	free(sig_ids);
+	free(sign_requests);
+	free(verify_requests);
+	free(zk_requests);
+	free(attr);
+	free(epoch);
+	return !ok;
+}
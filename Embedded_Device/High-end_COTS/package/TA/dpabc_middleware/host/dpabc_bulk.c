@@ -0,0 +1,431 @@
+#include <dpabc_bulk.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void skip_ws(char ** p) {
+
+	while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n')
+		(*p)++;
+}
+
+static int hex_value(char c) {
+
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Unescapes the string at *p (opening quote) in place, the result is terminated */
+static const char * parse_string(char ** p, char ** value, size_t * value_sz) {
+
+	char * src = *p + 1, * dst = src;
+
+	*value = dst;
+	for (;;) {
+		char c = *src++;
+
+		if (c == '"')
+			break;
+		if (c == '\0' || (unsigned char)c < 0x20)
+			return "unterminated string";
+		if (c != '\\') {
+			*dst++ = c;
+			continue;
+		}
+		switch (c = *src++) {
+		case '"': case '\\': case '/': *dst++ = c; break;
+		case 'b': *dst++ = '\b'; break;
+		case 'f': *dst++ = '\f'; break;
+		case 'n': *dst++ = '\n'; break;
+		case 'r': *dst++ = '\r'; break;
+		case 't': *dst++ = '\t'; break;
+		case 'u': {
+			uint32_t cp = 0;
+
+			for (int i = 0; i < 4; i++) {
+				int h = hex_value(src[i]);
+
+				if (h < 0)
+					return "invalid \\u escape";
+				cp = cp << 4 | h;
+			}
+			src += 4;
+			/* Basic multilingual plane only, always shorter than its escape */
+			if (cp >= 0xD800 && cp <= 0xDFFF)
+				return "surrogate pairs are not supported";
+			if (cp < 0x80) {
+				*dst++ = (char)cp;
+			} else if (cp < 0x800) {
+				*dst++ = (char)(0xC0 | cp >> 6);
+				*dst++ = (char)(0x80 | (cp & 0x3F));
+			} else {
+				*dst++ = (char)(0xE0 | cp >> 12);
+				*dst++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+				*dst++ = (char)(0x80 | (cp & 0x3F));
+			}
+			break;
+		}
+		default:
+			return "invalid escape";
+		}
+	}
+
+	*value_sz = dst - *value;
+	*dst = '\0';
+	*p = src;
+	return NULL;
+}
+
+/* Number or literal, terminated once the whole line is parsed (its delimiter is still needed) */
+static const char * parse_scalar(char ** p, char ** value, size_t * value_sz) {
+
+	char * s = *p;
+
+	while ((*s >= '0' && *s <= '9') || (*s >= 'a' && *s <= 'z') || *s == '-' || *s == '+' || *s == '.' || *s == 'E')
+		s++;
+	*value = *p;
+	*value_sz = s - *p;
+	if (*value_sz == 0)
+		return "invalid value";
+	if (!((**p >= '0' && **p <= '9') || **p == '-') &&
+	    !(*value_sz == 4 && !strncmp(*p, "true", 4)) &&
+	    !(*value_sz == 5 && !strncmp(*p, "false", 5)) &&
+	    !(*value_sz == 4 && !strncmp(*p, "null", 4)))
+		return "invalid value";
+	*p = s;
+	return NULL;
+}
+
+static const char * parse_array(char ** p, DPABC_bulkField * field) {
+
+	int cap = 0;
+	const char * error;
+
+	field->type = DPABC_BULK_ARRAY;
+	(*p)++;
+	skip_ws(p);
+	if (**p == ']') {
+		(*p)++;
+		return NULL;
+	}
+	for (;;) {
+		if (field->nitems == cap) {
+			cap = cap ? 2 * cap : 8;
+			field->items = realloc(field->items, cap * sizeof(char *));
+			field->items_sz = realloc(field->items_sz, cap * sizeof(size_t));
+		}
+		skip_ws(p);
+		if (**p == '"')
+			error = parse_string(p, &field->items[field->nitems], &field->items_sz[field->nitems]);
+		else if (**p == '[' || **p == '{')
+			error = "nested values are not supported";
+		else
+			error = parse_scalar(p, &field->items[field->nitems], &field->items_sz[field->nitems]);
+		if (error)
+			return error;
+		field->nitems++;
+		skip_ws(p);
+		if (**p == ']') {
+			(*p)++;
+			return NULL;
+		}
+		if (**p != ',')
+			return "expected ',' or ']'";
+		(*p)++;
+	}
+}
+
+static const char * parse_request(char * line, DPABC_bulkRequest * req) {
+
+	char * p = line;
+	const char * error;
+
+	skip_ws(&p);
+	if (*p != '{')
+		return "expected a JSON object";
+	p++;
+	skip_ws(&p);
+	if (*p == '}')
+		p++;
+	else for (;;) {
+		DPABC_bulkField * field;
+		size_t key_sz;
+
+		if (req->nfields == DPABC_BULK_MAX_FIELDS)
+			return "too many fields";
+		field = &req->fields[req->nfields++];
+		skip_ws(&p);
+		if (*p != '"')
+			return "expected a key";
+		if ((error = parse_string(&p, &field->key, &key_sz)))
+			return error;
+		skip_ws(&p);
+		if (*p++ != ':')
+			return "expected ':'";
+		skip_ws(&p);
+		if (*p == '"') {
+			field->type = DPABC_BULK_STRING;
+			error = parse_string(&p, &field->value, &field->value_sz);
+		} else if (*p == '[') {
+			error = parse_array(&p, field);
+		} else if (*p == '{') {
+			error = "nested values are not supported";
+		} else {
+			field->type = DPABC_BULK_NUMBER;
+			error = parse_scalar(&p, &field->value, &field->value_sz);
+		}
+		if (error)
+			return error;
+		if (!strcmp(field->key, "id") && field->type != DPABC_BULK_ARRAY)
+			req->id = field;
+		skip_ws(&p);
+		if (*p == '}') {
+			p++;
+			break;
+		}
+		if (*p++ != ',')
+			return "expected ',' or '}'";
+	}
+	skip_ws(&p);
+	if (*p != '\0')
+		return "trailing characters after the object";
+
+	for (int i = 0; i < req->nfields; i++) {
+		DPABC_bulkField * field = &req->fields[i];
+
+		if (field->type == DPABC_BULK_NUMBER)
+			field->value[field->value_sz] = '\0';
+		for (int j = 0; j < field->nitems; j++)
+			field->items[j][field->items_sz[j]] = '\0';
+	}
+	return NULL;
+}
+
+static void release_request(DPABC_bulkRequest * req) {
+
+	for (int i = 0; i < req->nfields; i++) {
+		free(req->fields[i].items);
+		free(req->fields[i].items_sz);
+	}
+}
+
+static void serve_stream(FILE * in, FILE * out, DPABC_bulkHandler handler, void * user_data) {
+
+	char * line = NULL;
+	size_t cap = 0;
+
+	while (getline(&line, &cap, in) != -1) {
+		DPABC_bulkRequest req;
+		const char * error;
+		char * p = line;
+
+		skip_ws(&p);
+		if (*p == '\0')
+			continue;
+		memset(&req, 0, sizeof(req));
+		if ((error = parse_request(line, &req))) {
+			/* The id, if it was parsed before the error, is still echoed (it is written by size) */
+			DPABC_bulkReplyError(out, &req, error);
+		} else {
+			handler(&req, out, user_data);
+		}
+		release_request(&req);
+		if (ferror(out))
+			break;
+	}
+	free(line);
+}
+
+/* Original stdout once detached, where the responses to stdin requests are written */
+static FILE * responses;
+
+FILE * DPABC_bulkDetachStdout(void) {
+
+	int out_fd;
+
+	if (responses != NULL)
+		return responses;
+	fflush(stdout);
+	if ((out_fd = dup(STDOUT_FILENO)) < 0)
+		return NULL;
+	if ((responses = fdopen(out_fd, "w")) == NULL) {
+		close(out_fd);
+		return NULL;
+	}
+	if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		fclose(responses);
+		responses = NULL;
+	}
+	return responses;
+}
+
+int DPABC_bulkServe(const char * socket_path, DPABC_bulkHandler handler, void * user_data) {
+
+	struct sockaddr_un addr;
+	int listen_fd;
+
+	if (socket_path == NULL) {
+		if (DPABC_bulkDetachStdout() == NULL)
+			return -1;
+		serve_stream(stdin, responses, handler, user_data);
+		return 0;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	/* A client that goes away must not take the server down with it */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+	unlink(socket_path);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(listen_fd, 8)) {
+		close(listen_fd);
+		return -1;
+	}
+
+	for (;;) {
+		int fd = accept(listen_fd, NULL, NULL);
+		int out_fd;
+		FILE * in, * out;
+
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		if ((out_fd = dup(fd)) < 0) {
+			close(fd);
+			continue;
+		}
+		in = fdopen(fd, "r");
+		out = fdopen(out_fd, "w");
+		if (in == NULL || out == NULL) {
+			in ? fclose(in) : close(fd);
+			out ? fclose(out) : close(out_fd);
+			continue;
+		}
+		serve_stream(in, out, handler, user_data);
+		fclose(in);
+		fclose(out);
+	}
+
+	close(listen_fd);
+	return -1;
+}
+
+const DPABC_bulkField * DPABC_bulkGet(const DPABC_bulkRequest * req, const char * key, DPABC_bulkType type) {
+
+	for (int i = 0; i < req->nfields; i++)
+		if (!strcmp(req->fields[i].key, key))
+			return req->fields[i].type == type ? &req->fields[i] : NULL;
+	return NULL;
+}
+
+void DPABC_bulkWriteString(FILE * out, const char * s, size_t s_sz) {
+
+	fputc('"', out);
+	for (size_t i = 0; i < s_sz; i++) {
+		unsigned char c = s[i];
+
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+static void reply_id(FILE * out, const DPABC_bulkRequest * req) {
+
+	fputc('{', out);
+	if (req->id == NULL)
+		return;
+	fputs("\"id\":", out);
+	if (req->id->type == DPABC_BULK_STRING)
+		DPABC_bulkWriteString(out, req->id->value, req->id->value_sz);
+	else
+		fwrite(req->id->value, 1, req->id->value_sz, out);
+	fputc(',', out);
+}
+
+void DPABC_bulkReplyBegin(FILE * out, const DPABC_bulkRequest * req) {
+
+	reply_id(out, req);
+	fputs("\"status\":\"ok\"", out);
+}
+
+void DPABC_bulkReplyEnd(FILE * out) {
+
+	fputs("}\n", out);
+	fflush(out);
+}
+
+void DPABC_bulkReplyError(FILE * out, const DPABC_bulkRequest * req, const char * error) {
+
+	reply_id(out, req);
+	fputs("\"status\":\"error\",\"error\":", out);
+	DPABC_bulkWriteString(out, error, strlen(error));
+	DPABC_bulkReplyEnd(out);
+}
+
+void DPABC_bulkCacheInit(DPABC_bulkCache * cache, int size, void (*release)(void * value)) {
+
+	cache->keys = calloc(size, sizeof(char *));
+	cache->values = calloc(size, sizeof(void *));
+	cache->size = size;
+	cache->used = 0;
+	cache->next = 0;
+	cache->release = release;
+}
+
+void * DPABC_bulkCacheGet(DPABC_bulkCache * cache, const char * key) {
+
+	for (int i = 0; i < cache->used; i++)
+		if (!strcmp(cache->keys[i], key))
+			return cache->values[i];
+	return NULL;
+}
+
+void DPABC_bulkCachePut(DPABC_bulkCache * cache, const char * key, void * value) {
+
+	int i = cache->next;
+
+	if (cache->used < cache->size) {
+		cache->used++;
+	} else {
+		free(cache->keys[i]);
+		cache->release(cache->values[i]);
+	}
+	cache->keys[i] = strdup(key);
+	cache->values[i] = value;
+	cache->next = (i + 1) % cache->size;
+}
+
+void DPABC_bulkCacheFree(DPABC_bulkCache * cache) {
+
+	for (int i = 0; i < cache->used; i++) {
+		free(cache->keys[i]);
+		cache->release(cache->values[i]);
+	}
+	free(cache->keys);
+	free(cache->values);
+}
@@ -0,0 +1,171 @@
+#include <dpabc_codec.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Value of every base64 character, -1 outside the alphabets ("+/" and "-_" both map to 62 and 63) */
+static const signed char base64_map[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/* Value of every base58 character, -1 outside the alphabet */
+static const signed char base58_map[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1,
+	-1,  9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1,
+	22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1,
+	-1, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46,
+	47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+int DPABC_base64Decode(const char * in, size_t in_sz, char * out, size_t out_cap, size_t * out_sz) {
+
+	const unsigned char * s = (const unsigned char *)in;
+	size_t full, rest, k = 0;
+	int32_t v;
+
+	for (int pad = 0; pad < 2 && in_sz > 0 && in[in_sz - 1] == '='; pad++)
+		in_sz--;
+	full = in_sz - in_sz % 4;
+	rest = in_sz % 4;
+	if (rest == 1 || out_cap < full / 4 * 3 + (rest ? rest - 1 : 0))
+		return -1;
+
+	for (size_t i = 0; i < full; i += 4) {
+		/* Any invalid character (-1) sets the sign bit */
+		if ((base64_map[s[i]] | base64_map[s[i + 1]] | base64_map[s[i + 2]] | base64_map[s[i + 3]]) < 0)
+			return -1;
+		v = base64_map[s[i]] << 18 | base64_map[s[i + 1]] << 12 | base64_map[s[i + 2]] << 6 | base64_map[s[i + 3]];
+		out[k++] = (char)(v >> 16);
+		out[k++] = (char)(v >> 8);
+		out[k++] = (char)v;
+	}
+	if (rest) {
+		v = 0;
+		for (size_t i = 0; i < rest; i++) {
+			if (base64_map[s[full + i]] < 0)
+				return -1;
+			v |= base64_map[s[full + i]] << (18 - 6 * i);
+		}
+		out[k++] = (char)(v >> 16);
+		if (rest == 3)
+			out[k++] = (char)(v >> 8);
+	}
+
+	*out_sz = k;
+	return 0;
+}
+
+size_t DPABC_base64Encode(const char * in, size_t in_sz, char * out) {
+
+	const unsigned char * s = (const unsigned char *)in;
+	size_t i, k = 0;
+	uint32_t v;
+
+	for (i = 0; i + 3 <= in_sz; i += 3) {
+		v = (uint32_t)s[i] << 16 | (uint32_t)s[i + 1] << 8 | s[i + 2];
+		out[k++] = base64_alphabet[v >> 18];
+		out[k++] = base64_alphabet[(v >> 12) & 0x3F];
+		out[k++] = base64_alphabet[(v >> 6) & 0x3F];
+		out[k++] = base64_alphabet[v & 0x3F];
+	}
+	if (i < in_sz) {
+		v = (uint32_t)s[i] << 16 | (i + 1 < in_sz ? (uint32_t)s[i + 1] << 8 : 0);
+		out[k++] = base64_alphabet[v >> 18];
+		out[k++] = base64_alphabet[(v >> 12) & 0x3F];
+		out[k++] = i + 1 < in_sz ? base64_alphabet[(v >> 6) & 0x3F] : '=';
+		out[k++] = '=';
+	}
+
+	out[k] = '\0';
+	return k;
+}
+
+/*
+ * Radix conversion on 32 bit limbs: 5 base58 digits (58^5 < 2^32) are folded
+ * into the number with one multiply-add pass over the limbs, instead of one
+ * pass per digit over single bytes
+ */
+int DPABC_base58Decode(const char * in, size_t in_sz, char * out, size_t out_cap, size_t * out_sz) {
+
+	const unsigned char * s = (const unsigned char *)in;
+	/* log(58)/log(256) < 0.733 bytes per digit */
+	size_t max_limbs = (in_sz * 733 / 1000 + 3) / 4 + 1;
+	size_t zeros = 0, nlimbs = 0, nbytes, i, k;
+	uint32_t * limbs = malloc(max_limbs * sizeof(uint32_t));
+
+	if (limbs == NULL)
+		return -1;
+
+	while (zeros < in_sz && s[zeros] == '1')
+		zeros++;
+
+	for (i = zeros; i < in_sz; i += k) {
+		uint32_t v = 0, m = 1;
+		uint64_t carry;
+
+		for (k = 0; k < 5 && i + k < in_sz; k++) {
+			if (base58_map[s[i + k]] < 0) {
+				free(limbs);
+				return -1;
+			}
+			v = v * 58 + base58_map[s[i + k]];
+			m *= 58;
+		}
+
+		/* limbs = limbs * 58^k + v, the carry out of the top limb is below 2^32 */
+		carry = v;
+		for (size_t j = 0; j < nlimbs; j++) {
+			carry += (uint64_t)limbs[j] * m;
+			limbs[j] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		if (carry)
+			limbs[nlimbs++] = (uint32_t)carry;
+	}
+
+	nbytes = nlimbs * 4;
+	while (nbytes > 0 && !((limbs[(nbytes - 1) / 4] >> (8 * ((nbytes - 1) % 4))) & 0xFF))
+		nbytes--;
+	if (zeros + nbytes > out_cap) {
+		free(limbs);
+		return -1;
+	}
+
+	for (i = 0; i < zeros; i++)
+		out[i] = 0;
+	for (i = 0; i < nbytes; i++) {
+		size_t b = nbytes - 1 - i;
+		out[zeros + i] = (char)(limbs[b / 4] >> (8 * (b % 4)));
+	}
+
+	free(limbs);
+	*out_sz = zeros + nbytes;
+	return 0;
+}
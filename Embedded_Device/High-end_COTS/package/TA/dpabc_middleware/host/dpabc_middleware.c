@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <tee_client_api.h>
+#include <Zp.h>
+#include <Dpabc.h>
 
 
 int ld_callback(struct dl_phdr_info * info, size_t size, void * data) {
@@ -47,6 +49,85 @@ char * auto_hash() {
 }
 
 
+/*
+ * Shared memory pool: a session keeps one region per operation parameter,
+ * allocated with TEEC_AllocateSharedMemory and reused by every call, so the
+ * parameters reach the TA without the allocation, registration and bounce
+ * copy of a temporary memory reference per call. Packed parameters are built
+ * directly in the region. A region only grows (to the next power of two of the
+ * size needed) and is released by DPABC_finalize
+ */
+static void * shm_reserve(DPABC_session * session, int slot, size_t size) {
+
+	TEEC_SharedMemory * shm = &(session->shm[slot]);
+	size_t shm_sz = DEFAULT_BUFFER_SIZE;
+
+	if (shm->buffer && shm->size >= size)
+		return shm->buffer;
+
+	while (shm_sz < size)
+		shm_sz *= 2;
+
+	if (shm->buffer)
+		TEEC_ReleaseSharedMemory(shm);
+
+	memset(shm, 0, sizeof(*shm));
+	shm->size = shm_sz;
+	shm->flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	if (TEEC_AllocateSharedMemory(&(session->ctx), shm) != TEEC_SUCCESS) {
+		printf("Could not allocate %zu bytes of shared memory\n", shm_sz);
+		memset(shm, 0, sizeof(*shm));
+		return NULL;
+	}
+
+	return shm->buffer;
+}
+
+/* Passes the first size bytes of the region of slot as parameter slot of op */
+static void * shm_param(DPABC_session * session, TEEC_Operation * op, int slot, size_t size) {
+
+	void * buffer = shm_reserve(session, slot, size);
+
+	if (buffer) {
+		op->params[slot].memref.parent = &(session->shm[slot]);
+		op->params[slot].memref.offset = 0;
+		op->params[slot].memref.size = size;
+	}
+
+	return buffer;
+}
+
+/* Passes a copy of data as parameter slot of op */
+static bool shm_input(DPABC_session * session, TEEC_Operation * op, int slot, const void * data, size_t size) {
+
+	void * buffer = shm_param(session, op, slot, size);
+
+	if (!buffer)
+		return false;
+	memcpy(buffer, data, size);
+	return true;
+}
+
+/* Copy of the output parameter slot of op, that must be freed */
+static char * shm_output(DPABC_session * session, TEEC_Operation * op, int slot) {
+
+	char * res = malloc(op->params[slot].memref.size);
+
+	if (res)
+		memcpy(res, session->shm[slot].buffer, op->params[slot].memref.size);
+	return res;
+}
+
+/* Size of the token of a presentation of nattr attributes revealing nreveal */
+static size_t token_size(size_t attr_sz, size_t indexReveal_sz) {
+
+	size_t nattr = attr_sz / zpByteSize();
+	size_t nreveal = indexReveal_sz / sizeof(int);
+
+	return dpabcZkByteSizeForN(nreveal < nattr ? nattr - nreveal : 0);
+}
+
+
 DPABC_status DPABC_initialize(DPABC_session * session) {
 
 	uint32_t err_origin;
@@ -55,6 +136,8 @@ DPABC_status DPABC_initialize(DPABC_session * session) {
 
 	TEEC_UUID session_uuid = TA_DPABC_UUID;
 	session->uuid = session_uuid;
+	memset(session->shm, 0, sizeof(session->shm));
+	session->online_token_sz = 0;
 
 	/* Initialize a context connecting us to the TEE */
 	res = TEEC_InitializeContext(NULL, &(session->ctx));
@@ -70,7 +153,7 @@ DPABC_status DPABC_initialize(DPABC_session * session) {
 
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
 					 TEEC_NONE,
-					 TEEC_NONE, 
+					 TEEC_NONE,
 					 TEEC_NONE);
 
 	char * self_check = auto_hash();
@@ -102,14 +185,14 @@ DPABC_status DPABC_generate_key(DPABC_session * session, char * key_id, int natt
 	 * Prepare the argument. Pass a value in the first parameter,
 	 * the remaining three parameters are unused.
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, 
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
 					 TEEC_VALUE_INPUT,
-					 TEEC_NONE, 
+					 TEEC_NONE,
 					 TEEC_NONE);
 
 
-	op.params[0].tmpref.buffer = key_id;
-	op.params[0].tmpref.size = key_id_sz;
+	if (!shm_input(session, &op, 0, key_id, key_id_sz))
+		return STATUS_GENERIC_ERROR;
 
 	op.params[1].value.a = nattr;
 
@@ -138,54 +221,54 @@ DPABC_status DPABC_get_key(DPABC_session * session, char * key_id, char ** pk, s
 	TEEC_Result res;
 	TEEC_Operation op;
 
-	char pk_buffer[DEFAULT_BUFFER_SIZE];
-	bool pk_initialized = false;
-
 	memset(&op, 0, sizeof(op));
 
 	size_t key_id_sz = strlen(key_id);
 
 	/*
-	 * Prepare the argument. Pass a value in the first parameter,
-	 * And expect to receibe the key in the second.
+	 * The size of the key depends on its number of attributes, which only
+	 * the TA knows: ask for it first so the output buffer is big enough
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_OUTPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_VALUE_OUTPUT,
 					 TEEC_NONE, TEEC_NONE);
 
+	if (!shm_input(session, &op, 0, key_id, key_id_sz))
+		return STATUS_GENERIC_ERROR;
 
-	op.params[0].tmpref.buffer = key_id;
-	op.params[0].tmpref.size = key_id_sz;
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_KEY_SIZE, &op,
+				 &err_origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_KEY_SIZE failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
 
-	op.params[1].tmpref.buffer = pk_buffer;
-	op.params[1].tmpref.size = DEFAULT_BUFFER_SIZE;
+	/*
+	 * Prepare the argument. Pass a value in the first parameter,
+	 * And expect to receibe the key in the second.
+	 */
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT,
+					 TEEC_NONE, TEEC_NONE);
 
-	do {
-		printf("Invoking TA to retrieve key\n");
-		res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_READ_KEY, &op,
-					 &err_origin);
-		if (res != TEEC_SUCCESS && res != TEEC_ERROR_SHORT_BUFFER) {
-			printf("Command TA_DPABC_READ_KEY failed: 0x%x / %u\n", res, err_origin);
-			return STATUS_KEY_READ_ERROR;
-		}
+	if (!shm_param(session, &op, 1, op.params[1].value.a))
+		return STATUS_GENERIC_ERROR;
 
-		if (res == TEEC_ERROR_SHORT_BUFFER) {
-			*pk = malloc(op.params[1].tmpref.size);
-			pk_initialized = true;
-			op.params[1].tmpref.buffer = *pk;
-		}
-	} while (res != TEEC_SUCCESS);
+	printf("Invoking TA to retrieve key\n");
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_READ_KEY, &op,
+				 &err_origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_READ_KEY failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
 
 	printf("TA key retrieved\n");
-	printf("Retrieved key size: %ld\n", op.params[1].tmpref.size);
+	printf("Retrieved key size: %ld\n", op.params[1].memref.size);
 
-	if (!pk_initialized) {
-		*pk = malloc(op.params[1].tmpref.size);
-		memcpy(*pk, pk_buffer, op.params[1].tmpref.size);
-	}
+	*pk = shm_output(session, &op, 1);
 
 	if (pk_sz)
-		*pk_sz = op.params[1].tmpref.size;
+		*pk_sz = op.params[1].memref.size;
 
 	return STATUS_OK;
 }
@@ -196,8 +279,6 @@ DPABC_status DPABC_sign(DPABC_session * session, char * key_id, char * epoch, si
 	uint32_t err_origin;
 	TEEC_Result res;
 	TEEC_Operation op;
-	char sig_buffer[DEFAULT_BUFFER_SIZE];
-	bool sig_initialized = false;
 
 	memset(&op, 0, sizeof(op));
 
@@ -207,50 +288,33 @@ DPABC_status DPABC_sign(DPABC_session * session, char * key_id, char * epoch, si
 	 * Prepare the argument. Pass a value in the first parameter,
 	 * And expect to receibe the key in the second.
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_OUTPUT);
-
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT);
 
-	op.params[0].tmpref.buffer = key_id;
-	op.params[0].tmpref.size = key_id_sz;
 
-	op.params[1].tmpref.buffer = attr;
-	op.params[1].tmpref.size = attr_sz;
+	if (!shm_input(session, &op, 0, key_id, key_id_sz) ||
+	    !shm_input(session, &op, 1, attr, attr_sz) ||
+	    !shm_input(session, &op, 2, epoch, epoch_sz) ||
+	    !shm_param(session, &op, 3, dpabcSignByteSize()))
+		return STATUS_GENERIC_ERROR;
 
-	op.params[2].tmpref.buffer = epoch;
-	op.params[2].tmpref.size = epoch_sz;
-
-	op.params[3].tmpref.buffer = sig_buffer;
-	op.params[3].tmpref.size = DEFAULT_BUFFER_SIZE;
-
-	do {
-		printf("Invoking TA to sign\n");
-		res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_SIGN, &op,
-					 &err_origin);
-		if (res != TEEC_SUCCESS && res != TEEC_ERROR_SHORT_BUFFER) {
-			printf("Command TA_DPABC_SIGN failed: 0x%x / %u\n", res, err_origin);
-			return STATUS_KEY_READ_ERROR;
-		}
-
-		if (res == TEEC_ERROR_SHORT_BUFFER) {
-			*sig = malloc(op.params[3].tmpref.size);
-			sig_initialized = true;
-			op.params[3].tmpref.buffer = *sig;
-		}
-	} while (res != TEEC_SUCCESS);
+	printf("Invoking TA to sign\n");
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_SIGN, &op,
+				 &err_origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_SIGN failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
 
 	printf("TA signed\n");
-	printf("Generated signature size: %ld\n", op.params[3].tmpref.size);
+	printf("Generated signature size: %ld\n", op.params[3].memref.size);
 
-	if (!sig_initialized) {
-		*sig = malloc(op.params[3].tmpref.size);
-		memcpy(*sig, sig_buffer, op.params[3].tmpref.size);
-	}
+	*sig = shm_output(session, &op, 3);
 
 	if (sig_sz)
-		*sig_sz = op.params[3].tmpref.size;
+		*sig_sz = op.params[3].memref.size;
 
 	return STATUS_OK;
 }
@@ -271,23 +335,17 @@ DPABC_status DPABC_signStore(DPABC_session * session, char * key_id, char * epoc
 	 * Prepare the argument. Pass a value in the first parameter,
 	 * And expect to receibe the key in the second.
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT);
-
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT);
 
-	op.params[0].tmpref.buffer = key_id;
-	op.params[0].tmpref.size = key_id_sz;
 
-	op.params[1].tmpref.buffer = attr;
-	op.params[1].tmpref.size = attr_sz;
-
-	op.params[2].tmpref.buffer = epoch;
-	op.params[2].tmpref.size = epoch_sz;
-
-	op.params[3].tmpref.buffer = sig_id;
-	op.params[3].tmpref.size = sig_id_sz;
+	if (!shm_input(session, &op, 0, key_id, key_id_sz) ||
+	    !shm_input(session, &op, 1, attr, attr_sz) ||
+	    !shm_input(session, &op, 2, epoch, epoch_sz) ||
+	    !shm_input(session, &op, 3, sig_id, sig_id_sz))
+		return STATUS_GENERIC_ERROR;
 
 
 	printf("Invoking TA to sign\n");
@@ -312,7 +370,7 @@ DPABC_status DPABC_signStore(DPABC_session * session, char * key_id, char * epoc
 
 
 DPABC_status DPABC_verifyStored(DPABC_session * session, char * pk, size_t pk_sz, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz, char * sig_id) {
-	
+
 	uint32_t err_origin;
 	TEEC_Result res;
 	TEEC_Operation op;
@@ -325,23 +383,17 @@ DPABC_status DPABC_verifyStored(DPABC_session * session, char * pk, size_t pk_sz
 	 * Prepare the argument. Pass a value in the first parameter,
 	 * And expect to receibe the key in the second.
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT);
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT);
 
 
-	op.params[0].tmpref.buffer = pk;
-	op.params[0].tmpref.size = pk_sz;
-
-	op.params[1].tmpref.buffer = attr;
-	op.params[1].tmpref.size = attr_sz;
-
-	op.params[2].tmpref.buffer = epoch;
-	op.params[2].tmpref.size = epoch_sz;
-
-	op.params[3].tmpref.buffer = sig_id;
-	op.params[3].tmpref.size = sig_id_sz;
+	if (!shm_input(session, &op, 0, pk, pk_sz) ||
+	    !shm_input(session, &op, 1, attr, attr_sz) ||
+	    !shm_input(session, &op, 2, epoch, epoch_sz) ||
+	    !shm_input(session, &op, 3, sig_id, sig_id_sz))
+		return STATUS_GENERIC_ERROR;
 
 
 	printf("Invoking TA to verify stored signature\n");
@@ -376,17 +428,15 @@ DPABC_status DPABC_storeSignature(DPABC_session * session, char * sign_id, char
 	 * Prepare the argument. Pass a value in the first parameter,
 	 * And expect to receibe the key in the second.
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
 					 TEEC_NONE,
 					 TEEC_NONE);
 
 
-	op.params[0].tmpref.buffer = sign_id;
-	op.params[0].tmpref.size = sign_id_sz;
-
-	op.params[1].tmpref.buffer = signatureBytes;
-	op.params[1].tmpref.size = signatureBytes_sz;
+	if (!shm_input(session, &op, 0, sign_id, sign_id_sz) ||
+	    !shm_input(session, &op, 1, signatureBytes, signatureBytes_sz))
+		return STATUS_GENERIC_ERROR;
 
 	printf("Invoking TA to store signature\n");
 	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_STORE_SIGN, &op,
@@ -408,20 +458,18 @@ DPABC_status DPABC_storeSignature(DPABC_session * session, char * sign_id, char
 }
 
 
-DPABC_status DPABC_generateZKtoken(DPABC_session * session, 
-				   char * pk, size_t pk_sz, 
+DPABC_status DPABC_generateZKtoken(DPABC_session * session,
+				   char * pk, size_t pk_sz,
 				   char * sign_id,
-				   char * epoch, size_t epoch_sz, 
-				   char * attr, size_t attr_sz, 
-				   int * indexReveal, size_t indexReveal_sz, 
+				   char * epoch, size_t epoch_sz,
+				   char * attr, size_t attr_sz,
+				   int * indexReveal, size_t indexReveal_sz,
 				   char * msg, size_t msg_sz,
 				   char ** zkToken, size_t * zkToken_sz) {
 
 	uint32_t err_origin;
 	TEEC_Result res;
 	TEEC_Operation op;
-	char token_buffer[DEFAULT_BUFFER_SIZE];
-	bool token_initialized = false;
 	char * parameters;
 	size_t parameters_sz;
 	char * parameters_ix;
@@ -434,12 +482,12 @@ DPABC_status DPABC_generateZKtoken(DPABC_session * session,
 	 * Prepare the argument. Pass a value in the first parameter,
 	 * And expect to receibe the key in the second.
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_OUTPUT);
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT);
 
-	// Struct of shared memory "parameters": 
+	// Struct of shared memory "parameters":
 	//   +---------+-------------+------------+------------------+---------+--------------+----------+----------------+
 	//   |  pk_sz  |     pk      | sign_id_sz |     sign_id      | msg_sz  |     msg      | eopch_sz |     epoch      |
 	//   +---------+-------------+------------+------------------+---------+--------------+----------+----------------+
@@ -448,7 +496,9 @@ DPABC_status DPABC_generateZKtoken(DPABC_session * session,
 
 
 	parameters_sz = sizeof(uint32_t) + pk_sz  + sizeof(uint32_t) + sign_id_sz + sizeof(uint32_t) + msg_sz + sizeof(uint32_t) + epoch_sz;
-	parameters = malloc(parameters_sz);
+	parameters = shm_param(session, &op, 0, parameters_sz);
+	if (!parameters)
+		return STATUS_GENERIC_ERROR;
 	parameters_ix = parameters;
 
 	memcpy(parameters_ix, &pk_sz, sizeof(uint32_t));
@@ -471,48 +521,356 @@ DPABC_status DPABC_generateZKtoken(DPABC_session * session,
 	memcpy(parameters_ix, epoch, epoch_sz);
 
 
-	op.params[0].tmpref.buffer = parameters;
-	op.params[0].tmpref.size = parameters_sz;
+	if (!shm_input(session, &op, 1, attr, attr_sz) ||
+	    !shm_input(session, &op, 2, indexReveal, indexReveal_sz) ||
+	    !shm_param(session, &op, 3, token_size(attr_sz, indexReveal_sz)))
+		return STATUS_GENERIC_ERROR;
+
+	printf("Invoking TA to generate zkToken\n");
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_ZKTOKEN, &op,
+				 &err_origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_ZKTOKEN failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
+
+	printf("TA generated zkToken\n");
+	printf("Generated zkToken size: %ld\n", op.params[3].memref.size);
+
+	*zkToken = shm_output(session, &op, 3);
+
+	if (zkToken_sz)
+		*zkToken_sz = op.params[3].memref.size;
+
+	return STATUS_OK;
+
+}
+
+DPABC_status DPABC_presentPrecompute(DPABC_session * session,
+				     char * pk, size_t pk_sz,
+				     char * sign_id,
+				     char * attr, size_t attr_sz,
+				     int * indexReveal, size_t indexReveal_sz,
+				     uint32_t count) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+	char * parameters;
+	size_t parameters_sz;
+	char * parameters_ix;
+
+	memset(&op, 0, sizeof(op));
+
+	size_t sign_id_sz = strlen(sign_id);
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_VALUE_INPUT);
+
+	// Struct of shared memory "parameters":
+	//   +---------+-------------+------------+------------------+
+	//   |  pk_sz  |     pk      | sign_id_sz |     sign_id      |
+	//   +---------+-------------+------------+------------------+
+	//   | 4 bytes | pk_sz bytes | 4 bytes    | sign_id_sz bytes |
+	//   +---------+-------------+------------+------------------+
+
+	parameters_sz = sizeof(uint32_t) + pk_sz + sizeof(uint32_t) + sign_id_sz;
+	parameters = shm_param(session, &op, 0, parameters_sz);
+	if (!parameters)
+		return STATUS_GENERIC_ERROR;
+	parameters_ix = parameters;
+
+	memcpy(parameters_ix, &pk_sz, sizeof(uint32_t));
+	parameters_ix += sizeof(uint32_t);
+	memcpy(parameters_ix, pk, pk_sz);
+	parameters_ix += pk_sz;
+
+	memcpy(parameters_ix, &sign_id_sz, sizeof(uint32_t));
+	parameters_ix += sizeof(uint32_t);
+	memcpy(parameters_ix, sign_id, sign_id_sz);
+
+	if (!shm_input(session, &op, 1, attr, attr_sz) ||
+	    !shm_input(session, &op, 2, indexReveal, indexReveal_sz))
+		return STATUS_GENERIC_ERROR;
+
+	op.params[3].value.a = count;
+
+	printf("Invoking TA to precompute %u presentations\n", count);
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_PRESENT_PRECOMPUTE, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_PRESENT_PRECOMPUTE failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
+
+	/* Every token of the pool has the same size */
+	session->online_token_sz = token_size(attr_sz, indexReveal_sz);
+
+	return STATUS_OK;
+}
+
+DPABC_status DPABC_generateZKtokenOnline(DPABC_session * session,
+					 char * msg, size_t msg_sz,
+					 char ** zkToken, size_t * zkToken_sz,
+					 uint32_t * remaining) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE);
+
+	if (!shm_input(session, &op, 0, msg, msg_sz) ||
+	    !shm_param(session, &op, 1, session->online_token_sz))
+		return STATUS_GENERIC_ERROR;
+
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_ZKTOKEN_ONLINE, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_ZKTOKEN_ONLINE failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
+
+	*zkToken = shm_output(session, &op, 1);
+
+	if (zkToken_sz)
+		*zkToken_sz = op.params[1].memref.size;
+	if (remaining)
+		*remaining = op.params[2].value.a;
 
-	op.params[1].tmpref.buffer = attr;
-	op.params[1].tmpref.size = attr_sz;
+	return STATUS_OK;
+}
 
-	op.params[2].tmpref.buffer = indexReveal;
-	op.params[2].tmpref.size = indexReveal_sz;
+/*
+ * Batched commands: the requests are sent as a uint32_t count followed by the
+ * fields of each request as a uint32_t size and the bytes, and one result per
+ * request is received as a uint32_t TA result, a uint32_t size and the bytes
+ */
+static char * batch_put_field(char * buf_ix, const void * field, uint32_t field_sz) {
+
+	memcpy(buf_ix, &field_sz, sizeof(uint32_t));
+	buf_ix += sizeof(uint32_t);
+	memcpy(buf_ix, field, field_sz);
+	return buf_ix + field_sz;
+}
 
-	op.params[3].tmpref.buffer = token_buffer;
-	op.params[3].tmpref.size = DEFAULT_BUFFER_SIZE;
+static DPABC_status batch_request_status(uint32_t ta_res) {
 
-	do {
-		printf("Invoking TA to generate zkToken\n");
-		res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_ZKTOKEN, &op,
-					 &err_origin);
-		
-		if (res != TEEC_SUCCESS && res != TEEC_ERROR_SHORT_BUFFER) {
-			printf("Command TA_DPABC_ZKTOKEN failed: 0x%x / %u\n", res, err_origin);
+	switch (ta_res) {
+		case TEEC_SUCCESS:
+			return STATUS_OK;
+		case TEEC_ERROR_BAD_PARAMETERS:
+			return STATUS_BAD_PARAMETERS;
+		case TEEC_ERROR_ITEM_NOT_FOUND:
 			return STATUS_KEY_READ_ERROR;
+		case TA_ERROR_SIGNATURE_INVALID:
+			return STATUS_VERIFICATION_ERROR;
+		default:
+			return STATUS_GENERIC_ERROR;
+	}
+}
+
+/*
+ * Prepares op for a batched command of count requests of requests_sz bytes
+ * (count included), returns where the fields of the requests go
+ */
+static char * batch_requests(DPABC_session * session, TEEC_Operation * op, size_t requests_sz, uint32_t count) {
+
+	char * requests;
+
+	memset(op, 0, sizeof(*op));
+
+	op->paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					  TEEC_MEMREF_PARTIAL_OUTPUT,
+					  TEEC_VALUE_OUTPUT,
+					  TEEC_NONE);
+
+	requests = shm_param(session, op, 0, requests_sz);
+	if (!requests)
+		return NULL;
+
+	memcpy(requests, &count, sizeof(uint32_t));
+	return requests + sizeof(uint32_t);
+}
+
+/*
+ * Invokes a batched command, with room for results_sz bytes of results (the
+ * most the requests can produce). results points to the shared memory, valid
+ * until the next call
+ */
+static DPABC_status batch_invoke(DPABC_session * session, TEEC_Operation * op, uint32_t cmd,
+				 const char * name, size_t results_sz, char ** results) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+
+	*results = shm_param(session, op, 1, results_sz);
+	if (!*results)
+		return STATUS_GENERIC_ERROR;
+
+	res = TEEC_InvokeCommand(&(session->sess), cmd, op, &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("Command %s failed: 0x%x / %u\n", name, res, err_origin);
+		return res == TEEC_ERROR_BAD_PARAMETERS ? STATUS_BAD_PARAMETERS : STATUS_GENERIC_ERROR;
+	}
+
+	return STATUS_OK;
+}
+
+/* Reads the next result, data points into results */
+static char * batch_get_result(char * results_ix, DPABC_status * status, char ** data, size_t * data_sz) {
+
+	uint32_t header[2];
+
+	memcpy(header, results_ix, sizeof(header));
+	*status = batch_request_status(header[0]);
+	*data = results_ix + sizeof(header);
+	*data_sz = header[1];
+	return *data + header[1];
+}
+
+DPABC_status DPABC_signBatch(DPABC_session * session, DPABC_signRequest * requests, int nrequests) {
+
+	DPABC_status status;
+	TEEC_Operation op;
+	char * buf_ix;
+	size_t buf_sz;
+	char * results_ix;
+
+	buf_sz = sizeof(uint32_t);
+	for (int i = 0; i < nrequests; i++)
+		buf_sz += 3 * sizeof(uint32_t) + strlen(requests[i].key_id) + requests[i].epoch_sz + requests[i].attr_sz;
+
+	buf_ix = batch_requests(session, &op, buf_sz, nrequests);
+	if (!buf_ix)
+		return STATUS_GENERIC_ERROR;
+
+	for (int i = 0; i < nrequests; i++) {
+		buf_ix = batch_put_field(buf_ix, requests[i].key_id, strlen(requests[i].key_id));
+		buf_ix = batch_put_field(buf_ix, requests[i].epoch, requests[i].epoch_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].attr, requests[i].attr_sz);
+	}
+
+	status = batch_invoke(session, &op, TA_DPABC_SIGN_BATCH, "TA_DPABC_SIGN_BATCH",
+			      nrequests * (2 * sizeof(uint32_t) + dpabcSignByteSize()), &results_ix);
+	if (status != STATUS_OK)
+		return status;
+
+	for (int i = 0; i < nrequests; i++) {
+		char * sig;
+
+		results_ix = batch_get_result(results_ix, &requests[i].status, &sig, &requests[i].sig_sz);
+		requests[i].sig = NULL;
+		if (requests[i].status == STATUS_OK) {
+			requests[i].sig = malloc(requests[i].sig_sz);
+			if (requests[i].sig)
+				memcpy(requests[i].sig, sig, requests[i].sig_sz);
+			else
+				requests[i].status = STATUS_GENERIC_ERROR;
 		}
-	
-		if (res == TEEC_ERROR_SHORT_BUFFER) {
-			*zkToken = malloc(op.params[3].tmpref.size);
-			token_initialized = true;
-			op.params[3].tmpref.buffer = *zkToken;
-		}
-	} while (res != TEEC_SUCCESS);
+	}
 
-	printf("TA generated zkToken\n");
-	printf("Generated zkToken size: %ld\n", op.params[3].tmpref.size);
+	return STATUS_OK;
+}
+
+DPABC_status DPABC_verifyBatch(DPABC_session * session, DPABC_verifyRequest * requests, int nrequests) {
 
-	if (!token_initialized) {
-		*zkToken = malloc(op.params[3].tmpref.size);
-		memcpy(*zkToken, token_buffer, op.params[3].tmpref.size);
+	DPABC_status status;
+	TEEC_Operation op;
+	char * buf_ix;
+	size_t buf_sz;
+	char * results_ix;
+
+	buf_sz = sizeof(uint32_t);
+	for (int i = 0; i < nrequests; i++)
+		buf_sz += 4 * sizeof(uint32_t) + requests[i].pk_sz + requests[i].epoch_sz + requests[i].attr_sz + strlen(requests[i].sig_id);
+
+	buf_ix = batch_requests(session, &op, buf_sz, nrequests);
+	if (!buf_ix)
+		return STATUS_GENERIC_ERROR;
+
+	for (int i = 0; i < nrequests; i++) {
+		buf_ix = batch_put_field(buf_ix, requests[i].pk, requests[i].pk_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].epoch, requests[i].epoch_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].attr, requests[i].attr_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].sig_id, strlen(requests[i].sig_id));
 	}
 
-	if (zkToken_sz)
-		*zkToken_sz = op.params[3].tmpref.size;
+	status = batch_invoke(session, &op, TA_DPABC_VERIFY_BATCH, "TA_DPABC_VERIFY_BATCH",
+			      nrequests * 2 * sizeof(uint32_t), &results_ix);
+	if (status != STATUS_OK)
+		return status;
+
+	for (int i = 0; i < nrequests; i++) {
+		char * data;
+		size_t data_sz;
+
+		results_ix = batch_get_result(results_ix, &requests[i].status, &data, &data_sz);
+	}
 
 	return STATUS_OK;
+}
+
+DPABC_status DPABC_generateZKtokenBatch(DPABC_session * session, DPABC_zkTokenRequest * requests, int nrequests) {
+
+	DPABC_status status;
+	TEEC_Operation op;
+	char * buf_ix;
+	size_t buf_sz;
+	size_t results_sz;
+	char * results_ix;
+
+	buf_sz = sizeof(uint32_t);
+	results_sz = 0;
+	for (int i = 0; i < nrequests; i++) {
+		buf_sz += 6 * sizeof(uint32_t) + requests[i].pk_sz + strlen(requests[i].sign_id) + requests[i].msg_sz +
+			  requests[i].epoch_sz + requests[i].attr_sz + requests[i].indexReveal_sz;
+		results_sz += 2 * sizeof(uint32_t) + token_size(requests[i].attr_sz, requests[i].indexReveal_sz);
+	}
 
+	buf_ix = batch_requests(session, &op, buf_sz, nrequests);
+	if (!buf_ix)
+		return STATUS_GENERIC_ERROR;
+
+	for (int i = 0; i < nrequests; i++) {
+		buf_ix = batch_put_field(buf_ix, requests[i].pk, requests[i].pk_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].sign_id, strlen(requests[i].sign_id));
+		buf_ix = batch_put_field(buf_ix, requests[i].msg, requests[i].msg_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].epoch, requests[i].epoch_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].attr, requests[i].attr_sz);
+		buf_ix = batch_put_field(buf_ix, requests[i].indexReveal, requests[i].indexReveal_sz);
+	}
+
+	status = batch_invoke(session, &op, TA_DPABC_ZKTOKEN_BATCH, "TA_DPABC_ZKTOKEN_BATCH",
+			      results_sz, &results_ix);
+	if (status != STATUS_OK)
+		return status;
+
+	for (int i = 0; i < nrequests; i++) {
+		char * token;
+
+		results_ix = batch_get_result(results_ix, &requests[i].status, &token, &requests[i].zkToken_sz);
+		requests[i].zkToken = NULL;
+		if (requests[i].status == STATUS_OK) {
+			requests[i].zkToken = malloc(requests[i].zkToken_sz);
+			if (requests[i].zkToken)
+				memcpy(requests[i].zkToken, token, requests[i].zkToken_sz);
+			else
+				requests[i].status = STATUS_GENERIC_ERROR;
+		}
+	}
+
+	return STATUS_OK;
 }
 
 DPABC_status DPABC_combineSignatures(DPABC_session * session, char * combined_id, char ** pks, uint32_t * pks_sz, char ** sig_ids, int nelements) {
@@ -521,10 +879,8 @@ DPABC_status DPABC_combineSignatures(DPABC_session * session, char * combined_id
 	TEEC_Result res;
 	TEEC_Operation op;
 
-	char * flat_pks;
 	char * flat_pks_idx;
 	size_t flat_pks_sz;
-	char * flat_ids;
 	char * flat_ids_idx;
 	size_t flat_ids_sz;
 
@@ -533,56 +889,150 @@ DPABC_status DPABC_combineSignatures(DPABC_session * session, char * combined_id
 	size_t combined_id_sz = strlen(combined_id);
 
 	/*
-	 * Prepare the argument. Pass a value in the first parameter,
-	 * And expect to receibe the key in the second.
+	 * Pass the public keys and the share ids as fields (uint32_t size and
+	 * bytes), the id of the combined signature and the number of shares
 	 */
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_MEMREF_TEMP_INPUT,
-					 TEEC_NONE);
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_VALUE_INPUT);
 
-	flat_pks_sz = flat_ids_sz = 0;
+	flat_pks_sz = flat_ids_sz = nelements * sizeof(uint32_t);
 	for (int i = 0; i < nelements; i++) {
 		flat_ids_sz += strlen(sig_ids[i]);
 		flat_pks_sz += pks_sz[i];
 	}
 
-	flat_pks = flat_pks_idx = malloc(flat_pks_sz);
-	flat_ids = flat_ids_idx = malloc(flat_ids_sz);
+	flat_pks_idx = shm_param(session, &op, 0, flat_pks_sz);
+	flat_ids_idx = shm_param(session, &op, 1, flat_ids_sz);
+	if (!flat_pks_idx || !flat_ids_idx || !shm_input(session, &op, 2, combined_id, combined_id_sz))
+		return STATUS_GENERIC_ERROR;
 
 	for (int i = 0; i < nelements; i++) {
-		uint32_t id_sz = strlen(sig_ids[i]);
-
-		memcpy(flat_pks_idx, &(pks_sz[i]), sizeof(uint32_t));
-		flat_pks_idx += sizeof(uint32_t);
-		memcpy(flat_pks_idx, pks[i], pks_sz[i]);
-
-		memcpy(flat_ids_idx, &id_sz, sizeof(uint32_t));
-		flat_ids_idx += sizeof(uint32_t);
-		memcpy(flat_ids_idx, sig_ids[i], id_sz);
+		flat_pks_idx = batch_put_field(flat_pks_idx, pks[i], pks_sz[i]);
+		flat_ids_idx = batch_put_field(flat_ids_idx, sig_ids[i], strlen(sig_ids[i]));
 	}
 
-	op.params[0].tmpref.buffer = flat_pks;
-	op.params[0].tmpref.size = flat_pks_sz;
-
-	op.params[1].tmpref.buffer = flat_ids;
-	op.params[1].tmpref.size = flat_ids_sz;
-
-	op.params[2].tmpref.buffer = combined_id;
-	op.params[2].tmpref.size = combined_id_sz;
+	op.params[3].value.a = nelements;
 
 	printf("Invoking TA to combine signatures\n");
 	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_COMBINE_SIGNATURES, &op,
 	&err_origin);
 
-	if (res != TEEC_SUCCESS) {
+	if (res == TEEC_ERROR_ACCESS_CONFLICT) {
+		printf("Command TA_DPABC_COMBINE_SIGNATURES failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_DUPLICATE_SIGNATURE;
+	}
+	else if (res == TEEC_ERROR_ITEM_NOT_FOUND) {
+		printf("Command TA_DPABC_COMBINE_SIGNATURES failed (missing share): 0x%x / %u\n", res, err_origin);
+		return STATUS_KEY_READ_ERROR;
+	}
+	else if (res == TEEC_ERROR_BAD_PARAMETERS) {
+		printf("Command TA_DPABC_COMBINE_SIGNATURES failed (bad parameters): 0x%x / %u\n", res, err_origin);
+		return STATUS_BAD_PARAMETERS;
+	}
+	else if (res != TEEC_SUCCESS) {
 		printf("Command TA_DPABC_COMBINE_SIGNATURES failed: 0x%x / %u\n", res, err_origin);
 		return STATUS_WRITE_ERROR;
 	}
 
 	printf("TA combined signatures\n");
 
+	return STATUS_OK;
+}
+
+
+DPABC_status DPABC_arenaStats(DPABC_session * session, uint32_t * high_water, uint32_t * arena_sz, uint32_t * overflows) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE,
+					 TEEC_NONE);
+
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_ARENA_STATS, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_ARENA_STATS failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_GENERIC_ERROR;
+	}
+
+	if (high_water)
+		*high_water = op.params[0].value.a;
+	if (arena_sz)
+		*arena_sz = op.params[0].value.b;
+	if (overflows)
+		*overflows = op.params[1].value.a;
+
+	return STATUS_OK;
+}
+
+DPABC_status DPABC_traceDrain(DPABC_session * session, ta_trace_event * events, uint32_t max_events, uint32_t * nevents, uint32_t * dropped) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = events;
+	op.params[0].tmpref.size = max_events * sizeof(ta_trace_event);
+
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_TRACE_DRAIN, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_TRACE_DRAIN failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_GENERIC_ERROR;
+	}
+
+	*nevents = op.params[1].value.a;
+	if (dropped)
+		*dropped = op.params[1].value.b;
+
+	return STATUS_OK;
+}
+
+DPABC_status DPABC_commandStats(DPABC_session * session, ta_cmd_stats * stats, uint32_t max_stats, uint32_t * nstats, int reset) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_NONE,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = stats;
+	op.params[0].tmpref.size = max_stats * sizeof(ta_cmd_stats);
+	op.params[1].value.a = reset != 0;
+
+	res = TEEC_InvokeCommand(&(session->sess), TA_DPABC_STATS, &op,
+				 &err_origin);
 
+	if (res == TEEC_ERROR_SHORT_BUFFER) {
+		return STATUS_BAD_PARAMETERS;
+	}
+	if (res != TEEC_SUCCESS) {
+		printf("Command TA_DPABC_STATS failed: 0x%x / %u\n", res, err_origin);
+		return STATUS_GENERIC_ERROR;
+	}
+
+	*nstats = op.params[0].tmpref.size / sizeof(ta_cmd_stats);
+
+	return STATUS_OK;
 }
 
 
@@ -596,6 +1046,10 @@ DPABC_status DPABC_finalize(DPABC_session * session) {
 	 */
 
 	TEEC_CloseSession(&(session->sess));
+	for (int i = 0; i < DPABC_SHM_SLOTS; i++) {
+		if (session->shm[i].buffer)
+			TEEC_ReleaseSharedMemory(&(session->shm[i]));
+	}
 	TEEC_FinalizeContext(&(session->ctx));
 
 	return STATUS_OK;
@@ -0,0 +1,504 @@
+#include <dpabc_pool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum job_kind {
+	JOB_SIGN,
+	JOB_SIGN_STORE,
+	JOB_VERIFY,
+	JOB_ZKTOKEN
+};
+
+struct DPABC_job {
+	enum job_kind kind;
+	union {
+		DPABC_signRequest sign;		/* JOB_SIGN and JOB_SIGN_STORE */
+		DPABC_verifyRequest verify;
+		DPABC_zkTokenRequest zk;
+	} req;
+	char * sig_id;				/* JOB_SIGN_STORE: id of the stored signature */
+	DPABC_callback callback;
+	void * user_data;
+	atomic_bool done;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/*
+ * Bounded MPMC queue (D. Vyukov): each cell has a sequence number telling
+ * whether it is free for the enqueue (seq == pos) or holds an item for the
+ * dequeue (seq == pos + 1) at position pos. Producers and consumers claim
+ * positions with a CAS and never wait on each other. The items and slots
+ * semaphores are posted once an operation is complete, so a thread that got
+ * one always finds its item (or free cell) in the ring
+ */
+struct DPABC_pool_cell {
+	_Atomic size_t seq;
+	DPABC_job * job;
+};
+
+static void queue_push(DPABC_pool * pool, DPABC_job * job) {
+
+	struct DPABC_pool_cell * cell;
+	size_t pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+
+	for (;;) {
+		cell = &pool->cells[pos & pool->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&pool->enqueue_pos, &pos, pos + 1,
+								  memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else {
+			/* Claimed by another producer (or, transiently, not yet released) */
+			pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+		}
+	}
+
+	cell->job = job;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+}
+
+static DPABC_job * queue_pop(DPABC_pool * pool) {
+
+	struct DPABC_pool_cell * cell;
+	DPABC_job * job;
+	size_t pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+
+	for (;;) {
+		cell = &pool->cells[pos & pool->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&pool->dequeue_pos, &pos, pos + 1,
+								  memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else {
+			pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+		}
+	}
+
+	job = cell->job;
+	atomic_store_explicit(&cell->seq, pos + pool->mask + 1, memory_order_release);
+	return job;
+}
+
+/* Blocks while the queue is full. A NULL job stops the worker that takes it */
+static void pool_submit(DPABC_pool * pool, DPABC_job * job) {
+
+	while (sem_wait(&pool->slots))
+		;
+	queue_push(pool, job);
+	sem_post(&pool->items);
+}
+
+static DPABC_job * pool_take(DPABC_pool * pool) {
+
+	DPABC_job * job = queue_pop(pool);
+
+	sem_post(&pool->slots);
+	return job;
+}
+
+static DPABC_job * job_new(enum job_kind kind, DPABC_callback callback, void * user_data) {
+
+	DPABC_job * job = calloc(1, sizeof(DPABC_job));
+
+	if (!job)
+		return NULL;
+
+	job->kind = kind;
+	job->callback = callback;
+	job->user_data = user_data;
+	atomic_init(&job->done, false);
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->cond, NULL);
+	return job;
+}
+
+static DPABC_status * job_status(DPABC_job * job) {
+
+	switch (job->kind) {
+		case JOB_VERIFY:
+			return &job->req.verify.status;
+		case JOB_ZKTOKEN:
+			return &job->req.zk.status;
+		default:
+			return &job->req.sign.status;
+	}
+}
+
+static void job_complete(DPABC_job * job) {
+
+	if (job->callback) {
+		atomic_store_explicit(&job->done, true, memory_order_release);
+		job->callback(job, job->user_data);
+		return;
+	}
+
+	pthread_mutex_lock(&job->lock);
+	atomic_store_explicit(&job->done, true, memory_order_release);
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void job_run(DPABC_session * session, DPABC_job * job) {
+
+	DPABC_signRequest * s = &job->req.sign;
+	DPABC_zkTokenRequest * z = &job->req.zk;
+	DPABC_verifyRequest * v = &job->req.verify;
+
+	switch (job->kind) {
+		case JOB_SIGN:
+			s->status = DPABC_sign(session, s->key_id, s->epoch, s->epoch_sz, s->attr, s->attr_sz, &s->sig, &s->sig_sz);
+			if (s->status != STATUS_OK)
+				s->sig = NULL;
+			break;
+		case JOB_SIGN_STORE:
+			s->status = DPABC_signStore(session, s->key_id, s->epoch, s->epoch_sz, s->attr, s->attr_sz, job->sig_id);
+			break;
+		case JOB_VERIFY:
+			v->status = DPABC_verifyStored(session, v->pk, v->pk_sz, v->epoch, v->epoch_sz, v->attr, v->attr_sz, v->sig_id);
+			break;
+		case JOB_ZKTOKEN:
+			z->status = DPABC_generateZKtoken(session, z->pk, z->pk_sz, z->sign_id, z->epoch, z->epoch_sz, z->attr, z->attr_sz,
+							  z->indexReveal, z->indexReveal_sz, z->msg, z->msg_sz, &z->zkToken, &z->zkToken_sz);
+			if (z->status != STATUS_OK)
+				z->zkToken = NULL;
+			break;
+	}
+}
+
+/* Runs n jobs of the same kind, batched in one command when possible */
+static void jobs_run(DPABC_session * session, DPABC_job ** jobs, int n) {
+
+	DPABC_signRequest sign[DPABC_POOL_MAX_BATCH];
+	DPABC_verifyRequest verify[DPABC_POOL_MAX_BATCH];
+	DPABC_zkTokenRequest zk[DPABC_POOL_MAX_BATCH];
+	DPABC_status status;
+
+	if (n == 1 || jobs[0]->kind == JOB_SIGN_STORE) {
+		for (int i = 0; i < n; i++)
+			job_run(session, jobs[i]);
+		return;
+	}
+
+	switch (jobs[0]->kind) {
+		case JOB_SIGN:
+			for (int i = 0; i < n; i++)
+				sign[i] = jobs[i]->req.sign;
+			status = DPABC_signBatch(session, sign, n);
+			for (int i = 0; i < n; i++) {
+				jobs[i]->req.sign = sign[i];
+				if (status != STATUS_OK) {
+					jobs[i]->req.sign.sig = NULL;
+					jobs[i]->req.sign.status = status;
+				}
+			}
+			break;
+		case JOB_VERIFY:
+			for (int i = 0; i < n; i++)
+				verify[i] = jobs[i]->req.verify;
+			status = DPABC_verifyBatch(session, verify, n);
+			for (int i = 0; i < n; i++) {
+				jobs[i]->req.verify = verify[i];
+				if (status != STATUS_OK)
+					jobs[i]->req.verify.status = status;
+			}
+			break;
+		case JOB_ZKTOKEN:
+			for (int i = 0; i < n; i++)
+				zk[i] = jobs[i]->req.zk;
+			status = DPABC_generateZKtokenBatch(session, zk, n);
+			for (int i = 0; i < n; i++) {
+				jobs[i]->req.zk = zk[i];
+				if (status != STATUS_OK) {
+					jobs[i]->req.zk.zkToken = NULL;
+					jobs[i]->req.zk.status = status;
+				}
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+struct pool_worker {
+	DPABC_pool * pool;
+	DPABC_session * session;
+};
+
+static void * pool_worker(void * arg) {
+
+	DPABC_pool * pool = ((struct pool_worker *)arg)->pool;
+	DPABC_session * session = ((struct pool_worker *)arg)->session;
+	DPABC_job * jobs[DPABC_POOL_MAX_BATCH];
+	bool stop = false;
+
+	free(arg);
+
+	while (!stop) {
+		int queued, share, n = 0;
+
+		while (sem_wait(&pool->items))
+			;
+		jobs[n++] = pool_take(pool);
+
+		/*
+		 * Take this worker's share of the requests already queued (at most
+		 * one stop sentinel, so that every worker gets its own)
+		 */
+		sem_getvalue(&pool->items, &queued);
+		share = queued / pool->nsessions;
+		while (jobs[n - 1] && n <= share && n < DPABC_POOL_MAX_BATCH && !sem_trywait(&pool->items))
+			jobs[n++] = pool_take(pool);
+
+		for (int i = 0; i < n; ) {
+			int run = 1;
+
+			if (!jobs[i]) {
+				stop = true;
+				i++;
+				continue;
+			}
+
+			while (i + run < n && jobs[i + run] && jobs[i + run]->kind == jobs[i]->kind)
+				run++;
+
+			jobs_run(session, jobs + i, run);
+			for (int j = i; j < i + run; j++)
+				job_complete(jobs[j]);
+			i += run;
+		}
+	}
+
+	return NULL;
+}
+
+DPABC_status DPABC_poolInitialize(DPABC_pool * pool, int nsessions, size_t queue_size) {
+
+	size_t ncells = 2;
+	int started = 0;
+
+	if (nsessions < 1)
+		return STATUS_BAD_PARAMETERS;
+
+	/* Room for the stop sentinels of DPABC_poolFinalize */
+	while (ncells < queue_size || ncells < (size_t)nsessions)
+		ncells <<= 1;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->nsessions = nsessions;
+	pool->mask = ncells - 1;
+	pool->sessions = calloc(nsessions, sizeof(DPABC_session));
+	pool->workers = calloc(nsessions, sizeof(pthread_t));
+	pool->cells = calloc(ncells, sizeof(struct DPABC_pool_cell));
+	if (!pool->sessions || !pool->workers || !pool->cells)
+		goto err_alloc;
+
+	for (size_t i = 0; i < ncells; i++)
+		atomic_init(&pool->cells[i].seq, i);
+	atomic_init(&pool->enqueue_pos, 0);
+	atomic_init(&pool->dequeue_pos, 0);
+	sem_init(&pool->items, 0, 0);
+	sem_init(&pool->slots, 0, ncells);
+
+	for (; started < nsessions; started++) {
+		struct pool_worker * worker;
+
+		if (DPABC_initialize(&pool->sessions[started]) != STATUS_OK)
+			goto err_workers;
+
+		worker = malloc(sizeof(struct pool_worker));
+		if (worker) {
+			worker->pool = pool;
+			worker->session = &pool->sessions[started];
+		}
+		if (!worker || pthread_create(&pool->workers[started], NULL, pool_worker, worker)) {
+			free(worker);
+			DPABC_finalize(&pool->sessions[started]);
+			goto err_workers;
+		}
+	}
+
+	return STATUS_OK;
+
+err_workers:
+	pool->nsessions = started;
+	DPABC_poolFinalize(pool);
+	return STATUS_INITIALIZATION_ERROR;
+err_alloc:
+	free(pool->sessions);
+	free(pool->workers);
+	free(pool->cells);
+	return STATUS_GENERIC_ERROR;
+}
+
+DPABC_job * DPABC_sign_async(DPABC_pool * pool, char * key_id, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz,
+			     DPABC_callback callback, void * user_data) {
+
+	DPABC_job * job = job_new(JOB_SIGN, callback, user_data);
+
+	if (!job)
+		return NULL;
+
+	job->req.sign.key_id = key_id;
+	job->req.sign.epoch = epoch;
+	job->req.sign.epoch_sz = epoch_sz;
+	job->req.sign.attr = attr;
+	job->req.sign.attr_sz = attr_sz;
+	pool_submit(pool, job);
+	return job;
+}
+
+DPABC_job * DPABC_signStore_async(DPABC_pool * pool, char * key_id, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz, char * sig_id,
+				  DPABC_callback callback, void * user_data) {
+
+	DPABC_job * job = job_new(JOB_SIGN_STORE, callback, user_data);
+
+	if (!job)
+		return NULL;
+
+	job->req.sign.key_id = key_id;
+	job->req.sign.epoch = epoch;
+	job->req.sign.epoch_sz = epoch_sz;
+	job->req.sign.attr = attr;
+	job->req.sign.attr_sz = attr_sz;
+	job->sig_id = sig_id;
+	pool_submit(pool, job);
+	return job;
+}
+
+DPABC_job * DPABC_verifyStored_async(DPABC_pool * pool, char * pk, size_t pk_sz, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz, char * sig_id,
+				     DPABC_callback callback, void * user_data) {
+
+	DPABC_job * job = job_new(JOB_VERIFY, callback, user_data);
+
+	if (!job)
+		return NULL;
+
+	job->req.verify.pk = pk;
+	job->req.verify.pk_sz = pk_sz;
+	job->req.verify.epoch = epoch;
+	job->req.verify.epoch_sz = epoch_sz;
+	job->req.verify.attr = attr;
+	job->req.verify.attr_sz = attr_sz;
+	job->req.verify.sig_id = sig_id;
+	pool_submit(pool, job);
+	return job;
+}
+
+DPABC_job * DPABC_generateZKtoken_async(DPABC_pool * pool,
+					char * pk, size_t pk_sz,
+					char * sign_id,
+					char * epoch, size_t epoch_sz,
+					char * attr, size_t attr_sz,
+					int * indexReveal, size_t indexReveal_sz,
+					char * msg, size_t msg_sz,
+					DPABC_callback callback, void * user_data
+) {
+
+	DPABC_job * job = job_new(JOB_ZKTOKEN, callback, user_data);
+
+	if (!job)
+		return NULL;
+
+	job->req.zk.pk = pk;
+	job->req.zk.pk_sz = pk_sz;
+	job->req.zk.sign_id = sign_id;
+	job->req.zk.epoch = epoch;
+	job->req.zk.epoch_sz = epoch_sz;
+	job->req.zk.attr = attr;
+	job->req.zk.attr_sz = attr_sz;
+	job->req.zk.indexReveal = indexReveal;
+	job->req.zk.indexReveal_sz = indexReveal_sz;
+	job->req.zk.msg = msg;
+	job->req.zk.msg_sz = msg_sz;
+	pool_submit(pool, job);
+	return job;
+}
+
+bool DPABC_jobDone(DPABC_job * job) {
+
+	return atomic_load_explicit(&job->done, memory_order_acquire);
+}
+
+DPABC_status DPABC_jobWait(DPABC_job * job) {
+
+	pthread_mutex_lock(&job->lock);
+	while (!atomic_load_explicit(&job->done, memory_order_acquire))
+		pthread_cond_wait(&job->cond, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+
+	return *job_status(job);
+}
+
+DPABC_status DPABC_jobResult(DPABC_job * job, char ** out, size_t * out_sz) {
+
+	char ** result = NULL;
+	size_t result_sz = 0;
+
+	if (job->kind == JOB_SIGN) {
+		result = &job->req.sign.sig;
+		result_sz = job->req.sign.sig_sz;
+	} else if (job->kind == JOB_ZKTOKEN) {
+		result = &job->req.zk.zkToken;
+		result_sz = job->req.zk.zkToken_sz;
+	}
+
+	if (out) {
+		*out = result ? *result : NULL;
+		if (result)
+			*result = NULL;
+	}
+	if (out_sz)
+		*out_sz = result ? result_sz : 0;
+
+	return *job_status(job);
+}
+
+void DPABC_jobFree(DPABC_job * job) {
+
+	if (!job)
+		return;
+
+	if (job->kind == JOB_SIGN)
+		free(job->req.sign.sig);
+	else if (job->kind == JOB_ZKTOKEN)
+		free(job->req.zk.zkToken);
+
+	/*
+	 * A caller polling DPABC_jobDone can see the job done while the worker
+	 * still holds the lock to broadcast it
+	 */
+	pthread_mutex_lock(&job->lock);
+	pthread_mutex_unlock(&job->lock);
+
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->cond);
+	free(job);
+}
+
+DPABC_status DPABC_poolFinalize(DPABC_pool * pool) {
+
+	/* Queued after the pending requests, one per worker */
+	for (int i = 0; i < pool->nsessions; i++)
+		pool_submit(pool, NULL);
+
+	for (int i = 0; i < pool->nsessions; i++) {
+		pthread_join(pool->workers[i], NULL);
+		DPABC_finalize(&pool->sessions[i]);
+	}
+
+	sem_destroy(&pool->items);
+	sem_destroy(&pool->slots);
+	free(pool->sessions);
+	free(pool->workers);
+	free(pool->cells);
+
+	return STATUS_OK;
+}
@@ -2,104 +2,14 @@
 #include <Zp.h>
 #include <Dpabc.h>
 #include <dpabc_middleware.h>
+#include <dpabc_bulk.h>
+#include <dpabc_codec.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
-const char base64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-uint32_t base64_decode(char *input, char *output, size_t * output_sz) {
-    int i, j, k = 0;
-    unsigned char temp[4], decoded[3];
-
-    for (i = 0; input[i] != '\0' && input[i] != '='; i += 4) {
-        for (j = 0; j < 4; j++) {
-            if (input[i + j] == '\0' || input[i + j] == '=') {
-                // Reached end of input string, stop decoding
-                break;
-            }
-            temp[j] = strchr(base64_table, input[i + j]) - base64_table;
-        }
-
-        // Check if we reached end of input string before completing a group of 4 characters
-        if (j < 4) {
-            memset(&(temp[j]), 0, 4 - j);
-        }
-
-        decoded[0] = (temp[0] << 2) + ((temp[1] & 0x30) >> 4);
-        decoded[1] = ((temp[1] & 0x0F) << 4) + ((temp[2] & 0x3C) >> 2);
-        decoded[2] = ((temp[2] & 0x03) << 6) + temp[3];
-
-        for (j = 0; j < 3; j++) {
-	    if (!decoded[j]) {
-		break;
-	    }
-            output[k++] = decoded[j];
-        }
-    }
-
-    output[k] = '\0';
-    *output_sz = k;
-    return 0;
-}
-
-const char * const ALPHABET =
-    "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
-const char ALPHABET_MAP[256] = {
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1,
-    -1,  9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1,
-    22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1,
-    -1, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46,
-    47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-};
-
-const double iFactor = 1.36565823730976103695740418120764243208481439700722980119458355862779176747360903943915516885072037696111192757109;
-
-// result must be declared (for the worst case): char result[len * 2];
-size_t DecodeBase58(
-    const unsigned char *str, int len, unsigned char *result) {
-    result[0] = 0;
-    size_t resultlen = 1;
-    for (int i = 0; i < len; i++) {
-        unsigned int carry = (unsigned int) ALPHABET_MAP[str[i]];
-        if (carry == -1) return 0;
-        for (int j = 0; j < resultlen; j++) {
-            carry += (unsigned int) (result[j]) * 58;
-            result[j] = (unsigned char) (carry & 0xff);
-            carry >>= 8;
-        }
-        while (carry > 0) {
-            result[resultlen++] = carry & 0xff;
-            carry >>= 8;
-        }
-    }
-
-    for (int i = 0; i < len && str[i] == '1'; i++)
-        result[resultlen++] = 0;
-
-    // Poorly coded, but guaranteed to work.
-    for (int i = resultlen - 1, z = (resultlen >> 1) + (resultlen & 1);
-        i >= z; i--) {
-        int k = result[i];
-        result[i] = result[resultlen - i - 1];
-        result[resultlen - i - 1] = k;
-    }
-    return resultlen;
-}
-
 uint32_t format(uint16_t nattrs, int * revealed, int revealed_sz, char * zktokenBytes, size_t zktokenBytes_sz, char * res, size_t * res_sz) {
 
     char * offset;
@@ -141,7 +51,166 @@ uint32_t format(uint16_t nattrs, int * revealed, int revealed_sz, char * zktoken
     return 0;
 }
 
-int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, epoch, attributes
+#define PK_CACHE_SIZE 64
+#define DEFAULT_SIGN_ID "test_signature"
+
+/* Decoded public key of the bulk mode, as sent to the TA */
+struct cached_pk {
+	size_t pk_sz;
+	char pk[];
+};
+
+struct bulk_state {
+	DPABC_session session;
+	DPABC_bulkCache cache;
+};
+
+static struct cached_pk * decode_pk(const char * pkeyBase58, size_t len) {
+
+	struct cached_pk * cached = malloc(sizeof(struct cached_pk) + len);
+	size_t bytes_sz;
+
+	// We don't care about first 2 bytes
+	if (DPABC_base58Decode(pkeyBase58, len, cached->pk, len, &bytes_sz) || bytes_sz <= 2 ||
+	    bytes_sz - 2 < (size_t)dpabcPkByteSizeForN((uint8_t)cached->pk[2])) {
+		free(cached);
+		return NULL;
+	}
+	cached->pk_sz = bytes_sz - 2;
+	memmove(cached->pk, cached->pk + 2, cached->pk_sz);
+	return cached;
+}
+
+// Request: {"id":..., "pk":"<base58>", "reveal":[<index>, ...], "nonce":"<base64>", "epoch":"...",
+//           "attributes":["...", ...], "sign_id":"..." (optional, "test_signature" by default)}
+// Response: {"id":..., "status":"ok", "zktoken":"<base64 of the formatted token>"}
+static void handle_request(DPABC_bulkRequest * req, FILE * out, void * user_data) {
+
+	struct bulk_state * state = user_data;
+	const DPABC_bulkField * pkey = DPABC_bulkGet(req, "pk", DPABC_BULK_STRING);
+	const DPABC_bulkField * indexes = DPABC_bulkGet(req, "reveal", DPABC_BULK_ARRAY);
+	const DPABC_bulkField * base64Nonce = DPABC_bulkGet(req, "nonce", DPABC_BULK_STRING);
+	const DPABC_bulkField * epochAttr = DPABC_bulkGet(req, "epoch", DPABC_BULK_STRING);
+	const DPABC_bulkField * attrs = DPABC_bulkGet(req, "attributes", DPABC_BULK_ARRAY);
+	const DPABC_bulkField * sign = DPABC_bulkGet(req, "sign_id", DPABC_BULK_STRING);
+	struct cached_pk * cached;
+	char * nonce, * tokenBytes, * formated, * encoded;
+	size_t nonce_sz, zksize, formated_sz;
+	int nattr, * indexReveal;
+	char error[64];
+
+	if (!pkey || !indexes || !base64Nonce || !epochAttr || !attrs) {
+		DPABC_bulkReplyError(out, req, "expected pk, reveal, nonce, epoch and attributes");
+		return;
+	}
+
+	cached = DPABC_bulkCacheGet(&state->cache, pkey->value);
+	if (cached == NULL) {
+		if ((cached = decode_pk(pkey->value, pkey->value_sz)) == NULL) {
+			DPABC_bulkReplyError(out, req, "invalid public key");
+			return;
+		}
+		DPABC_bulkCachePut(&state->cache, pkey->value, cached);
+	}
+	nattr = (uint8_t)cached->pk[0];
+	if (attrs->nitems != nattr) {
+		snprintf(error, sizeof(error), "expected %d attributes", nattr);
+		DPABC_bulkReplyError(out, req, error);
+		return;
+	}
+
+	// format() needs the indexes in increasing order
+	indexReveal = malloc((indexes->nitems + 1) * sizeof(int));
+	for (int i = 0; i < indexes->nitems; i++) {
+		char * end;
+		long index = strtol(indexes->items[i], &end, 10);
+
+		if (*end != '\0' || index < 0 || index >= nattr || (i > 0 && index <= indexReveal[i - 1])) {
+			free(indexReveal);
+			DPABC_bulkReplyError(out, req, "reveal must list increasing attribute indexes");
+			return;
+		}
+		indexReveal[i] = index;
+	}
+
+	nonce = malloc(base64Nonce->value_sz + 1);
+	if (DPABC_base64Decode(base64Nonce->value, base64Nonce->value_sz, nonce, base64Nonce->value_sz + 1, &nonce_sz)) {
+		free(nonce);
+		free(indexReveal);
+		DPABC_bulkReplyError(out, req, "invalid base64 nonce");
+		return;
+	}
+
+	char * binaryAttr = malloc(nattr * zpByteSize());
+	for (int i = 0; i < nattr; i++) {
+		Zp * attr = hashToZp(attrs->items[i], attrs->items_sz[i]);
+		zpToBytes(binaryAttr + i*zpByteSize(), attr);
+		zpFree(attr);
+	}
+
+	Zp * epoch = hashToZp(epochAttr->value, epochAttr->value_sz);
+	char * Binaryepoch = malloc(zpByteSize());
+	zpToBytes(Binaryepoch, epoch);
+	zpFree(epoch);
+
+	if (DPABC_generateZKtoken(&state->session,
+			      cached->pk, cached->pk_sz,
+			      sign ? sign->value : DEFAULT_SIGN_ID,
+			      Binaryepoch, zpByteSize(),
+			      binaryAttr, nattr * zpByteSize(),
+			      indexReveal, indexes->nitems * sizeof(int),
+			      nonce, nonce_sz,
+			      &tokenBytes, &zksize) != STATUS_OK)
+	{
+		DPABC_bulkReplyError(out, req, "error generating zkToken");
+	} else {
+		formated = calloc(1, 2 + (nattr / 8) + 1 + zksize);
+		format(nattr, indexReveal, indexes->nitems, tokenBytes, zksize, formated, &formated_sz);
+		encoded = malloc(DPABC_BASE64_ENCODED_SIZE(formated_sz));
+		DPABC_base64Encode(formated, formated_sz, encoded);
+
+		DPABC_bulkReplyBegin(out, req);
+		fputs(",\"zktoken\":\"", out);
+		fputs(encoded, out);
+		fputc('"', out);
+		DPABC_bulkReplyEnd(out);
+
+		free(encoded);
+		free(formated);
+		free(tokenBytes);
+	}
+
+	free(Binaryepoch);
+	free(binaryAttr);
+	free(nonce);
+	free(indexReveal);
+}
+
+// Serves newline delimited JSON requests from stdin (or a Unix socket) with one session and the decoded keys cached
+static int bulk_main(const char * socket_path) {
+
+	struct bulk_state state;
+	int ret;
+
+	if (socket_path == NULL && DPABC_bulkDetachStdout() == NULL) {
+		perror("stdout");
+		return 1;
+	}
+	if (DPABC_initialize(&state.session) != STATUS_OK) {
+		fprintf(stderr, "Error opening the session\n");
+		return 1;
+	}
+	DPABC_bulkCacheInit(&state.cache, PK_CACHE_SIZE, free);
+
+	if ((ret = DPABC_bulkServe(socket_path, handle_request, &state)))
+		perror(socket_path);
+
+	DPABC_bulkCacheFree(&state.cache);
+	DPABC_finalize(&state.session);
+	return ret ? 1 : 0;
+}
+
+int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, nonce, epoch, attributes (or --bulk [socket path])
 
 	DPABC_session session;
 	int nattr = argc - 5; // Discard first 5 arguments
@@ -155,7 +224,11 @@ int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, epoch, attribut
 	char * tokenBytes;
 	size_t zksize;
 	char * Binaryepoch;
-	char * sign_id = "test_signature";
+	char * sign_id = DEFAULT_SIGN_ID;
+
+	if (argc >= 2 && !strcmp(argv[1], "--bulk")) {
+		return bulk_main(argc > 2 ? argv[2] : NULL);
+	}
 
 	for (int i = 1; i < argc; i++) {
 		printf("argument: %s\n", argv[i]);
@@ -177,9 +250,13 @@ int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, epoch, attribut
 	// }
 	
 	// base58_decode(pkeyBase58, pk, &pk_sz);
-	pk_sz = DecodeBase58((unsigned char *)pkeyBase58, strlen(pkeyBase58), (unsigned char *)pk_buffer) - 2;
+	if (DPABC_base58Decode(pkeyBase58, strlen(pkeyBase58), pk_buffer, sizeof(pk_buffer), &pk_sz) || pk_sz < 2) {
+		printf("Error decoding base58 public key\n");
+		return 1;
+	}
+	pk_sz -= 2;
 
-	if (base64_decode(base64Nonce, nonce, &nonce_sz)) {
+	if (DPABC_base64Decode(base64Nonce, strlen(base64Nonce), nonce, sizeof(nonce), &nonce_sz)) {
 	    printf("Error decoding base64 nonce: %s\n", base64Nonce);
 	    return 1;
 	}
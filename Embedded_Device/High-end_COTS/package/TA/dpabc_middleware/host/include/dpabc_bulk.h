@@ -0,0 +1,121 @@
+#ifndef DPABC_BULK_H
+#define DPABC_BULK_H
+
+#include <stdio.h>
+
+/*
+ * Bulk mode of the host tools: newline delimited JSON requests, read from
+ * stdin or from the clients of a Unix socket, answered with one JSON line
+ * each (flushed as soon as it is written) so a process keeps its TEE session
+ * and decoded keys across requests. A request is a flat object whose values
+ * are strings, numbers, literals or arrays of them
+ */
+
+#define DPABC_BULK_MAX_FIELDS 16
+
+typedef enum {
+	DPABC_BULK_STRING,
+	DPABC_BULK_NUMBER,			/* Also true, false and null, kept as text */
+	DPABC_BULK_ARRAY
+} DPABC_bulkType;
+
+typedef struct {
+	char * key;
+	DPABC_bulkType type;
+	char * value;				/* Unescaped string or number text */
+	size_t value_sz;
+	char ** items;				/* DPABC_BULK_ARRAY: unescaped strings or number texts */
+	size_t * items_sz;
+	int nitems;
+} DPABC_bulkField;
+
+/* Request parsed in place from its line, valid until the handler returns */
+typedef struct {
+	DPABC_bulkField fields[DPABC_BULK_MAX_FIELDS];
+	int nfields;
+	const DPABC_bulkField * id;		/* Echoed in the response, NULL if missing */
+} DPABC_bulkRequest;
+
+/**
+ * @brief Handles one request, answering it with DPABC_bulkReplyBegin/End or
+ * DPABC_bulkReplyError
+ */
+typedef void (*DPABC_bulkHandler)(DPABC_bulkRequest * req, FILE * out, void * user_data);
+
+/**
+ * @brief Keeps stdout for the responses and sends to stderr whatever else is
+ * printed to it from then on (middleware and TA traces). Call it before
+ * opening the session when serving stdin
+ *
+ * @return stream of the original stdout, NULL on error
+ */
+FILE * DPABC_bulkDetachStdout(void);
+
+/**
+ * @brief Serves requests until the end of the input. Lines that are not a
+ * valid request get an error response
+ *
+ * @param socket_path NULL to read stdin and answer on stdout (detached with
+ * DPABC_bulkDetachStdout if it was not yet), otherwise the path of a Unix
+ * socket to listen on (clients are served one after another, each one until
+ * it closes its end)
+ * @return 0 at the end of stdin, -1 if stdout or the socket could not be set up
+ */
+int DPABC_bulkServe(const char * socket_path, DPABC_bulkHandler handler, void * user_data);
+
+/**
+ * @brief Field of a request
+ *
+ * @return NULL if missing or of another type
+ */
+const DPABC_bulkField * DPABC_bulkGet(const DPABC_bulkRequest * req, const char * key, DPABC_bulkType type);
+
+/**
+ * @brief Starts a response: writes {"id":...,"status":"ok" so the handler
+ * can append its own ,"key":value members
+ */
+void DPABC_bulkReplyBegin(FILE * out, const DPABC_bulkRequest * req);
+
+/**
+ * @brief Closes the response started with DPABC_bulkReplyBegin and flushes it
+ */
+void DPABC_bulkReplyEnd(FILE * out);
+
+/**
+ * @brief Writes a complete {"id":...,"status":"error","error":...} response
+ */
+void DPABC_bulkReplyError(FILE * out, const DPABC_bulkRequest * req, const char * error);
+
+/**
+ * @brief Writes s as a JSON string
+ */
+void DPABC_bulkWriteString(FILE * out, const char * s, size_t s_sz);
+
+/*
+ * Small cache of decoded values (public keys) keyed by their encoded form,
+ * the oldest entry is evicted when it is full
+ */
+typedef struct {
+	char ** keys;
+	void ** values;
+	int size;
+	int used;
+	int next;				/* Entry evicted by the next put */
+	void (*release)(void * value);
+} DPABC_bulkCache;
+
+void DPABC_bulkCacheInit(DPABC_bulkCache * cache, int size, void (*release)(void * value));
+
+/**
+ * @return the value stored for key, NULL if there is none
+ */
+void * DPABC_bulkCacheGet(DPABC_bulkCache * cache, const char * key);
+
+/**
+ * @brief Stores value (the cache owns it from now on) for key
+ */
+void DPABC_bulkCachePut(DPABC_bulkCache * cache, const char * key, void * value);
+
+void DPABC_bulkCacheFree(DPABC_bulkCache * cache);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef DPABC_CODEC_H
+#define DPABC_CODEC_H
+
+#include <stddef.h>
+
+/*
+ * Table driven base64 and base58 codecs shared by the host tools. Decoders
+ * look every character up in a 256 entry table and reject anything outside
+ * the alphabet instead of reading past it
+ */
+
+/* Characters needed to base64 encode n bytes, terminator included */
+#define DPABC_BASE64_ENCODED_SIZE(n) (4 * (((n) + 2) / 3) + 1)
+
+/**
+ * @brief Decodes base64, both the standard ("+/") and the url-safe ("-_")
+ * alphabets, with or without '=' padding
+ *
+ * @param in encoded text, in_sz characters long
+ * @param out buffer of out_cap bytes (3 * in_sz / 4 is always enough)
+ * @param out_sz number of decoded bytes
+ * @return 0 on success, -1 if the input is not base64 or out is too small
+ */
+int DPABC_base64Decode(const char * in, size_t in_sz, char * out, size_t out_cap, size_t * out_sz);
+
+/**
+ * @brief Encodes in_sz bytes as padded standard base64, out needs
+ * DPABC_BASE64_ENCODED_SIZE(in_sz) characters
+ *
+ * @return length of the encoded text, without the terminator
+ */
+size_t DPABC_base64Encode(const char * in, size_t in_sz, char * out);
+
+/**
+ * @brief Decodes base58 (bitcoin alphabet), every leading '1' is a leading
+ * zero byte
+ *
+ * @param in encoded text, in_sz characters long
+ * @param out buffer of out_cap bytes (in_sz is always enough)
+ * @param out_sz number of decoded bytes
+ * @return 0 on success, -1 if the input is not base58 or out is too small
+ */
+int DPABC_base58Decode(const char * in, size_t in_sz, char * out, size_t out_cap, size_t * out_sz);
+
+#endif
@@ -1,6 +1,11 @@
+#ifndef DPABC_MIDDLEWARE_H
+#define DPABC_MIDDLEWARE_H
+
 #include <tee_client_api.h>
 /* For the UUID (found in the TA's h-file(s)) */
 #include <dpabc_ta.h>
+/* Layout of the trace events and command counters */
+#include <ta_trace.h>
 
 #include <core.h>
 
@@ -26,16 +31,73 @@
 
 #define STATUS_OK 1
 
+/* Minimum size of a shared memory region */
 #define DEFAULT_BUFFER_SIZE 512
 
+/* TEE_ERROR_SIGNATURE_INVALID, returned by the TA for invalid signatures */
+#define TA_ERROR_SIGNATURE_INVALID	0xFFFF3072
+
 typedef uint32_t DPABC_status;
 
+/* Regions of the shared memory pool of a session, one per operation parameter */
+#define DPABC_SHM_SLOTS 4
+
 typedef struct {
 	TEEC_Context ctx;
 	TEEC_Session sess;
 	TEEC_UUID uuid;
+	TEEC_SharedMemory shm[DPABC_SHM_SLOTS];	/* Shared memory pool, reused by every call */
+	size_t online_token_sz;			/* Size of the tokens of DPABC_generateZKtokenOnline */
 } DPABC_session;
 
+/**
+ * @brief Request of DPABC_signBatch
+ */
+typedef struct {
+	char * key_id;		/* Private key id */
+	char * epoch;		/* Epoch in byte form */
+	size_t epoch_sz;
+	char * attr;		/* Attributes to sign in byte form */
+	size_t attr_sz;
+	char * sig;		/* Output: signature, allocated by the call if status is STATUS_OK, must be freed */
+	size_t sig_sz;
+	DPABC_status status;	/* Output: result of the request */
+} DPABC_signRequest;
+
+/**
+ * @brief Request of DPABC_verifyBatch
+ */
+typedef struct {
+	char * pk;		/* Public key of the signature in byte form */
+	size_t pk_sz;
+	char * epoch;		/* Epoch in byte form */
+	size_t epoch_sz;
+	char * attr;		/* Signed attributes in byte form */
+	size_t attr_sz;
+	char * sig_id;		/* Stored signature id */
+	DPABC_status status;	/* Output: STATUS_OK if valid, STATUS_VERIFICATION_ERROR if not */
+} DPABC_verifyRequest;
+
+/**
+ * @brief Request of DPABC_generateZKtokenBatch
+ */
+typedef struct {
+	char * pk;		/* Public key of the signature in byte form */
+	size_t pk_sz;
+	char * sign_id;		/* Stored signature id */
+	char * epoch;		/* Epoch in byte form */
+	size_t epoch_sz;
+	char * attr;		/* Signed attributes in byte form */
+	size_t attr_sz;
+	int * indexReveal;	/* Indexes of the revealed attributes, in ascendent order */
+	size_t indexReveal_sz;	/* Size in bytes of indexReveal */
+	char * msg;		/* Message to sign with the token */
+	size_t msg_sz;
+	char * zkToken;		/* Output: token, allocated by the call if status is STATUS_OK, must be freed */
+	size_t zkToken_sz;
+	DPABC_status status;	/* Output: result of the request */
+} DPABC_zkTokenRequest;
+
 /**
  * @brief Initialize trusted application and get session information
  * the session param which needs to be allocated previously
@@ -152,11 +214,152 @@ DPABC_status DPABC_generateZKtoken(DPABC_session * session,
 				   char ** zkToken, size_t * zkToken_sz
 );
 
+/**
+ * @brief Precomputes in the TA the message-independent part of count
+ * zero-knowledge tokens for a previously stored signature, to be used by
+ * DPABC_generateZKtokenOnline. Replaces the previous precomputed presentations
+ * of the session
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param pk Array with public key in byte form corresponding to the signature
+ * @param pk_sz Size of pk
+ * @param sign_id String id of previously stored signature
+ * @param attr Array of signed attributes in byte form
+ * @param attr_sz Size of attributes array
+ * @param indexReveal indexes of the revealed attributes (with respect to the whole set of attributes, starting from 0). Assumed to be in ascendent order
+ * @param indexReveal_sz Size of indexes array
+ * @param count Number of presentations to precompute, 1 to
+ * TA_DPABC_MAX_PRECOMPUTE
+*/
+DPABC_status DPABC_presentPrecompute(DPABC_session * session, 
+				     char * pk, size_t pk_sz, 
+				     char * sign_id,
+				     char * attr, size_t attr_sz, 
+				     int * indexReveal, size_t indexReveal_sz, 
+				     uint32_t count
+);
+
+/**
+ * @brief Generates a zero knowledge token for a message from the next
+ * presentation precomputed with DPABC_presentPrecompute
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param msg Message that will be signed for generating the zero-knowldege token
+ * @param msg_sz Size of the message to be signed
+ * @param zkToken zero knowledge token reference where the token will be placed, memory will be allocated for it, after call, after use must be freed
+ * @param zkToken_sz Size reference where the token size in bytes will be reference, can be set to NULL if not needed
+ * @param remaining Number of precomputed presentations left, can be set to NULL if not needed
+*/
+DPABC_status DPABC_generateZKtokenOnline(DPABC_session * session, 
+					 char * msg, size_t msg_sz,
+					 char ** zkToken, size_t * zkToken_sz,
+					 uint32_t * remaining
+);
+
+/**
+ * @brief Signs several sets of attributes in one call to the TA, which
+ * saves a world switch (and the key load, for repeated keys) per signature
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param requests Requests, their sig and status are filled
+ * @param nrequests Number of requests
+ * @return STATUS_OK if the TA processed the requests (each one has its own
+ * status)
+*/
+DPABC_status DPABC_signBatch(DPABC_session * session, DPABC_signRequest * requests, int nrequests);
+
+/**
+ * @brief Verifies several stored signatures in one call to the TA.
+ * Consecutive requests with the same public key are batch verified
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param requests Requests, their status is filled
+ * @param nrequests Number of requests
+ * @return STATUS_OK if the TA processed the requests (each one has its own
+ * status)
+*/
+DPABC_status DPABC_verifyBatch(DPABC_session * session, DPABC_verifyRequest * requests, int nrequests);
+
+/**
+ * @brief Generates several zero knowledge tokens in one call to the TA
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param requests Requests, their zkToken and status are filled
+ * @param nrequests Number of requests
+ * @return STATUS_OK if the TA processed the requests (each one has its own
+ * status)
+*/
+DPABC_status DPABC_generateZKtokenBatch(DPABC_session * session, DPABC_zkTokenRequest * requests, int nrequests);
+
+/**
+ * @brief Combines signature shares stored in the TA (signatures of the same
+ * attributes and epoch by different keys) into a signature that is stored
+ * under combined_id, without leaving the TA. It verifies with the aggregation
+ * of the public keys
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param combined_id Id of the combined signature
+ * @param pks Public keys of the signers in byte form
+ * @param pks_sz Sizes of the public keys
+ * @param sig_ids Ids of the stored shares, in the order of pks
+ * @param nelements Number of shares
+*/
 DPABC_status DPABC_combineSignatures(DPABC_session * session, char * combined_id, char ** pks, uint32_t * pks_sz, char ** sig_ids, int nelements);
+
 /**
- * @brief Finalize TA session
+ * @brief Reads the memory usage of the TA session arena, to size
+ * TA_DPABC_ARENA_SIZE and TA_DATA_SIZE
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param high_water Maximum number of bytes used by a command since the
+ * session was opened, can be set to NULL if not needed
+ * @param arena_sz Size of the arena in bytes, can be set to NULL if not needed
+ * @param overflows Number of allocations that did not fit in the arena, can be
+ * set to NULL if not needed
+*/
+DPABC_status DPABC_arenaStats(DPABC_session * session, uint32_t * high_water, uint32_t * arena_sz, uint32_t * overflows);
+
+/**
+ * @brief Reads the oldest events of the TA trace ring (ta_trace.h) in a
+ * single call, removing them from it. The ring holds TA_TRACE_RING_SIZE
+ * events, drain it until nevents comes back 0 to empty it
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param events Buffer for max_events events
+ * @param nevents Number of events read
+ * @param dropped Events overwritten before they could be read since the last
+ * drain, can be set to NULL if not needed
+*/
+DPABC_status DPABC_traceDrain(DPABC_session * session, ta_trace_event * events, uint32_t max_events, uint32_t * nevents, uint32_t * dropped);
+
+/**
+ * @brief Reads the calls, errors and latency of every command called so far
+ * on the TA
+ * 
+ * @param session contains session information that needs to be provided
+ * for every call to the TA
+ * @param stats Buffer for max_stats counters (TA_TRACE_MAX_CMDS is always
+ * enough)
+ * @param nstats Number of counters read
+ * @param reset Zeroes the counters after reading them if not 0
+ * @return STATUS_BAD_PARAMETERS if stats is too small
+*/
+DPABC_status DPABC_commandStats(DPABC_session * session, ta_cmd_stats * stats, uint32_t max_stats, uint32_t * nstats, int reset);
+
+/**
+ * @brief Finalize TA session, releasing its shared memory
  * 
  * @param session contains session information, after
  * calling finalize must be freed
 */
 DPABC_status DPABC_finalize(DPABC_session * session);
+
+#endif /* DPABC_MIDDLEWARE_H */
@@ -0,0 +1,147 @@
+#ifndef DPABC_POOL_H
+#define DPABC_POOL_H
+
+#include <dpabc_middleware.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * Session pool: N TEE sessions, each one driven by a worker thread, serving
+ * the requests submitted with the DPABC_*_async calls from a bounded lock-free
+ * multi-producer multi-consumer queue. A worker takes the requests already
+ * queued (its share of them) and sends consecutive ones of the same kind to the
+ * TA as one batched command
+ */
+
+/* Most requests a worker sends to the TA in one batched command */
+#define DPABC_POOL_MAX_BATCH 16
+
+/* Request submitted to a pool, also the handle used to wait for its result */
+typedef struct DPABC_job DPABC_job;
+
+/**
+ * @brief Completion callback of a request, called by the worker thread that
+ * ran it. The callback owns the job, it must get its result with
+ * DPABC_jobResult and release it with DPABC_jobFree (it can do it inside the
+ * callback)
+ */
+typedef void (*DPABC_callback)(DPABC_job * job, void * user_data);
+
+struct DPABC_pool_cell;
+
+typedef struct {
+	int nsessions;
+	DPABC_session * sessions;		/* One session per worker */
+	pthread_t * workers;
+	struct DPABC_pool_cell * cells;		/* Queue, a ring of a power of two cells */
+	size_t mask;
+	_Atomic size_t enqueue_pos;
+	_Atomic size_t dequeue_pos;
+	sem_t items;				/* Queued requests, workers sleep on it */
+	sem_t slots;				/* Free cells, submitters block on it when the queue is full */
+} DPABC_pool;
+
+/**
+ * @brief Opens the sessions of the pool and starts its workers, the pool param
+ * needs to be allocated previously
+ *
+ * @param pool pool information that needs to be provided for every async call
+ * @param nsessions Number of TEE sessions (and worker threads)
+ * @param queue_size Number of requests that can be queued before the async
+ * calls block, rounded up to a power of two
+*/
+DPABC_status DPABC_poolInitialize(DPABC_pool * pool, int nsessions, size_t queue_size);
+
+/**
+ * @brief Signs the provided attributes with the private key id provided, see
+ * DPABC_sign. The arguments must stay valid until the request completes
+ *
+ * @param pool pool that runs the request
+ * @param callback Called when the request completes, can be set to NULL to
+ * wait for the returned job instead
+ * @param user_data Passed to the callback
+ * @return job of the request, NULL if it could not be allocated. Its result is
+ * the signature
+*/
+DPABC_job * DPABC_sign_async(DPABC_pool * pool, char * key_id, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz,
+			     DPABC_callback callback, void * user_data);
+
+/**
+ * @brief Signs the provided attributes and stores the signature generated, see
+ * DPABC_signStore. The arguments must stay valid until the request completes
+ *
+ * @return job of the request, NULL if it could not be allocated. It has no result
+*/
+DPABC_job * DPABC_signStore_async(DPABC_pool * pool, char * key_id, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz, char * sig_id,
+				  DPABC_callback callback, void * user_data);
+
+/**
+ * @brief Verifies a stored signature against a set of attributes, see
+ * DPABC_verifyStored. The arguments must stay valid until the request completes
+ *
+ * @return job of the request, NULL if it could not be allocated. It has no
+ * result, its status is STATUS_VERIFICATION_ERROR for invalid signatures
+*/
+DPABC_job * DPABC_verifyStored_async(DPABC_pool * pool, char * pk, size_t pk_sz, char * epoch, size_t epoch_sz, char * attr, size_t attr_sz, char * sig_id,
+				     DPABC_callback callback, void * user_data);
+
+/**
+ * @brief Generates a zero knowledge token from a previously stored signature,
+ * see DPABC_generateZKtoken. The arguments must stay valid until the request
+ * completes
+ *
+ * @return job of the request, NULL if it could not be allocated. Its result is
+ * the token
+*/
+DPABC_job * DPABC_generateZKtoken_async(DPABC_pool * pool,
+					char * pk, size_t pk_sz,
+					char * sign_id,
+					char * epoch, size_t epoch_sz,
+					char * attr, size_t attr_sz,
+					int * indexReveal, size_t indexReveal_sz,
+					char * msg, size_t msg_sz,
+					DPABC_callback callback, void * user_data
+);
+
+/**
+ * @brief Checks, without blocking, if a request has completed
+*/
+bool DPABC_jobDone(DPABC_job * job);
+
+/**
+ * @brief Waits for a request submitted without callback to complete
+ *
+ * @return status of the request
+*/
+DPABC_status DPABC_jobWait(DPABC_job * job);
+
+/**
+ * @brief Gets the result of a completed request
+ *
+ * @param job completed request
+ * @param out Reference where the result (signature or token) will be placed,
+ * after use must be freed, can be set to NULL if not needed
+ * @param out_sz Size reference where the result size in bytes will be
+ * placed, can be set to NULL if not needed
+ * @return status of the request
+*/
+DPABC_status DPABC_jobResult(DPABC_job * job, char ** out, size_t * out_sz);
+
+/**
+ * @brief Releases a completed request, and its result if it was not taken
+ * with DPABC_jobResult
+*/
+void DPABC_jobFree(DPABC_job * job);
+
+/**
+ * @brief Runs the requests already submitted, stops the workers and closes
+ * the sessions of the pool
+ *
+ * @param pool pool information, after calling finalize must be freed
+*/
+DPABC_status DPABC_poolFinalize(DPABC_pool * pool);
+
+#endif /* DPABC_POOL_H */
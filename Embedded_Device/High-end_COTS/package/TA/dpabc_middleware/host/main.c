@@ -10,7 +10,7 @@ extern jmp_buf *AceUnit_env;
 
 #include <Zp.h>
 #include <Dpabc.h>
-#include <dpabc_middleware.h>
+#include <dpabc_pool.h>
 
 DPABC_session session;
 char * pk;
@@ -115,6 +115,44 @@ void testVerifyStored() {
 	assert(DPABC_verifyStored(&session, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), sign_id) != STATUS_OK);
 }
 
+void testSignatureOverwrittenBySession() {
+
+	DPABC_session other;
+	char * shared_id = "test_signature_shared";
+	char * other_sig;
+	Zp * attr[] = {zpFromInt(0), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(0), zpFromInt(1), zpFromInt(-1)};
+	Zp * other_attr[] = {zpFromInt(5), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(5), zpFromInt(1), zpFromInt(-1)};
+
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	char * otherBinaryAttr = malloc(nattr*zpByteSize());
+	for (int i = 0; i < nattr; i++) {
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+		zpToBytes(otherBinaryAttr + i*zpByteSize(), other_attr[i]);
+	}
+
+	char * epoch = malloc(zpByteSize());
+	zpToBytes(epoch, zpFromInt(3));
+
+	assert(DPABC_initialize(&other) == STATUS_OK);
+	assert(DPABC_sign(&other, keyID, epoch, zpByteSize(), otherBinaryAttr, nattr*zpByteSize(), &other_sig, NULL) == STATUS_OK);
+
+	/* Cached by the first session, then overwritten by the other one */
+	assert(DPABC_storeSignature(&session, shared_id, sig, dpabcSignByteSize()) == STATUS_OK);
+	assert(DPABC_verifyStored(&session, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), shared_id) == STATUS_OK);
+	assert(DPABC_storeSignature(&other, shared_id, other_sig, dpabcSignByteSize()) == STATUS_OK);
+
+	assert(DPABC_verifyStored(&session, pk, pk_sz, epoch, zpByteSize(), otherBinaryAttr, nattr * zpByteSize(), shared_id) == STATUS_OK);
+	assert(DPABC_verifyStored(&session, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), shared_id) != STATUS_OK);
+
+	DPABC_finalize(&other);
+	free(other_sig);
+	free(binaryAttr);
+	free(otherBinaryAttr);
+	free(epoch);
+}
+
 void testZkToken() {
 
 	char * msg="signedMessage";
@@ -156,6 +194,313 @@ void testverifyZkToken() {
 	assert(res != 0);
 }
 
+void testPresentPrecompute() {
+
+	char * msg="onlineMessage";
+	int msgLength=13;
+	int nIndexReveal=2;
+	int indexReveal[]={0,2};
+	Zp * attr[] = {zpFromInt(2), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(2), zpFromInt(1), zpFromInt(-1)};
+	Zp * revealedAttributes[] = {zpFromInt(2), zpFromInt(-1)};
+	char * onlineToken;
+	size_t onlineToken_sz;
+	uint32_t remaining;
+
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	for (int i = 0; i < nattr; i++)
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+
+	assert(DPABC_presentPrecompute(&session, pk, pk_sz, sign_id_2, binaryAttr, nattr * zpByteSize(),
+				       indexReveal, sizeof(indexReveal), 0) != STATUS_OK);
+	assert(DPABC_presentPrecompute(&session, pk, pk_sz, sign_id_2, binaryAttr, nattr * zpByteSize(),
+				       indexReveal, sizeof(indexReveal), TA_DPABC_MAX_PRECOMPUTE + 1) != STATUS_OK);
+	assert(DPABC_presentPrecompute(&session, pk, pk_sz, sign_id_2, binaryAttr, nattr * zpByteSize(),
+				       indexReveal, sizeof(indexReveal), 2) == STATUS_OK);
+
+	/* A short buffer is refused without using up a presentation */
+	onlineToken_sz = session.online_token_sz;
+	session.online_token_sz = 1;
+	assert(DPABC_generateZKtokenOnline(&session, msg, msgLength, &onlineToken, NULL, NULL) != STATUS_OK);
+	session.online_token_sz = onlineToken_sz;
+
+	assert(DPABC_generateZKtokenOnline(&session, msg, msgLength, &onlineToken, &onlineToken_sz, &remaining) == STATUS_OK);
+	assert(remaining == 1);
+
+	publicKey * dpabc_pk = dpabcPkFromBytes(pk);
+	zkToken * token = dpabcZkFromBytes(onlineToken);
+	assert(verifyZkToken(token, dpabc_pk, zpFromInt(3), (const Zp **)revealedAttributes, indexReveal, nIndexReveal, msg, msgLength));
+
+	dpabcZkFree(token);
+	dpabcPkFree(dpabc_pk);
+	free(onlineToken);
+	free(binaryAttr);
+}
+
+void testSignBatch() {
+
+	int nrequests = 3;
+	DPABC_signRequest requests[3];
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	char * epoch = malloc(zpByteSize());
+	Zp * attr[6];
+	Zp * dpabc_epoch = zpFromInt(3);
+	publicKey * dpabc_pk = dpabcPkFromBytes(pk);
+
+	for (int i = 0; i < nattr; i++) {
+		attr[i] = zpFromInt(i);
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+	}
+	zpToBytes(epoch, dpabc_epoch);
+
+	for (int i = 0; i < nrequests; i++) {
+		requests[i].key_id = i == 1 ? "test_missing_key" : keyID;
+		requests[i].epoch = epoch;
+		requests[i].epoch_sz = zpByteSize();
+		requests[i].attr = binaryAttr;
+		requests[i].attr_sz = nattr * zpByteSize();
+	}
+
+	assert(DPABC_signBatch(&session, requests, nrequests) == STATUS_OK);
+	assert(requests[1].status != STATUS_OK);
+	for (int i = 0; i < nrequests; i += 2) {
+		assert(requests[i].status == STATUS_OK);
+		signature * dpabc_sig = dpabcSignFromBytes(requests[i].sig);
+		assert(verify(dpabc_pk, dpabc_sig, dpabc_epoch, (const Zp **)attr) == 1);
+		dpabcSignFree(dpabc_sig);
+		free(requests[i].sig);
+	}
+
+	dpabcPkFree(dpabc_pk);
+	free(binaryAttr);
+	free(epoch);
+}
+
+void testVerifyBatch() {
+
+	DPABC_verifyRequest requests[3];
+	Zp * attr[] = {zpFromInt(2), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(2), zpFromInt(1), zpFromInt(-1)};
+
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	for (int i = 0; i < nattr; i++)
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+
+	char * epoch = malloc(zpByteSize());
+	zpToBytes(epoch, zpFromInt(3));
+
+	for (int i = 0; i < 3; i++) {
+		requests[i].pk = pk;
+		requests[i].pk_sz = pk_sz;
+		requests[i].epoch = epoch;
+		requests[i].epoch_sz = zpByteSize();
+		requests[i].attr = binaryAttr;
+		requests[i].attr_sz = nattr * zpByteSize();
+		requests[i].sig_id = i == 1 ? sign_id : sign_id_2;
+	}
+
+	assert(DPABC_verifyBatch(&session, requests, 3) == STATUS_OK);
+	assert(requests[0].status == STATUS_OK);
+	assert(requests[1].status == STATUS_VERIFICATION_ERROR);
+	assert(requests[2].status == STATUS_OK);
+
+	free(binaryAttr);
+	free(epoch);
+}
+
+void testZkTokenBatch() {
+
+	char * msgs[] = {"signedMessage", "otherMessage"};
+	int indexReveal[] = {0,2};
+	Zp * revealedAttributes[] = {zpFromInt(2), zpFromInt(-1)};
+	DPABC_zkTokenRequest requests[2];
+	Zp * attr[] = {zpFromInt(2), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(2), zpFromInt(1), zpFromInt(-1)};
+
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	for (int i = 0; i < nattr; i++)
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+
+	char * epoch = malloc(zpByteSize());
+	zpToBytes(epoch, zpFromInt(3));
+
+	for (int i = 0; i < 2; i++) {
+		requests[i].pk = pk;
+		requests[i].pk_sz = pk_sz;
+		requests[i].sign_id = sign_id_2;
+		requests[i].epoch = epoch;
+		requests[i].epoch_sz = zpByteSize();
+		requests[i].attr = binaryAttr;
+		requests[i].attr_sz = nattr * zpByteSize();
+		requests[i].indexReveal = indexReveal;
+		requests[i].indexReveal_sz = sizeof(indexReveal);
+		requests[i].msg = msgs[i];
+		requests[i].msg_sz = strlen(msgs[i]);
+	}
+
+	assert(DPABC_generateZKtokenBatch(&session, requests, 2) == STATUS_OK);
+
+	publicKey * dpabc_pk = dpabcPkFromBytes(pk);
+	for (int i = 0; i < 2; i++) {
+		assert(requests[i].status == STATUS_OK);
+		zkToken * token = dpabcZkFromBytes(requests[i].zkToken);
+		assert(verifyZkToken(token, dpabc_pk, zpFromInt(3), (const Zp **)revealedAttributes, indexReveal, 2, msgs[i], strlen(msgs[i])) != 0);
+		dpabcZkFree(token);
+		free(requests[i].zkToken);
+	}
+
+	dpabcPkFree(dpabc_pk);
+	free(binaryAttr);
+	free(epoch);
+}
+
+void testCombineSignatures() {
+
+	char * combined_id = "test_combined_signature";
+	char * share_ids[] = {"test_signature_share", "test_signature_share_two"};
+	char * missing_ids[] = {"test_signature_share", "test_missing_share"};
+	char * pks[2];
+	uint32_t pks_sz[2];
+	size_t pk2_sz;
+	publicKey * dpabc_pks[2];
+	Zp * attr[] = {zpFromInt(4), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(4), zpFromInt(1), zpFromInt(-1)};
+
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	for (int i = 0; i < nattr; i++)
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+
+	char * epoch = malloc(zpByteSize());
+	zpToBytes(epoch, zpFromInt(3));
+
+	pks[0] = pk;
+	pks_sz[0] = pk_sz;
+	assert(DPABC_get_key(&session, keyID2, &pks[1], &pk2_sz) == STATUS_OK);
+	pks_sz[1] = pk2_sz;
+
+	assert(DPABC_signStore(&session, keyID, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), share_ids[0]) == STATUS_OK);
+	assert(DPABC_signStore(&session, keyID2, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), share_ids[1]) == STATUS_OK);
+
+	assert(DPABC_combineSignatures(&session, combined_id, pks, pks_sz, missing_ids, 2) != STATUS_OK);
+	assert(DPABC_combineSignatures(&session, combined_id, pks, pks_sz, share_ids, 2) == STATUS_OK);
+	assert(DPABC_combineSignatures(&session, combined_id, pks, pks_sz, share_ids, 2) == STATUS_DUPLICATE_SIGNATURE);
+
+	/* The combined signature verifies with the aggregated key */
+	for (int i = 0; i < 2; i++)
+		dpabc_pks[i] = dpabcPkFromBytes(pks[i]);
+	publicKey * aggr = keyAggr((const publicKey **)dpabc_pks, 2);
+	size_t aggr_sz = dpabcPkByteSize(aggr);
+	char * aggrBytes = malloc(aggr_sz);
+	dpabcPkToBytes(aggrBytes, aggr);
+
+	assert(DPABC_verifyStored(&session, aggrBytes, aggr_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), combined_id) == STATUS_OK);
+	assert(DPABC_verifyStored(&session, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), combined_id) != STATUS_OK);
+
+	for (int i = 0; i < 2; i++)
+		dpabcPkFree(dpabc_pks[i]);
+	dpabcPkFree(aggr);
+	free(aggrBytes);
+	free(pks[1]);
+	free(binaryAttr);
+	free(epoch);
+}
+
+static void poolCallback(DPABC_job * job, void * user_data) {
+
+	*(DPABC_status *)user_data = DPABC_jobResult(job, NULL, NULL);
+	DPABC_jobFree(job);
+}
+
+void testPool() {
+
+	DPABC_pool pool;
+	DPABC_job * signs[4];
+	DPABC_job * verifies[2];
+	DPABC_status callbackStatus = STATUS_GENERIC_ERROR;
+	Zp * attr[] = {zpFromInt(2), zpFromInt(1), zpFromInt(-1),
+				zpFromInt(2), zpFromInt(1), zpFromInt(-1)};
+	publicKey * dpabc_pk = dpabcPkFromBytes(pk);
+
+	char * binaryAttr = malloc(nattr*zpByteSize());
+	for (int i = 0; i < nattr; i++)
+		zpToBytes(binaryAttr + i*zpByteSize(), attr[i]);
+
+	char * epoch = malloc(zpByteSize());
+	zpToBytes(epoch, zpFromInt(3));
+
+	assert(DPABC_poolInitialize(&pool, 2, 4) == STATUS_OK);
+
+	for (int i = 0; i < 4; i++)
+		signs[i] = DPABC_sign_async(&pool, keyID, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), NULL, NULL);
+	verifies[0] = DPABC_verifyStored_async(&pool, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), sign_id_2, NULL, NULL);
+	verifies[1] = DPABC_verifyStored_async(&pool, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), sign_id, NULL, NULL);
+	assert(DPABC_verifyStored_async(&pool, pk, pk_sz, epoch, zpByteSize(), binaryAttr, nattr * zpByteSize(), sign_id_2,
+					poolCallback, &callbackStatus) != NULL);
+
+	for (int i = 0; i < 4; i++) {
+		char * poolSig;
+		size_t poolSig_sz;
+
+		assert(DPABC_jobWait(signs[i]) == STATUS_OK);
+		assert(DPABC_jobDone(signs[i]));
+		assert(DPABC_jobResult(signs[i], &poolSig, &poolSig_sz) == STATUS_OK);
+		assert(poolSig_sz == dpabcSignByteSize());
+		signature * dpabc_sig = dpabcSignFromBytes(poolSig);
+		assert(verify(dpabc_pk, dpabc_sig, zpFromInt(3), (const Zp **)attr) == 1);
+		dpabcSignFree(dpabc_sig);
+		free(poolSig);
+		DPABC_jobFree(signs[i]);
+	}
+	assert(DPABC_jobWait(verifies[0]) == STATUS_OK);
+	assert(DPABC_jobWait(verifies[1]) != STATUS_OK);
+	DPABC_jobFree(verifies[0]);
+	DPABC_jobFree(verifies[1]);
+
+	/* Runs the pending callback */
+	assert(DPABC_poolFinalize(&pool) == STATUS_OK);
+	assert(callbackStatus == STATUS_OK);
+
+	dpabcPkFree(dpabc_pk);
+	free(binaryAttr);
+	free(epoch);
+}
+
+void testTraceAndStats() {
+
+	ta_trace_event events[8];
+	ta_cmd_stats stats[TA_TRACE_MAX_CMDS];
+	uint32_t nevents, nstats, dropped;
+	int failed = 0, signs = 0;
+
+	assert(DPABC_generate_key(&session, keyID2, 6) == STATUS_DUPLICATE_KEY);
+
+	/* Last failure in the ring is the duplicate key */
+	do {
+		assert(DPABC_traceDrain(&session, events, 8, &nevents, &dropped) == STATUS_OK);
+		for (uint32_t i = 0; i < nevents; i++) {
+			if (events[i].event == TA_TRACE_EV_CMD_FAILED)
+				failed = events[i].cmd == TA_DPABC_GENERATE_KEY;
+		}
+	} while (nevents > 0);
+	assert(failed);
+
+	assert(DPABC_commandStats(&session, stats, 1, &nstats, 0) == STATUS_BAD_PARAMETERS);
+	assert(DPABC_commandStats(&session, stats, TA_TRACE_MAX_CMDS, &nstats, 1) == STATUS_OK);
+	for (uint32_t i = 0; i < nstats; i++) {
+		assert(stats[i].errors <= stats[i].calls);
+		assert(stats[i].max_ms <= stats[i].total_ms);
+		if (stats[i].cmd == TA_DPABC_GENERATE_KEY)
+			assert(stats[i].errors > 0);
+		if (stats[i].cmd == TA_DPABC_SIGN)
+			signs = stats[i].calls;
+	}
+	assert(signs > 0);
+
+	/* Only the reading call is counted after a reset */
+	assert(DPABC_commandStats(&session, stats, TA_TRACE_MAX_CMDS, &nstats, 0) == STATUS_OK);
+	assert(nstats == 1 && stats[0].cmd == TA_DPABC_STATS && stats[0].calls == 1);
+}
+
 void afterAll() { 
 	free(pk);
 	free(sig);
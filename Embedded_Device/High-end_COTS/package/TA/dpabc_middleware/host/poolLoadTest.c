@@ -0,0 +1,144 @@
+#include <Zp.h>
+#include <Dpabc.h>
+#include <dpabc_pool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Submits requests to a session pool as fast as possible and reports their latency and the throughput
+// Usage: pool_load_test [sessions] [n requests] [nattr] [sign|verify|zktoken]
+
+struct load_test {
+	struct timespec * submitted;
+	double * latency;
+	atomic_int failures;
+	sem_t completed;
+};
+
+struct request {
+	struct load_test * test;
+	int id;
+};
+
+static double since(struct timespec * start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void on_completion(DPABC_job * job, void * user_data) {
+	struct request * req = user_data;
+	struct load_test * test = req->test;
+
+	test->latency[req->id] = since(&test->submitted[req->id]);
+	if (DPABC_jobResult(job, NULL, NULL) != STATUS_OK)
+		atomic_fetch_add(&test->failures, 1);
+	DPABC_jobFree(job);
+	sem_post(&test->completed);
+}
+
+static int compare_double(const void * a, const void * b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char ** argv) {
+
+	DPABC_session session;
+	DPABC_pool pool;
+	int nsessions = argc > 1 ? atoi(argv[1]) : 4;
+	int n = argc > 2 ? atoi(argv[2]) : 256;
+	int nattr = argc > 3 ? atoi(argv[3]) : 6;
+	const char * operation = argc > 4 ? argv[4] : "sign";
+	char * key_id = "pool_load_test_key";
+	char * sig_id = "pool_load_test_signature";
+	char * msg = "loadTestMessage";
+	int indexReveal[] = {0};
+	char * pk;
+	size_t pk_sz;
+	char * attr = malloc(nattr * zpByteSize());
+	char * epoch = malloc(zpByteSize());
+	struct load_test test;
+	struct request * requests = malloc(n * sizeof(struct request));
+	struct timespec start;
+	double total;
+
+	if (n < 1 || nsessions < 1 || (strcmp(operation, "sign") && strcmp(operation, "verify") && strcmp(operation, "zktoken"))) {
+		fprintf(stderr, "Usage: %s [sessions] [n requests] [nattr] [sign|verify|zktoken]\n", argv[0]);
+		return 1;
+	}
+
+	for (int i = 0; i < nattr; i++) {
+		Zp * a = zpFromInt(i + 1);
+		zpToBytes(attr + i * zpByteSize(), a);
+		zpFree(a);
+	}
+	Zp * e = zpFromInt(12034);
+	zpToBytes(epoch, e);
+	zpFree(e);
+
+	// Key and stored signature used by every request
+	if (DPABC_initialize(&session) != STATUS_OK)
+		return 1;
+	DPABC_generate_key(&session, key_id, nattr);	// Already generated in previous runs
+	if (DPABC_get_key(&session, key_id, &pk, &pk_sz) != STATUS_OK)
+		return 1;
+	DPABC_signStore(&session, key_id, epoch, zpByteSize(), attr, nattr * zpByteSize(), sig_id);	// Already stored in previous runs
+	DPABC_finalize(&session);
+
+	if (DPABC_poolInitialize(&pool, nsessions, n) != STATUS_OK)
+		return 1;
+
+	test.submitted = malloc(n * sizeof(struct timespec));
+	test.latency = malloc(n * sizeof(double));
+	atomic_init(&test.failures, 0);
+	sem_init(&test.completed, 0, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < n; i++) {
+		DPABC_job * job;
+
+		requests[i].test = &test;
+		requests[i].id = i;
+		clock_gettime(CLOCK_MONOTONIC, &test.submitted[i]);
+
+		if (!strcmp(operation, "sign"))
+			job = DPABC_sign_async(&pool, key_id, epoch, zpByteSize(), attr, nattr * zpByteSize(),
+					       on_completion, &requests[i]);
+		else if (!strcmp(operation, "verify"))
+			job = DPABC_verifyStored_async(&pool, pk, pk_sz, epoch, zpByteSize(), attr, nattr * zpByteSize(), sig_id,
+						       on_completion, &requests[i]);
+		else
+			job = DPABC_generateZKtoken_async(&pool, pk, pk_sz, sig_id, epoch, zpByteSize(), attr, nattr * zpByteSize(),
+							  indexReveal, sizeof(indexReveal), msg, strlen(msg),
+							  on_completion, &requests[i]);
+		if (!job)
+			return 1;
+	}
+	for (int i = 0; i < n; i++)
+		while (sem_wait(&test.completed))
+			;
+	total = since(&start);
+
+	DPABC_poolFinalize(&pool);
+
+	qsort(test.latency, n, sizeof(double), compare_double);
+	printf("%-8s sessions %d  x%d  %8.1f ops/s  p50 %8.2f ms  p99 %8.2f ms  failures %d\n",
+	       operation, nsessions, n, n / total,
+	       test.latency[n / 2] * 1e3, test.latency[(n * 99) / 100] * 1e3,
+	       atomic_load(&test.failures));
+
+	sem_destroy(&test.completed);
+	free(test.submitted);
+	free(test.latency);
+	free(requests);
+	free(attr);
+	free(epoch);
+	free(pk);
+
+	return atomic_load(&test.failures) ? 1 : 0;
+}
@@ -3,100 +3,135 @@
 #include <Zp.h>
 #include <Dpabc.h>
 #include <dpabc_middleware.h>
+#include <dpabc_bulk.h>
+#include <dpabc_codec.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-const char base64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
-
-uint32_t base64_decode(char *input, char *output, size_t * output_sz) {
-    int i, j, k = 0;
-    unsigned char temp[4], decoded[3];
-
-    for (i = 0; input[i] != '\0'; i += 4) {
-        for (j = 0; j < 4; j++) {
-            if (input[i + j] == '\0') {
-                // Reached end of input string, stop decoding
-                break;
-            }
-            temp[j] = strchr(base64_table, input[i + j]) - base64_table;
-        }
-
-        // Check if we reached end of input string before completing a group of 4 characters
-        if (j < 4) {
-            memset(&(temp[j]), 0, 4 - j);
-        }
-
-        decoded[0] = (temp[0] << 2) + ((temp[1] & 0x30) >> 4);
-        decoded[1] = ((temp[1] & 0x0F) << 4) + ((temp[2] & 0x3C) >> 2);
-        decoded[2] = ((temp[2] & 0x03) << 6) + temp[3];
-
-        for (j = 0; j < 3; j++) {
-            output[k++] = decoded[j];
-        }
-    }
-
-    output[k] = '\0';
-    *output_sz = k;
-    return 0;
-}
+#define PK_CACHE_SIZE 64
 
-const char * const ALPHABET =
-    "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
-const char ALPHABET_MAP[256] = {
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1,
-    -1,  9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1,
-    22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1,
-    -1, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46,
-    47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+/* Decoded public keys of the bulk mode, prepared for verifyPrepared */
+struct cached_pk {
+	publicKey * pk;
+	preparedPublicKey * ppk;
 };
 
-const double iFactor = 1.36565823730976103695740418120764243208481439700722980119458355862779176747360903943915516885072037696111192757109;
-
-// result must be declared (for the worst case): char result[len * 2];
-size_t DecodeBase58(
-    const unsigned char *str, int len, unsigned char *result) {
-    result[0] = 0;
-    size_t resultlen = 1;
-    for (int i = 0; i < len; i++) {
-        unsigned int carry = (unsigned int) ALPHABET_MAP[str[i]];
-        if (carry == -1) return 0;
-        for (int j = 0; j < resultlen; j++) {
-            carry += (unsigned int) (result[j]) * 58;
-            result[j] = (unsigned char) (carry & 0xff);
-            carry >>= 8;
-        }
-        while (carry > 0) {
-            result[resultlen++] = carry & 0xff;
-            carry >>= 8;
-        }
-    }
-
-    for (int i = 0; i < len && str[i] == '1'; i++)
-        result[resultlen++] = 0;
-
-    // Poorly coded, but guaranteed to work.
-    for (int i = resultlen - 1, z = (resultlen >> 1) + (resultlen & 1);
-        i >= z; i--) {
-        int k = result[i];
-        result[i] = result[resultlen - i - 1];
-        result[resultlen - i - 1] = k;
-    }
-    return resultlen;
+static void release_pk(void * value) {
+	struct cached_pk * cached = value;
+
+	dpabcPreparedPkFree(cached->ppk);
+	dpabcPkFree(cached->pk);
+	free(cached);
+}
+
+static struct cached_pk * decode_pk(const char * pkeyBase58, size_t len) {
+
+	char * bytes = malloc(len);
+	size_t bytes_sz;
+	struct cached_pk * cached = NULL;
+
+	// We don't care about first 2 bytes
+	if (!DPABC_base58Decode(pkeyBase58, len, bytes, len, &bytes_sz) && bytes_sz > 2 &&
+	    bytes_sz - 2 >= (size_t)dpabcPkByteSizeForN((uint8_t)bytes[2])) {
+		cached = malloc(sizeof(struct cached_pk));
+		cached->pk = dpabcPkFromBytes(bytes + 2);
+		cached->ppk = dpabcPkPrepare(cached->pk);
+	}
+	free(bytes);
+	return cached;
 }
 
-int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, epoch, attributes
+// Request: {"id":..., "pk":"<base58>", "epoch":"...", "signature":"<base64>", "attributes":["...", ...]}
+// Response: {"id":..., "status":"ok", "valid":true|false}
+static void handle_request(DPABC_bulkRequest * req, FILE * out, void * user_data) {
+
+	DPABC_bulkCache * cache = user_data;
+	const DPABC_bulkField * pkey = DPABC_bulkGet(req, "pk", DPABC_BULK_STRING);
+	const DPABC_bulkField * epochAttr = DPABC_bulkGet(req, "epoch", DPABC_BULK_STRING);
+	const DPABC_bulkField * sign = DPABC_bulkGet(req, "signature", DPABC_BULK_STRING);
+	const DPABC_bulkField * attrs = DPABC_bulkGet(req, "attributes", DPABC_BULK_ARRAY);
+	struct cached_pk * cached;
+	char * signatureBytes;
+	size_t signatureBytes_sz;
+	char error[64];
+
+	if (!pkey || !epochAttr || !sign || !attrs) {
+		DPABC_bulkReplyError(out, req, "expected pk, epoch, signature and attributes");
+		return;
+	}
+
+	cached = DPABC_bulkCacheGet(cache, pkey->value);
+	if (cached == NULL) {
+		if ((cached = decode_pk(pkey->value, pkey->value_sz)) == NULL) {
+			DPABC_bulkReplyError(out, req, "invalid public key");
+			return;
+		}
+		DPABC_bulkCachePut(cache, pkey->value, cached);
+	}
+	if (attrs->nitems != cached->pk->n) {
+		snprintf(error, sizeof(error), "expected %d attributes", cached->pk->n);
+		DPABC_bulkReplyError(out, req, error);
+		return;
+	}
+
+	signatureBytes = malloc(sign->value_sz + 1);
+	if (DPABC_base64Decode(sign->value, sign->value_sz, signatureBytes, sign->value_sz + 1, &signatureBytes_sz) ||
+	    signatureBytes_sz < (size_t)dpabcSignByteSize()) {
+		free(signatureBytes);
+		DPABC_bulkReplyError(out, req, "invalid signature");
+		return;
+	}
+
+	signature * composedSignature = dpabcSignFromBytes(signatureBytes);
+	Zp ** attr = malloc(sizeof(Zp*) * attrs->nitems);
+	for (int i = 0; i < attrs->nitems; i++) {
+		attr[i] = hashToZp(attrs->items[i], attrs->items_sz[i]);
+	}
+	Zp * epoch = hashToZp(epochAttr->value, epochAttr->value_sz);
+
+	int valid = verifyPrepared(cached->ppk, composedSignature, epoch, (const Zp **)attr);
+
+	DPABC_bulkReplyBegin(out, req);
+	fprintf(out, ",\"valid\":%s", valid ? "true" : "false");
+	DPABC_bulkReplyEnd(out);
+
+	for (int i = 0; i < attrs->nitems; i++) {
+		zpFree(attr[i]);
+	}
+	free(attr);
+	zpFree(epoch);
+	dpabcSignFree(composedSignature);
+	free(signatureBytes);
+}
+
+// Serves newline delimited JSON requests from stdin (or a Unix socket) with one session and the decoded keys cached
+static int bulk_main(const char * socket_path) {
+
+	DPABC_session session;
+	DPABC_bulkCache cache;
+	int ret;
+
+	if (socket_path == NULL && DPABC_bulkDetachStdout() == NULL) {
+		perror("stdout");
+		return 1;
+	}
+	if (DPABC_initialize(&session) != STATUS_OK) {
+		fprintf(stderr, "Error opening the session\n");
+		return 1;
+	}
+	DPABC_bulkCacheInit(&cache, PK_CACHE_SIZE, release_pk);
+
+	if ((ret = DPABC_bulkServe(socket_path, handle_request, &cache)))
+		perror(socket_path);
+
+	DPABC_bulkCacheFree(&cache);
+	DPABC_finalize(&session);
+	return ret ? 1 : 0;
+}
+
+int main(int argc, char ** argv) { // Args: pkeyBase58, epoch, signature, attributes (or --bulk [socket path])
 
 	DPABC_session session;
 	int nattr = argc - 4; // Discard first three arguments
@@ -106,6 +141,10 @@ int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, epoch, attribut
 	char signatureBytes[1024];
 	size_t signatureBytes_sz;
 
+	if (argc >= 2 && !strcmp(argv[1], "--bulk")) {
+		return bulk_main(argc > 2 ? argv[2] : NULL);
+	}
+
 	for (int i = 1; i < argc; i++) {
 		printf("argument: %s\n", argv[i]);
 	}
@@ -124,12 +163,19 @@ int main(int argc, char ** argv) { // Args: pkeyBase58, indexes, epoch, attribut
 	// 	return 1;
 	// }
 	
-	pk_sz = DecodeBase58((unsigned char *)pkeyBase58, strlen(pkeyBase58), (unsigned char *)pk_buffer) - 2;
+	if (DPABC_base58Decode(pkeyBase58, strlen(pkeyBase58), pk_buffer, sizeof(pk_buffer), &pk_sz) || pk_sz < 2) {
+		printf("Error decoding base58 public key\n");
+		return 1;
+	}
+	pk_sz -= 2;
 
 	pk = pk_buffer + 2; // We don't care about first 2 bytes
 	
 
-	base64_decode(sign, signatureBytes, &signatureBytes_sz);
+	if (DPABC_base64Decode(sign, strlen(sign), signatureBytes, sizeof(signatureBytes), &signatureBytes_sz)) {
+		printf("Error decoding base64 signature\n");
+		return 1;
+	}
 
 	signature * composedSignature = dpabcSignFromBytes(signatureBytes);
 
@@ -10,10 +10,246 @@
 #include <tee_internal_api_extensions.h>
 
 #include <dpabc_ta.h>
+#include <ta_trace.h>
 
 
 
 char client_auth[] = {0x00, 0x30, 0xd4, 0xc5, 0xbd, 0x4b, 0xd7, 0x0d, 0xb2, 0x91, 0xbb, 0xbd, 0xd6, 0x82, 0x87, 0x86, 0x04, 0x36, 0xf9, 0x18, 0x2e, 0x5f, 0x93, 0x3c, 0x5c, 0xfe, 0x58, 0x7f, 0x55, 0x65, 0x5b, 0x02};
+
+enum cache_kind {
+	CACHE_SECRET_KEY,
+	CACHE_SIGNATURE,
+	CACHE_PUBLIC_KEY,
+};
+
+/*
+ * Decoded object of the session cache. Secret keys and signatures are keyed
+ * by their storage id, public keys by their serialization.
+ *
+ * Other sessions (other instances of the TA) can overwrite a stored signature
+ * (TA_DPABC_STORE_SIGN), so signatures keep the bytes they were decoded from
+ * and are checked against the storage the first time they are used by a
+ * command. Keys are created once and never overwritten
+ */
+struct cache_entry {
+	struct cache_entry *prev;
+	struct cache_entry *next;
+	enum cache_kind kind;
+	void *obj;
+	size_t cost;
+	uint32_t last_cmd;
+	char *flat;		/* Serialized signature, after the id */
+	size_t flat_sz;
+	size_t id_sz;
+	char id[];
+};
+
+/* LRU list, most recently used first */
+struct dpabc_cache {
+	struct cache_entry *head;
+	struct cache_entry *tail;
+	size_t used;
+	size_t budget;
+	uint32_t cmd;		/* Commands since the session was opened */
+	uint32_t hits;
+	uint32_t misses;
+};
+
+/*
+ * Per-session state. Every allocation made while a command runs (handlers and
+ * p-abc library) is served by the session arena, which is reserved once when
+ * the session is opened and reset after each command. The presentation pool
+ * and the cached objects outlive the command that builds them, so they are
+ * allocated from the heap.
+ */
+struct dpabc_session {
+	pfecArena arena;
+	pfecAllocator allocator;
+	presentationPool *pool;
+	struct dpabc_cache cache;
+};
+
+/* Command-scoped allocation, zero filled like TEE_Malloc() */
+static void *cmd_malloc(size_t size)
+{
+	void *ptr = pfecMalloc(size);
+
+	if (ptr)
+		TEE_MemFill(ptr, 0, size);
+	return ptr;
+}
+
+static void wipe_zp(Zp *a)
+{
+	Zp *zero = zpFromInt(0);
+
+	zpCopyValue(a, zero);
+	zpFree(zero);
+}
+
+/* Zeroize the secret values of a cached object and free it */
+static void cache_entry_free(struct cache_entry *e)
+{
+	secretKey *sk;
+	signature *sign;
+
+	switch (e->kind) {
+		case CACHE_SECRET_KEY:
+			sk = e->obj;
+			wipe_zp(sk->x);
+			wipe_zp(sk->y_m);
+			wipe_zp(sk->y_epoch);
+			for (int i = 0; i < sk->n; i++)
+				wipe_zp(sk->y[i]);
+			dpabcSkFree(sk);
+			break;
+		case CACHE_SIGNATURE:
+			sign = e->obj;
+			wipe_zp(sign->mprime);
+			dpabcSignFree(sign);
+			break;
+		case CACHE_PUBLIC_KEY:
+			dpabcPkFree(e->obj);
+			break;
+	}
+	TEE_MemFill(e->id, 0, e->id_sz + e->flat_sz);
+	TEE_Free(e);
+}
+
+static void cache_unlink(struct dpabc_cache *cache, struct cache_entry *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+	cache->used -= e->cost;
+}
+
+static void cache_push_front(struct dpabc_cache *cache, struct cache_entry *e)
+{
+	e->prev = NULL;
+	e->next = cache->head;
+	if (cache->head)
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+	cache->used += e->cost;
+}
+
+/* Entry for (kind, id), or NULL, without counting a hit or a miss */
+static struct cache_entry *cache_find(struct dpabc_cache *cache,
+				      enum cache_kind kind, const char *id,
+				      size_t id_sz)
+{
+	for (struct cache_entry *e = cache->head; e; e = e->next) {
+		if (e->kind == kind && e->id_sz == id_sz &&
+		    !TEE_MemCompare(e->id, id, id_sz))
+			return e;
+	}
+	return NULL;
+}
+
+/* Object of e, which is kept until the end of the current command */
+static void *cache_hit(struct dpabc_cache *cache, struct cache_entry *e)
+{
+	cache_unlink(cache, e);
+	cache_push_front(cache, e);
+	e->last_cmd = cache->cmd;
+	cache->hits++;
+	return e->obj;
+}
+
+/*
+ * Cached object for (kind, id), or NULL. The object is owned by the cache and
+ * must not be freed by the caller. It is not evicted during the current
+ * command
+ */
+static void *cache_lookup(struct dpabc_cache *cache, enum cache_kind kind,
+			  const char *id, size_t id_sz)
+{
+	struct cache_entry *e = cache_find(cache, kind, id, id_sz);
+
+	if (e)
+		return cache_hit(cache, e);
+	cache->misses++;
+	return NULL;
+}
+
+/*
+ * Give obj (allocated from the heap) to the cache, evicting the least
+ * recently used entries over the budget. Entries used by the current command
+ * are kept, so the budget can be exceeded until the next command. flat
+ * (flat_sz bytes, NULL if 0) is kept along to check the object later
+ */
+static TEE_Result cache_insert(struct dpabc_cache *cache, enum cache_kind kind,
+			       const char *id, size_t id_sz, void *obj,
+			       size_t obj_sz, const char *flat, size_t flat_sz)
+{
+	struct cache_entry *e;
+
+	e = TEE_Malloc(sizeof(*e) + id_sz + flat_sz, TEE_MALLOC_FILL_ZERO);
+	if (!e)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	e->kind = kind;
+	e->obj = obj;
+	e->cost = sizeof(*e) + id_sz + flat_sz + obj_sz;
+	e->last_cmd = cache->cmd;
+	e->id_sz = id_sz;
+	TEE_MemMove(e->id, id, id_sz);
+	if (flat_sz) {
+		e->flat = e->id + id_sz;
+		e->flat_sz = flat_sz;
+		TEE_MemMove(e->flat, flat, flat_sz);
+	}
+	cache_push_front(cache, e);
+
+	for (struct cache_entry *victim = cache->tail;
+	     victim && cache->used > cache->budget;) {
+		struct cache_entry *prev = victim->prev;
+
+		if (victim->last_cmd != cache->cmd) {
+			cache_unlink(cache, victim);
+			cache_entry_free(victim);
+		}
+		victim = prev;
+	}
+	return TEE_SUCCESS;
+}
+
+/* Drop the objects stored under id, to be called when the object is written */
+static void cache_invalidate(struct dpabc_cache *cache, const char *id,
+			     size_t id_sz)
+{
+	struct cache_entry *e = cache->head;
+
+	while (e) {
+		struct cache_entry *next = e->next;
+
+		if (e->kind != CACHE_PUBLIC_KEY && e->id_sz == id_sz &&
+		    !TEE_MemCompare(e->id, id, id_sz)) {
+			cache_unlink(cache, e);
+			cache_entry_free(e);
+		}
+		e = next;
+	}
+}
+
+static void cache_clear(struct dpabc_cache *cache)
+{
+	while (cache->head) {
+		struct cache_entry *e = cache->head;
+
+		cache_unlink(cache, e);
+		cache_entry_free(e);
+	}
+}
+
 /*
  * Called when the instance of the TA is created. This is the first call in
  * the TA.
@@ -34,6 +270,26 @@ void TA_DestroyEntryPoint(void)
 	DMSG("has been called");
 }
 
+static TEE_Result create_session_ctx(void **sess_ctx)
+{
+	struct dpabc_session *sess;
+	void *arena_buf;
+
+	sess = TEE_Malloc(sizeof(*sess), TEE_MALLOC_FILL_ZERO);
+	arena_buf = TEE_Malloc(TA_DPABC_ARENA_SIZE, TEE_MALLOC_FILL_ZERO);
+	if (!sess || !arena_buf) {
+		TEE_Free(sess);
+		TEE_Free(arena_buf);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	pfecArenaInit(&sess->arena, arena_buf, TA_DPABC_ARENA_SIZE);
+	sess->allocator = pfecArenaAllocator(&sess->arena);
+	sess->cache.budget = TA_DPABC_CACHE_SIZE;
+	*sess_ctx = sess;
+	return TEE_SUCCESS;
+}
+
 /*
  * Called when a new session is opened to the TA. *sess_ctx can be updated
  * with a value to be able to identify this session in subsequent calls to the
@@ -59,9 +315,6 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	/* Unused parameter */
-	(void)&sess_ctx;
-
 	hash_sz = params[0].memref.size;
 
 	self_check = TEE_Malloc(hash_sz, TEE_MALLOC_FILL_ZERO);
@@ -70,11 +323,7 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
 	}
 	TEE_MemMove(self_check, params[0].memref.buffer, hash_sz);
 
-	IMSG("Received hash: ");
-	for (size_t byte_id = 0; byte_id < hash_sz; byte_id++) {
-		printf("%02x", self_check[byte_id]);
-	}
-	printf("\n");
+	TA_TRACE_HEX(TA_TRACE_DEBUG, "Received hash", self_check, hash_sz);
 
 	if (!USE_CLIENT_AUTH) {
 		IMSG("Session created\n");
@@ -106,6 +355,10 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
 
 free_ret:
 	TEE_Free(self_check);
+	if (res == TEE_SUCCESS)
+		res = create_session_ctx(sess_ctx);
+	if (res == TEE_SUCCESS)
+		ta_trace_record(TA_TRACE_EV_SESSION_OPEN, 0);
 	return res;
 }
 
@@ -115,7 +368,18 @@ free_ret:
  */
 void TA_CloseSessionEntryPoint(void __maybe_unused *sess_ctx)
 {
-	(void)&sess_ctx; /* Unused parameter */
+	struct dpabc_session *sess = sess_ctx;
+
+	IMSG("Arena high-water mark: %zu of %zu bytes (%zu overflows)\n",
+	     sess->arena.highWater, sess->arena.size, sess->arena.nOverflows);
+	IMSG("Object cache: %" PRIu32 " hits, %" PRIu32 " misses\n",
+	     sess->cache.hits, sess->cache.misses);
+	cache_clear(&sess->cache);
+	if (sess->pool)
+		dpabcPresentPoolFree(sess->pool);
+	TEE_Free(sess->arena.buf);
+	TEE_Free(sess);
+	ta_trace_record(TA_TRACE_EV_SESSION_CLOSE, 0);
 	IMSG("Goodbye!\n");
 }
 
@@ -175,10 +439,11 @@ TEE_Result get_raw_object_size(char * obj_id, size_t obj_id_sz, size_t * object_
 	}
 
 	*object_size = object_info.dataSize;
+	TEE_CloseObject(object);
 	return res;
 }
 
-TEE_Result read_raw_object(char * obj_id, size_t obj_id_sz, char * data, size_t data_sz, uint32_t * read_bytes) {
+TEE_Result read_raw_object(char * obj_id, size_t obj_id_sz, char * data, size_t data_sz, size_t * read_bytes) {
 
 	TEE_ObjectHandle object;
 	TEE_ObjectInfo object_info;
@@ -218,8 +483,8 @@ TEE_Result read_raw_object(char * obj_id, size_t obj_id_sz, char * data, size_t
 	res = TEE_ReadObjectData(object, data, object_info.dataSize,
 				 read_bytes);
 	if (res != TEE_SUCCESS || *read_bytes != object_info.dataSize) {
-		EMSG("TEE_ReadObjectData failed 0x%08x, read %" PRIu32 " over %u",
-				res, read_bytes, object_info.dataSize);
+		EMSG("TEE_ReadObjectData failed 0x%08x, read %zu over %zu",
+				res, *read_bytes, (size_t)object_info.dataSize);
 		TEE_CloseObject(object);
 		return res;
 	}
@@ -228,68 +493,256 @@ TEE_Result read_raw_object(char * obj_id, size_t obj_id_sz, char * data, size_t
 	return res;
 }
 
-TEE_Result retreive_secret_key(char * key_id, size_t key_id_sz, secretKey ** sk) {
+/* Copy of an id or key that may be in shared memory */
+static char *copy_param(const char *buf, size_t sz)
+{
+	char *res = cmd_malloc(sz);
+
+	if (res)
+		TEE_MemMove(res, buf, sz);
+	return res;
+}
+
+/*
+ * Secret key stored under key_id, from the session cache or else read from
+ * secure storage and added to it. The key is owned by the cache. key_id may
+ * be in shared memory
+ */
+TEE_Result retreive_secret_key(struct dpabc_session *sess, char * key_id, size_t key_id_sz, secretKey ** sk) {
 
 	TEE_Result res;
 	char * flat_key;
 	size_t flat_key_sz;
-	uint32_t read_bytes;
+	size_t read_bytes;
+
+	*sk = cache_lookup(&sess->cache, CACHE_SECRET_KEY, key_id, key_id_sz);
+	if (*sk)
+		return TEE_SUCCESS;
 
+	key_id = copy_param(key_id, key_id_sz);
+	if (!key_id)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	res = get_raw_object_size(key_id, key_id_sz, &flat_key_sz);
-	if (res != TEE_SUCCESS) {
-		TEE_Free(key_id);
+	if (res != TEE_SUCCESS)
 		return res;
-	}
 
-	flat_key = TEE_Malloc(flat_key_sz, TEE_MALLOC_FILL_ZERO);
+	flat_key = cmd_malloc(flat_key_sz);
 	res = read_raw_object(key_id, key_id_sz, flat_key, flat_key_sz, &read_bytes);
 
 	if (res != TEE_SUCCESS) {
-		TEE_Free(flat_key);
+		pfecFree(flat_key);
 		return res;
 	}
 
-	DMSG("Private key read with size: %" PRIu32 "\n", read_bytes);
+	DMSG("Private key read with size: %zu\n", read_bytes);
 
+	pfecSetAllocator(NULL);
 	*sk = dpabcSkFromBytes(flat_key);
-	TEE_Free(flat_key);
+	pfecSetAllocator(&sess->allocator);
+	TEE_MemFill(flat_key, 0, flat_key_sz);
+	pfecFree(flat_key);
+
+	res = cache_insert(&sess->cache, CACHE_SECRET_KEY, key_id, key_id_sz, *sk, flat_key_sz, NULL, 0);
+	if (res != TEE_SUCCESS)
+		dpabcSkFree(*sk);
 
 	return res;
 }
 
 
-TEE_Result retreive_signature(char * sign_id, size_t sign_id_sz, signature ** sign) {
+/*
+ * Signature stored under sign_id, read from secure storage. It is decoded
+ * only if the session cache does not have the same bytes already, and added
+ * to it. The signature is owned by the cache. sign_id may be in shared memory
+ */
+TEE_Result retreive_signature(struct dpabc_session *sess, char * sign_id, size_t sign_id_sz, signature ** sign) {
 
 	TEE_Result res;
 	char * flat_sign;
 	size_t flat_sign_sz;
-	uint32_t read_bytes;
+	size_t read_bytes;
+	struct cache_entry *e;
+
+	/* Checked against the storage earlier in this command */
+	e = cache_find(&sess->cache, CACHE_SIGNATURE, sign_id, sign_id_sz);
+	if (e && e->last_cmd == sess->cache.cmd) {
+		*sign = cache_hit(&sess->cache, e);
+		return TEE_SUCCESS;
+	}
+
+	sign_id = copy_param(sign_id, sign_id_sz);
+	if (!sign_id)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	res = get_raw_object_size(sign_id, sign_id_sz, &flat_sign_sz);
-	if (res != TEE_SUCCESS) {
-		TEE_Free(sign_id);
+	if (res != TEE_SUCCESS)
 		return res;
-	}
 
-	flat_sign = TEE_Malloc(flat_sign_sz, TEE_MALLOC_FILL_ZERO);
+	flat_sign = cmd_malloc(flat_sign_sz);
 	res = read_raw_object(sign_id, sign_id_sz, flat_sign, flat_sign_sz, &read_bytes);
 
 	if (res != TEE_SUCCESS) {
-		TEE_Free(flat_sign);
+		pfecFree(flat_sign);
 		return res;
 	}
 
-	DMSG("Signature read with size: %" PRIu32 "\n", read_bytes);
+	DMSG("Signature read with size: %zu\n", read_bytes);
+
+	if (e && e->flat_sz == flat_sign_sz &&
+	    !TEE_MemCompare(e->flat, flat_sign, flat_sign_sz)) {
+		*sign = cache_hit(&sess->cache, e);
+		TEE_MemFill(flat_sign, 0, flat_sign_sz);
+		pfecFree(flat_sign);
+		return TEE_SUCCESS;
+	}
+
+	/* Overwritten by another session since it was cached */
+	if (e) {
+		cache_unlink(&sess->cache, e);
+		cache_entry_free(e);
+	}
+	sess->cache.misses++;
 
+	pfecSetAllocator(NULL);
 	*sign = dpabcSignFromBytes(flat_sign);
-	TEE_Free(flat_sign);
+	pfecSetAllocator(&sess->allocator);
+
+	res = cache_insert(&sess->cache, CACHE_SIGNATURE, sign_id, sign_id_sz, *sign, flat_sign_sz, flat_sign, flat_sign_sz);
+	if (res != TEE_SUCCESS)
+		dpabcSignFree(*sign);
+
+	TEE_MemFill(flat_sign, 0, flat_sign_sz);
+	pfecFree(flat_sign);
+
+	return res;
+}
+
+/*
+ * Public key from its serialization, decoded once per session. The key is
+ * owned by the cache. pk_bytes may be in shared memory, it is copied and its
+ * size checked before decoding
+ */
+TEE_Result retreive_public_key(struct dpabc_session *sess, char * pk_bytes, size_t pk_sz, publicKey ** pk) {
+
+	TEE_Result res;
+
+	*pk = cache_lookup(&sess->cache, CACHE_PUBLIC_KEY, pk_bytes, pk_sz);
+	if (*pk)
+		return TEE_SUCCESS;
+
+	pk_bytes = copy_param(pk_bytes, pk_sz);
+	if (!pk_bytes)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	if (pk_sz == 0 || pk_sz != (size_t)dpabcPkByteSizeForN((uint8_t)pk_bytes[0]))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	pfecSetAllocator(NULL);
+	*pk = dpabcPkFromBytes(pk_bytes);
+	pfecSetAllocator(&sess->allocator);
+
+	res = cache_insert(&sess->cache, CACHE_PUBLIC_KEY, pk_bytes, pk_sz, *pk, pk_sz, NULL, 0);
+	if (res != TEE_SUCCESS)
+		dpabcPkFree(*pk);
+
+	return res;
+}
+
+/*
+ * Inputs are parsed in place, from the memory of the parameters, which is
+ * shared with the client. Sizes are read once and checked against the
+ * parameter size, so a client writing to the buffer while a command runs can
+ * change the values but not make the TA read out of bounds. Storage ids,
+ * public keys on a cache miss and attribute indexes, that must not change
+ * once checked, are copied.
+ *
+ * A field is a uint32_t size followed by the bytes
+ */
+struct field_reader {
+	char *buf;
+	size_t size;
+	size_t pos;
+};
+
+static void field_reader_init(struct field_reader *r, TEE_Param *param)
+{
+	r->buf = param->memref.buffer;
+	r->size = param->memref.size;
+	r->pos = 0;
+}
+
+static TEE_Result field_read_u32(struct field_reader *r, uint32_t *v)
+{
+	if (r->size - r->pos < sizeof(uint32_t))
+		return TEE_ERROR_BAD_PARAMETERS;
+	TEE_MemMove(v, r->buf + r->pos, sizeof(uint32_t));
+	r->pos += sizeof(uint32_t);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result field_read(struct field_reader *r, char **field,
+			     size_t *field_sz)
+{
+	uint32_t sz;
+	TEE_Result res = field_read_u32(r, &sz);
+
+	if (res != TEE_SUCCESS)
+		return res;
+	if (r->size - r->pos < sz)
+		return TEE_ERROR_BAD_PARAMETERS;
+	*field = r->buf + r->pos;
+	*field_sz = sz;
+	r->pos += sz;
+	return TEE_SUCCESS;
+}
 
+/* Checks the sizes of an epoch and n attributes in byte form */
+static TEE_Result check_zp_fields(size_t epoch_sz, size_t attr_sz, int n)
+{
+	if (epoch_sz != (size_t)zpByteSize() ||
+	    attr_sz != (size_t)n * zpByteSize())
+		return TEE_ERROR_BAD_PARAMETERS;
+	return TEE_SUCCESS;
+}
+
+static Zp **compose_attributes(const char *attr, int n)
+{
+	Zp **res = cmd_malloc(sizeof(Zp *) * n);
+
+	for (int i = 0; i < n; i++)
+		res[i] = zpFromBytes(attr + i * zpByteSize());
 	return res;
 }
 
-static TEE_Result dpabc_generate_key(uint32_t param_types,
-	TEE_Param params[4])
+static void free_attributes(Zp **attr, int n)
+{
+	for (int i = 0; i < n; i++)
+		zpFree(attr[i]);
+	pfecFree(attr);
+}
+
+/*
+ * Copies the indexes of the revealed attributes (index_sz bytes of int), which
+ * must be ascending and below n. indexReveal has room for n indexes
+ */
+static TEE_Result read_reveal(const char *index, size_t index_sz, int n,
+			      int *indexReveal, int *nReveal)
+{
+	if (index_sz % sizeof(int) || index_sz / sizeof(int) > (size_t)n)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	*nReveal = index_sz / sizeof(int);
+	TEE_MemMove(indexReveal, index, index_sz);
+	for (int j = 0; j < *nReveal; j++) {
+		if (indexReveal[j] < 0 || indexReveal[j] >= n ||
+		    (j && indexReveal[j] <= indexReveal[j - 1]))
+			return TEE_ERROR_BAD_PARAMETERS;
+	}
+	return TEE_SUCCESS;
+}
+
+static TEE_Result dpabc_generate_key(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 
 	const uint32_t exp_param_types =
@@ -307,6 +760,7 @@ static TEE_Result dpabc_generate_key(uint32_t param_types,
 	char * flat_key;
 	uint32_t key_data_flag;
 	char * seed_buffer;
+	dpabcContext * ctx;
 
 	/*
 	 * Safely get the invocation parameters
@@ -319,7 +773,7 @@ static TEE_Result dpabc_generate_key(uint32_t param_types,
 
 	nattr = params[1].value.a;
 
-	key_id = TEE_Malloc(key_id_sz, TEE_MALLOC_FILL_ZERO);
+	key_id = cmd_malloc(key_id_sz);
 	if (!key_id) {
 		return TEE_ERROR_OUT_OF_MEMORY;
 	}
@@ -331,15 +785,12 @@ static TEE_Result dpabc_generate_key(uint32_t param_types,
 	publicKey * pk;
 	secretKey * sk;
 
-	seed_buffer = TEE_Malloc(seed_sz, TEE_MALLOC_FILL_ZERO);
+	seed_buffer = cmd_malloc(seed_sz);
 	TEE_GenerateRandom(seed_buffer, seed_sz);
-	seedRng(seed_buffer, seed_sz);
-	changeNattr(nattr);
-	uint8_t keygenBufferLen = 128;
-        char * keygenBuffer = TEE_Malloc(keygenBufferLen, TEE_MALLOC_FILL_ZERO);
-	TEE_GenerateRandom(keygenBuffer, keygenBufferLen);
-	keyGen(&sk, &pk, keygenBuffer, keygenBufferLen);
-	TEE_Free(seed_buffer);
+	ctx = dpabcContextNew(nattr, seed_buffer, seed_sz);
+	keyGen(ctx, &sk, &pk);
+	dpabcContextFree(ctx);
+	pfecFree(seed_buffer);
 
 
 	/*
@@ -350,9 +801,10 @@ static TEE_Result dpabc_generate_key(uint32_t param_types,
 			TEE_DATA_FLAG_ACCESS_WRITE_META;	/* we can later destroy or rename the object */
 			// TEE_DATA_FLAG_OVERWRITE;		/* destroy existing object of same ID */
 
-	flat_key = TEE_Malloc(dpabcSkByteSize(sk), TEE_MALLOC_FILL_ZERO);
+	flat_key = cmd_malloc(dpabcSkByteSize(sk));
 	dpabcSkToBytes(flat_key, sk);
 
+	cache_invalidate(&sess->cache, key_id, key_id_sz);
 	res = create_raw_object(key_data_flag, key_id, key_id_sz, flat_key, dpabcSkByteSize(sk));
 
 	if (res != TEE_SUCCESS) {
@@ -364,14 +816,14 @@ static TEE_Result dpabc_generate_key(uint32_t param_types,
 
 	dpabcSkFree(sk);
 	dpabcPkFree(pk);
-	TEE_Free(key_id);
-	TEE_Free(flat_key);
+	pfecFree(key_id);
+	pfecFree(flat_key);
 
 	return res;
 }
 
-static TEE_Result dpabc_read_key(uint32_t param_types,
-	TEE_Param params[4])
+static TEE_Result dpabc_read_key(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
@@ -380,8 +832,6 @@ static TEE_Result dpabc_read_key(uint32_t param_types,
 				TEE_PARAM_TYPE_NONE);
 
 	TEE_Result res;
-	char * key_id;
-	size_t key_id_sz;
 
 	publicKey * pk;
 	secretKey * sk;
@@ -392,14 +842,7 @@ static TEE_Result dpabc_read_key(uint32_t param_types,
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	key_id_sz = params[0].memref.size;
-	key_id = TEE_Malloc(key_id_sz, 0);
-	if (!key_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(key_id, params[0].memref.buffer, key_id_sz);
-
-	res = retreive_secret_key(key_id, key_id_sz, &sk);
+	res = retreive_secret_key(sess, params[0].memref.buffer, params[0].memref.size, &sk);
 
 
 	if (res == TEE_SUCCESS) {
@@ -414,14 +857,43 @@ static TEE_Result dpabc_read_key(uint32_t param_types,
 		dpabcPkFree(pk);
 	}
 
-	TEE_Free(key_id);
-	dpabcSkFree(sk);
 	return res;
 
 }
 
-static TEE_Result dpabc_sign(uint32_t param_types,
-	TEE_Param params[4])
+/*
+ * Size query for TA_DPABC_READ_KEY, so the client can provide a big enough
+ * buffer: params[1].value.a returns the size of the public key of the key
+ * stored under the id in params[0], and params[1].value.b its number of
+ * attributes
+ */
+static TEE_Result dpabc_key_size(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	TEE_Result res;
+	secretKey * sk;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = retreive_secret_key(sess, params[0].memref.buffer, params[0].memref.size, &sk);
+
+	if (res == TEE_SUCCESS) {
+		params[1].value.a = dpabcPkByteSizeForN(sk->n);
+		params[1].value.b = sk->n;
+	}
+
+	return res;
+}
+
+static TEE_Result dpabc_sign(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
@@ -430,8 +902,6 @@ static TEE_Result dpabc_sign(uint32_t param_types,
 				TEE_PARAM_TYPE_MEMREF_OUTPUT);
 
 	TEE_Result res;
-	char * key_id;
-	size_t key_id_sz;
 	char * attr;
 	size_t attr_sz;
 	char * epoch;
@@ -445,48 +915,25 @@ static TEE_Result dpabc_sign(uint32_t param_types,
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-
-	key_id_sz = params[0].memref.size;
-	key_id = TEE_Malloc(key_id_sz, 0);
-	if (!key_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(key_id, params[0].memref.buffer, key_id_sz);
-
+	attr = params[1].memref.buffer;
 	attr_sz = params[1].memref.size;
-	attr = TEE_Malloc(attr_sz, 0);
-	if (!attr)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(attr, params[1].memref.buffer, attr_sz);
-
+	epoch = params[2].memref.buffer;
 	epoch_sz = params[2].memref.size;
-	epoch = TEE_Malloc(epoch_sz, 0);
-	if (!epoch)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(epoch, params[2].memref.buffer, epoch_sz);
 
-	res = retreive_secret_key(key_id, key_id_sz, &sk);
+	res = retreive_secret_key(sess, params[0].memref.buffer, params[0].memref.size, &sk);
 
-	if (sk->n != (attr_sz / zpByteSize())) {
+	if (res == TEE_SUCCESS && check_zp_fields(epoch_sz, attr_sz, sk->n) != TEE_SUCCESS) {
 		EMSG("Number of int attributes (%ld) missmatch with key attributes (%d)", 
 			(attr_sz / zpByteSize()),
 			sk->n
 		);
-		TEE_Free(key_id);
-		TEE_Free(attr);
-		dpabcSkFree(sk);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
 
 	if (res == TEE_SUCCESS) {
 		Zp * composedEpoch = zpFromBytes(epoch);
-		Zp ** composedAttr = TEE_Malloc(sizeof(Zp*) * sk->n, TEE_MALLOC_FILL_ZERO);
-
-		for (int i = 0; i < sk->n; i++)
-			composedAttr[i] = zpFromBytes(attr + i*zpByteSize());
+		Zp ** composedAttr = compose_attributes(attr, sk->n);
 
 		signature *sig = sign(sk, composedEpoch, (const Zp **) composedAttr);
 
@@ -504,22 +951,17 @@ static TEE_Result dpabc_sign(uint32_t param_types,
 		params[3].memref.size = dpabcSignByteSize(sig);
 
 		zpFree(composedEpoch);
-		for (size_t i = 0; i < sk->n; i++)
-			zpFree(composedAttr[i]);
+		free_attributes(composedAttr, sk->n);
 		dpabcSignFree(sig);
 	}
 
-	TEE_Free(key_id);
-	TEE_Free(attr);
-	TEE_Free(epoch);
-	dpabcSkFree(sk);
 	return res;
 
 }
 
 
-static TEE_Result dpabc_sign_store(uint32_t param_types,
-	TEE_Param params[4])
+static TEE_Result dpabc_sign_store(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
@@ -528,8 +970,6 @@ static TEE_Result dpabc_sign_store(uint32_t param_types,
 				TEE_PARAM_TYPE_MEMREF_INPUT);
 
 	TEE_Result res;
-	char * key_id;
-	size_t key_id_sz;
 	char * sig_id;
 	size_t sig_id_sz;
 	char * flat_sig;
@@ -548,55 +988,32 @@ static TEE_Result dpabc_sign_store(uint32_t param_types,
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-
-	key_id_sz = params[0].memref.size;
-	key_id = TEE_Malloc(key_id_sz, 0);
-	if (!key_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(key_id, params[0].memref.buffer, key_id_sz);
-
+	attr = params[1].memref.buffer;
 	attr_sz = params[1].memref.size;
-	attr = TEE_Malloc(attr_sz, 0);
-	if (!attr)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(attr, params[1].memref.buffer, attr_sz);
-
+	epoch = params[2].memref.buffer;
 	epoch_sz = params[2].memref.size;
-	epoch = TEE_Malloc(epoch_sz, 0);
-	if (!epoch)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(epoch, params[2].memref.buffer, epoch_sz);
 
+	/* The storage id is copied, storage does not take shared memory */
 	sig_id_sz = params[3].memref.size;
-	sig_id = TEE_Malloc(sig_id_sz, 0);
+	sig_id = copy_param(params[3].memref.buffer, sig_id_sz);
 	if (!sig_id)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	TEE_MemMove(sig_id, params[3].memref.buffer, sig_id_sz);
+	res = retreive_secret_key(sess, params[0].memref.buffer, params[0].memref.size, &sk);
 
-	res = retreive_secret_key(key_id, key_id_sz, &sk);
-
-	if (sk->n != (attr_sz / zpByteSize())) {
+	if (res == TEE_SUCCESS && check_zp_fields(epoch_sz, attr_sz, sk->n) != TEE_SUCCESS) {
 		EMSG("Number of int attributes (%ld) missmatch with key attributes (%d)", 
 			(attr_sz / zpByteSize()),
 			sk->n
 		);
-		TEE_Free(key_id);
-		TEE_Free(attr);
-		dpabcSkFree(sk);
+		pfecFree(sig_id);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
 
 	if (res == TEE_SUCCESS) {
 		Zp * composedEpoch = zpFromBytes(epoch);
-		Zp ** composedAttr = TEE_Malloc(sizeof(Zp*) * sk->n, TEE_MALLOC_FILL_ZERO);
-
-		for (int i = 0; i < sk->n; i++)
-			composedAttr[i] = zpFromBytes(attr + i*zpByteSize());
+		Zp ** composedAttr = compose_attributes(attr, sk->n);
 
 		signature *sig = sign(sk, composedEpoch, (const Zp **) composedAttr);
 
@@ -611,9 +1028,10 @@ static TEE_Result dpabc_sign_store(uint32_t param_types,
 					TEE_DATA_FLAG_ACCESS_WRITE_META;	/* we can later destroy or rename the object */
 
 			flat_sig_sz = dpabcSignByteSize();
-			flat_sig = TEE_Malloc(flat_sig_sz, 0); 
+			flat_sig = cmd_malloc(flat_sig_sz); 
 			dpabcSignToBytes(flat_sig, sig);
 
+			cache_invalidate(&sess->cache, sig_id, sig_id_sz);
 			res = create_raw_object(sig_data_flag, sig_id, sig_id_sz, flat_sig, flat_sig_sz);
 
 			if (res != TEE_SUCCESS) {
@@ -625,21 +1043,17 @@ static TEE_Result dpabc_sign_store(uint32_t param_types,
 		}
 
 		zpFree(composedEpoch);
-		for (size_t i = 0; i < sk->n; i++)
-			zpFree(composedAttr[i]);
+		free_attributes(composedAttr, sk->n);
 		dpabcSignFree(sig);
 	}
 
-	TEE_Free(key_id);
-	TEE_Free(attr);
-	TEE_Free(epoch);
-	dpabcSkFree(sk);
+	pfecFree(sig_id);
 	return res;
 
 }
 
-static TEE_Result dpabc_zktoken(uint32_t param_types,
-	TEE_Param params[4])
+static TEE_Result dpabc_zktoken(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
@@ -656,16 +1070,15 @@ static TEE_Result dpabc_zktoken(uint32_t param_types,
 	size_t msg_sz;
 	char * attr;
 	size_t attr_sz;
-	int * indexReveal;
-	size_t indexReveal_sz;
+	int indexReveal[UINT8_MAX];
+	int nReveal;
 	char * epoch;
 	size_t epoch_sz;
 
-	uint32_t attr_n;
 	publicKey * composedPk;
 	signature * composedSign;
 
-	char * parameters;
+	struct field_reader parameters;
 
 	/*
 	 * Safely get the invocation parameters
@@ -681,74 +1094,44 @@ static TEE_Result dpabc_zktoken(uint32_t param_types,
 	//   | 4 bytes | pk_sz bytes | 4 bytes    | sign_id_sz bytes | 4 bytes | msg_sz bytes | 4 bytes  | epoch_sz bytes |
 	//   +---------+-------------+------------+------------------+---------+--------------+----------+----------------+
 
-	parameters = (char *) params[0].memref.buffer;
-
-
-	// pk_sz = (uint32_t) parameters[0];
-	TEE_MemMove(&pk_sz, parameters, sizeof(uint32_t));
-	pk = TEE_Malloc(pk_sz, 0);
-	if (!pk)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(pk, parameters + sizeof(uint32_t), pk_sz);
-
-
-	sign_id_sz = (uint32_t) parameters[sizeof(uint32_t) + pk_sz];
-	sign_id = TEE_Malloc(sign_id_sz, 0);
-	if (!sign_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(sign_id, parameters + 2 * sizeof(uint32_t) + pk_sz, sign_id_sz);
-
-	msg_sz = (uint32_t) parameters[2 * sizeof(uint32_t) + pk_sz + sign_id_sz];
-	msg = TEE_Malloc(msg_sz, 0);
-	if (!msg)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(msg, parameters + 3 * sizeof(uint32_t) + pk_sz + sign_id_sz, msg_sz);
-
-
-	epoch_sz = (uint32_t) parameters[3 * sizeof(uint32_t) + pk_sz + sign_id_sz + msg_sz];
-	epoch = TEE_Malloc(epoch_sz, 0);
-	if (!epoch)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(epoch, parameters + 4 * sizeof(uint32_t) + pk_sz + sign_id_sz + msg_sz, epoch_sz);
+	field_reader_init(&parameters, &params[0]);
 
+	res = field_read(&parameters, &pk, &pk_sz);
+	if (res == TEE_SUCCESS)
+		res = field_read(&parameters, &sign_id, &sign_id_sz);
+	if (res == TEE_SUCCESS)
+		res = field_read(&parameters, &msg, &msg_sz);
+	if (res == TEE_SUCCESS)
+		res = field_read(&parameters, &epoch, &epoch_sz);
+	if (res != TEE_SUCCESS)
+		return res;
 
+	attr = params[1].memref.buffer;
 	attr_sz = params[1].memref.size;
-	attr = TEE_Malloc(attr_sz, 0);
-	if (!attr)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(attr, params[1].memref.buffer, attr_sz);
 
-	attr_n = attr_sz / zpByteSize();
+	res = retreive_signature(sess, sign_id, sign_id_sz, &composedSign);
 
+	if (res == TEE_SUCCESS)
+		res = retreive_public_key(sess, pk, pk_sz, &composedPk);
 
-	indexReveal_sz = params[2].memref.size;
-	indexReveal = TEE_Malloc(indexReveal_sz, 0);
-	if (!indexReveal)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(indexReveal, params[2].memref.buffer, indexReveal_sz);
+	if (res == TEE_SUCCESS)
+		res = check_zp_fields(epoch_sz, attr_sz, composedPk->n);
 
-	res = retreive_signature(sign_id, sign_id_sz, &composedSign);
+	if (res == TEE_SUCCESS)
+		res = read_reveal(params[2].memref.buffer, params[2].memref.size, composedPk->n, indexReveal, &nReveal);
 
 	if (res == TEE_SUCCESS) {
 
-		composedPk = dpabcPkFromBytes(pk);
-
 		Zp * composedEpoch = zpFromBytes(epoch);
-		Zp ** composedAttr = TEE_Malloc(sizeof(Zp*) * attr_n, TEE_MALLOC_FILL_ZERO);
-
-		for (int i = 0; i < attr_n; i++)
-			composedAttr[i] = zpFromBytes(attr + i*zpByteSize());
+		Zp ** composedAttr = compose_attributes(attr, composedPk->n);
 
                 uint8_t tokenBufferLen = 128;
-    	        char *tokenBuffer = TEE_Malloc(tokenBufferLen, TEE_MALLOC_FILL_ZERO);
+    	        char *tokenBuffer = cmd_malloc(tokenBufferLen);
 		TEE_GenerateRandom(tokenBuffer, tokenBufferLen);
-				zkToken * token = presentZkToken(composedPk, composedSign, composedEpoch, composedAttr, indexReveal, indexReveal_sz / sizeof(int), msg, msg_sz, tokenBuffer, tokenBufferLen);
+		dpabcContext * ctx = dpabcContextNew(composedPk->n, tokenBuffer, tokenBufferLen);
+				zkToken * token = presentZkToken(ctx, composedPk, composedSign, composedEpoch, (const Zp **) composedAttr, indexReveal, nReveal, msg, msg_sz);
+		dpabcContextFree(ctx);
+		pfecFree(tokenBuffer);
 
 		if (!token){
 			EMSG("DPABC zkToken error\n");
@@ -759,30 +1142,20 @@ static TEE_Result dpabc_zktoken(uint32_t param_types,
 				res = TEE_ERROR_SHORT_BUFFER;
 				else 
 				dpabcZkToBytes(params[3].memref.buffer, token);
+			params[3].memref.size = dpabcZkByteSize(token);
+			dpabcZkFree(token);
 		}
 
-		params[3].memref.size = dpabcZkByteSize(token);
-
 		zpFree(composedEpoch);
-		for (size_t i = 0; i < attr_n; i++)
-			zpFree(composedAttr[i]);
-		dpabcSignFree(composedSign);
-		dpabcPkFree(composedPk);
-		dpabcZkFree(token);
+		free_attributes(composedAttr, composedPk->n);
 	}
 
-	TEE_Free(pk);
-	TEE_Free(msg);
-	TEE_Free(sign_id);
-	TEE_Free(attr);
-	TEE_Free(indexReveal);
-	TEE_Free(epoch);
 	return res;
 
 }
 
-static TEE_Result dpabc_store_sign(uint32_t param_types,
-	TEE_Param params[4])
+static TEE_Result dpabc_store_sign(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 
 	const uint32_t exp_param_types =
@@ -806,14 +1179,14 @@ static TEE_Result dpabc_store_sign(uint32_t param_types,
 	}
 
 	sign_id_sz = params[0].memref.size;
-	sign_id = TEE_Malloc(sign_id_sz, TEE_MALLOC_FILL_ZERO);
+	sign_id = cmd_malloc(sign_id_sz);
 	if (!sign_id) {
 		return TEE_ERROR_OUT_OF_MEMORY;
 	}
 	TEE_MemMove(sign_id, params[0].memref.buffer, sign_id_sz);
 
 	flat_sign_sz = params[1].memref.size;
-	flat_sign = TEE_Malloc(flat_sign_sz, TEE_MALLOC_FILL_ZERO);
+	flat_sign = cmd_malloc(flat_sign_sz);
 	if (!flat_sign) {
 		return TEE_ERROR_OUT_OF_MEMORY;
 	}
@@ -827,6 +1200,7 @@ static TEE_Result dpabc_store_sign(uint32_t param_types,
 			TEE_DATA_FLAG_ACCESS_WRITE_META |	/* we can later destroy or rename the object */
 			TEE_DATA_FLAG_OVERWRITE;
 
+	cache_invalidate(&sess->cache, sign_id, sign_id_sz);
 	res = create_raw_object(sign_data_flag, sign_id, sign_id_sz, flat_sign, flat_sign_sz);
 	if (res != TEE_SUCCESS) {
 		EMSG("Could not store signature\n");
@@ -835,15 +1209,15 @@ static TEE_Result dpabc_store_sign(uint32_t param_types,
 		DMSG("Signature written with size: %" PRIu32 "\n",  flat_sign_sz);
 	}
 
-	TEE_Free(sign_id);
-	TEE_Free(flat_sign);
+	pfecFree(sign_id);
+	pfecFree(flat_sign);
 
 	return res;
 }
 
 
-static TEE_Result dpabc_verify_stored(uint32_t param_types,
-	TEE_Param params[4])
+static TEE_Result dpabc_verify_stored(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
 {
 
 	const uint32_t exp_param_types =
@@ -853,17 +1227,12 @@ static TEE_Result dpabc_verify_stored(uint32_t param_types,
 				TEE_PARAM_TYPE_MEMREF_INPUT);
 
 	TEE_Result res;
-	char * pk;
-	size_t pk_sz;
-	char * sig_id;
-	size_t sig_id_sz;
 	char * attr;
 	size_t attr_sz;
 	char * epoch;
 	size_t epoch_sz;
 
 	publicKey * public_key;
-	char * sig_bytes;
 	signature * sig;
 
 	res = TEE_SUCCESS;
@@ -875,37 +1244,14 @@ static TEE_Result dpabc_verify_stored(uint32_t param_types,
 		return TEE_ERROR_BAD_PARAMETERS;
 
 
-	pk_sz = params[0].memref.size;
-	pk = TEE_Malloc(pk_sz, 0);
-	if (!pk)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(pk, params[0].memref.buffer, pk_sz);
-
+	attr = params[1].memref.buffer;
 	attr_sz = params[1].memref.size;
-	attr = TEE_Malloc(attr_sz, 0);
-	if (!attr)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(attr, params[1].memref.buffer, attr_sz);
-
+	epoch = params[2].memref.buffer;
 	epoch_sz = params[2].memref.size;
-	epoch = TEE_Malloc(epoch_sz, 0);
-	if (!epoch)
-		return TEE_ERROR_OUT_OF_MEMORY;
 
-	TEE_MemMove(epoch, params[2].memref.buffer, epoch_sz);
+	res = retreive_public_key(sess, params[0].memref.buffer, params[0].memref.size, &public_key);
 
-	sig_id_sz = params[3].memref.size;
-	sig_id = TEE_Malloc(sig_id_sz, 0);
-	if (!sig_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	TEE_MemMove(sig_id, params[3].memref.buffer, sig_id_sz);
-
-	public_key = dpabcPkFromBytes(pk);
-
-	if (public_key->n != (attr_sz / zpByteSize())) {
+	if (res == TEE_SUCCESS && check_zp_fields(epoch_sz, attr_sz, public_key->n) != TEE_SUCCESS) {
 		EMSG("Number of int attributes (%ld) missmatch with key attributes (%d)", 
 			(attr_sz / zpByteSize()),
 			public_key->n
@@ -917,12 +1263,9 @@ static TEE_Result dpabc_verify_stored(uint32_t param_types,
 
 	if (res == TEE_SUCCESS) {
 		Zp * composedEpoch = zpFromBytes(epoch);
-		Zp ** composedAttr = TEE_Malloc(sizeof(Zp*) * public_key->n, TEE_MALLOC_FILL_ZERO);
+		Zp ** composedAttr = compose_attributes(attr, public_key->n);
 
-		for (int i = 0; i < public_key->n; i++)
-			composedAttr[i] = zpFromBytes(attr + i*zpByteSize());
-
-		res = retreive_signature(sig_id, sig_id_sz, &sig);
+		res = retreive_signature(sess, params[3].memref.buffer, params[3].memref.size, &sig);
 
 		if (res == TEE_SUCCESS) {
 			if (!verify(public_key, sig, composedEpoch, (const Zp **)composedAttr)) {
@@ -931,21 +1274,713 @@ static TEE_Result dpabc_verify_stored(uint32_t param_types,
 			else {
 				res = TEE_SUCCESS;
 			}
-			dpabcSignFree(sig);
 		}
 
 		zpFree(composedEpoch);
-		for (size_t i = 0; i < public_key->n; i++)
-			zpFree(composedAttr[i]);
+		free_attributes(composedAttr, public_key->n);
+	}
+
+	return res;
+
+}
+
+
+/*
+ * Combines signature shares stored in the TA into a signature stored under a
+ * new id, which never leaves the secure world. params[0] holds the public
+ * keys of the signers and params[1] the ids of their shares, as fields (in the
+ * same order), params[2] is the id of the combined signature and
+ * params[3].value.a the number of shares. The keys are consumed as they are
+ * read: each one is decoded, hashed and released, only its hash is kept for
+ * the multi-scalar multiplication of combineHashed
+ */
+static TEE_Result dpabc_combine_signatures(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT);
+
+	TEE_Result res = TEE_SUCCESS;
+	struct field_reader pks;
+	struct field_reader ids;
+	uint32_t count;
+	uint32_t hashed = 0;
+	char * combined_id;
+	size_t combined_id_sz;
+	char * flat_sig;
+	size_t flat_sig_sz;
+	uint32_t sig_data_flag;
+	const signature ** shares;
+	Zp ** t;
+	signature * combined;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	field_reader_init(&pks, &params[0]);
+	field_reader_init(&ids, &params[1]);
+	count = params[3].value.a;
+
+	/* Every share takes at least a field size, which bounds the allocations */
+	if (count == 0 || count > ids.size / sizeof(uint32_t) ||
+	    params[2].memref.size == 0)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* The storage id is copied, storage does not take shared memory */
+	combined_id_sz = params[2].memref.size;
+	combined_id = copy_param(params[2].memref.buffer, combined_id_sz);
+	shares = cmd_malloc(count * sizeof(signature *));
+	t = cmd_malloc(count * sizeof(Zp *));
+	if (!combined_id || !shares || !t)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (uint32_t i = 0; i < count && res == TEE_SUCCESS; i++) {
+		char * pk_bytes;
+		size_t pk_sz;
+		char * sig_id;
+		size_t sig_id_sz;
+		publicKey * pk;
+		signature * share;
+
+		res = field_read(&pks, &pk_bytes, &pk_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&ids, &sig_id, &sig_id_sz);
+		if (res != TEE_SUCCESS)
+			break;
+
+		pk_bytes = copy_param(pk_bytes, pk_sz);
+		if (!pk_bytes) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			break;
+		}
+		if (pk_sz == 0 || pk_sz != (size_t)dpabcPkByteSizeForN((uint8_t)pk_bytes[0])) {
+			pfecFree(pk_bytes);
+			res = TEE_ERROR_BAD_PARAMETERS;
+			break;
+		}
+
+		pk = dpabcPkFromBytes(pk_bytes);
+		t[hashed++] = dpabcPkHash(pk);
+		dpabcPkFree(pk);
+		pfecFree(pk_bytes);
+
+		res = retreive_signature(sess, sig_id, sig_id_sz, &share);
+		shares[i] = share;
+	}
+
+	if (res == TEE_SUCCESS && (pks.pos != pks.size || ids.pos != ids.size))
+		res = TEE_ERROR_BAD_PARAMETERS;
+
+	if (res == TEE_SUCCESS) {
+		combined = combineHashed(shares, (const Zp **)t, count);
+
+		if (!combined) {
+			EMSG("Signature shares are not over the same attributes\n");
+			res = TEE_ERROR_BAD_PARAMETERS;
+		}
+		else {
+			sig_data_flag = TEE_DATA_FLAG_ACCESS_READ |		/* we can later read the oject */
+					TEE_DATA_FLAG_ACCESS_WRITE |		/* we can later write into the object */
+					TEE_DATA_FLAG_ACCESS_WRITE_META;	/* we can later destroy or rename the object */
+
+			flat_sig_sz = dpabcSignByteSize();
+			flat_sig = cmd_malloc(flat_sig_sz);
+			dpabcSignToBytes(flat_sig, combined);
+
+			cache_invalidate(&sess->cache, combined_id, combined_id_sz);
+			res = create_raw_object(sig_data_flag, combined_id, combined_id_sz, flat_sig, flat_sig_sz);
+
+			if (res != TEE_SUCCESS) {
+				EMSG("Could not store combined signature\n");
+			}
+			else {
+				DMSG("Combined %" PRIu32 " signatures, written with size: %zu\n", count, flat_sig_sz);
+			}
+
+			TEE_MemFill(flat_sig, 0, flat_sig_sz);
+			pfecFree(flat_sig);
+			wipe_zp(combined->mprime);
+			dpabcSignFree(combined);
+		}
+	}
+
+	for (uint32_t i = 0; i < hashed; i++)
+		zpFree(t[i]);
+	pfecFree(t);
+	pfecFree(shares);
+	pfecFree(combined_id);
+
+	return res;
+}
+
+/*
+ * Batched commands. params[0] holds the requests: a uint32_t count followed,
+ * for each request, by its fields (like the parameters of TA_DPABC_ZKTOKEN),
+ * parsed in place. params[1] receives one result per request:
+ * a uint32_t TEE_Result, a uint32_t size and the bytes. If params[1] is too
+ * short the command returns TEE_ERROR_SHORT_BUFFER with the size needed.
+ * params[2].value.a returns the number of requests
+ */
+struct batch_writer {
+	char *buf;
+	size_t size;
+	size_t pos;	/* Bytes needed so far, may exceed size */
+};
+
+/*
+ * Appends the header of a result, returns where its data_sz bytes go or NULL
+ * if they do not fit in the output buffer
+ */
+static char *batch_write_result(struct batch_writer *w, TEE_Result status,
+				size_t data_sz)
+{
+	uint32_t header[2] = { status, data_sz };
+	char *res = NULL;
+
+	if (w->pos <= w->size && w->size - w->pos >= sizeof(header) + data_sz) {
+		TEE_MemMove(w->buf + w->pos, header, sizeof(header));
+		res = w->buf + w->pos + sizeof(header);
+	}
+	w->pos += sizeof(header) + data_sz;
+	return res;
+}
+
+static TEE_Result batch_begin(TEE_Param params[4], struct field_reader *r,
+			      struct batch_writer *w, uint32_t *count)
+{
+	TEE_Result res;
+
+	field_reader_init(r, &params[0]);
+
+	w->buf = params[1].memref.buffer;
+	w->size = params[1].memref.size;
+	w->pos = 0;
+
+	/* Every request has at least one field */
+	res = field_read_u32(r, count);
+	if (res == TEE_SUCCESS && *count > r->size / sizeof(uint32_t))
+		res = TEE_ERROR_BAD_PARAMETERS;
+	return res;
+}
+
+static TEE_Result batch_end(struct batch_writer *w, uint32_t count,
+			    TEE_Param params[4], TEE_Result res)
+{
+	if (res != TEE_SUCCESS)
+		return res;
+
+	params[1].memref.size = w->pos;
+	params[2].value.a = count;
+	params[2].value.b = 0;
+	return w->pos > w->size ? TEE_ERROR_SHORT_BUFFER : TEE_SUCCESS;
+}
+
+/*
+ * Requests after this one start with an empty arena, and may evict the
+ * cached objects it used
+ */
+static void batch_next(struct dpabc_session *sess)
+{
+	pfecArenaReset(&sess->arena);
+	sess->cache.cmd++;
+}
+
+/* Context for the proofs of a batch, allocated from the heap */
+static dpabcContext *batch_context(struct dpabc_session *sess)
+{
+	char seed[40];
+	dpabcContext *ctx;
+
+	TEE_GenerateRandom(seed, sizeof(seed));
+	pfecSetAllocator(NULL);
+	ctx = dpabcContextNew(1, seed, sizeof(seed));
+	pfecSetAllocator(&sess->allocator);
+	TEE_MemFill(seed, 0, sizeof(seed));
+	return ctx;
+}
+
+/* Request fields: key_id, epoch, attributes. Result: signature */
+static TEE_Result dpabc_sign_batch(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+
+	TEE_Result res;
+	struct field_reader r;
+	struct batch_writer w;
+	uint32_t count;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = batch_begin(params, &r, &w, &count);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (uint32_t i = 0; i < count; i++) {
+		char *key_id, *epoch, *attr, *dest;
+		size_t key_id_sz, epoch_sz, attr_sz;
+		secretKey *sk;
+		signature *sig = NULL;
+		TEE_Result status;
+
+		res = field_read(&r, &key_id, &key_id_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &epoch, &epoch_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &attr, &attr_sz);
+		if (res != TEE_SUCCESS)
+			break;
+
+		status = retreive_secret_key(sess, key_id, key_id_sz, &sk);
+		if (status == TEE_SUCCESS)
+			status = check_zp_fields(epoch_sz, attr_sz, sk->n);
+
+		if (status == TEE_SUCCESS) {
+			Zp *composedEpoch = zpFromBytes(epoch);
+			Zp **composedAttr = compose_attributes(attr, sk->n);
+
+			sig = sign(sk, composedEpoch, (const Zp **)composedAttr);
+			if (!sig)
+				status = TEE_ERROR_GENERIC;
+			free_attributes(composedAttr, sk->n);
+			zpFree(composedEpoch);
+		}
+
+		dest = batch_write_result(&w, status, sig ? dpabcSignByteSize() : 0);
+		if (sig) {
+			if (dest)
+				dpabcSignToBytes(dest, sig);
+			dpabcSignFree(sig);
+		}
+		batch_next(sess);
+	}
+
+	return batch_end(&w, count, params, res);
+}
+
+/*
+ * Request fields: public key, epoch, attributes, stored signature id. Empty
+ * result, TEE_ERROR_SIGNATURE_INVALID if the signature is not valid.
+ * Consecutive requests for the same public key are checked together with
+ * verifyBatch
+ */
+static TEE_Result dpabc_verify_batch(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+
+	TEE_Result res;
+	struct field_reader r;
+	struct batch_writer w;
+	uint32_t count;
+	uint32_t nvalid = 0;
+
+	TEE_Result *status;
+	publicKey **pks;
+	const signature **signs;
+	const Zp **epochs;
+	const Zp ***attributes;
+	int *valid;
+	int *results;
+	dpabcContext *ctx;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = batch_begin(params, &r, &w, &count);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	status = cmd_malloc(sizeof(TEE_Result) * count);
+	pks = cmd_malloc(sizeof(publicKey *) * count);
+	signs = cmd_malloc(sizeof(signature *) * count);
+	epochs = cmd_malloc(sizeof(Zp *) * count);
+	attributes = cmd_malloc(sizeof(Zp **) * count);
+	valid = cmd_malloc(sizeof(int) * count);
+	results = cmd_malloc(sizeof(int) * count);
+	if (count && (!status || !pks || !signs || !epochs || !attributes ||
+		      !valid || !results))
+		return batch_end(&w, count, params, TEE_ERROR_OUT_OF_MEMORY);
+
+	/* Every object used stays in the cache until the command ends */
+	for (uint32_t i = 0; i < count; i++) {
+		char *pk, *epoch, *attr, *sig_id;
+		size_t pk_sz, epoch_sz, attr_sz, sig_id_sz;
+		signature *sig;
+
+		res = field_read(&r, &pk, &pk_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &epoch, &epoch_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &attr, &attr_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &sig_id, &sig_id_sz);
+		if (res != TEE_SUCCESS)
+			break;
+
+		status[i] = retreive_public_key(sess, pk, pk_sz, &pks[i]);
+		if (status[i] == TEE_SUCCESS)
+			status[i] = check_zp_fields(epoch_sz, attr_sz, pks[i]->n);
+		if (status[i] == TEE_SUCCESS)
+			status[i] = retreive_signature(sess, sig_id, sig_id_sz, &sig);
+		if (status[i] == TEE_SUCCESS) {
+			signs[nvalid] = sig;
+			epochs[nvalid] = zpFromBytes(epoch);
+			attributes[nvalid] = (const Zp **)compose_attributes(attr, pks[i]->n);
+			valid[nvalid++] = i;
+		}
+	}
+
+	if (res == TEE_SUCCESS && nvalid) {
+		ctx = batch_context(sess);
+		for (uint32_t start = 0, end; start < nvalid; start = end) {
+			publicKey *pk = pks[valid[start]];
+
+			for (end = start + 1; end < nvalid && pks[valid[end]] == pk; end++)
+				;
+			verifyBatch(ctx, pk, signs + start, epochs + start,
+				    attributes + start, end - start, results + start);
+			for (uint32_t j = start; j < end; j++)
+				status[valid[j]] = results[j] ? TEE_SUCCESS : TEE_ERROR_SIGNATURE_INVALID;
+		}
+		dpabcContextFree(ctx);
+	}
+
+	for (uint32_t j = 0; j < nvalid; j++) {
+		zpFree((Zp *)epochs[j]);
+		free_attributes((Zp **)attributes[j], pks[valid[j]]->n);
+	}
+
+	if (res == TEE_SUCCESS) {
+		for (uint32_t i = 0; i < count; i++)
+			batch_write_result(&w, status[i], 0);
+	}
+
+	return batch_end(&w, count, params, res);
+}
+
+/*
+ * Request fields: public key, stored signature id, message, epoch,
+ * attributes, indexes of the revealed attributes (int). Result: token
+ */
+static TEE_Result dpabc_zktoken_batch(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+
+	TEE_Result res;
+	struct field_reader r;
+	struct batch_writer w;
+	uint32_t count;
+	dpabcContext *ctx;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = batch_begin(params, &r, &w, &count);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	ctx = batch_context(sess);
+
+	for (uint32_t i = 0; i < count; i++) {
+		char *pk, *sign_id, *msg, *epoch, *attr, *index, *dest;
+		size_t pk_sz, sign_id_sz, msg_sz, epoch_sz, attr_sz, index_sz;
+		int indexReveal[UINT8_MAX];
+		int nReveal;
+		publicKey *composedPk;
+		signature *composedSign;
+		zkToken *token = NULL;
+		TEE_Result status;
+
+		res = field_read(&r, &pk, &pk_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &sign_id, &sign_id_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &msg, &msg_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &epoch, &epoch_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &attr, &attr_sz);
+		if (res == TEE_SUCCESS)
+			res = field_read(&r, &index, &index_sz);
+		if (res != TEE_SUCCESS)
+			break;
+
+		status = retreive_public_key(sess, pk, pk_sz, &composedPk);
+		if (status == TEE_SUCCESS)
+			status = check_zp_fields(epoch_sz, attr_sz, composedPk->n);
+		if (status == TEE_SUCCESS)
+			status = read_reveal(index, index_sz, composedPk->n, indexReveal, &nReveal);
+		if (status == TEE_SUCCESS)
+			status = retreive_signature(sess, sign_id, sign_id_sz, &composedSign);
+
+		if (status == TEE_SUCCESS) {
+			Zp *composedEpoch = zpFromBytes(epoch);
+			Zp **composedAttr = compose_attributes(attr, composedPk->n);
+
+			token = presentZkToken(ctx, composedPk, composedSign, composedEpoch,
+					       (const Zp **)composedAttr, indexReveal, nReveal,
+					       msg, msg_sz);
+			if (!token)
+				status = TEE_ERROR_GENERIC;
+			free_attributes(composedAttr, composedPk->n);
+			zpFree(composedEpoch);
+		}
+
+		dest = batch_write_result(&w, status, token ? dpabcZkByteSize(token) : 0);
+		if (token) {
+			if (dest)
+				dpabcZkToBytes(dest, token);
+			dpabcZkFree(token);
+		}
+		batch_next(sess);
+	}
+
+	dpabcContextFree(ctx);
+	return batch_end(&w, count, params, res);
+}
+
+/*
+ * Offline part of the zero-knowledge token generation: precomputes
+ * params[3].value.a presentations (up to TA_DPABC_MAX_PRECOMPUTE) of a stored
+ * signature, kept in the session (replacing the previous pool) for
+ * TA_DPABC_ZKTOKEN_ONLINE
+ */
+static TEE_Result dpabc_present_precompute(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT);
+
+	TEE_Result res;
+	char * pk;
+	size_t pk_sz;
+	char * sign_id;
+	size_t sign_id_sz;
+	char * attr;
+	size_t attr_sz;
+	int indexReveal[UINT8_MAX];
+	int nReveal;
+	uint32_t count;
+
+	publicKey * composedPk;
+	signature * composedSign;
+
+	struct field_reader parameters;
+
+	/*
+	 * Safely get the invocation parameters
+	 */
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	// Struct of shared memory "parameters" (params[0]): 
+	//   +---------+-------------+------------+------------------+
+	//   |  pk_sz  |     pk      | sign_id_sz |     sign_id      |
+	//   +---------+-------------+------------+------------------+
+	//   | 4 bytes | pk_sz bytes | 4 bytes    | sign_id_sz bytes |
+	//   +---------+-------------+------------+------------------+
+
+	field_reader_init(&parameters, &params[0]);
+
+	res = field_read(&parameters, &pk, &pk_sz);
+	if (res == TEE_SUCCESS)
+		res = field_read(&parameters, &sign_id, &sign_id_sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	attr = params[1].memref.buffer;
+	attr_sz = params[1].memref.size;
+
+	count = params[3].value.a;
+	if (count == 0 || count > TA_DPABC_MAX_PRECOMPUTE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = retreive_signature(sess, sign_id, sign_id_sz, &composedSign);
+
+	if (res == TEE_SUCCESS)
+		res = retreive_public_key(sess, pk, pk_sz, &composedPk);
+
+	if (res == TEE_SUCCESS && attr_sz != (size_t)composedPk->n * zpByteSize())
+		res = TEE_ERROR_BAD_PARAMETERS;
+
+	if (res == TEE_SUCCESS)
+		res = read_reveal(params[2].memref.buffer, params[2].memref.size, composedPk->n, indexReveal, &nReveal);
+
+	if (res == TEE_SUCCESS) {
+
+		Zp ** composedAttr = compose_attributes(attr, composedPk->n);
+
+		uint8_t seedLen = 128;
+		char *seed = cmd_malloc(seedLen);
+		TEE_GenerateRandom(seed, seedLen);
+		dpabcContext * ctx = dpabcContextNew(composedPk->n, seed, seedLen);
+
+		if (sess->pool)
+			dpabcPresentPoolFree(sess->pool);
+		/* The pool must survive the arena reset at the end of the command */
+		pfecSetAllocator(NULL);
+		sess->pool = dpabcPresentPrecompute(ctx, composedPk, composedSign, (const Zp **) composedAttr, indexReveal, nReveal, count);
+		pfecSetAllocator(&sess->allocator);
+
+		dpabcContextFree(ctx);
+		pfecFree(seed);
+
+		if (!sess->pool) {
+			EMSG("DPABC presentation precomputation error\n");
+			res = TEE_ERROR_OUT_OF_MEMORY;
+		}
+
+		free_attributes(composedAttr, composedPk->n);
 	}
 
-	TEE_Free(pk);
-	TEE_Free(attr);
-	TEE_Free(epoch);
-	TEE_Free(sig_id);
-	dpabcPkFree(public_key);
 	return res;
+}
 
+/*
+ * Online part of the zero-knowledge token generation: token for the message
+ * in params[0] from the next precomputed presentation. params[2].value.a
+ * returns the number of presentations left
+ */
+static TEE_Result dpabc_zktoken_online(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+
+	TEE_Result res = TEE_SUCCESS;
+	zkToken * token;
+	size_t token_sz;
+
+	/*
+	 * Safely get the invocation parameters
+	 */
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (!sess->pool || dpabcPresentPoolSize(sess->pool) == 0) {
+		EMSG("No precomputed presentations left\n");
+		return TEE_ERROR_BAD_STATE;
+	}
+
+	/* Each presentation is used once, do not spend it on a short buffer */
+	token_sz = dpabcZkByteSizeForN(dpabcPresentPoolHidden(sess->pool));
+	if (token_sz > params[1].memref.size) {
+		params[1].memref.size = token_sz;
+		params[2].value.a = dpabcPresentPoolSize(sess->pool);
+		params[2].value.b = 0;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	token = presentZkTokenOnline(sess->pool, params[0].memref.buffer, params[0].memref.size);
+
+	if (!token){
+		EMSG("DPABC zkToken error\n");
+		res = TEE_ERROR_GENERIC;
+	}
+	else {
+		dpabcZkToBytes(params[1].memref.buffer, token);
+		params[1].memref.size = token_sz;
+		dpabcZkFree(token);
+	}
+
+	params[2].value.a = dpabcPresentPoolSize(sess->pool);
+	params[2].value.b = 0;
+
+	return res;
+}
+
+
+static TEE_Result dpabc_arena_stats(struct dpabc_session *sess,
+	uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	params[0].value.a = sess->arena.highWater;
+	params[0].value.b = sess->arena.size;
+	params[1].value.a = sess->arena.nOverflows;
+	params[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+
+static TEE_Result dpabc_trace_drain(uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	uint32_t n;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	n = ta_trace_drain(params[0].memref.buffer,
+			   params[0].memref.size / sizeof(ta_trace_event),
+			   &params[1].value.b);
+	params[0].memref.size = n * sizeof(ta_trace_event);
+	params[1].value.a = n;
+
+	return TEE_SUCCESS;
+}
+
+
+static TEE_Result dpabc_command_stats(uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	uint32_t n;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	n = ta_trace_stats(params[0].memref.buffer,
+			   params[0].memref.size / sizeof(ta_cmd_stats));
+	if (n * sizeof(ta_cmd_stats) > params[0].memref.size) {
+		params[0].memref.size = n * sizeof(ta_cmd_stats);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	params[0].memref.size = n * sizeof(ta_cmd_stats);
+
+	if (params[1].value.a)
+		ta_trace_stats_reset();
+
+	return TEE_SUCCESS;
 }
 
 
@@ -958,26 +1993,78 @@ TEE_Result TA_InvokeCommandEntryPoint(void __maybe_unused *sess_ctx,
 			uint32_t cmd_id,
 			uint32_t param_types, TEE_Param params[4])
 {
-	(void)&sess_ctx; /* Unused parameter */
+	struct dpabc_session *sess = sess_ctx;
+	size_t overflows = sess->arena.nOverflows;
+	TEE_Result res;
 
 	//dpabcInit("SEEDRNG", 7); //TODO initialize this someware else
 
+	ta_trace_cmd_begin(cmd_id);
+	pfecSetAllocator(&sess->allocator);
+	sess->cache.cmd++;
+
 	switch (cmd_id) {
 		case TA_DPABC_GENERATE_KEY:
-			return dpabc_generate_key(param_types, params);
+			res = dpabc_generate_key(sess, param_types, params);
+			break;
 		case TA_DPABC_READ_KEY:
-			return dpabc_read_key(param_types,params);
+			res = dpabc_read_key(sess, param_types,params);
+			break;
+		case TA_DPABC_KEY_SIZE:
+			res = dpabc_key_size(sess, param_types, params);
+			break;
 		case TA_DPABC_SIGN:
-			return dpabc_sign(param_types, params);
+			res = dpabc_sign(sess, param_types, params);
+			break;
 		case TA_DPABC_ZKTOKEN:
-			return dpabc_zktoken(param_types, params);
+			res = dpabc_zktoken(sess, param_types, params);
+			break;
 		case TA_DPABC_STORE_SIGN:
-			return dpabc_store_sign(param_types, params);
+			res = dpabc_store_sign(sess, param_types, params);
+			break;
 		case TA_DPABC_SIGN_STORE:
-			return dpabc_sign_store(param_types, params);
+			res = dpabc_sign_store(sess, param_types, params);
+			break;
 		case TA_DPABC_VERIFY_STORED:
-			return dpabc_verify_stored(param_types, params);
+			res = dpabc_verify_stored(sess, param_types, params);
+			break;
+		case TA_DPABC_COMBINE_SIGNATURES:
+			res = dpabc_combine_signatures(sess, param_types, params);
+			break;
+		case TA_DPABC_ARENA_STATS:
+			res = dpabc_arena_stats(sess, param_types, params);
+			break;
+		case TA_DPABC_PRESENT_PRECOMPUTE:
+			res = dpabc_present_precompute(sess, param_types, params);
+			break;
+		case TA_DPABC_ZKTOKEN_ONLINE:
+			res = dpabc_zktoken_online(sess, param_types, params);
+			break;
+		case TA_DPABC_SIGN_BATCH:
+			res = dpabc_sign_batch(sess, param_types, params);
+			break;
+		case TA_DPABC_VERIFY_BATCH:
+			res = dpabc_verify_batch(sess, param_types, params);
+			break;
+		case TA_DPABC_ZKTOKEN_BATCH:
+			res = dpabc_zktoken_batch(sess, param_types, params);
+			break;
+		case TA_DPABC_TRACE_DRAIN:
+			res = dpabc_trace_drain(param_types, params);
+			break;
+		case TA_DPABC_STATS:
+			res = dpabc_command_stats(param_types, params);
+			break;
 		default:
-			return TEE_ERROR_BAD_PARAMETERS;
+			res = TEE_ERROR_BAD_PARAMETERS;
 	}
+
+	pfecSetAllocator(NULL);
+	if (sess->arena.nOverflows != overflows)
+		ta_trace_record(TA_DPABC_EV_ARENA_OVERFLOW,
+				sess->arena.nOverflows - overflows);
+	pfecArenaReset(&sess->arena);
+	ta_trace_cmd_end(res);
+
+	return res;
 }
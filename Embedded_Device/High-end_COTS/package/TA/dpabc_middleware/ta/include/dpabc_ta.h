@@ -48,5 +48,48 @@
 #define TA_DPABC_SIGN_STORE		5
 #define TA_DPABC_VERIFY_STORED		6
 #define TA_DPABC_COMBINE_SIGNATURES	7	
+#define TA_DPABC_ARENA_STATS		8
+#define TA_DPABC_PRESENT_PRECOMPUTE	9
+#define TA_DPABC_ZKTOKEN_ONLINE		10
+#define TA_DPABC_SIGN_BATCH		11
+#define TA_DPABC_VERIFY_BATCH		12
+#define TA_DPABC_ZKTOKEN_BATCH		13
+#define TA_DPABC_KEY_SIZE		14
+#define TA_DPABC_TRACE_DRAIN		15
+#define TA_DPABC_STATS			16
+
+/*
+ * Per-session arena for the allocations made while a command runs, enough for
+ * keys of up to ~200 attributes. Allocations that do not fit are served from
+ * the regular heap. TA_DPABC_ARENA_STATS reports the high-water mark to adjust
+ * it
+ */
+#define TA_DPABC_ARENA_SIZE		(128 * 1024)
+
+/*
+ * Presentations precomputed by TA_DPABC_PRESENT_PRECOMPUTE, kept in the heap
+ * until used: ~2.2 KiB each with 10 hidden attributes, ~16 KiB with 255 (512
+ * KiB for a full pool)
+ */
+#define TA_DPABC_MAX_PRECOMPUTE		32
+
+/*
+ * Budget of the per-session cache of decoded secret keys, signatures and
+ * public keys, which saves the secure storage reads and deserialization of
+ * repeated operations on the same credential (signatures are only saved the
+ * deserialization, they are read again by every command as other sessions
+ * may overwrite them). Entries are zeroized when evicted, overwritten or at
+ * session close. With 0 only the objects of the last command that read one
+ * are kept
+ */
+#define TA_DPABC_CACHE_SIZE		(16 * 1024)
+
+/*
+ * Trace ring and command counters (ta_trace.h). TA_DPABC_TRACE_DRAIN moves
+ * the oldest events that fit in its output buffer to it, TA_DPABC_STATS
+ * copies the counters of the commands called so far (and resets them if
+ * asked to). Events of this TA:
+ */
+#define TA_DPABC_EV_ARENA_OVERFLOW	0x100	/* value: allocations served from the heap */
 
 #endif /*TA_DPABC_H*/
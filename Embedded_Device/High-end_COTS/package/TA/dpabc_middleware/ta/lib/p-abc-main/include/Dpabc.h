@@ -13,12 +13,19 @@
 #ifndef DPABC_H
 #define DPABC_H
 
-#ifndef NATTRINI
-#define NATTRINI 4
-#endif 
+#ifndef DPABC_THREADS
+#define DPABC_THREADS 1 // Worker threads used by batch operations (1 means no threads, e.g., inside a TA)
+#endif
+
+#define DPABC_BITMAP_SIZE(n) (((n)+7)/8) // Bytes of a result bitmap for n elements
+
+#ifndef PREPAREBATCHSIZE
+#define PREPAREBATCHSIZE 4 // Batch verifications of at least this size prepare the public key themselves when not given a prepared one
+#endif
 
 #include <Dpabc_types.h>
 #include <stdio.h>
+#include <stdint.h>
 
 //TODO Avoid (should we?) "DoS" by segmentation faults, etc. (e.g., token says correct n but array is shorter)
 
@@ -26,29 +33,62 @@
 // Issue with double pointers: forcing user to cast to const
 
 /**
- * @brief Change the number of attributes considered for the operations of the scheme
+ * Encapsulated declaration of the scheme context: number of attributes for new keys and secure random number generator.
+ * Every method that generates keys or randomness takes one, so different credential types can be used at the same time.
+ * A context must not be used by two threads at once, each thread should use its own (see dpabcContextSpawn)
+ */
+typedef struct dpabcContextImpl dpabcContext;
+
+/**
+ * @brief Create a context. It must be freed after usage
+ * 
+ * @param nattr Number of attributes of the keys generated with the context
+ * @param seed Seed of the random number generator
+ * @param seedLength Seed length
+ * @return The new context
+ */
+dpabcContext* dpabcContextNew(int nattr, const char *seed, int seedLength);
+
+/**
+ * @brief Create a context with the same number of attributes and an independent random number generator, seeded from the
+ * generator of ctx. Used to give a random stream to each thread. It must be freed after usage
+ * 
+ * @param ctx Context to derive from (its generator advances)
+ * @return The new context
+ */
+dpabcContext* dpabcContextSpawn(dpabcContext *ctx);
+
+/**
+ * @brief Change the number of attributes of the keys generated with the context
  * 
+ * @param ctx Context
  * @param n Number of attributes
  */
-void changeNattr(int n); //TODO Think about this "initialization" (other options: macros/compile, just extra argument when generating keys...)
+void dpabcContextSetNattr(dpabcContext *ctx, int n);
 
 /**
- * @brief Seed the secure random number generator used in the scheme
+ * @brief Number of attributes of the keys generated with the context
  * 
- * @param seed Seed
- * @param n Seed length
+ * @param ctx Context
+ * @return Number of attributes
  */
-void seedRng(const char* seed, int n);
+int dpabcContextNattr(const dpabcContext *ctx);
+
+/**
+ * @brief Free a context and its random number generator
+ * 
+ * @param ctx Context
+ */
+void dpabcContextFree(dpabcContext *ctx);
 
 /**
  * @brief Generate secret and public key pair. They must be freed after usage
  * 
+ * @param ctx Context, gives the number of attributes and the randomness
  * @param sk Pointer to a pointer to secret key, so it can be modified (i.e., after method *sk will point to the secret key, or null if something went wrong)
  * @param pk Pointer to a pointer to public key, so it can be modified (i.e., after method *pk will point to the pulic key, or null if something went wrong)
- * @param seed Seed
- * @param seed_sz Seed length
  */
-void keyGen(secretKey **sk, publicKey **pk, char * seed, size_t seed_sz);
+void keyGen(dpabcContext *ctx, secretKey **sk, publicKey **pk);
 
 
 /**
@@ -60,6 +100,15 @@ void keyGen(secretKey **sk, publicKey **pk, char * seed, size_t seed_sz);
  */
 publicKey* keyAggr(const publicKey *pks[], int nkeys);
 
+/**
+ * @brief Same as keyAggr, using the cached hashes and fixed-base tables of prepared public keys
+ * 
+ * @param ppks Array of prepared public keys (pointers)
+ * @param nkeys Number of keys to aggregate
+ * @return The aggregated public key (must be freed after usage), or null if something went wrong  
+ */
+publicKey* keyAggrPrepared(const preparedPublicKey *ppks[], int nkeys);
+
 /**
  * @brief Generate a signature over a set of attributes (the number of attributes is assumed to be the same as in the secret key) and epoch.
  * Note that the order of the attributes is crucial
@@ -81,6 +130,29 @@ signature* sign(const secretKey *sk, const Zp *epoch, const Zp *attributes[]);
  */
 signature* combine(const publicKey *pks[], const signature *signs[], int nkeys);
 
+/**
+ * @brief Same as combine, using the cached hashes of prepared public keys
+ * 
+ * @param ppks Prepared public keys
+ * @param signs Signatures (shares)
+ * @param nkeys Number of pks/signatures
+ * @return signature*  Resulting signature (must be freed after usage), or null if something went wrong 
+ */
+signature* combinePrepared(const preparedPublicKey *ppks[], const signature *signs[], int nkeys);
+
+/**
+ * @brief Same as combine, with the hashes of the public keys (dpabcPkHash) computed by the caller, so the keys need not be
+ * kept until the combination (e.g. when they are received one at a time). sigma2 is combined with one multi-scalar
+ * multiplication
+ * 
+ * @param signs Signatures (shares)
+ * @param t Hashes of the public keys of the shares
+ * @param nkeys Number of signatures/hashes
+ * @return signature*  Resulting signature (must be freed after usage), or null if the shares are not over the same
+ * attributes and epoch (different mprime or sigma1)
+ */
+signature* combineHashed(const signature *signs[], const Zp *t[], int nkeys);
+
 /**
  * @brief Verify a signature over a set of attributes (the number of attributes is assumed to be the same as in the public key) and epoch with respect to a public key
  * Note that the order of the attributes is crucial
@@ -93,10 +165,55 @@ signature* combine(const publicKey *pks[], const signature *signs[], int nkeys);
  */
 int verify(const publicKey *pk, const signature* sign, const Zp *epoch, const Zp *attributes[]);
 
+/**
+ * @brief Same as verify, using the fixed-base tables of a prepared public key
+ * 
+ * @param ppk Prepared public key
+ * @param sign Signature
+ * @param epoch Sigend epoch
+ * @param attributes  Signed attributes
+ * @return 1 if the signature is valid with respect to the public key, 0 otherwise 
+ */
+int verifyPrepared(const preparedPublicKey *ppk, const signature* sign, const Zp *epoch, const Zp *attributes[]);
+
+/**
+ * @brief Verify n signatures with respect to the same public key at once. The pairing equations are combined with small random
+ * exponents and checked with a single multi-pairing (one Miller loop and one final exponentiation). If the combined check fails,
+ * the batch is bisected to find which signatures are invalid
+ * 
+ * @param ctx Context, gives the random exponents
+ * @param pk Public key
+ * @param signs Signatures
+ * @param epochs Signed epoch of each signature
+ * @param attributes Signed attributes of each signature (the number of attributes is assumed to be the same as in the public key)
+ * @param n Number of signatures
+ * @param results Array of size n, results[i] is set to 1 if signs[i] is valid and 0 otherwise. Can be null if only the overall result is needed (no bisection is done then)
+ * @return 1 if all the signatures are valid with respect to the public key, 0 otherwise 
+ */
+int verifyBatch(dpabcContext *ctx, const publicKey *pk, const signature *signs[], const Zp *epochs[], const Zp **attributes[], int n,
+        int results[]);
+
+/**
+ * @brief Same as verifyBatch, using the fixed-base tables of a prepared public key (verifyBatch prepares the key itself for 
+ * batches of PREPAREBATCHSIZE signatures or more, so this saves that cost when the key is used for several batches)
+ * 
+ * @param ctx Context, gives the random exponents
+ * @param ppk Prepared public key
+ * @param signs Signatures
+ * @param epochs Signed epoch of each signature
+ * @param attributes Signed attributes of each signature
+ * @param n Number of signatures
+ * @param results Array of size n with the result of each signature, or null (see verifyBatch)
+ * @return 1 if all the signatures are valid with respect to the public key, 0 otherwise 
+ */
+int verifyBatchPrepared(dpabcContext *ctx, const preparedPublicKey *ppk, const signature *signs[], const Zp *epochs[], 
+        const Zp **attributes[], int n, int results[]);
+
 /**
  * @brief Do a zero-konwledge proof to obtain a zero-knowledge token that reveals the attributes defined by their indexes (indexReveal)
  * Note that the order of the attributes is crucial
  * 
+ * @param ctx Context, gives the randomness of the proof
  * @param pk Public key corresponding to the signature
  * @param sign  Signature for which we are computing a zero-knowledge proof
  * @param epoch Epoch
@@ -105,12 +222,100 @@ int verify(const publicKey *pk, const signature* sign, const Zp *epoch, const Zp
  * @param nIndexReveal Number of revealed attributes
  * @param message Message that will be signed for generating the zero-knowldege token
  * @param messageSize Size of the message to be signed
- * @param seed Seed
- * @param seed_sz Seed length
  * @return zkToken* Resulting zero-knowledge token (must be freed after usage), or null if something went wrong 
  */
-zkToken* presentZkToken(const publicKey * pk, const signature *sign, const Zp *epoch, const Zp *attributes[], 
-        const int indexReveal[], int nIndexReveal, const char *message, int messageSize, char * seed, size_t seed_sz);
+zkToken* presentZkToken(dpabcContext *ctx, const publicKey * pk, const signature *sign, const Zp *epoch, const Zp *attributes[], 
+        const int indexReveal[], int nIndexReveal, const char *message, int messageSize);
+
+/**
+ * @brief Same as presentZkToken, using the fixed-base tables (constant time) and cached serialization of a prepared public key
+ * 
+ * @param ctx Context, gives the randomness of the proof
+ * @param ppk Prepared public key corresponding to the signature
+ * @param sign  Signature for which we are computing a zero-knowledge proof
+ * @param epoch Epoch
+ * @param attributes Signed attributes
+ * @param indexReveal Indexes of the revealed attributes, in ascendent order
+ * @param nIndexReveal Number of revealed attributes
+ * @param message Message that will be signed for generating the zero-knowldege token
+ * @param messageSize Size of the message to be signed
+ * @return zkToken* Resulting zero-knowledge token (must be freed after usage), or null if something went wrong 
+ */
+zkToken* presentZkTokenPrepared(dpabcContext *ctx, const preparedPublicKey * ppk, const signature *sign, const Zp *epoch, 
+        const Zp *attributes[], const int indexReveal[], int nIndexReveal, const char *message, int messageSize);
+
+/**
+ * Encapsulated declaration of a pool of precomputed presentations for one signature and set of revealed attributes
+ */
+typedef struct presentationPoolImpl presentationPool;
+
+/**
+ * @brief Offline part of presentZkToken: computes count commitments (randomized signature, blinding exponents, pairing and
+ * hash state) that do not depend on the message, so presentZkTokenOnline only needs the hash of the message and a few Zp
+ * operations. The pool keeps copies of the secret values (m' and hidden attributes) and must be freed after usage
+ * 
+ * @param ctx Context, gives the randomness of the proofs
+ * @param pk Public key corresponding to the signature
+ * @param sign Signature for which the zero-knowledge proofs will be computed
+ * @param attributes Signed attributes
+ * @param indexReveal Indexes of the revealed attributes, in ascendent order
+ * @param nIndexReveal Number of revealed attributes
+ * @param count Number of presentations to precompute
+ * @return The pool (must be freed after usage), or null if count is not positive or the pool does not fit in memory
+ */
+presentationPool* dpabcPresentPrecompute(dpabcContext *ctx, const publicKey * pk, const signature *sign, const Zp *attributes[], 
+        const int indexReveal[], int nIndexReveal, int count);
+
+/**
+ * @brief Same as dpabcPresentPrecompute, using the fixed-base tables (constant time) and cached serialization of a prepared
+ * public key
+ * 
+ * @param ctx Context, gives the randomness of the proofs
+ * @param ppk Prepared public key corresponding to the signature
+ * @param sign Signature for which the zero-knowledge proofs will be computed
+ * @param attributes Signed attributes
+ * @param indexReveal Indexes of the revealed attributes, in ascendent order
+ * @param nIndexReveal Number of revealed attributes
+ * @param count Number of presentations to precompute
+ * @return The pool (must be freed after usage), or null if count is not positive or the pool does not fit in memory
+ */
+presentationPool* dpabcPresentPrecomputePrepared(dpabcContext *ctx, const preparedPublicKey * ppk, const signature *sign, 
+        const Zp *attributes[], const int indexReveal[], int nIndexReveal, int count);
+
+/**
+ * @brief Number of precomputed presentations left in a pool
+ * 
+ * @param pool Pool
+ * @return Presentations left
+ */
+int dpabcPresentPoolSize(const presentationPool *pool);
+
+/**
+ * @brief Number of hidden attributes of the tokens of a pool, to size them with dpabcZkByteSizeForN before consuming a
+ * presentation
+ * 
+ * @param pool Pool
+ * @return Hidden attributes
+ */
+int dpabcPresentPoolHidden(const presentationPool *pool);
+
+/**
+ * @brief Online part of presentZkToken: zero-knowledge token for a message from one of the precomputed presentations of the
+ * pool, which is then wiped (each one is used once, as answering two messages with it would reveal the hidden attributes)
+ * 
+ * @param pool Pool of precomputed presentations
+ * @param message Message that will be signed for generating the zero-knowldege token
+ * @param messageSize Size of the message to be signed
+ * @return zkToken* Resulting zero-knowledge token (must be freed after usage), or null if the pool is empty
+ */
+zkToken* presentZkTokenOnline(presentationPool *pool, const char *message, int messageSize);
+
+/**
+ * @brief Wipe and free a pool of precomputed presentations
+ * 
+ * @param pool Pool
+ */
+void dpabcPresentPoolFree(presentationPool *pool);
 
 /**
  * @brief Verify a zero-knowledge token that reveals the attributes defined by their indexes (indexReveal). Revealed attributes are assumed to be on ascendent order in regards to their indexes.
@@ -130,10 +335,57 @@ int verifyZkToken(const zkToken *token, const publicKey * pk, const Zp *epoch, c
         const int indexReveal[], int nReveal, const char *message, int messageSize);
 
 /**
- * @brief Frees all necessary data associated to the scheme, e.g., rng
+ * @brief Same as verifyZkToken, using the fixed-base tables and cached serialization of a prepared public key
  * 
+ * @param token Zero-knowledge token
+ * @param ppk Prepared public key
+ * @param epoch Epoch
+ * @param revealed Revealed attributes, in ascendent order (see verifyZkToken)
+ * @param indexReveal Indexes of revealed attributes, in ascendent order
+ * @param nReveal Number of revealed attributes
+ * @param message Message that was be signed for generating the zero-knowldege token
+ * @param messageSize Size of the signed message 
+ * @return 1 if the token is valid, 0 otherwise 
+ */
+int verifyZkTokenPrepared(const zkToken *token, const preparedPublicKey * ppk, const Zp *epoch, const Zp *revealed[],
+        const int indexReveal[], int nReveal, const char *message, int messageSize);
+
+/**
+ * @brief Verify several zero-knowledge tokens presented for the same public key. Each token may reveal different attributes and sign a different
+ * message. The G1 work of each token is done with a single n-multiplication, the public key is prepared (fixed-base tables) for batches of
+ * PREPAREBATCHSIZE tokens or more, and tokens are distributed among DPABC_THREADS worker threads when it is greater than 1
+ * 
+ * @param tokens Zero-knowledge tokens
+ * @param pk Public key
+ * @param epochs Epoch of each token
+ * @param revealed Revealed attributes of each token, in ascendent order (see verifyZkToken)
+ * @param indexReveal Indexes of the revealed attributes of each token, in ascendent order
+ * @param nReveal Number of revealed attributes of each token
+ * @param messages Message signed by each token
+ * @param messageSizes Size of each message
+ * @param ntokens Number of tokens
+ * @param bitmap Result bitmap of DPABC_BITMAP_SIZE(ntokens) bytes, bit i%8 of bitmap[i/8] is set to 1 if tokens[i] is valid and to 0 otherwise
+ * @return 1 if all tokens are valid, 0 otherwise
  */
-void dpabcFreeStateData();
+int verifyZkTokenBatch(const zkToken *tokens[], const publicKey * pk, const Zp *epochs[], const Zp **revealed[],
+        const int *indexReveal[], const int nReveal[], const char *messages[], const int messageSizes[], int ntokens, uint8_t bitmap[]);
 
+/**
+ * @brief Same as verifyZkTokenBatch, using a prepared public key
+ * 
+ * @param tokens Zero-knowledge tokens
+ * @param ppk Prepared public key
+ * @param epochs Epoch of each token
+ * @param revealed Revealed attributes of each token, in ascendent order (see verifyZkToken)
+ * @param indexReveal Indexes of the revealed attributes of each token, in ascendent order
+ * @param nReveal Number of revealed attributes of each token
+ * @param messages Message signed by each token
+ * @param messageSizes Size of each message
+ * @param ntokens Number of tokens
+ * @param bitmap Result bitmap of DPABC_BITMAP_SIZE(ntokens) bytes (see verifyZkTokenBatch)
+ * @return 1 if all tokens are valid, 0 otherwise
+ */
+int verifyZkTokenBatchPrepared(const zkToken *tokens[], const preparedPublicKey * ppk, const Zp *epochs[], const Zp **revealed[],
+        const int *indexReveal[], const int nReveal[], const char *messages[], const int messageSizes[], int ntokens, uint8_t bitmap[]);
 
 #endif 
@@ -28,6 +28,12 @@ typedef struct secretKeyImpl secretKey;
  */
 typedef struct publicKeyImpl publicKey;
 
+/**
+ * @brief Encapsulated definition of a public key prepared for fast operations (precomputed fixed-base tables, serialization and hash)
+ * 
+ */
+typedef struct preparedPublicKeyImpl preparedPublicKey;
+
 /**
  * @brief Encapsulated definition of the representation of a signature of the scheme
  * 
@@ -56,6 +62,11 @@ void dpabcPkFree(publicKey *pk);
  */
 int dpabcPkByteSize(const publicKey *pk);
 
+/**
+ * @brief Size of byte representation of a public key for n attributes, to size buffers before the key is available
+ */
+int dpabcPkByteSizeForN(int n);
+
 /**
  * @brief Represent PublicKey element as byte array. Array is assumed to be big enough for copy
  * @param res Byte array where it will be copied
@@ -75,6 +86,28 @@ publicKey * dpabcPkFromBytes(const char *bytes);
  */
 int dpabcPkEquals(const publicKey *pk1, const publicKey *pk2);
 
+/**
+ * @brief Prepare a public key for repeated use: computes fixed-base tables for the generator and all the key elements, and caches 
+ * the serialized key and its hash. The prepared key references pk, which must not be freed (or modified) before the prepared key
+ * @param pk Public key
+ * @return The prepared key (must be freed with dpabcPreparedPkFree after usage)
+ */
+preparedPublicKey *dpabcPkPrepare(const publicKey *pk);
+
+/**
+ * @brief Free memory from prepared public key (the referenced public key is not freed)
+ * @param ppk 
+ */
+void dpabcPreparedPkFree(preparedPublicKey *ppk);
+
+/**
+ * @brief Hash of a public key (Hash1), the exponent applied to its signature share when combining
+ * 
+ * @param pk Public key
+ * @return Zp* Hash of the key (must be freed after usage)
+ */
+Zp *dpabcPkHash(const publicKey *pk);
+
 /**
  * @brief Free memory from secret key (and all its elements)
  * 
@@ -137,6 +170,12 @@ void dpabcZkFree(zkToken *zk);
  */
 int dpabcZkByteSize(zkToken *zk);
 
+/**
+ * @brief Size of byte representation of a zero knowledge token with nHidden hidden attributes, to size buffers before
+ * the token is available
+ */
+int dpabcZkByteSizeForN(int nHidden);
+
 /**
  * @brief Represent zkToken as byte array. Array is assumed to be big enough for copy
  * @param res Byte array where it will be copied
@@ -151,4 +190,77 @@ void dpabcZkToBytes(char *res, const zkToken *zk);
 zkToken * dpabcZkFromBytes(const char *bytes);
 
 
+/**
+ * Compact wire format: a header of DPABC_COMPACT_HEADER_SIZE bytes, version (DPABC_COMPACT_VERSION) | element type 
+ * (DPABC_COMPACT_PK, DPABC_COMPACT_SIGN or DPABC_COMPACT_ZK) | payload length (4 bytes, big endian), followed by the 
+ * payload, with the same fields as the ToBytes serializations but compressed points and Zp elements of the byte 
+ * length of the group order. About half the size, at the cost of a square root per point when deserializing.
+ * FromBytesCompact functions check the header, the length and every element, returning NULL for malformed input
+ */
+#define DPABC_COMPACT_VERSION 1
+#define DPABC_COMPACT_HEADER_SIZE 6
+#define DPABC_COMPACT_PK 1
+#define DPABC_COMPACT_SIGN 2
+#define DPABC_COMPACT_ZK 3
+
+/**
+ * @brief Size of compact byte representation of a public key pk (header included)
+ */
+int dpabcPkByteSizeCompact(const publicKey *pk);
+
+/**
+ * @brief Represent public key in the compact wire format. Array is assumed to be big enough for copy
+ * @param res Byte array where it will be copied (dpabcPkByteSizeCompact(pk) bytes)
+ * @param pk Public key
+ */
+void dpabcPkToBytesCompact(char *res, const publicKey *pk);
+
+/**
+ * @brief Generate public key from bytes in the compact wire format. Has to be freed after usage.
+ * @param bytes Byte array of serialized element
+ * @param nbytes Number of bytes of the array
+ * @return The public key, or NULL if bytes is not a valid compact public key
+ */
+publicKey * dpabcPkFromBytesCompact(const char *bytes, int nbytes);
+
+/**
+ * @brief Size of compact byte representation of a signature (header included)
+ */
+int dpabcSignByteSizeCompact();
+
+/**
+ * @brief Represent signature in the compact wire format. Array is assumed to be big enough for copy
+ * @param res Byte array where it will be copied (dpabcSignByteSizeCompact() bytes)
+ * @param sig Signature
+ */
+void dpabcSignToBytesCompact(char *res, const signature *sig);
+
+/**
+ * @brief Generate signature from bytes in the compact wire format. Has to be freed after usage.
+ * @param bytes Byte array of serialized element
+ * @param nbytes Number of bytes of the array
+ * @return The signature, or NULL if bytes is not a valid compact signature
+ */
+signature * dpabcSignFromBytesCompact(const char *bytes, int nbytes);
+
+/**
+ * @brief Size of compact byte representation of a zero knowledge token zk (header included)
+ */
+int dpabcZkByteSizeCompact(const zkToken *zk);
+
+/**
+ * @brief Represent zkToken in the compact wire format. Array is assumed to be big enough for copy
+ * @param res Byte array where it will be copied (dpabcZkByteSizeCompact(zk) bytes)
+ * @param zk Zero knowledge token
+ */
+void dpabcZkToBytesCompact(char *res, const zkToken *zk);
+
+/**
+ * @brief Generate zkToken from bytes in the compact wire format. Has to be freed after usage.
+ * @param bytes Byte array of serialized element
+ * @param nbytes Number of bytes of the array
+ * @return The token, or NULL if bytes is not a valid compact token
+ */
+zkToken * dpabcZkFromBytesCompact(const char *bytes, int nbytes);
+
 #endif 
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <g1.h>
 #include <g2.h>
 #include <g3.h>
+#include <values.h>
 #include <stdint.h>
 
 //We use uint8_t for number of attributes, setting a maximum of 255 
@@ -26,6 +27,19 @@ struct publicKeyImpl{
     G1 *vy[];
 };
 
+struct preparedPublicKeyImpl{
+    const publicKey *pk;
+    G1Table *gen;
+    G1Table *vx;
+    G1Table *vy_m;
+    G1Table *vy_epoch;
+    Zp *hash;       // hashPk(pk)
+    zp_hash_t hash2; // hash2Prefix(pk)
+    char *bytes;    // dpabcPkToBytes(pk)
+    int nbytes;
+    G1Table *vy[];
+};
+
 struct signatureImpl{
     G2 *sigma1;
     G2 *sigma2;
@@ -46,6 +46,31 @@ void zpToBytes(char *res, const Zp *a);
  */
 Zp * zpFromBytes(const char *bytes);
 
+/**
+ * @brief Size of compact byte representation of Zp element (byte length of
+ * the group order, when computing zpToBytesCompact)
+ */
+int zpCompactByteSize();
+
+/**
+ * @brief Represent Zp as byte array of zpCompactByteSize() bytes (reduced
+ * modulo the group order). Array is assumed to be big enough for copy
+ * 
+ * @param res Byte array where it will be copied
+ * @param a Zp element
+ */
+void zpToBytesCompact(char *res, const Zp *a);
+
+/**
+ * @brief Generates a Zp element from bytes (previously serialized with
+ * zpToBytesCompact). Has to be freed after usage
+ * 
+ * @param bytes Byte array of serialized element (assumed to be the correct
+ * length, i.e. zpCompactByteSize())
+ * @return The element, or NULL if the value is not smaller than the order
+ */
+Zp * zpFromBytesCompact(const char *bytes);
+
 /**
  * @brief Construct a new Zp element, hashing from bytes. Has to be freed after
  * usage
@@ -55,6 +80,47 @@ Zp * zpFromBytes(const char *bytes);
  */
 Zp *hashToZp(const char * bytes,int nBytes);
 
+/**
+ * Encapsulated declaration of type ZpHash, state of an incremental hash to Zp.
+ * Hashing bytes incrementally gives the same result as hashToZp over their
+ * concatenation, so a fixed prefix can be absorbed once and reused
+ */
+typedef struct ZpHashImpl ZpHash;
+
+/**
+ * @brief Start an incremental hash to Zp. Has to be freed after usage
+ */
+ZpHash *zpHashInit();
+
+/**
+ * @brief Absorb bytes into the hash state
+ * 
+ * @param h Hash state
+ * @param bytes Bytes for hash
+ * @param nBytes Number of bytes
+ */
+void zpHashProcess(ZpHash *h, const char *bytes, int nBytes);
+
+/**
+ * @brief Construct a new Zp element, hashing the bytes absorbed by h followed
+ * by nchunks chunks of bytes. The state h is not modified, so it can be reused
+ * (also concurrently), and no heap memory is used apart from the result. Has to
+ * be freed after usage
+ * 
+ * @param h Hash state
+ * @param chunks Chunks of bytes hashed after the ones absorbed by h
+ * @param sizes Size of each chunk
+ * @param nchunks Number of chunks
+ */
+Zp *zpHashResult(const ZpHash *h, const char *const chunks[], const int sizes[], int nchunks);
+
+/**
+ * @brief Free memory of hash state
+ * 
+ * @param h Hash state
+ */
+void zpHashFree(ZpHash *h);
+
 /**
  * @brief Zp from integer. Has to be freed after usage
  * 
@@ -21,6 +21,12 @@
  */
 typedef struct G1Impl G1;
 
+/**
+ * Encapsulated declaration of type G1Table, which holds precomputed data for
+ * fast multiplications of a fixed G1 element (base)
+ */
+typedef struct G1TableImpl G1Table;
+
 
 /**
  * @brief Generates a copy of the group generator. Can be safely modified. Has
@@ -70,6 +76,32 @@ G1* hashToG1(const char *bytes, int n);
  */
 G1 * g1FromBytes(const char *bytes);
 
+/**
+ * @brief Size of compressed byte representation of G1 element (when computing
+ * g1ToBytesCompressed), about half of g1ByteSize()
+ */
+int g1CompressedByteSize();
+
+/**
+ * @brief Represent G1 element as compressed byte array (x coordinate and sign
+ * of y). Array is assumed to be big enough for copy
+ * 
+ * @param res Byte array where it will be copied
+ * @param a G1 element
+ */
+void g1ToBytesCompressed(char *res, const G1 *a);
+
+/**
+ * @brief Generates a G1 element from compressed bytes (previously serialized
+ * with g1ToBytesCompressed), computing y with a square root. Has to be freed
+ * after usage
+ * 
+ * @param bytes Byte array of serialized element (assumed to be the correct
+ * length, i.e. g1CompressedByteSize())
+ * @return The element, or NULL if bytes do not encode a point of the curve
+ */
+G1 * g1FromBytesCompressed(const char *bytes);
+
 /**
  * @brief Addition within the curve a+b
  * 
@@ -131,7 +163,8 @@ void g1InvMul(G1* a, const Zp* b);
 
 
 /**
- * @brief Multi-multiplication (n-multiplication), res=Sigma [b_i]a_i
+ * @brief Multi-multiplication (n-multiplication), res=Sigma [b_i]a_i. Large
+ * n use Pippenger's method, split among pfecGetThreads() threads
  * 
  * @param a Array of bases (G1 elements)
  * @param b Array of multipliers (Zp elements)
@@ -139,6 +172,56 @@ void g1InvMul(G1* a, const Zp* b);
  */
 G1* g1Muln(const G1 *const a[], const Zp *const b[],int n);
 
+/**
+ * @brief Compute the fixed-base table of a G1 element (comb method). Has to be
+ * freed after usage
+ * 
+ * @param g Base, not modified
+ * @return The table for g
+ */
+G1Table* g1TableCompute(const G1* g);
+
+/**
+ * @brief Fixed-base multiplication [b]g, with g the base of the table. Runs in
+ * constant time with respect to b. Result must be freed
+ * 
+ * @param t Table of the base
+ * @param b Multiplier
+ * @return The result [b]g
+ */
+G1* g1TableMul(const G1Table* t, const Zp* b);
+
+/**
+ * @brief Fixed-base n-multiplication, res=Sigma [b_i]g_i with g_i the base of
+ * t[i]. Doublings are shared among all bases. Runs in constant time with
+ * respect to the multipliers. Result must be freed
+ * 
+ * @param t Array of tables
+ * @param b Array of multipliers (Zp elements)
+ * @param n Length of arrays (assumed to be same and valid)
+ * @return The result Sigma [b_i]g_i
+ */
+G1* g1TableMuln(const G1Table *const t[], const Zp *const b[], int n);
+
+/**
+ * @brief Same as g1TableMuln, but the running time depends on the multipliers
+ * (faster). Only for public multipliers, e.g., in verifications. Result must be
+ * freed
+ * 
+ * @param t Array of tables
+ * @param b Array of multipliers (Zp elements), must not be secret
+ * @param n Length of arrays (assumed to be same and valid)
+ * @return The result Sigma [b_i]g_i
+ */
+G1* g1TableMulnVarTime(const G1Table *const t[], const Zp *const b[], int n);
+
+/**
+ * @brief Destroy fixed-base table, freeing memory
+ * 
+ * @param t 
+ */
+void g1TableFree(G1Table* t);
+
 /**
  * @brief Check if element is identity
  * 
@@ -71,6 +71,32 @@ G2* hashToG2(const char *bytes, int n);
  */
 G2 * g2FromBytes(const char *bytes);
 
+/**
+ * @brief Size of compressed byte representation of G2 element (when computing
+ * g2ToBytesCompressed), about half of g2ByteSize()
+ */
+int g2CompressedByteSize();
+
+/**
+ * @brief Represent G2 element as compressed byte array (x coordinate and sign
+ * of y). Array is assumed to be big enough for copy
+ * 
+ * @param res Byte array where it will be copied
+ * @param a G2 element
+ */
+void g2ToBytesCompressed(char *res, const G2 *a);
+
+/**
+ * @brief Generates a G2 element from compressed bytes (previously serialized
+ * with g2ToBytesCompressed), computing y with a square root. Has to be freed
+ * after usage
+ * 
+ * @param bytes Byte array of serialized element (assumed to be the correct
+ * length, i.e. g2CompressedByteSize())
+ * @return The element, or NULL if bytes do not encode a point of the curve
+ */
+G2 * g2FromBytesCompressed(const char *bytes);
+
 /**
  * @brief Addition within the curve a+b
  * 
@@ -103,6 +129,18 @@ void g2Mul(G2* a, const Zp* b);
  */
 void g2InvMul(G2* a, const Zp* b);
 
+/**
+ * @brief Multi-multiplication (n-multiplication), res=Sigma [b_i]a_i. Large
+ * n use Pippenger's method, split among pfecGetThreads() threads. Result must
+ * be freed
+ * 
+ * @param a Array of bases (G2 elements)
+ * @param b Array of multipliers (Zp elements)
+ * @param n Length of arrays (assumed to be same and valid)
+ * @return The result Sigma [b_i]a_i
+ */
+G2* g2Muln(const G2 *const a[], const Zp *const b[], int n);
+
 /**
  * @brief Check if element is identity
  * 
@@ -59,6 +59,28 @@ void g3Mul(G3* a, const G3* b);
  */
 void g3Exp(G3* a, const Zp* b);
 
+/**
+ * @brief Exponentiation a^b for a in the cyclotomic subgroup (which holds
+ * every pairing result). Faster than g3Exp, and its running time does not
+ * depend on b
+ * 
+ * @param a Pairing result, will be modified to the resulting value
+ * @param b Second operand, not modified
+ */
+void g3ExpCyclotomic(G3* a, const Zp* b);
+
+/**
+ * @brief Multi-exponentiation a[0]^b[0]*...*a[n-1]^b[n-1] for elements in the
+ * cyclotomic subgroup (pairing results), sharing the squarings between all
+ * the terms. Same constant time guarantee as g3ExpCyclotomic
+ * 
+ * @param a Array of pairing results
+ * @param b Array of exponents
+ * @param n Number of elements
+ * @return New G3 element, must be freed
+ */
+G3* g3MultiExp(const G3 *const a[], const Zp *const b[], int n);
+
 /**	@brief Tests for equality of two G3 elements
  *
 	@param a instance to be compared
@@ -10,6 +10,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+
 /**
  * Encapsulated declaration of type ranGen, which represents random generator
  * structure (can be initialized with a seed, used to generate random bytes...)
@@ -46,4 +48,94 @@ char * rgGenBytes(ranGen * rg,int n);
  */
 void rgFree(ranGen* rg);
 
+/**
+ * Allocator used for every heap allocation of the wrapper (and of the
+ * libraries built on it, through pfecMalloc/pfecFree). ctx is passed back to
+ * both functions
+ */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size);
+    void (*release)(void *ctx, void *ptr);
+    void *ctx;
+} pfecAllocator;
+
+/**
+ * Bump (arena) allocator over a caller provided buffer. Allocations are
+ * carved sequentially from the buffer, and released all at once with
+ * pfecArenaReset (releasing the most recent allocation also gives its space
+ * back). If the buffer is exhausted, the allocation is served by malloc
+ * instead. Freeing a pointer outside the buffer calls free, so memory obtained
+ * from the default allocator can be freed while the arena is installed.
+ * Fields are read-only for users
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t used;        // Bytes of buf in use
+    size_t last;        // Offset of the most recent allocation
+    size_t overflow;    // Bytes served by malloc since the last reset
+    size_t highWater;   // Maximum of used+overflow since initialization
+    size_t nOverflows;  // Number of allocations served by malloc since initialization
+} pfecArena;
+
+/**
+ * @brief Set the allocator used by pfecMalloc/pfecFree. Memory must be freed
+ * with the allocator it was obtained from. Not thread safe, must not be
+ * changed while other threads use the library, unless built with
+ * PFEC_THREAD_LOCAL_ALLOCATOR (the allocator is then set per thread)
+ * 
+ * @param a Allocator (copied), NULL restores malloc/free
+ */
+void pfecSetAllocator(const pfecAllocator *a);
+
+/**
+ * @brief Allocate size bytes with the current allocator
+ */
+void *pfecMalloc(size_t size);
+
+/**
+ * @brief Free memory obtained from pfecMalloc (NULL is ignored)
+ */
+void pfecFree(void *ptr);
+
+/**
+ * @brief Initialize an arena over buf (not owned by the arena)
+ * 
+ * @param a Arena to be initialized
+ * @param buf Memory for the arena
+ * @param size Number of bytes of buf
+ */
+void pfecArenaInit(pfecArena *a, void *buf, size_t size);
+
+/**
+ * @brief Allocator backed by the arena, to be used with pfecSetAllocator
+ */
+pfecAllocator pfecArenaAllocator(pfecArena *a);
+
+/**
+ * @brief Release every allocation of the arena. Allocations that overflowed
+ * to malloc must have been freed before
+ */
+void pfecArenaReset(pfecArena *a);
+
+#ifndef PFEC_THREADS
+#define PFEC_THREADS 1 // Maximum worker threads of multi-scalar multiplications (1 inside a TA, where pthreads are not available)
+#endif
+
+/**
+ * @brief Set the number of threads used by large multi-scalar
+ * multiplications (g1Muln, g2Muln...), which split their windows among them.
+ * Worker threads do not allocate memory, so any allocator can be used. Not
+ * thread safe, must not be changed while other threads use the library
+ * 
+ * @param n Number of threads, clamped to [1,PFEC_THREADS] (default PFEC_THREADS)
+ */
+void pfecSetThreads(int n);
+
+/**
+ * @brief Number of threads used by multi-scalar multiplications
+ */
+int pfecGetThreads(void);
+
+
 #endif 
@@ -0,0 +1,242 @@
+/**
+ * @file values.h
+ * @brief File with method definitions for value (stack-allocatable) versions of
+ * the Zp, G1, G2 and G3 types
+ *
+ * @details The types defined in Zp.h, g1.h, g2.h and g3.h are encapsulated and
+ * every element lives in the heap. This file defines alternative value types
+ * with fixed size (large enough for every instantiation of the wrapper), that
+ * can be declared as local variables, copied by assignment and operated in
+ * place, so no heap memory is used. Contents are opaque and must only be
+ * accessed through these methods. Conversions from/to the encapsulated types
+ * are provided (load/store/new), and n-multiplications take the encapsulated
+ * bases directly, as they are usually long-lived elements (e.g., keys).
+ * Operations writing into dst allow dst to be the same as any operand
+ *
+ * @see https://github.com/JesusGarciaRodriguez/dpabcCimplementation
+ */
+#ifndef VALUES_H
+#define VALUES_H
+
+#include <stdint.h>
+#include <Zp.h>
+#include <g1.h>
+#include <g2.h>
+#include <g3.h>
+
+/**
+ * Value type for Zp elements
+ */
+typedef struct { uint64_t v[7]; } zp_t;
+
+/**
+ * Value type for G1 elements
+ */
+typedef struct { uint64_t v[24]; } g1_t;
+
+/**
+ * Value type for G2 elements
+ */
+typedef struct { uint64_t v[48]; } g2_t;
+
+/**
+ * Value type for G3 elements
+ */
+typedef struct { uint64_t v[97]; } g3_t;
+
+/**
+ * Value type for the state of an incremental hash to Zp (see ZpHash)
+ */
+typedef struct { uint64_t v[91]; } zp_hash_t;
+
+/**
+ * @brief dst=a
+ */
+void zp_from_int(zp_t *dst, int a);
+
+/**
+ * @brief Copy the value of an encapsulated Zp element
+ */
+void zp_load(zp_t *dst, const Zp *src);
+
+/**
+ * @brief Copy a value into an (already allocated) encapsulated Zp element
+ */
+void zp_store(Zp *dst, const zp_t *src);
+
+/**
+ * @brief New encapsulated Zp element with the given value. Has to be freed
+ * after usage
+ */
+Zp *zp_new(const zp_t *src);
+
+/**
+ * @brief Random Zp element
+ */
+void zp_random_into(zp_t *dst, ranGen *rg);
+
+/**
+ * @brief dst=a+b
+ */
+void zp_add_into(zp_t *dst, const zp_t *a, const zp_t *b);
+
+/**
+ * @brief dst=a-b
+ */
+void zp_sub_into(zp_t *dst, const zp_t *a, const zp_t *b);
+
+/**
+ * @brief dst=a*b
+ */
+void zp_mul_into(zp_t *dst, const zp_t *a, const zp_t *b);
+
+/**
+ * @brief dst=-a
+ */
+void zp_neg_into(zp_t *dst, const zp_t *a);
+
+/**
+ * @brief Same as zpEquals
+ */
+int zp_equals(const zp_t *a, const zp_t *b);
+
+/**
+ * @brief Same as zpToBytes (zpByteSize() bytes)
+ */
+void zp_to_bytes(char *res, const zp_t *a);
+
+/**
+ * @brief Start an incremental hash to Zp (see zpHashInit)
+ */
+void zp_hash_init(zp_hash_t *h);
+
+/**
+ * @brief Absorb bytes into the hash state (see zpHashProcess)
+ */
+void zp_hash_process(zp_hash_t *h, const char *bytes, int nBytes);
+
+/**
+ * @brief Hash of the bytes absorbed by h followed by nchunks chunks of bytes,
+ * h is not modified (see zpHashResult)
+ */
+void zp_hash_result_into(zp_t *dst, const zp_hash_t *h,
+        const char *const chunks[], const int sizes[], int nchunks);
+
+/**
+ * @brief dst=Group generator
+ */
+void g1_generator_into(g1_t *dst);
+
+/**
+ * @brief dst=Group identity
+ */
+void g1_identity_into(g1_t *dst);
+
+/**
+ * @brief Copy the value of an encapsulated G1 element
+ */
+void g1_load(g1_t *dst, const G1 *src);
+
+/**
+ * @brief New encapsulated G1 element with the given value. Has to be freed
+ * after usage
+ */
+G1 *g1_new(const g1_t *src);
+
+/**
+ * @brief dst=a+b
+ */
+void g1_add_into(g1_t *dst, const g1_t *a, const g1_t *b);
+
+/**
+ * @brief dst=[k]src
+ */
+void g1_mul_into(g1_t *dst, const g1_t *src, const zp_t *k);
+
+/**
+ * @brief dst=Sum [k_i]bases_i, same as g1Muln
+ */
+void g1_muln_into(g1_t *dst, const G1 *const bases[], const zp_t k[], int n);
+
+/**
+ * @brief dst=Sum [k_i]base_i using fixed-base tables, same as g1TableMuln
+ * (constant time)
+ */
+void g1_table_muln_into(g1_t *dst, const G1Table *const t[], const zp_t k[],
+        int n);
+
+/**
+ * @brief Same as g1_table_muln_into, but the running time depends on the
+ * multipliers (see g1TableMulnVarTime)
+ */
+void g1_table_muln_vartime_into(g1_t *dst, const G1Table *const t[],
+        const zp_t k[], int n);
+
+/**
+ * @brief Same as g1IsIdentity
+ */
+int g1_is_identity(const g1_t *a);
+
+/**
+ * @brief Same as g1Equals
+ */
+int g1_equals(const g1_t *a, const g1_t *b);
+
+/**
+ * @brief Copy the value of an encapsulated G2 element
+ */
+void g2_load(g2_t *dst, const G2 *src);
+
+/**
+ * @brief New encapsulated G2 element with the given value. Has to be freed
+ * after usage
+ */
+G2 *g2_new(const g2_t *src);
+
+/**
+ * @brief Same as hashToG2
+ */
+void g2_hash_into(g2_t *dst, const char *bytes, int n);
+
+/**
+ * @brief dst=a+b
+ */
+void g2_add_into(g2_t *dst, const g2_t *a, const g2_t *b);
+
+/**
+ * @brief dst=[k]src
+ */
+void g2_mul_into(g2_t *dst, const g2_t *src, const zp_t *k);
+
+/**
+ * @brief Same as g2IsIdentity
+ */
+int g2_is_identity(const g2_t *a);
+
+/**
+ * @brief Same as g2ToBytes (g2ByteSize() bytes)
+ */
+void g2_to_bytes(char *res, const g2_t *a);
+
+/**
+ * @brief dst=e(a,b), same as pair
+ */
+void pair_into(g3_t *dst, const g1_t *a, const g2_t *b);
+
+/**
+ * @brief dst=e(a1,b1)*e(a2,b2), same as doublepair
+ */
+void doublepair_into(g3_t *dst, const g1_t *a1, const g1_t *a2,
+        const g2_t *b1, const g2_t *b2);
+
+/**
+ * @brief Same as g3equals
+ */
+int g3_equals(const g3_t *a, const g3_t *b);
+
+/**
+ * @brief Same as g3ToBytes (g3ByteSize() bytes)
+ */
+void g3_to_bytes(char *res, const g3_t *a);
+
+#endif
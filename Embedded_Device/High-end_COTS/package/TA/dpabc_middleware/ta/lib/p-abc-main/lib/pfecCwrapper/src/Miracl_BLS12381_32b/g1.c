@@ -3,10 +3,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if PFEC_THREADS>1
+#include <pthread.h>
+#endif
 #define CEIL(a,b) (((a)-1)/(b)+1)
+#define MULNCHUNK 32 // Table n-multiplications are done in chunks of this
+		     // size (bounded stack usage)
+#ifndef MULNBREAKPOINT
 #define MULNBREAKPOINT 12 // Experimentally computed value, until this
 			  // point naive n-multiplication is faster
 			  // (may vary depending on deployment)
+#endif
+#ifndef G1TABLEWIDTH
+#define G1TABLEWIDTH 6 // Comb width for fixed-base tables, each table holds
+		       // 2^G1TABLEWIDTH points
+#endif
 
 
 // Methods for hashing from AMCL, following
@@ -73,22 +84,22 @@ static int htp_BLS12381(const char *mess, int n, ECP_BLS12381 *P)
 //Header methods
 
 G1* g1Generator(){
-    G1 *r=malloc(sizeof(G1));
-    r->p=malloc(sizeof(ECP_BLS12381));
+    G1 *r=pfecMalloc(sizeof(G1));
+    r->p=pfecMalloc(sizeof(ECP_BLS12381));
     ECP_BLS12381_generator(r->p);
     return r;
 }
 
 G1* g1Identity(){
-    G1 *r=malloc(sizeof(G1));
-    r->p=malloc(sizeof(ECP_BLS12381));
+    G1 *r=pfecMalloc(sizeof(G1));
+    r->p=pfecMalloc(sizeof(ECP_BLS12381));
     ECP_BLS12381_inf(r->p);
     return r;
 }
 
 int g1ByteSize(){
-    return 2*MODBYTES_384_29+1; //0x04|x|y TODO, Check compressed
-				//serializations for possible usage
+    return 2*MODBYTES_384_29+1; //0x04|x|y (see g1CompressedByteSize
+				//for the compressed form)
 }
 
 void g1ToBytes(char *res, const G1 *a){
@@ -100,8 +111,8 @@ void g1ToBytes(char *res, const G1 *a){
 }
 
 G1* hashToG1(const char *bytes, int n){
-    G1 *r=malloc(sizeof(G1));
-    r->p=malloc(sizeof(ECP_BLS12381));
+    G1 *r=pfecMalloc(sizeof(G1));
+    r->p=pfecMalloc(sizeof(ECP_BLS12381));
     htp_BLS12381(bytes,n,r->p);
     return r;
 } 
@@ -110,14 +121,61 @@ G1 * g1FromBytes(const char *bytes){
 	if (*bytes == 0x6c) {
 		return g1Identity();
 	} else {
-		G1 *r=malloc(sizeof(G1));
-		r->p=malloc(sizeof(ECP_BLS12381));
+		G1 *r=pfecMalloc(sizeof(G1));
+		r->p=pfecMalloc(sizeof(ECP_BLS12381));
 		octet o={0,2*MODBYTES_384_29+1,bytes};
 		ECP_BLS12381_fromOctet(r->p,&o);
 		return r;
 	}
 }
 
+int g1CompressedByteSize(){
+    return MODBYTES_384_29+1; //0x02|x or 0x03|x, with the sign of y
+}
+
+void g1ToBytesCompressed(char *res, const G1 *a){
+    octet o={0,MODBYTES_384_29+1,res};
+    if(g1IsIdentity(a))
+        memset(res,0x6c,g1CompressedByteSize());
+    else
+        ECP_BLS12381_toOctet(&o,a->p,true);
+}
+
+// (p+1)/4, with p=3 mod 4 the square root of a quadratic residue a is
+// a^((p+1)/4). Precomputed so decompression takes a single exponentiation,
+// checked by squaring the result (instead of a residuosity test and a square
+// root)
+static const BIG_384_29 SqrtExp={0x1FFFEAAB,0x13FDFFFF,0x153FFFFB,0x15FFFF58,0x3D8907A,0x1A541ED6,0x12BF6730,0x1C279C28,0x15D91DD2,0xC869759,0x4B1BA7B,0x1CBFF34D,
+        0x80447A8,0x3};
+
+G1 * g1FromBytesCompressed(const char *bytes){
+    BIG_384_29 x;
+    FP_BLS12381 fx, rhs, y, check;
+    G1 *r;
+    if(bytes[0]==0x6c)
+        return g1Identity();
+    if(bytes[0]!=0x02 && bytes[0]!=0x03)
+        return NULL;
+    BIG_384_29_fromBytes(x,(char *)bytes+1);
+    if(BIG_384_29_comp(x,(chunk *)Modulus_BLS12381)>=0)
+        return NULL;
+    FP_BLS12381_nres(&fx,x);
+    ECP_BLS12381_rhs(&rhs,&fx);
+    FP_BLS12381_pow(&y,&rhs,(chunk *)SqrtExp);
+    FP_BLS12381_sqr(&check,&y);
+    if(!FP_BLS12381_equals(&check,&rhs))
+        return NULL; // x^3+b is not a square, x is not in the curve
+    if(FP_BLS12381_sign(&y)!=(bytes[0]&1))
+        FP_BLS12381_neg(&y,&y);
+    FP_BLS12381_reduce(&y);
+    r=pfecMalloc(sizeof(G1));
+    r->p=pfecMalloc(sizeof(ECP_BLS12381));
+    FP_BLS12381_copy(&r->p->x,&fx);
+    FP_BLS12381_copy(&r->p->y,&y);
+    FP_BLS12381_one(&r->p->z);
+    return r;
+}
+
 void g1Add(G1* a, const G1* b){
     ECP_BLS12381_add(a->p,b->p); 
 }
@@ -130,6 +188,112 @@ void g1Mul(G1* a, const Zp* b){
     ECP_BLS12381_mul(a->p,b->z); 
 }
 
+// Number of comb columns, i.e., doublings for a fixed-base multiplication
+static int g1TableColumns(){
+    BIG_384_29 r;
+    BIG_384_29_rcopy(r, CURVE_Order_BLS12381);
+    return CEIL(BIG_384_29_nbits(r),G1TABLEWIDTH);
+}
+
+// Comb index of column col of k (bits col, col+d, col+2d...)
+static int g1TableIndex(BIG_384_29 k, int col, int d){
+    int idx=0;
+    for(int i=0;i<G1TABLEWIDTH;i++)
+        idx|=BIG_384_29_bit(k,i*d+col)<<i;
+    return idx;
+}
+
+// Constant time P=t[idx], scanning the whole table
+static void g1TableSelect(ECP_BLS12381 *P, const ECP_BLS12381 *t, int idx){
+    const int nwords=sizeof(ECP_BLS12381)/sizeof(chunk);
+    chunk *res=(chunk *)P;
+    const chunk *entry;
+    memset(P,0,sizeof(ECP_BLS12381));
+    for(int j=0;j<(1<<G1TABLEWIDTH);j++){
+        chunk mask=-(chunk)((((j^idx)-1)>>31)&1);
+        entry=(const chunk *)&t[j];
+        for(int w=0;w<nwords;w++)
+            res[w]|=entry[w]&mask;
+    }
+}
+
+// Scalar reduced modulo the group order, so it fits in the comb
+static void g1TableScalar(BIG_384_29 k, const chunk *b){
+    BIG_384_29 r;
+    BIG_384_29_rcopy(r, CURVE_Order_BLS12381);
+    BIG_384_29_copy(k,(chunk *)b);
+    BIG_384_29_mod(k,r);
+}
+
+G1Table* g1TableCompute(const G1* g){
+    int d=g1TableColumns();
+    G1Table *res=pfecMalloc(sizeof(G1Table));
+    ECP_BLS12381 base;
+    res->t=pfecMalloc((1<<G1TABLEWIDTH)*sizeof(ECP_BLS12381));
+    ECP_BLS12381_inf(&res->t[0]);
+    ECP_BLS12381_copy(&base,g->p);
+    for(int i=0;i<G1TABLEWIDTH;i++){
+        // base=[2^(i*d)]g, t[j+2^i]=t[j]+base
+        for(int j=0;j<(1<<i);j++){
+            ECP_BLS12381_copy(&res->t[j+(1<<i)],&res->t[j]);
+            ECP_BLS12381_add(&res->t[j+(1<<i)],&base);
+        }
+        for(int k=0;k<d;k++)
+            ECP_BLS12381_dbl(&base);
+    }
+    return res;
+}
+
+G1* g1TableMul(const G1Table* t, const Zp* b){
+    return g1TableMuln(&t,&b,1);
+}
+
+// Comb evaluation of m<=MULNCHUNK tables with reduced multipliers k, added to r. Table entries are selected in 
+// constant time if ct is set
+static void g1TableCombAdd(ECP_BLS12381 *r, const G1Table *const t[], BIG_384_29 k[], int m, int ct){
+    int d=g1TableColumns();
+    ECP_BLS12381 acc, aux;
+    ECP_BLS12381_inf(&acc);
+    for(int col=d-1;col>=0;col--){
+        ECP_BLS12381_dbl(&acc);
+        for(int i=0;i<m;i++){
+            if(ct){
+                g1TableSelect(&aux,t[i]->t,g1TableIndex(k[i],col,d));
+                ECP_BLS12381_add(&acc,&aux);
+            }
+            else
+                ECP_BLS12381_add(&acc,&t[i]->t[g1TableIndex(k[i],col,d)]);
+        }
+    }
+    ECP_BLS12381_add(r,&acc);
+}
+
+// Comb evaluation shared by both n-multiplication variants
+static G1* g1TableComb(const G1Table *const t[], const Zp *const b[], int n, int ct){
+    G1 *r=g1Identity();
+    BIG_384_29 k[MULNCHUNK];
+    for(int first=0;first<n;first+=MULNCHUNK){
+        int m=n-first<MULNCHUNK?n-first:MULNCHUNK;
+        for(int i=0;i<m;i++)
+            g1TableScalar(k[i],b[first+i]->z);
+        g1TableCombAdd(r->p,t+first,k,m,ct);
+    }
+    return r;
+}
+
+G1* g1TableMuln(const G1Table *const t[], const Zp *const b[], int n){
+    return g1TableComb(t,b,n,1);
+}
+
+G1* g1TableMulnVarTime(const G1Table *const t[], const Zp *const b[], int n){
+    return g1TableComb(t,b,n,0);
+}
+
+void g1TableFree(G1Table* t){
+    pfecFree(t->t);
+    pfecFree(t);
+}
+
 void g1InvMul(G1* a, const Zp* b){
     Zp aux;
     BIG_384_29_rcopy(aux.z,b->z);
@@ -155,7 +319,7 @@ void g1MulLookupWithoutAllocation(G1* res, const G1* lt[], const Zp* b){
 }
 
 G1** g1CompLookupTable(const G1* g, int n){
-    G1** lt=malloc(n*sizeof(G1*));
+    G1** lt=pfecMalloc(n*sizeof(G1*));
     lt[0]=g1Copy(g);
     for(int i=1;i<n;i++){
         lt[i]=g1Copy(lt[i-1]);
@@ -164,32 +328,143 @@ G1** g1CompLookupTable(const G1* g, int n){
     return lt;
 }
 
+// Pippenger's bucket method: each window of the signed digits
+// (msmSignedDigits) adds the bases to 2^(c-1) buckets, which are then summed
+// as Sigma [j]bucket_j. Windows first,first+step,... are computed into
+// windows[w], so they can be split among threads, each with its own buckets
+typedef struct {
+    const G1 *const *a;
+    const int16_t *digits; // nd digits per multiplier
+    int n;
+    int c;
+    int nd;
+    ECP_BLS12381 *buckets;
+    char *used;
+    ECP_BLS12381 *windows;
+    int first;
+    int step;
+} g1MsmJob;
+
+static void *g1MsmWorker(void *arg){
+    g1MsmJob *job=arg;
+    int nb=1<<(job->c-1);
+    ECP_BLS12381 aux, sum;
+    for(int w=job->first;w<job->nd;w+=job->step){
+        memset(job->used,0,nb);
+        for(int i=0;i<job->n;i++){
+            int d=job->digits[i*job->nd+w];
+            ECP_BLS12381 *p=job->a[i]->p;
+            if(d==0)
+                continue;
+            if(d<0){
+                // The bases are shared among threads, negate a copy
+                ECP_BLS12381_copy(&aux,p);
+                ECP_BLS12381_neg(&aux);
+                p=&aux;
+                d=-d;
+            }
+            if(job->used[d-1])
+                ECP_BLS12381_add(&job->buckets[d-1],p);
+            else{
+                ECP_BLS12381_copy(&job->buckets[d-1],p);
+                job->used[d-1]=1;
+            }
+        }
+        // Running sums from the top bucket, the bucket j is added j+1 times
+        int started=0;
+        ECP_BLS12381_inf(&sum);
+        ECP_BLS12381_inf(&job->windows[w]);
+        for(int j=nb-1;j>=0;j--){
+            if(job->used[j]){
+                ECP_BLS12381_add(&sum,&job->buckets[j]);
+                started=1;
+            }
+            if(started)
+                ECP_BLS12381_add(&job->windows[w],&sum);
+        }
+    }
+    return NULL;
+}
+
+// r=Sigma [k_i]a_i, with the multipliers k_i taken from b (if not NULL) or
+// kv. Not constant time (like ECP_BLS12381_muln)
+static void g1Msm(ECP_BLS12381 *r, const G1 *const a[], const Zp *const b[],
+        const zp_t kv[], int n){
+    int c=msmWindow(n);
+    int nd=msmDigits(c);
+    int nb=1<<(c-1);
+    int nthreads=pfecGetThreads();
+    if(nthreads>nd)
+        nthreads=nd;
+    if(n<MSMTHREADBREAKPOINT)
+        nthreads=1;
+    int16_t *digits=pfecMalloc(n*nd*sizeof(int16_t));
+    ECP_BLS12381 *windows=pfecMalloc(nd*sizeof(ECP_BLS12381));
+    ECP_BLS12381 *buckets=pfecMalloc(nthreads*nb*sizeof(ECP_BLS12381));
+    char *used=pfecMalloc(nthreads*nb);
+    for(int i=0;i<n;i++)
+        msmSignedDigits(digits+i*nd,b!=NULL?b[i]->z:ZPV(&kv[i]),c,
+                nd);
+    g1MsmJob job={a,digits,n,c,nd,buckets,used,windows,0,1};
+#if PFEC_THREADS>1
+    if(nthreads>1){
+        pthread_t threads[PFEC_THREADS];
+        int started[PFEC_THREADS];
+        g1MsmJob jobs[PFEC_THREADS];
+        for(int t=0;t<nthreads;t++){
+            jobs[t]=job;
+            jobs[t].buckets=buckets+t*nb;
+            jobs[t].used=used+t*nb;
+            jobs[t].first=t;
+            jobs[t].step=nthreads;
+        }
+        // The calling thread computes the windows of the first job
+        for(int t=1;t<nthreads;t++){
+            started[t]=pthread_create(&threads[t],NULL,g1MsmWorker,
+                    &jobs[t])==0;
+            if(!started[t])
+                g1MsmWorker(&jobs[t]);
+        }
+        g1MsmWorker(&jobs[0]);
+        for(int t=1;t<nthreads;t++){
+            if(started[t])
+                pthread_join(threads[t],NULL);
+        }
+    }
+    else
+#endif
+        g1MsmWorker(&job);
+    // Horner evaluation of the windows, r=Sigma [2^(c*w)]windows_w
+    ECP_BLS12381_copy(r,&windows[nd-1]);
+    for(int w=nd-2;w>=0;w--){
+        for(int i=0;i<c;i++)
+            ECP_BLS12381_dbl(r);
+        ECP_BLS12381_add(r,&windows[w]);
+    }
+    pfecFree(used);
+    pfecFree(buckets);
+    pfecFree(windows);
+    pfecFree(digits);
+}
+
 G1* g1Muln(const G1 *const a[], const Zp *const b[], int n){
     if(n==0)
         return g1Identity();
-    G1 *r=malloc(sizeof(G1));
-    r->p=malloc(sizeof(ECP_BLS12381));
+    G1 *r=pfecMalloc(sizeof(G1));
+    r->p=pfecMalloc(sizeof(ECP_BLS12381));
     if(n<MULNBREAKPOINT){
         ECP_BLS12381_copy(r->p,a[0]->p);
         ECP_BLS12381_mul(r->p,b[0]->z); 
-        ECP_BLS12381 *aux=malloc(sizeof(ECP_BLS12381));
+        ECP_BLS12381 *aux=pfecMalloc(sizeof(ECP_BLS12381));
         for(int i=1;i<n;i++){
             ECP_BLS12381_copy(aux,a[i]->p);
             ECP_BLS12381_mul(aux,b[i]->z); 
             ECP_BLS12381_add(r->p,aux);
         }
-        free(aux);
+        pfecFree(aux);
         return r;
     }
-    ECP_BLS12381* aecp=malloc(n*sizeof(ECP_BLS12381));
-    BIG_384_29* bbig=malloc(n*sizeof(BIG_384_29));
-    for(int i=0;i<n;i++){
-        aecp[i]=*(a[i]->p);
-        BIG_384_29_copy(bbig[i],b[i]->z);
-    }
-    ECP_BLS12381_muln(r->p,n,aecp,bbig);
-    free(aecp);
-    free(bbig);
+    g1Msm(r->p,a,b,NULL,n);
     return r;   
 }
 
@@ -203,8 +478,8 @@ int g1Equals(const G1* a, const G1* b){
 
 
 G1* g1Copy(const G1* a){
-    G1 * res=malloc(sizeof(G1));
-    res->p=malloc(sizeof(ECP_BLS12381));
+    G1 * res=pfecMalloc(sizeof(G1));
+    res->p=pfecMalloc(sizeof(ECP_BLS12381));
     ECP_BLS12381_copy(res->p,a->p);
     return res;
 }
@@ -218,7 +493,82 @@ void g1Print(const G1* e){
 }
 
 void g1Free(G1* e){
-    free(e->p);
-    free(e);
+    pfecFree(e->p);
+    pfecFree(e);
+}
+
+
+// Value-type API (values.h)
+
+void g1_generator_into(g1_t *dst){
+    ECP_BLS12381_generator(G1V(dst));
+}
+
+void g1_identity_into(g1_t *dst){
+    ECP_BLS12381_inf(G1V(dst));
+}
+
+void g1_load(g1_t *dst, const G1 *src){
+    ECP_BLS12381_copy(G1V(dst),src->p);
 }
 
+G1 *g1_new(const g1_t *src){
+    G1 *r=pfecMalloc(sizeof(G1));
+    r->p=pfecMalloc(sizeof(ECP_BLS12381));
+    ECP_BLS12381_copy(r->p,G1V(src));
+    return r;
+}
+
+void g1_add_into(g1_t *dst, const g1_t *a, const g1_t *b){
+    ECP_BLS12381 aux;
+    ECP_BLS12381_copy(&aux,G1V(b));
+    ECP_BLS12381_copy(G1V(dst),G1V(a));
+    ECP_BLS12381_add(G1V(dst),&aux);
+}
+
+void g1_mul_into(g1_t *dst, const g1_t *src, const zp_t *k){
+    ECP_BLS12381_copy(G1V(dst),G1V(src));
+    ECP_BLS12381_mul(G1V(dst),ZPV(k));
+}
+
+void g1_muln_into(g1_t *dst, const G1 *const bases[], const zp_t k[], int n){
+    ECP_BLS12381 aux;
+    ECP_BLS12381_inf(G1V(dst));
+    if(n<MULNBREAKPOINT){
+        for(int i=0;i<n;i++){
+            ECP_BLS12381_copy(&aux,bases[i]->p);
+            ECP_BLS12381_mul(&aux,ZPV(&k[i]));
+            ECP_BLS12381_add(G1V(dst),&aux);
+        }
+        return;
+    }
+    g1Msm(G1V(dst),bases,NULL,k,n);
+}
+
+// Value version of g1TableComb
+static void g1TableCombInto(g1_t *dst, const G1Table *const t[], const zp_t kv[], int n, int ct){
+    BIG_384_29 k[MULNCHUNK];
+    ECP_BLS12381_inf(G1V(dst));
+    for(int first=0;first<n;first+=MULNCHUNK){
+        int m=n-first<MULNCHUNK?n-first:MULNCHUNK;
+        for(int i=0;i<m;i++)
+            g1TableScalar(k[i],ZPV(&kv[first+i]));
+        g1TableCombAdd(G1V(dst),t+first,k,m,ct);
+    }
+}
+
+void g1_table_muln_into(g1_t *dst, const G1Table *const t[], const zp_t k[], int n){
+    g1TableCombInto(dst,t,k,n,1);
+}
+
+void g1_table_muln_vartime_into(g1_t *dst, const G1Table *const t[], const zp_t k[], int n){
+    g1TableCombInto(dst,t,k,n,0);
+}
+
+int g1_is_identity(const g1_t *a){
+    return ECP_BLS12381_isinf(G1V(a));
+}
+
+int g1_equals(const g1_t *a, const g1_t *b){
+    return ECP_BLS12381_equals(G1V(a),G1V(b));
+}
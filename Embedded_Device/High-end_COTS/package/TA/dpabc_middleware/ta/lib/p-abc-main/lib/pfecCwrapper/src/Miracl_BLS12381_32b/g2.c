@@ -2,7 +2,16 @@
 #include "types.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#if PFEC_THREADS>1
+#include <pthread.h>
+#endif
 #define CEIL(a,b) (((a)-1)/(b)+1)
+#ifndef MULNBREAKPOINT
+#define MULNBREAKPOINT 6 // Experimentally computed value, until this
+			 // point naive n-multiplication is faster
+			 // (may vary depending on deployment)
+#endif
 
 // Methods for hashing from AMCL, following
 // https://datatracker.ietf.org/doc/draft-irtf-cfrg-hash-to-curve/,
@@ -73,15 +82,15 @@ static int htp_BLS12381_G2(const char *mess, int n, ECP2_BLS12381 *P)
 
 
 G2* g2Generator(){
-    G2 *r=malloc(sizeof(G2));
-    r->p=malloc(sizeof(ECP2_BLS12381));
+    G2 *r=pfecMalloc(sizeof(G2));
+    r->p=pfecMalloc(sizeof(ECP2_BLS12381));
     ECP2_BLS12381_generator(r->p);
     return r;
 }
 
 G2* g2Identity(){
-    G2 *r=malloc(sizeof(G2));
-    r->p=malloc(sizeof(ECP2_BLS12381));
+    G2 *r=pfecMalloc(sizeof(G2));
+    r->p=pfecMalloc(sizeof(ECP2_BLS12381));
     ECP2_BLS12381_inf(r->p);
     return r;
 }
@@ -101,8 +110,8 @@ void g2ToBytes(char *res, const G2 *a){
 }
 
 G2* hashToG2(const char *bytes, int n){
-    G2 *r=malloc(sizeof(G2));
-    r->p=malloc(sizeof(ECP2_BLS12381));
+    G2 *r=pfecMalloc(sizeof(G2));
+    r->p=pfecMalloc(sizeof(ECP2_BLS12381));
     htp_BLS12381_G2(bytes,n,r->p);
     return r;
 }
@@ -111,14 +120,44 @@ G2 * g2FromBytes(const char *bytes){
 	if (bytes[0] == 0x6c) {
 		return g2Identity();
 	} else {
-		G2 *r=malloc(sizeof(G2));
-		r->p=malloc(sizeof(ECP2_BLS12381));
+		G2 *r=pfecMalloc(sizeof(G2));
+		r->p=pfecMalloc(sizeof(ECP2_BLS12381));
 		octet o={0,4*MODBYTES_384_29+1,bytes};
 		ECP2_BLS12381_fromOctet(r->p,&o);
 		return r;
 	}
 }
 
+int g2CompressedByteSize(){
+    return 2*MODBYTES_384_29+1; //0x02|x or 0x03|x, with the sign of y
+}
+
+void g2ToBytesCompressed(char *res, const G2 *a){
+    octet o={0,2*MODBYTES_384_29+1,res};
+    if(g2IsIdentity(a))
+        memset(res,0x6c,g2CompressedByteSize());
+    else
+        ECP2_BLS12381_toOctet(&o,a->p,true);
+}
+
+// Miracl takes the square roots in FP from the hint of its residuosity
+// tests, so no exponentiation is repeated
+G2 * g2FromBytesCompressed(const char *bytes){
+    octet o={2*MODBYTES_384_29+1,2*MODBYTES_384_29+1,(char *)bytes};
+    G2 *r;
+    if(bytes[0]==0x6c)
+        return g2Identity();
+    if(bytes[0]!=0x02 && bytes[0]!=0x03)
+        return NULL;
+    r=pfecMalloc(sizeof(G2));
+    r->p=pfecMalloc(sizeof(ECP2_BLS12381));
+    if(!ECP2_BLS12381_fromOctet(r->p,&o)){
+        g2Free(r);
+        return NULL;
+    }
+    return r;
+}
+
 void g2Add(G2* a, const G2* b){
     ECP2_BLS12381_add(a->p,b->p); 
 }
@@ -138,6 +177,140 @@ void g2InvMul(G2* a, const Zp* b){
     ECP2_BLS12381_mul(a->p,aux.z); 
 }
 
+// Pippenger's bucket method: each window of the signed digits
+// (msmSignedDigits) adds the bases to 2^(c-1) buckets, which are then summed
+// as Sigma [j]bucket_j. Windows first,first+step,... are computed into
+// windows[w], so they can be split among threads, each with its own buckets
+typedef struct {
+    const G2 *const *a;
+    const int16_t *digits; // nd digits per multiplier
+    int n;
+    int c;
+    int nd;
+    ECP2_BLS12381 *buckets;
+    char *used;
+    ECP2_BLS12381 *windows;
+    int first;
+    int step;
+} g2MsmJob;
+
+static void *g2MsmWorker(void *arg){
+    g2MsmJob *job=arg;
+    int nb=1<<(job->c-1);
+    ECP2_BLS12381 aux, sum;
+    for(int w=job->first;w<job->nd;w+=job->step){
+        memset(job->used,0,nb);
+        for(int i=0;i<job->n;i++){
+            int d=job->digits[i*job->nd+w];
+            ECP2_BLS12381 *p=job->a[i]->p;
+            if(d==0)
+                continue;
+            if(d<0){
+                // The bases are shared among threads, negate a copy
+                ECP2_BLS12381_copy(&aux,p);
+                ECP2_BLS12381_neg(&aux);
+                p=&aux;
+                d=-d;
+            }
+            if(job->used[d-1])
+                ECP2_BLS12381_add(&job->buckets[d-1],p);
+            else{
+                ECP2_BLS12381_copy(&job->buckets[d-1],p);
+                job->used[d-1]=1;
+            }
+        }
+        // Running sums from the top bucket, the bucket j is added j+1 times
+        int started=0;
+        ECP2_BLS12381_inf(&sum);
+        ECP2_BLS12381_inf(&job->windows[w]);
+        for(int j=nb-1;j>=0;j--){
+            if(job->used[j]){
+                ECP2_BLS12381_add(&sum,&job->buckets[j]);
+                started=1;
+            }
+            if(started)
+                ECP2_BLS12381_add(&job->windows[w],&sum);
+        }
+    }
+    return NULL;
+}
+
+// r=Sigma [b_i]a_i. Not constant time
+static void g2Msm(ECP2_BLS12381 *r, const G2 *const a[], const Zp *const b[],
+        int n){
+    int c=msmWindow(n);
+    int nd=msmDigits(c);
+    int nb=1<<(c-1);
+    int nthreads=pfecGetThreads();
+    if(nthreads>nd)
+        nthreads=nd;
+    if(n<MSMTHREADBREAKPOINT)
+        nthreads=1;
+    int16_t *digits=pfecMalloc(n*nd*sizeof(int16_t));
+    ECP2_BLS12381 *windows=pfecMalloc(nd*sizeof(ECP2_BLS12381));
+    ECP2_BLS12381 *buckets=pfecMalloc(nthreads*nb*sizeof(ECP2_BLS12381));
+    char *used=pfecMalloc(nthreads*nb);
+    for(int i=0;i<n;i++)
+        msmSignedDigits(digits+i*nd,b[i]->z,c,nd);
+    g2MsmJob job={a,digits,n,c,nd,buckets,used,windows,0,1};
+#if PFEC_THREADS>1
+    if(nthreads>1){
+        pthread_t threads[PFEC_THREADS];
+        int started[PFEC_THREADS];
+        g2MsmJob jobs[PFEC_THREADS];
+        for(int t=0;t<nthreads;t++){
+            jobs[t]=job;
+            jobs[t].buckets=buckets+t*nb;
+            jobs[t].used=used+t*nb;
+            jobs[t].first=t;
+            jobs[t].step=nthreads;
+        }
+        // The calling thread computes the windows of the first job
+        for(int t=1;t<nthreads;t++){
+            started[t]=pthread_create(&threads[t],NULL,g2MsmWorker,
+                    &jobs[t])==0;
+            if(!started[t])
+                g2MsmWorker(&jobs[t]);
+        }
+        g2MsmWorker(&jobs[0]);
+        for(int t=1;t<nthreads;t++){
+            if(started[t])
+                pthread_join(threads[t],NULL);
+        }
+    }
+    else
+#endif
+        g2MsmWorker(&job);
+    // Horner evaluation of the windows, r=Sigma [2^(c*w)]windows_w
+    ECP2_BLS12381_copy(r,&windows[nd-1]);
+    for(int w=nd-2;w>=0;w--){
+        for(int i=0;i<c;i++)
+            ECP2_BLS12381_dbl(r);
+        ECP2_BLS12381_add(r,&windows[w]);
+    }
+    pfecFree(used);
+    pfecFree(buckets);
+    pfecFree(windows);
+    pfecFree(digits);
+}
+
+G2* g2Muln(const G2 *const a[], const Zp *const b[], int n){
+    G2 *r=pfecMalloc(sizeof(G2));
+    r->p=pfecMalloc(sizeof(ECP2_BLS12381));
+    if(n<MULNBREAKPOINT){
+        ECP2_BLS12381 aux;
+        ECP2_BLS12381_inf(r->p);
+        for(int i=0;i<n;i++){
+            ECP2_BLS12381_copy(&aux,a[i]->p);
+            ECP2_BLS12381_mul(&aux,b[i]->z);
+            ECP2_BLS12381_add(r->p,&aux);
+        }
+        return r;
+    }
+    g2Msm(r->p,a,b,n);
+    return r;
+}
+
 int g2IsIdentity(const G2* a){
     return ECP2_BLS12381_isinf(a->p);
 }
@@ -147,8 +320,8 @@ int g2Equals(const G2* a, const G2* b){
 }
 
 G2* g2Copy(const G2* a){
-    G2 * res=malloc(sizeof(G2));
-    res->p=malloc(sizeof(ECP2_BLS12381));
+    G2 * res=pfecMalloc(sizeof(G2));
+    res->p=pfecMalloc(sizeof(ECP2_BLS12381));
     ECP2_BLS12381_copy(res->p,a->p);
     return res;
 }
@@ -162,6 +335,45 @@ void g2Print(const G2* e){
 }
 
 void g2Free(G2* e){
-    free(e->p);
-    free(e);
+    pfecFree(e->p);
+    pfecFree(e);
+}
+
+
+// Value-type API (values.h)
+
+void g2_load(g2_t *dst, const G2 *src){
+    ECP2_BLS12381_copy(G2V(dst),src->p);
+}
+
+G2 *g2_new(const g2_t *src){
+    G2 *r=pfecMalloc(sizeof(G2));
+    r->p=pfecMalloc(sizeof(ECP2_BLS12381));
+    ECP2_BLS12381_copy(r->p,G2V(src));
+    return r;
+}
+
+void g2_hash_into(g2_t *dst, const char *bytes, int n){
+    htp_BLS12381_G2(bytes,n,G2V(dst));
+}
+
+void g2_add_into(g2_t *dst, const g2_t *a, const g2_t *b){
+    ECP2_BLS12381 aux;
+    ECP2_BLS12381_copy(&aux,G2V(b));
+    ECP2_BLS12381_copy(G2V(dst),G2V(a));
+    ECP2_BLS12381_add(G2V(dst),&aux);
+}
+
+void g2_mul_into(g2_t *dst, const g2_t *src, const zp_t *k){
+    ECP2_BLS12381_copy(G2V(dst),G2V(src));
+    ECP2_BLS12381_mul(G2V(dst),ZPV(k));
+}
+
+int g2_is_identity(const g2_t *a){
+    return ECP2_BLS12381_isinf(G2V(a));
+}
+
+void g2_to_bytes(char *res, const g2_t *a){
+    G2 aux={G2V(a)}; // Encapsulated view of the value, no copy
+    g2ToBytes(res,&aux);
 }
@@ -4,8 +4,8 @@
 
 
 G3* pair(const G1 *a,const G2 *b){
-    G3* result=malloc(sizeof(G3));
-    result->z=malloc(sizeof(FP12_BLS12381));
+    G3* result=pfecMalloc(sizeof(G3));
+    result->z=pfecMalloc(sizeof(FP12_BLS12381));
     PAIR_BLS12381_ate(result->z,b->p,a->p);
     PAIR_BLS12381_fexp(result->z);
     return result;
@@ -18,20 +18,33 @@ G3* multipair(const G1 *a[], const G2 *b[], int n){
     for(int i=0;i<n;i++){
         PAIR_BLS12381_another(r,b[i]->p,a[i]->p);
     }
-    FP12_BLS12381 *res=malloc(sizeof(FP12_BLS12381));
+    FP12_BLS12381 *res=pfecMalloc(sizeof(FP12_BLS12381));
     PAIR_BLS12381_miller(res,r);
     PAIR_BLS12381_fexp(res);
-    G3* result=malloc(sizeof(G3));
+    G3* result=pfecMalloc(sizeof(G3));
     result->z=res;
     return result;
 }
 
 G3* doublepair(const G1 *a1,const G1* a2, const G2 *b1,const G2 *b2){
     //Error handling: Check array sizes
-    FP12_BLS12381 *res=malloc(sizeof(FP12_BLS12381));
+    FP12_BLS12381 *res=pfecMalloc(sizeof(FP12_BLS12381));
     PAIR_BLS12381_double_ate(res,b1->p,a1->p,b2->p,a2->p);
     PAIR_BLS12381_fexp(res);
-    G3* result=malloc(sizeof(G3));
+    G3* result=pfecMalloc(sizeof(G3));
     result->z=res;
     return result;
-}
\ No newline at end of file
+}
+
+
+// Value-type API (values.h)
+
+void pair_into(g3_t *dst, const g1_t *a, const g2_t *b){
+    PAIR_BLS12381_ate(G3V(dst),G2V(b),G1V(a));
+    PAIR_BLS12381_fexp(G3V(dst));
+}
+
+void doublepair_into(g3_t *dst, const g1_t *a1, const g1_t *a2, const g2_t *b1, const g2_t *b2){
+    PAIR_BLS12381_double_ate(G3V(dst),G2V(b1),G1V(a1),G2V(b2),G1V(a2));
+    PAIR_BLS12381_fexp(G3V(dst));
+}
@@ -3,8 +3,10 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define P CURVE_Order_BLS12381
+#define ZPCOMPACTBYTES 32 // Byte length of the order (255 bits)
 
 extern const BIG_384_58 P;
 // Operations with P discard const (though it is not modified). Happens with other qualifiers too
@@ -23,49 +25,119 @@ void zpToBytes(char *res, const Zp *a)
 
 Zp * zpFromBytes(const char *bytes)
 {
-	Zp * r=malloc(sizeof(Zp));
+	Zp * r=pfecMalloc(sizeof(Zp));
 	BIG_384_58_fromBytes(r->z,bytes);
 	return r;
 }
 
+int zpCompactByteSize()
+{
+	return ZPCOMPACTBYTES;
+}
+
+void zpToBytesCompact(char *res, const Zp *a)
+{
+	char aux[MODBYTES_384_58];
+	BIG_384_58 t;
+	BIG_384_58_copy(t,(chunk *)a->z);
+	BIG_384_58_mod(t,P);
+	BIG_384_58_toBytes(aux,t);
+	memcpy(res,aux+MODBYTES_384_58-ZPCOMPACTBYTES,ZPCOMPACTBYTES); // Leading bytes are zero
+}
+
+Zp * zpFromBytesCompact(const char *bytes)
+{
+	char aux[MODBYTES_384_58]={0};
+	Zp * r=pfecMalloc(sizeof(Zp));
+	memcpy(aux+MODBYTES_384_58-ZPCOMPACTBYTES,bytes,ZPCOMPACTBYTES);
+	BIG_384_58_fromBytes(r->z,aux);
+	if(BIG_384_58_comp(r->z,P)>=0){
+		pfecFree(r);
+		return NULL;
+	}
+	return r;
+}
+
 Zp *hashToZp(const char * bytes,int nBytes)
 {
-	Zp * r=malloc(sizeof(Zp));
+	Zp * r=pfecMalloc(sizeof(Zp));
 	hash384 h;
+	char hashed[64]; // Enough for HASH384 output
 	HASH384_init(&h);
 	int hashSize=h.hlen;
-	char *hashed=malloc(hashSize*sizeof(char));
 	for(int i=0; i<nBytes; i++)
 		HASH384_process(&h,bytes[i]);
 	HASH384_hash(&h,hashed);
 	BIG_384_58_fromBytesLen(r->z,hashed,hashSize);
-	free(hashed);
 	return r;
 }
 
-Zp* zpFromInt (int a)
+ZpHash *zpHashInit()
+{
+	ZpHash * r=pfecMalloc(sizeof(ZpHash));
+	HASH384_init(&r->h);
+	return r;
+}
+
+void zpHashProcess(ZpHash *h, const char *bytes, int nBytes)
+{
+	for(int i=0; i<nBytes; i++)
+		HASH384_process(&h->h,bytes[i]);
+}
+
+// Hash of the state h followed by the chunks into r, h is not modified
+static void zpHashFinal(chunk *r, const hash384 *h, const char *const chunks[], const int sizes[], int nchunks)
+{
+	hash384 aux=*h; // Work on a copy, the state can be reused
+	char hashed[64];
+	int hashSize=aux.hlen;
+	for(int k=0;k<nchunks;k++)
+		for(int i=0;i<sizes[k];i++)
+			HASH384_process(&aux,chunks[k][i]);
+	HASH384_hash(&aux,hashed);
+	BIG_384_58_fromBytesLen(r,hashed,hashSize);
+}
+
+Zp *zpHashResult(const ZpHash *h, const char *const chunks[], const int sizes[], int nchunks)
+{
+	Zp * r=pfecMalloc(sizeof(Zp));
+	zpHashFinal(r->z,&h->h,chunks,sizes,nchunks);
+	return r;
+}
+
+void zpHashFree(ZpHash *h)
+{
+	pfecFree(h);
+}
+
+static void zpSetInt(chunk *z, int a)
 {
-	Zp * r=malloc(sizeof(Zp));
-	if (r == NULL)
-		return NULL;
 	if (a >= 0) {
-		BIG_384_58_zero(r->z);
-		BIG_384_58_inc(r->z,a);
+		BIG_384_58_zero(z);
+		BIG_384_58_inc(z,a);
 	} else {
-		BIG_384_58_copy(r->z, P);
+		BIG_384_58_copy(z, P);
 		if (a == INT_MIN) {
-			BIG_384_58_dec(r->z, INT_MAX);
-			BIG_384_58_dec(r->z, -(INT_MAX+INT_MIN));
+			BIG_384_58_dec(z, INT_MAX);
+			BIG_384_58_dec(z, -(INT_MAX+INT_MIN));
 		} else { /* Overflow can't happen here on C99 */
-			BIG_384_58_dec(r->z, -a);
+			BIG_384_58_dec(z, -a);
 		}
 	}
+}
+
+Zp* zpFromInt (int a)
+{
+	Zp * r=pfecMalloc(sizeof(Zp));
+	if (r == NULL)
+		return NULL;
+	zpSetInt(r->z,a);
 	return r;
 }
 
 Zp* zpRandom(ranGen *rg)
 {
-	Zp *r=malloc(sizeof(Zp));
+	Zp *r=pfecMalloc(sizeof(Zp));
 	BIG_384_58_randomnum(r->z,P,rg->rg);
 	return r;
 }
@@ -77,7 +149,7 @@ void zpRandomValue(ranGen *rg, Zp *r)
 
 Zp* zpModulus()
 {
-	Zp *r=malloc(sizeof(Zp));
+	Zp *r=pfecMalloc(sizeof(Zp));
 	BIG_384_58_copy(r->z,P);
 	return r;
 }
@@ -142,8 +214,8 @@ int zpHalf(Zp* a)
 
 int zpEquals(const Zp* a, const Zp* b)
 {
-	BIG_384_58_norm(a->z);
-	BIG_384_58_norm(b->z);
+	BIG_384_58_mod(a->z,P);
+	BIG_384_58_mod(b->z,P);
 	return BIG_384_58_comp(a->z,b->z)==0;
 }
 
@@ -155,7 +227,7 @@ int zpIsZero(const Zp* a)
 
 Zp* zpCopy(const Zp* a)
 {
-	Zp * r=malloc(sizeof(Zp));
+	Zp * r=pfecMalloc(sizeof(Zp));
 	BIG_384_58_rcopy(r->z,a->z);
 	return r;
 }
@@ -172,5 +244,123 @@ void zpPrint(const Zp *e)
 
 void zpFree(Zp* e)
 {
-	free(e);
+	pfecFree(e);
+}
+
+
+// Value-type API (values.h)
+
+void zp_from_int(zp_t *dst, int a)
+{
+	zpSetInt(ZPV(dst),a);
+}
+
+void zp_load(zp_t *dst, const Zp *src)
+{
+	BIG_384_58_copy(ZPV(dst),(chunk *)src->z);
+}
+
+void zp_store(Zp *dst, const zp_t *src)
+{
+	BIG_384_58_copy(dst->z,ZPV(src));
+}
+
+Zp *zp_new(const zp_t *src)
+{
+	Zp * r=pfecMalloc(sizeof(Zp));
+	BIG_384_58_copy(r->z,ZPV(src));
+	return r;
+}
+
+void zp_random_into(zp_t *dst, ranGen *rg)
+{
+	BIG_384_58_randomnum(ZPV(dst),P,rg->rg);
+}
+
+void zp_add_into(zp_t *dst, const zp_t *a, const zp_t *b)
+{
+	BIG_384_58_modadd(ZPV(dst),ZPV(a),ZPV(b),P);
+}
+
+void zp_sub_into(zp_t *dst, const zp_t *a, const zp_t *b)
+{
+	Zp x, y;
+	BIG_384_58_copy(x.z,ZPV(a));
+	BIG_384_58_copy(y.z,ZPV(b));
+	zpSub(&x,&y);
+	BIG_384_58_copy(ZPV(dst),x.z);
+}
+
+void zp_mul_into(zp_t *dst, const zp_t *a, const zp_t *b)
+{
+	BIG_384_58_modmul(ZPV(dst),ZPV(a),ZPV(b),P);
+}
+
+void zp_neg_into(zp_t *dst, const zp_t *a)
+{
+	BIG_384_58_modneg(ZPV(dst),ZPV(a),P);
+}
+
+int zp_equals(const zp_t *a, const zp_t *b)
+{
+	BIG_384_58_mod(ZPV(a),P);
+	BIG_384_58_mod(ZPV(b),P);
+	return BIG_384_58_comp(ZPV(a),ZPV(b))==0;
+}
+
+void zp_to_bytes(char *res, const zp_t *a)
+{
+	BIG_384_58_toBytes(res,ZPV(a));
+}
+
+void zp_hash_init(zp_hash_t *h)
+{
+	HASH384_init(HASHV(h));
+}
+
+void zp_hash_process(zp_hash_t *h, const char *bytes, int nBytes)
+{
+	for(int i=0;i<nBytes;i++)
+		HASH384_process(HASHV(h),bytes[i]);
+}
+
+void zp_hash_result_into(zp_t *dst, const zp_hash_t *h, const char *const chunks[], const int sizes[], int nchunks)
+{
+	zpHashFinal(ZPV(dst),HASHV(h),chunks,sizes,nchunks);
+}
+
+int msmWindow(int n)
+{
+	// Additions of Pippenger's method: ceil(bits/c) windows, each adding n points to 2^(c-1) buckets and summing them
+	int bits=BIG_384_58_nbits((chunk *)P);
+	int best=2;
+	long bestCost=-1;
+	for(int c=2;c<=MSMMAXWINDOW;c++){
+		long cost=(long)((bits+c-1)/c)*(n+(1L<<(c-1)));
+		if(bestCost<0 || cost<bestCost){
+			best=c;
+			bestCost=cost;
+		}
+	}
+	return best;
+}
+
+int msmDigits(int c)
+{
+	return (BIG_384_58_nbits((chunk *)P)+c-1)/c+1; // One more for the last carry
+}
+
+void msmSignedDigits(int16_t *d, const chunk *k, int c, int nd)
+{
+	BIG_384_58 t;
+	int half=1<<(c-1);
+	int carry=0;
+	BIG_384_58_copy(t,(chunk *)k);
+	BIG_384_58_mod(t,P);
+	for(int i=0;i<nd;i++){
+		int u=BIG_384_58_lastbits(t,c)+carry;
+		BIG_384_58_fshr(t,c);
+		carry=u>half;
+		d[i]=(int16_t)(u-(carry<<c));
+	}
 }
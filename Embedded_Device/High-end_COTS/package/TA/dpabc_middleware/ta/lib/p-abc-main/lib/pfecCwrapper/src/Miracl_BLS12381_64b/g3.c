@@ -1,12 +1,22 @@
 #include <g3.h>
 #include "types.h"
+#include <../lib/Miracl_Core/pair_BLS12381.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#define GTDIGITS 65 // Signed binary digits of the exponents after decomposition, all below |x|<2^64
+
+// Exponent of one term, decomposed and recoded for a joint exponentiation of f,f^|x|,f^(|x|^2),f^(|x|^3)
+typedef struct {
+    FP12_BLS12381 g[8]; // g[j]=f*Prod_{bit i of j set} f^(|x|^(i+1))
+    sign8 w[GTDIGITS];
+    sign8 s[GTDIGITS];
+    int pb; // Exponent was incremented to make it odd
+} G3ExpTerm;
 
 G3* g3One(){
-    G3 *r=malloc(sizeof(G3));
-    r->z=malloc(sizeof(FP12_BLS12381));
+    G3 *r=pfecMalloc(sizeof(G3));
+    r->z=pfecMalloc(sizeof(FP12_BLS12381));
     FP12_BLS12381_one(r->z);
     return r;
 }
@@ -29,6 +39,123 @@ void g3Exp(G3* a, const Zp* b){
     FP12_BLS12381_pow(a->z,a->z,b->z); 
 }
 
+static int g3Teq(int b, int c){
+    int x=b^c;
+    x-=1;
+    return (x>>31)&1;
+}
+
+// f=g[(|b|-1)/2] (b odd), inverted if b<0, without branching on b
+static void g3Select(FP12_BLS12381 *f, FP12_BLS12381 g[8], int b){
+    FP12_BLS12381 invf;
+    int m=b>>31;
+    int babs=((b^m)-m-1)/2;
+    for(int i=0;i<8;i++)
+        FP12_BLS12381_cmove(f,&g[i],g3Teq(babs,i));
+    FP12_BLS12381_conj(&invf,f); // Inverse in the cyclotomic subgroup
+    FP12_BLS12381_cmove(f,&invf,m&1);
+}
+
+static void g3ExpPrepare(G3ExpTerm *t, FP12_BLS12381 *f, const chunk *e){
+    BIG_384_58 q, x, ee, u[4];
+    FP12_BLS12381 fr[4];
+    FP2_BLS12381 X;
+    FP_BLS12381 fx, fy;
+    int bd, k;
+    // Galbraith-Scott decomposition e=u0+u1*|x|+u2*|x|^2+u3*|x|^3 with ui<|x|.
+    // As p=x mod r and x<0, f^|x|=conj(frob(f)) in the cyclotomic subgroup
+    BIG_384_58_rcopy(q,CURVE_Order_BLS12381);
+    BIG_384_58_rcopy(x,CURVE_Bnx_BLS12381);
+    BIG_384_58_copy(ee,(chunk *)e);
+    BIG_384_58_norm(ee);
+    BIG_384_58_ctmod(ee,q,8*MODBYTES_384_58-BIG_384_58_nbits(q));
+    bd=BIG_384_58_nbits(q)-BIG_384_58_nbits(x);
+    for(int i=0;i<3;i++){
+        BIG_384_58_copy(u[i],ee);
+        BIG_384_58_ctmod(u[i],x,bd);
+        BIG_384_58_ctsdiv(ee,x,bd);
+    }
+    BIG_384_58_copy(u[3],ee);
+    FP_BLS12381_rcopy(&fx,Fra_BLS12381);
+    FP_BLS12381_rcopy(&fy,Frb_BLS12381);
+    FP2_BLS12381_from_FPs(&X,&fx,&fy);
+    FP12_BLS12381_copy(&fr[0],f);
+    FP12_BLS12381_norm(&fr[0]);
+    for(int i=1;i<4;i++){
+        FP12_BLS12381_copy(&fr[i],&fr[i-1]);
+        FP12_BLS12381_frob(&fr[i],&X);
+    }
+    FP12_BLS12381_conj(&fr[1],&fr[1]);
+    FP12_BLS12381_conj(&fr[3],&fr[3]);
+    for(int j=0;j<8;j++){
+        FP12_BLS12381_copy(&t->g[j],&fr[0]);
+        for(int i=0;i<3;i++)
+            if(j&(1<<i))
+                FP12_BLS12381_mul(&t->g[j],&fr[i+1]);
+    }
+    // Recoding of FP12_pow4, with a fixed number of digits: the first exponent
+    // (made odd) gives the signs, the others are written in {0,sign}
+    t->pb=1-BIG_384_58_parity(u[0]);
+    BIG_384_58_inc(u[0],t->pb);
+    BIG_384_58_norm(u[0]);
+    t->s[GTDIGITS-1]=1;
+    for(int i=0;i<GTDIGITS-1;i++){
+        BIG_384_58_fshr(u[0],1);
+        t->s[i]=2*BIG_384_58_parity(u[0])-1;
+    }
+    for(int i=0;i<GTDIGITS;i++){
+        t->w[i]=0;
+        k=1;
+        for(int j=1;j<4;j++){
+            int bt=t->s[i]*BIG_384_58_parity(u[j]);
+            BIG_384_58_fshr(u[j],1);
+            BIG_384_58_dec(u[j],(bt>>1));
+            BIG_384_58_norm(u[j]);
+            t->w[i]+=bt*k;
+            k*=2;
+        }
+    }
+}
+
+// r=Prod f_j^e_j for the prepared terms, one cyclotomic squaring per digit shared by all of them
+static void g3MultiExpInto(FP12_BLS12381 *r, G3ExpTerm t[], int n){
+    FP12_BLS12381 aux;
+    FP12_BLS12381_one(r);
+    for(int i=GTDIGITS-1;i>=0;i--){
+        if(i<GTDIGITS-1)
+            FP12_BLS12381_usqr(r,r);
+        for(int j=0;j<n;j++){
+            g3Select(&aux,t[j].g,2*t[j].w[i]+t[j].s[i]);
+            FP12_BLS12381_mul(r,&aux);
+        }
+    }
+    for(int j=0;j<n;j++){
+        FP12_BLS12381_conj(&aux,&t[j].g[0]);
+        FP12_BLS12381_mul(&aux,r);
+        FP12_BLS12381_cmove(r,&aux,t[j].pb);
+    }
+    FP12_BLS12381_reduce(r);
+}
+
+void g3ExpCyclotomic(G3* a, const Zp* b){
+    G3ExpTerm t;
+    g3ExpPrepare(&t,a->z,b->z);
+    g3MultiExpInto(a->z,&t,1);
+}
+
+G3* g3MultiExp(const G3 *const a[], const Zp *const b[], int n){
+    G3 *r=g3One();
+    G3ExpTerm *t;
+    if(n<=0)
+        return r;
+    t=pfecMalloc(n*sizeof(G3ExpTerm));
+    for(int j=0;j<n;j++)
+        g3ExpPrepare(&t[j],a[j]->z,b[j]->z);
+    g3MultiExpInto(r->z,t,n);
+    pfecFree(t);
+    return r;
+}
+
 int g3equals(const G3* a, const G3* b){
     return FP12_BLS12381_equals(a->z,b->z);
 }
@@ -38,6 +165,18 @@ void g3Print(const G3 *e){
 }
 
 void g3Free(G3* e){
-    free(e->z);
-    free(e);
-}
\ No newline at end of file
+    pfecFree(e->z);
+    pfecFree(e);
+}
+
+
+// Value-type API (values.h)
+
+int g3_equals(const g3_t *a, const g3_t *b){
+    return FP12_BLS12381_equals(G3V(a),G3V(b));
+}
+
+void g3_to_bytes(char *res, const g3_t *a){
+    G3 aux={G3V(a)}; // Encapsulated view of the value, no copy
+    g3ToBytes(res,&aux);
+}
@@ -5,16 +5,25 @@
 #include <../lib/Miracl_Core/ecp_BLS12381.h>
 #include <../lib/Miracl_Core/ecp2_BLS12381.h>
 #include <../lib/Miracl_Core/fp12_BLS12381.h>
+#include <values.h>
 
 
 struct ZpImpl{
     BIG_384_58 z;
 };
 
+struct ZpHashImpl{
+    hash384 h;
+};
+
 struct G1Impl{
     ECP_BLS12381 *p;
 };
 
+struct G1TableImpl{
+    ECP_BLS12381 *t; // t[j]=Sigma_{bit i of j set} [2^(i*d)]g, with d=CEIL(nbits(order),G1TABLEWIDTH)
+};
+
 struct G2Impl{
     ECP2_BLS12381 *p;
 };
@@ -27,4 +36,25 @@ struct ranGen{
     csprng  *rg;
 };
 
-#endif
\ No newline at end of file
+// Pippenger multi-scalar multiplication (g1.c, g2.c). Multipliers are recoded (Zp.c) into signed digits of c bits,
+// d_i in [-2^(c-1)+1,2^(c-1)], so each window needs 2^(c-1) buckets
+#define MSMMAXWINDOW 12
+#define MSMTHREADBREAKPOINT 64 // Fewer points are not worth starting threads
+int msmWindow(int n);   // Window size c minimizing the number of additions for n points
+int msmDigits(int c);   // Number of digits (windows) of a multiplier
+void msmSignedDigits(int16_t *d, const chunk *k, int c, int nd);
+
+// Value types (values.h) hold the Miracl structures directly
+#define ZPV(a) ((chunk *)(a)->v)
+#define G1V(a) ((ECP_BLS12381 *)(a)->v)
+#define G2V(a) ((ECP2_BLS12381 *)(a)->v)
+#define G3V(a) ((FP12_BLS12381 *)(a)->v)
+#define HASHV(a) ((hash384 *)(a)->v)
+
+_Static_assert(sizeof(BIG_384_58)<=sizeof(zp_t),"zp_t too small");
+_Static_assert(sizeof(ECP_BLS12381)<=sizeof(g1_t),"g1_t too small");
+_Static_assert(sizeof(ECP2_BLS12381)<=sizeof(g2_t),"g2_t too small");
+_Static_assert(sizeof(FP12_BLS12381)<=sizeof(g3_t),"g3_t too small");
+_Static_assert(sizeof(hash384)<=sizeof(zp_hash_t),"zp_hash_t too small");
+
+#endif
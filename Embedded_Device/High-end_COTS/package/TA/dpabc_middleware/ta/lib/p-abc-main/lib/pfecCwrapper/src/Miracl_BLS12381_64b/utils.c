@@ -1,11 +1,12 @@
 #include <utils.h>
 #include "types.h"
+#include <stdlib.h>
 
 
 
 ranGen * rgInit(const char *seed,int n){
-    ranGen * res=malloc(sizeof(ranGen));
-    res->rg=malloc(sizeof(csprng));
+    ranGen * res=pfecMalloc(sizeof(ranGen));
+    res->rg=pfecMalloc(sizeof(csprng));
     RAND_seed(res->rg,n,seed);
     return res;
 }
@@ -13,7 +14,7 @@ ranGen * rgInit(const char *seed,int n){
 
 char * rgGenBytes(ranGen * rg,int n){
     octet O;
-    char * res=malloc(n*sizeof(char));
+    char * res=pfecMalloc(n*sizeof(char));
     O.len=n;
     O.max=n;
     O.val=res;
@@ -23,6 +24,110 @@ char * rgGenBytes(ranGen * rg,int n){
 
 
 void rgFree(ranGen* rg){
-    free(rg->rg);
-    free(rg);
-}
\ No newline at end of file
+    pfecFree(rg->rg);
+    pfecFree(rg);
+}
+
+#define ARENAALIGN 16 // Alignment of arena allocations (enough for every type of the wrapper)
+
+static void *defaultAlloc(void *ctx, size_t size){
+    (void)ctx;
+    return malloc(size);
+}
+
+static void defaultRelease(void *ctx, void *ptr){
+    (void)ctx;
+    free(ptr);
+}
+
+// Per thread when the library is shared by threads that install different allocators
+// (host and TA running in the same process)
+#ifdef PFEC_THREAD_LOCAL_ALLOCATOR
+static _Thread_local pfecAllocator allocator={defaultAlloc,defaultRelease,NULL};
+#else
+static pfecAllocator allocator={defaultAlloc,defaultRelease,NULL};
+#endif
+
+void pfecSetAllocator(const pfecAllocator *a){
+    if(a==NULL){
+        allocator.alloc=defaultAlloc;
+        allocator.release=defaultRelease;
+        allocator.ctx=NULL;
+    }
+    else
+        allocator=*a;
+}
+
+void *pfecMalloc(size_t size){
+    return allocator.alloc(allocator.ctx,size);
+}
+
+void pfecFree(void *ptr){
+    if(ptr!=NULL)
+        allocator.release(allocator.ctx,ptr);
+}
+
+static void *arenaAlloc(void *ctx, size_t size){
+    pfecArena *a=ctx;
+    size_t start=(a->used+ARENAALIGN-1)&~(size_t)(ARENAALIGN-1);
+    void *res;
+    if(start>a->size || size>a->size-start){
+        res=malloc(size);
+        if(res!=NULL){
+            a->overflow+=size;
+            a->nOverflows++;
+        }
+    }
+    else{
+        res=a->buf+start;
+        a->last=a->used;
+        a->used=start+size;
+    }
+    if(a->used+a->overflow>a->highWater)
+        a->highWater=a->used+a->overflow;
+    return res;
+}
+
+static void arenaRelease(void *ctx, void *ptr){
+    pfecArena *a=ctx;
+    char *p=ptr;
+    if(p<a->buf || p>=a->buf+a->size){
+        free(ptr);  // Overflowed to malloc (or allocated before the arena was installed)
+        return;
+    }
+    // Only the most recent allocation can be given back, the rest wait for pfecArenaReset
+    if(a->last<a->used && p==a->buf+((a->last+ARENAALIGN-1)&~(size_t)(ARENAALIGN-1))){
+        a->used=a->last;
+    }
+}
+
+void pfecArenaInit(pfecArena *a, void *buf, size_t size){
+    a->buf=buf;
+    a->size=size;
+    a->used=0;
+    a->last=0;
+    a->overflow=0;
+    a->highWater=0;
+    a->nOverflows=0;
+}
+
+pfecAllocator pfecArenaAllocator(pfecArena *a){
+    pfecAllocator res={arenaAlloc,arenaRelease,a};
+    return res;
+}
+
+void pfecArenaReset(pfecArena *a){
+    a->used=0;
+    a->last=0;
+    a->overflow=0;
+}
+
+static int nthreads=PFEC_THREADS;
+
+void pfecSetThreads(int n){
+    nthreads=n<1?1:(n>PFEC_THREADS?PFEC_THREADS:n);
+}
+
+int pfecGetThreads(void){
+    return nthreads;
+}
@@ -2,6 +2,7 @@
 #include <setjmp.h>
 #include <stddef.h>
 #include <cmocka.h>
+#include <string.h>
 #include <Zp.h>
 #include <g1.h>
 
@@ -130,6 +131,59 @@ static void test_serial(void **state){
     rgFree(rng);
 }
 
+static void test_serial_compressed(void **state){
+    char * seed="Seed_test_serial_compressed_0123456789";
+    int seedLength=38;
+    ranGen * rng=rgInit(seed,seedLength);
+    Zp* z=zpRandom(rng);
+    G1* a=g1Generator();
+    G1* aNeg=g1Identity();
+    G1* id=g1Identity();
+    G1* b;
+    int nbytes=g1CompressedByteSize();
+    char *bytes1=malloc(nbytes*sizeof(char));
+    int invalid=0;
+    assert_true(nbytes<g1ByteSize());
+    g1Mul(a,z);
+    g1Sub(aNeg,a);
+    // Both signs of y
+    g1ToBytesCompressed(bytes1,a);
+    b=g1FromBytesCompressed(bytes1);
+    assert_non_null(b);
+    assert_true(g1Equals(a,b));
+    g1Free(b);
+    g1ToBytesCompressed(bytes1,aNeg);
+    b=g1FromBytesCompressed(bytes1);
+    assert_non_null(b);
+    assert_true(g1Equals(aNeg,b));
+    g1Free(b);
+    g1ToBytesCompressed(bytes1,id);
+    b=g1FromBytesCompressed(bytes1);
+    assert_true(g1IsIdentity(b));
+    g1Free(b);
+    // About half of the x coordinates are not in the curve
+    g1ToBytesCompressed(bytes1,a);
+    for(int i=0;i<64 && !invalid;i++){
+        bytes1[nbytes-1]+=1;
+        b=g1FromBytesCompressed(bytes1);
+        if(b==NULL)
+            invalid=1;
+        else{
+            assert_false(g1Equals(a,b));
+            g1Free(b);
+        }
+    }
+    assert_true(invalid);
+    bytes1[0]=0x04;
+    assert_null(g1FromBytesCompressed(bytes1));
+    free(bytes1);
+    zpFree(z);
+    g1Free(a);
+    g1Free(aNeg);
+    g1Free(id);
+    rgFree(rng);
+}
+
 static void test_muln(void **state){
     char * seed="Seed_test_muln_0123456789";
     int seedLength=25;
@@ -168,6 +222,58 @@ static void test_muln(void **state){
     rgFree(rng);
 }
 
+// Large n (Pippenger's method, with threads if available), including multipliers 0, 1 and -1 and the identity as base
+static void test_muln_large(void **state){
+    char * seed="Seed_test_muln_large_0123456789";
+    int seedLength=31;
+    ranGen * rng=rgInit(seed,seedLength);
+    int n=300;
+    G1 *res1, *res2;
+    G1 *auxG1=g1Generator();
+    Zp *auxZp=zpFromInt(0);
+    G1 **bases=malloc(n*sizeof(G1*));
+    Zp **scalars=malloc(n*sizeof(Zp*));
+    for(int i=0;i<n;i++){
+        scalars[i]=zpRandom(rng);
+        bases[i]=g1Generator();
+        zpRandomValue(rng,auxZp);
+        g1Mul(bases[i],auxZp);
+    }
+    zpFree(scalars[0]);
+    scalars[0]=zpFromInt(0);
+    zpFree(scalars[1]);
+    scalars[1]=zpFromInt(1);
+    zpFree(scalars[2]);
+    scalars[2]=zpFromInt(1);
+    zpNeg(scalars[2]);
+    g1Free(bases[3]);
+    bases[3]=g1Identity();
+    res1=g1Identity();
+    for(int i=0;i<n;i++){
+        g1CopyValue(auxG1,bases[i]); 
+        g1Mul(auxG1,scalars[i]);
+        g1Add(res1,auxG1);
+    } 
+    pfecSetThreads(1);
+    res2=g1Muln((const G1 **)bases,(const Zp **)scalars,n);
+    assert_true(g1Equals(res1,res2));
+    g1Free(res2);
+    pfecSetThreads(4); // Clamped to the PFEC_THREADS the library was built with
+    res2=g1Muln((const G1 **)bases,(const Zp **)scalars,n);
+    assert_true(g1Equals(res1,res2));
+    g1Free(res2);
+    g1Free(res1);
+    g1Free(auxG1);
+    zpFree(auxZp);
+    for(int i=0;i<n;i++){
+        g1Free(bases[i]);
+        zpFree(scalars[i]);
+    }
+    free(bases);
+    free(scalars);
+    rgFree(rng);
+}
+
 static void test_mul_lookup(void **state)
 {
     char * seed="Seed_test_mul_lookup_0123456789";
@@ -191,6 +297,68 @@ static void test_mul_lookup(void **state)
     free(lt);
 }
 
+static void test_mul_table(void **state)
+{
+    char * seed="Seed_test_mul_table_0123456789";
+    int seedLength=30;
+    ranGen * rng=rgInit(seed,seedLength);
+    int n=5;
+    G1 *res1, *res2, *auxG1;
+    G1 **bases=malloc(n*sizeof(G1*));
+    G1Table **tables=malloc(n*sizeof(G1Table*));
+    Zp **scalars=malloc(n*sizeof(Zp*));
+    char *bytes=malloc(zpByteSize());
+    for(int i=0;i<n;i++){
+        scalars[i]=zpRandom(rng);
+        bases[i]=g1Generator();
+        g1Mul(bases[i],scalars[i]);
+        tables[i]=g1TableCompute(bases[i]);
+        zpRandomValue(rng,scalars[i]);
+    }
+    //Single multiplication, including zero and a multiplier not reduced modulo the order
+    for(int i=0;i<n;i++){
+        res1=g1TableMul(tables[i],scalars[i]);
+        res2=g1Copy(bases[i]);
+        g1Mul(res2,scalars[i]);
+        assert_true(g1Equals(res1,res2));
+        g1Free(res1);
+        g1Free(res2);
+    }
+    zpFree(scalars[0]);
+    scalars[0]=zpFromInt(0);
+    res1=g1TableMul(tables[0],scalars[0]);
+    assert_true(g1IsIdentity(res1));
+    g1Free(res1);
+    zpFree(scalars[0]);
+    memset(bytes,0xff,zpByteSize());
+    scalars[0]=zpFromBytes(bytes);
+    res1=g1TableMul(tables[0],scalars[0]);
+    res2=g1Copy(bases[0]);
+    g1Mul(res2,scalars[0]);
+    assert_true(g1Equals(res1,res2));
+    g1Free(res1);
+    g1Free(res2);
+    //n-multiplication
+    res1=g1TableMuln((const G1Table **)tables,(const Zp **)scalars,n);
+    res2=g1Muln((const G1 **)bases,(const Zp **)scalars,n);
+    assert_true(g1Equals(res1,res2));
+    g1Free(res1);
+    res1=g1TableMulnVarTime((const G1Table **)tables,(const Zp **)scalars,n);
+    assert_true(g1Equals(res1,res2));
+    g1Free(res1);
+    g1Free(res2);
+    for(int i=0;i<n;i++){
+        g1Free(bases[i]);
+        g1TableFree(tables[i]);
+        zpFree(scalars[i]);
+    }
+    free(bases);
+    free(tables);
+    free(scalars);
+    free(bytes);
+    rgFree(rng);
+}
+
 int main()
 {
     const struct CMUnitTest g1tests[] =
@@ -199,8 +367,11 @@ int main()
         cmocka_unit_test(test_addition),
         cmocka_unit_test(test_multiplication),
         cmocka_unit_test(test_muln),
+        cmocka_unit_test(test_muln_large),
         cmocka_unit_test(test_serial),
-        cmocka_unit_test(test_mul_lookup)
+        cmocka_unit_test(test_serial_compressed),
+        cmocka_unit_test(test_mul_lookup),
+        cmocka_unit_test(test_mul_table)
     };
     //cmocka_set_message_output(CM_OUTPUT_XML);
 	// Define environment variable CMOCKA_XML_FILE=testresults/libc.xml 
@@ -129,6 +129,99 @@ static void test_serial(void **state){
     rgFree(rng);
 }
 
+static void test_serial_compressed(void **state){
+    char * seed="Seed_test_serial_compressed_0123456789";
+    int seedLength=38;
+    ranGen * rng=rgInit(seed,seedLength);
+    Zp* z=zpRandom(rng);
+    G2* a=g2Generator();
+    G2* aNeg=g2Identity();
+    G2* id=g2Identity();
+    G2* b;
+    int nbytes=g2CompressedByteSize();
+    char *bytes1=malloc(nbytes*sizeof(char));
+    int invalid=0;
+    assert_true(nbytes<g2ByteSize());
+    g2Mul(a,z);
+    g2Sub(aNeg,a);
+    // Both signs of y
+    g2ToBytesCompressed(bytes1,a);
+    b=g2FromBytesCompressed(bytes1);
+    assert_non_null(b);
+    assert_true(g2Equals(a,b));
+    g2Free(b);
+    g2ToBytesCompressed(bytes1,aNeg);
+    b=g2FromBytesCompressed(bytes1);
+    assert_non_null(b);
+    assert_true(g2Equals(aNeg,b));
+    g2Free(b);
+    g2ToBytesCompressed(bytes1,id);
+    b=g2FromBytesCompressed(bytes1);
+    assert_true(g2IsIdentity(b));
+    g2Free(b);
+    // About half of the x coordinates are not in the curve
+    g2ToBytesCompressed(bytes1,a);
+    for(int i=0;i<64 && !invalid;i++){
+        bytes1[nbytes-1]+=1;
+        b=g2FromBytesCompressed(bytes1);
+        if(b==NULL)
+            invalid=1;
+        else{
+            assert_false(g2Equals(a,b));
+            g2Free(b);
+        }
+    }
+    assert_true(invalid);
+    bytes1[0]=0x04;
+    assert_null(g2FromBytesCompressed(bytes1));
+    free(bytes1);
+    zpFree(z);
+    g2Free(a);
+    g2Free(aNeg);
+    g2Free(id);
+    rgFree(rng);
+}
+
+static void test_muln(void **state){
+    char * seed="Seed_test_muln_0123456789";
+    int seedLength=25;
+    ranGen * rng=rgInit(seed,seedLength);
+    int sizes[]={5,100};
+    G2 *res1, *res2;
+    G2 *auxG2=g2Generator();
+    Zp *auxZp=zpFromInt(0);
+    for(int s=0;s<2;s++){
+        int n=sizes[s];
+        G2 **bases=malloc(n*sizeof(G2*));
+        Zp **scalars=malloc(n*sizeof(Zp*));
+        for(int i=0;i<n;i++){
+            scalars[i]=zpRandom(rng);
+            bases[i]=g2Generator();
+            zpRandomValue(rng,auxZp);
+            g2Mul(bases[i],auxZp);
+        }
+        res1=g2Identity();
+        for(int i=0;i<n;i++){
+            g2CopyValue(auxG2,bases[i]); 
+            g2Mul(auxG2,scalars[i]);
+            g2Add(res1,auxG2);
+        } 
+        res2=g2Muln((const G2 **)bases,(const Zp **)scalars,n);
+        assert_true(g2Equals(res1,res2));
+        g2Free(res1);
+        g2Free(res2);
+        for(int i=0;i<n;i++){
+            g2Free(bases[i]);
+            zpFree(scalars[i]);
+        }
+        free(bases);
+        free(scalars);
+    }
+    g2Free(auxG2);
+    zpFree(auxZp);
+    rgFree(rng);
+}
+
 int main()
 {
     const struct CMUnitTest g2tests[] =
@@ -136,7 +229,9 @@ int main()
         cmocka_unit_test(test_copies),
         cmocka_unit_test(test_addition),
         cmocka_unit_test(test_multiplication),
-        cmocka_unit_test(test_serial)
+        cmocka_unit_test(test_muln),
+        cmocka_unit_test(test_serial),
+        cmocka_unit_test(test_serial_compressed)
     };
     //cmocka_set_message_output(CM_OUTPUT_XML);
 	// Define environment variable CMOCKA_XML_FILE=testresults/libc.xml 
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <cmocka.h>
 #include <pair.h>
+#include <string.h>
 
 
 //TODO Test with known result for serialized elements?
@@ -117,13 +118,74 @@ static void test_multipair(void **state)
     rgFree(rng);
 }
 
+static void test_exp_cyclotomic(void **state)
+{
+    char * seed="Seed_test_exp_cyclotomic_0123456789";
+    int seedLength=35;
+    int n=6;
+    char maxBytes[64];
+    ranGen * rng=rgInit(seed,seedLength);
+    G1* g1=g1Generator();
+    G2* g2=g2Generator();
+    Zp* exps[6];
+    G3* bases[6];
+    G3 *res1,*res2,*res3;
+    memset(maxBytes,0xff,sizeof(maxBytes));
+    exps[0]=zpRandom(rng);
+    exps[1]=zpFromInt(0);
+    exps[2]=zpFromInt(1);
+    exps[3]=zpFromInt(-1);
+    exps[4]=zpFromBytes(maxBytes); // Not reduced modulo the order
+    exps[5]=zpRandom(rng);
+    for(int i=0;i<n;i++){
+        Zp *aux=zpRandom(rng);
+        g1Mul(g1,aux);
+        bases[i]=pair(g1,g2);
+        zpFree(aux);
+    }
+    //g3ExpCyclotomic(a,b)=g3Exp(a,b), for a pairing result and a product of them
+    for(int i=0;i<n;i++){
+        res1=pair(g1,g2);
+        res2=pair(g1,g2);
+        g3Mul(res1,bases[i]);
+        g3Mul(res2,bases[i]);
+        g3Exp(res1,exps[i]);
+        g3ExpCyclotomic(res2,exps[i]);
+        assert_true(g3equals(res1,res2));
+        g3Free(res1);
+        g3Free(res2);
+    }
+    //g3MultiExp for the first k terms, including k=0
+    res3=g3One();
+    for(int k=0;k<=n;k++){
+        res1=g3MultiExp((const G3 *const *)bases,(const Zp *const *)exps,k);
+        assert_true(g3equals(res1,res3));
+        g3Free(res1);
+        if(k<n){
+            res2=g3One();
+            g3Mul(res2,bases[k]);
+            g3Exp(res2,exps[k]);
+            g3Mul(res3,res2);
+            g3Free(res2);
+        }
+    }
+    for(int i=0;i<n;i++){
+        zpFree(exps[i]);
+        g3Free(bases[i]);
+    }
+    g1Free(g1);
+    g2Free(g2);
+    g3Free(res3);
+    rgFree(rng);
+}
 
 int main()
 {
     const struct CMUnitTest pairtests[] =
     {
         cmocka_unit_test(test_pairing),
-        cmocka_unit_test(test_multipair)
+        cmocka_unit_test(test_multipair),
+        cmocka_unit_test(test_exp_cyclotomic)
     };
     //cmocka_set_message_output(CM_OUTPUT_XML);
 	// Define environment variable CMOCKA_XML_FILE=testresults/libc.xml 
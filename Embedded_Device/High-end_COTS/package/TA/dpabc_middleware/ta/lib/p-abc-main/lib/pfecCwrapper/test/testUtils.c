@@ -0,0 +1,64 @@
+#include <stdarg.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <g1.h>
+#include <utils.h>
+
+
+static void test_arena_allocator(void **state)
+{
+    char buffer[4096];
+    pfecArena arena;
+    pfecAllocator alloc;
+    char * seed="Seed_test_arena_allocator_01234";
+    int seedLength=31;
+    Zp *before=zpFromInt(7);    // Allocated with malloc, freed with the arena installed
+    pfecArenaInit(&arena,buffer,sizeof(buffer));
+    alloc=pfecArenaAllocator(&arena);
+    pfecSetAllocator(&alloc);
+    ranGen *rng=rgInit(seed,seedLength);
+    Zp *z=zpRandom(rng);
+    G1 *g=g1Generator();
+    g1Mul(g,z);
+    assert_true((char *)z>=buffer && (char *)z<buffer+sizeof(buffer));
+    assert_int_equal((size_t)z%16,0);
+    assert_int_equal(arena.nOverflows,0);
+    size_t used=arena.used;
+    // Releasing the most recent allocation gives its space back
+    char *tmp=pfecMalloc(100);
+    assert_true(arena.used>used);
+    pfecFree(tmp);
+    assert_int_equal(arena.used,used);
+    // Bigger than the buffer, served by malloc
+    tmp=pfecMalloc(2*sizeof(buffer));
+    assert_non_null(tmp);
+    assert_int_equal(arena.nOverflows,1);
+    assert_true(arena.highWater>=used+2*sizeof(buffer));
+    pfecFree(tmp);
+    zpFree(before);
+    g1Free(g);
+    zpFree(z);
+    rgFree(rng);
+    size_t highWater=arena.highWater;
+    pfecArenaReset(&arena);
+    assert_int_equal(arena.used,0);
+    assert_int_equal(arena.highWater,highWater);
+    z=zpFromInt(3);
+    assert_ptr_equal((char *)z,buffer);
+    zpFree(z);
+    pfecSetAllocator(NULL);
+    z=zpFromInt(3);
+    assert_true((char *)z<buffer || (char *)z>=buffer+sizeof(buffer));
+    zpFree(z);
+}
+
+int main()
+{
+    const struct CMUnitTest utilstests[] =
+    {
+        cmocka_unit_test(test_arena_allocator)
+    };
+    return cmocka_run_group_tests(utilstests, NULL, NULL);
+}
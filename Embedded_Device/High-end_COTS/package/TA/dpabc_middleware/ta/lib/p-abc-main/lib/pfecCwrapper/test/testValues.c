@@ -0,0 +1,202 @@
+#include <stdarg.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <pair.h>
+#include <values.h>
+
+
+static void test_zp_values(void **state)
+{
+    char * seed="Seed_test_zp_values_0123456789";
+    int seedLength=30;
+    ranGen * rng=rgInit(seed,seedLength);
+    Zp* z1=zpRandom(rng);
+    Zp* z2=zpRandom(rng);
+    Zp* aux=zpCopy(z1);
+    zp_t v1, v2, v3;
+    zp_load(&v1,z1);
+    zp_load(&v2,z2);
+    zp_add_into(&v3,&v1,&v2);
+    zpAdd(aux,z2);
+    zp_store(z1,&v3);
+    assert_true(zpEquals(z1,aux));
+    zp_sub_into(&v3,&v3,&v2);   //In place
+    zp_load(&v2,z2);
+    zp_sub_into(&v2,&v2,&v3);
+    zpSub(aux,z2);
+    zpSub(z2,aux);
+    zp_store(z1,&v2);
+    assert_true(zpEquals(z1,z2));
+    zp_mul_into(&v1,&v2,&v3);
+    zpMul(z2,aux);
+    zp_store(z1,&v1);
+    assert_true(zpEquals(z1,z2));
+    zp_neg_into(&v1,&v1);
+    zpNeg(z2);
+    zp_store(z1,&v1);
+    assert_true(zpEquals(z1,z2));
+    v2=v1;                      //Copy by assignment
+    assert_true(zp_equals(&v1,&v2));
+    zp_from_int(&v2,-3);
+    zpFree(aux);
+    aux=zpFromInt(-3);
+    zp_store(z1,&v2);
+    assert_true(zpEquals(z1,aux));
+    zpFree(z1);
+    zpFree(z2);
+    zpFree(aux);
+    rgFree(rng);
+}
+
+static void test_zp_hash_values(void **state)
+{
+    char * bytes="PrefixAbsorbedOnce|first|second|third";
+    int nbytes=38;
+    const char *chunks[]={bytes+19,bytes+25,bytes+32};
+    int sizes[]={6,7,6};
+    zp_hash_t h;
+    zp_t v;
+    Zp* z1=hashToZp(bytes,nbytes);
+    Zp* z2=zpFromInt(0);
+    zp_hash_init(&h);
+    zp_hash_process(&h,bytes,19);
+    zp_hash_result_into(&v,&h,chunks,sizes,3);
+    zp_store(z2,&v);
+    assert_true(zpEquals(z1,z2));
+    zpFree(z1);
+    zpFree(z2);
+}
+
+static void test_g1_values(void **state)
+{
+    char * seed="Seed_test_g1_values_0123456789";
+    int seedLength=30;
+    ranGen * rng=rgInit(seed,seedLength);
+    int n=15;
+    G1 **bases=malloc(n*sizeof(G1*));
+    G1Table **tables=malloc(n*sizeof(G1Table*));
+    Zp **scalars=malloc(n*sizeof(Zp*));
+    zp_t *k=malloc(n*sizeof(zp_t));
+    G1 *res, *aux;
+    g1_t v1, v2, v3;
+    for(int i=0;i<n;i++){
+        scalars[i]=zpRandom(rng);
+        bases[i]=g1Generator();
+        g1Mul(bases[i],scalars[i]);
+        tables[i]=g1TableCompute(bases[i]);
+        zpRandomValue(rng,scalars[i]);
+        zp_load(&k[i],scalars[i]);
+    }
+    //Addition and multiplication
+    g1_generator_into(&v1);
+    g1_mul_into(&v2,&v1,&k[0]);
+    res=g1Generator();
+    g1Mul(res,scalars[0]);
+    aux=g1_new(&v2);
+    assert_true(g1Equals(res,aux));
+    g1Free(aux);
+    g1_load(&v3,bases[1]);
+    g1_add_into(&v2,&v3,&v2);
+    g1Add(res,bases[1]);
+    aux=g1_new(&v2);
+    assert_true(g1Equals(res,aux));
+    g1Free(aux);
+    g1Free(res);
+    g1_identity_into(&v3);
+    assert_true(g1_is_identity(&v3));
+    g1_add_into(&v3,&v3,&v1);
+    assert_true(g1_equals(&v3,&v1));
+    //n-multiplications, below and above the naive breakpoint
+    for(int m=3;m<=n;m+=n-3){
+        res=g1Muln((const G1 **)bases,(const Zp **)scalars,m);
+        g1_muln_into(&v1,(const G1 **)bases,k,m);
+        g1_table_muln_into(&v2,(const G1Table **)tables,k,m);
+        g1_table_muln_vartime_into(&v3,(const G1Table **)tables,k,m);
+        aux=g1_new(&v1);
+        assert_true(g1Equals(res,aux));
+        assert_true(g1_equals(&v1,&v2));
+        assert_true(g1_equals(&v1,&v3));
+        g1Free(aux);
+        g1Free(res);
+    }
+    for(int i=0;i<n;i++){
+        g1Free(bases[i]);
+        g1TableFree(tables[i]);
+        zpFree(scalars[i]);
+    }
+    free(bases);
+    free(tables);
+    free(scalars);
+    free(k);
+    rgFree(rng);
+}
+
+static void test_g2_pair_values(void **state)
+{
+    char * seed="Seed_test_g2_pair_values_0123456789";
+    int seedLength=35;
+    ranGen * rng=rgInit(seed,seedLength);
+    Zp* z=zpRandom(rng);
+    zp_t k;
+    G1* a=g1Generator();
+    G2* b=hashToG2("message",7);
+    G2* aux;
+    G3 *p1, *p2;
+    g1_t va;
+    g2_t vb, vb2;
+    g3_t vp;
+    int nbytes=g3ByteSize();
+    char *bytes1=malloc(nbytes);
+    char *bytes2=malloc(nbytes);
+    zp_load(&k,z);
+    g2_hash_into(&vb,"message",7);
+    aux=g2_new(&vb);
+    assert_true(g2Equals(aux,b));
+    g2Free(aux);
+    g2_mul_into(&vb2,&vb,&k);
+    g2_add_into(&vb2,&vb2,&vb);
+    aux=g2Copy(b);
+    g2Mul(aux,z);
+    g2Add(aux,b);
+    g2_load(&vb,aux);
+    g2_to_bytes(bytes1,&vb);
+    g2_to_bytes(bytes2,&vb2);
+    assert_memory_equal(bytes1,bytes2,g2ByteSize());
+    assert_false(g2_is_identity(&vb));
+    //Pairings
+    g1_generator_into(&va);
+    p1=pair(a,aux);
+    pair_into(&vp,&va,&vb2);
+    g3ToBytes(bytes1,p1);
+    g3_to_bytes(bytes2,&vp);
+    assert_memory_equal(bytes1,bytes2,nbytes);
+    p2=doublepair(a,a,aux,b);
+    g2_load(&vb,b);
+    doublepair_into(&vp,&va,&va,&vb2,&vb);
+    g3ToBytes(bytes1,p2);
+    g3_to_bytes(bytes2,&vp);
+    assert_memory_equal(bytes1,bytes2,nbytes);
+    free(bytes1);
+    free(bytes2);
+    g1Free(a);
+    g2Free(b);
+    g2Free(aux);
+    g3Free(p1);
+    g3Free(p2);
+    zpFree(z);
+    rgFree(rng);
+}
+
+int main()
+{
+    const struct CMUnitTest valuetests[] =
+    {
+        cmocka_unit_test(test_zp_values),
+        cmocka_unit_test(test_zp_hash_values),
+        cmocka_unit_test(test_g1_values),
+        cmocka_unit_test(test_g2_pair_values)
+    };
+    return cmocka_run_group_tests(valuetests, NULL, NULL);
+}
@@ -2,6 +2,8 @@
 #include <setjmp.h>
 #include <stddef.h>
 #include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
 #include <Zp.h>
 
 
@@ -135,6 +137,55 @@ static void test_serial(void **state){
     rgFree(rng);
 }
 
+static void test_serial_compact(void **state){
+    char * seed="Seed_test_serial_compact_0123456789";
+    int seedLength=35;
+    ranGen * rng=rgInit(seed,seedLength);
+    Zp* z1=zpRandom(rng);
+    Zp* z2;
+    int nbytes=zpCompactByteSize();
+    char *bytes1=malloc(nbytes*sizeof(char));
+    assert_true(nbytes<zpByteSize());
+    zpToBytesCompact(bytes1,z1);
+    z2=zpFromBytesCompact(bytes1);
+    assert_non_null(z2);
+    assert_true(zpEquals(z1,z2));
+    zpFree(z2);
+    memset(bytes1,0xff,nbytes); // Not smaller than the order
+    assert_null(zpFromBytesCompact(bytes1));
+    free(bytes1);
+    zpFree(z1);
+    rgFree(rng);
+}
+
+static void test_incremental_hash(void **state){
+    char * bytes="PrefixAbsorbedOnce|first|second|third";
+    int nbytes=38;
+    const char *chunks[]={bytes+19,bytes+25,bytes+32};
+    int sizes[]={6,7,6};
+    Zp* z1=hashToZp(bytes,nbytes);
+    Zp* z2;
+    ZpHash* h=zpHashInit();
+    zpHashProcess(h,bytes,10);
+    zpHashProcess(h,bytes+10,9);
+    z2=zpHashResult(h,chunks,sizes,3);
+    assert_true(zpEquals(z1,z2));
+    zpFree(z2);
+    //State is not modified by zpHashResult
+    z2=zpHashResult(h,chunks,sizes,3);
+    assert_true(zpEquals(z1,z2));
+    zpFree(z2);
+    z2=zpHashResult(h,chunks,sizes,2);
+    assert_false(zpEquals(z1,z2));
+    zpFree(z2);
+    zpHashProcess(h,bytes+19,nbytes-19);
+    z2=zpHashResult(h,NULL,NULL,0);
+    assert_true(zpEquals(z1,z2));
+    zpFree(z1);
+    zpFree(z2);
+    zpHashFree(h);
+}
+
 static void test_bitops(void **state)
 {
     Zp* z1=zpFromInt(27);
@@ -165,6 +216,8 @@ int main()
         cmocka_unit_test(test_neg_sub),
         cmocka_unit_test(test_multiplication),
         cmocka_unit_test(test_serial),
+        cmocka_unit_test(test_serial_compact),
+        cmocka_unit_test(test_incremental_hash),
         cmocka_unit_test(test_bitops)
     };
     //cmocka_set_message_output(CM_OUTPUT_XML);
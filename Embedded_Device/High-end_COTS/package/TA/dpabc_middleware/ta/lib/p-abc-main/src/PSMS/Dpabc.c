@@ -4,52 +4,65 @@
 #include <pair.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#if DPABC_THREADS>1
+#include <pthread.h>
+#endif
 
 
-static int nattr=NATTRINI; // Instead we could simply put an extra argument at keyGen (as keys are always used in other methods and have the number of attributes stored)
-static ranGen *rng=NULL;
+#define BATCHEXPBYTES 8 // Size of the random exponents used in batch verification (64 bits)
+#define MAXATTR 255 // Maximum number of attributes (n is a uint8_t), bounds the stack arrays of sign/verify/present/verifyZkToken
+#define SPAWNSEEDBYTES 32 // Seed taken from a context generator for a spawned context
 //TODO Change comments to additive notation
 
-void changeNattr(int n){
-    nattr=n;
+struct dpabcContextImpl{
+    int nattr;
+    ranGen *rng;
+};
+
+dpabcContext* dpabcContextNew(int nattr, const char *seed, int seedLength){
+    dpabcContext *ctx=pfecMalloc(sizeof(dpabcContext));
+    ctx->nattr=nattr;
+    ctx->rng=rgInit(seed,seedLength);
+    return ctx;
 }
 
-void seedRng(const char* seed,int n){
-    if(rng!=NULL)
-        rgFree(rng);
-    rng=rgInit(seed,n);
+dpabcContext* dpabcContextSpawn(dpabcContext *ctx){
+    char *seed=rgGenBytes(ctx->rng,SPAWNSEEDBYTES);
+    dpabcContext *res=dpabcContextNew(ctx->nattr,seed,SPAWNSEEDBYTES);
+    pfecFree(seed);
+    return res;
 }
 
-/*void createSeed(char * seed, int length){ //TODO Crypto safe seed generation 
-    //srand(time(NULL));
-    for (int i=0;i<length;i++){
-        seed[i]=rand();
-    }
-}*/
+void dpabcContextSetNattr(dpabcContext *ctx, int n){
+    ctx->nattr=n;
+}
 
+int dpabcContextNattr(const dpabcContext *ctx){
+    return ctx->nattr;
+}
 
-void keyGen(secretKey ** sk, publicKey ** pk, char * seed, size_t seed_sz){
-    if(rng==NULL){
-        //int seedLength=128;
-        //char * newSeed=malloc(seedLength*sizeof(char));
-        //createSeed(newSeed,seedLength);
-        seedRng(seed,seed_sz);
-    }
-    //Error handling: Check random generator ready
+void dpabcContextFree(dpabcContext *ctx){
+    rgFree(ctx->rng);
+    pfecFree(ctx);
+}
+
+void keyGen(dpabcContext *ctx, secretKey ** sk, publicKey ** pk){
+    int nattr=ctx->nattr;
     secretKey * newsk;
     publicKey * newpk;
     //Generate random Zp elements for the secret key sk.
-    *sk= malloc(sizeof(secretKey)+nattr*sizeof(Zp*));
+    *sk= pfecMalloc(sizeof(secretKey)+nattr*sizeof(Zp*));
     newsk=*sk;
-    newsk->x=zpRandom(rng);
-    newsk->y_m=zpRandom(rng);
-    newsk->y_epoch=zpRandom(rng);
+    newsk->x=zpRandom(ctx->rng);
+    newsk->y_m=zpRandom(ctx->rng);
+    newsk->y_epoch=zpRandom(ctx->rng);
     newsk->n=nattr;
     for(int i=0;i<nattr;i++)
-        newsk->y[i]=zpRandom(rng);
+        newsk->y[i]=zpRandom(ctx->rng);
     //Generate the corresponding verification key through exponentiation of generator by the sk members.
-    *pk= malloc(sizeof(publicKey)+nattr*sizeof(G1*));
+    *pk= pfecMalloc(sizeof(publicKey)+nattr*sizeof(G1*));
     newpk=*pk;
     newpk->vx=g1Generator();
     g1Mul(newpk->vx,newsk->x);
@@ -65,16 +78,35 @@ void keyGen(secretKey ** sk, publicKey ** pk, char * seed, size_t seed_sz){
 }
 
 
-publicKey* keyAggr(const publicKey *pks[], int nkeys){
+//Aggregation given t<-H1(Verification keys). If the keys are prepared (ppks!=NULL), their fixed-base tables are used
+static publicKey* keyAggrHashed(const publicKey *pks[], const preparedPublicKey *ppks[], const Zp *t[], int nkeys){
     //Error handling:Check sizes match for keys
     //Error handling: Check nkeys value
     uint8_t n=pks[0]->n;
-    Zp **t=malloc(nkeys*sizeof(Zp*));
-    publicKey * avk=malloc(sizeof(publicKey)+n*sizeof(G1*));
-    G1 **auxArrayG1=malloc(nkeys*sizeof(G1*)); //Will just hold pointers so we can use the Muln method properly
-    //Generate t<-H1(Verification keys)
-    hash1(pks,nkeys,t);
+    publicKey * avk=pfecMalloc(sizeof(publicKey)+n*sizeof(G1*));
+    const G1 **auxArrayG1=pfecMalloc(nkeys*sizeof(G1*)); //Will just hold pointers so we can use the Muln method properly
+    const G1Table **auxArrayTable=pfecMalloc(nkeys*sizeof(G1Table*));
     avk->n=n;
+    if(ppks!=NULL){
+        // Hashes and keys are public, so variable time multiplications can be used
+        for(int i=0;i<nkeys;i++)
+            auxArrayTable[i]=ppks[i]->vx;
+        avk->vx=g1TableMulnVarTime(auxArrayTable,t,nkeys);
+        for(int i=0;i<nkeys;i++)
+            auxArrayTable[i]=ppks[i]->vy_epoch;
+        avk->vy_epoch=g1TableMulnVarTime(auxArrayTable,t,nkeys);
+        for(int i=0;i<nkeys;i++)
+            auxArrayTable[i]=ppks[i]->vy_m;
+        avk->vy_m=g1TableMulnVarTime(auxArrayTable,t,nkeys);
+        for(int j=0;j<n;j++){
+            for(int i=0;i<nkeys;i++)
+                auxArrayTable[i]=ppks[i]->vy[j];
+            avk->vy[j]=g1TableMulnVarTime(auxArrayTable,t,nkeys);
+        }
+        pfecFree(auxArrayG1);
+        pfecFree(auxArrayTable);
+        return avk;
+    }
     // Multiplication+exponentiation of member X of the verification keys (Getting X member of Avk).
     for(int i=0;i<nkeys;i++){
         auxArrayG1[i]=pks[i]->vx;
@@ -97,108 +129,303 @@ publicKey* keyAggr(const publicKey *pks[], int nkeys){
         }
         avk->vy[j]=g1Muln(auxArrayG1,t,nkeys);
     }
+    pfecFree(auxArrayG1);
+    pfecFree(auxArrayTable);
+    return avk;
+}
+
+publicKey* keyAggr(const publicKey *pks[], int nkeys){
+    Zp **t=pfecMalloc(nkeys*sizeof(Zp*));
+    publicKey * avk;
+    //Generate t<-H1(Verification keys)
+    hash1(pks,nkeys,t);
+    avk=keyAggrHashed(pks,NULL,(const Zp **)t,nkeys);
     for(int i=0;i<nkeys;i++)
         zpFree(t[i]);
-    free(t);
-    free(auxArrayG1);
+    pfecFree(t);
+    return avk;
+}
+
+publicKey* keyAggrPrepared(const preparedPublicKey *ppks[], int nkeys){
+    const publicKey **pks=pfecMalloc(nkeys*sizeof(publicKey*));
+    const Zp **t=pfecMalloc(nkeys*sizeof(Zp*));
+    publicKey * avk;
+    //t<-H1(Verification keys) is cached in the prepared keys
+    for(int i=0;i<nkeys;i++){
+        pks[i]=ppks[i]->pk;
+        t[i]=ppks[i]->hash;
+    }
+    avk=keyAggrHashed(pks,ppks,t,nkeys);
+    pfecFree(pks);
+    pfecFree(t);
     return avk;
 }
 
 
 signature* sign(const secretKey *sk, const Zp *epoch, const Zp *attributes[]){
     //Error handling: Check attributes/key sizes
-    signature *result=malloc(sizeof(signature));
-    Zp *exp, *aux;
+    signature *result=pfecMalloc(sizeof(signature));
+    zp_t mprime, exp, aux, y;
+    g2_t sigma1, sigma2;
     uint8_t n=sk->n;
     //Obtain (m',h) <- H0(m)
-    hash0(attributes,n,&result->mprime,&result->sigma1);
+    hash0(attributes,n,&mprime,&sigma1);
     //Generate exponent of third member of the signature sigma2
-    exp=zpCopy(sk->x);
-    aux=zpCopy(result->mprime);
-    zpMul(aux,sk->y_m);
-    zpAdd(exp,aux);
-    zpCopyValue(aux,epoch);
-    zpMul(aux,sk->y_epoch);
-    zpAdd(exp,aux);
+    zp_load(&exp,sk->x);
+    zp_load(&y,sk->y_m);
+    zp_mul_into(&aux,&mprime,&y);
+    zp_add_into(&exp,&exp,&aux);
+    zp_load(&aux,epoch);
+    zp_load(&y,sk->y_epoch);
+    zp_mul_into(&aux,&aux,&y);
+    zp_add_into(&exp,&exp,&aux);
     for(int i=0;i<n;i++){
-        zpCopyValue(aux,attributes[i]);
-        zpMul(aux,sk->y[i]);
-        zpAdd(exp,aux);
+        zp_load(&aux,attributes[i]);
+        zp_load(&y,sk->y[i]);
+        zp_mul_into(&aux,&aux,&y);
+        zp_add_into(&exp,&exp,&aux);
     }
-    result->sigma2=g2Copy(result->sigma1);
-    g2Mul(result->sigma2,exp);
-    zpFree(aux);
-    zpFree(exp);
+    g2_mul_into(&sigma2,&sigma1,&exp);
+    result->mprime=zp_new(&mprime);
+    result->sigma1=g2_new(&sigma1);
+    result->sigma2=g2_new(&sigma2);
     return result;
 }
 
-
-signature* combine(const publicKey *pks[], const signature *signs[], int nkeys){
+//Combination given t<-H1(Verification keys)
+signature* combineHashed(const signature *signs[], const Zp *t[], int nkeys){
     //Error handling: Number of signatures/keys is the same
-    //Error handling: Check same mprime/sigma1?
-    signature *result=malloc(sizeof(signature));
-    Zp **t=malloc(nkeys*sizeof(Zp*));
-    G2 *aux;
-    //Get t<-H1(Verification keys)
-    hash1(pks,nkeys,t);
+    signature *result;
+    const G2 **sigma2;
+    //Shares of the same attributes and epoch have the same mprime and sigma1
+    for(int i=1;i<nkeys;i++)
+        if(!zpEquals(signs[i]->mprime,signs[0]->mprime) || !g2Equals(signs[i]->sigma1,signs[0]->sigma1))
+            return NULL;
+    result=pfecMalloc(sizeof(signature));
+    sigma2=pfecMalloc(nkeys*sizeof(G2*));
     //Multiplication+exponentiation of sigma 2 of the signature shares.
     result->mprime=zpCopy(signs[0]->mprime);
     result->sigma1=g2Copy(signs[0]->sigma1);
-    result->sigma2=g2Copy(signs[0]->sigma2);
-    g2Mul(result->sigma2,t[0]);
-    for(int i=1;i<nkeys;i++){
-        if(i==1)
-            aux=g2Copy(signs[i]->sigma2);
-        else
-            g2CopyValue(aux,signs[i]->sigma2);
-        g2Mul(aux,t[i]);
-        g2Add(result->sigma2,aux);
-    }
+    for(int i=0;i<nkeys;i++)
+        sigma2[i]=signs[i]->sigma2;
+    result->sigma2=g2Muln(sigma2,t,nkeys);
+    pfecFree(sigma2);
+    return result;
+}
+
+signature* combine(const publicKey *pks[], const signature *signs[], int nkeys){
+    Zp **t=pfecMalloc(nkeys*sizeof(Zp*));
+    signature *result;
+    //Get t<-H1(Verification keys)
+    hash1(pks,nkeys,t);
+    result=combineHashed(signs,(const Zp **)t,nkeys);
     for(int i=0;i<nkeys;i++)
         zpFree(t[i]);
-    free(t);
-    g2Free(aux);
+    pfecFree(t);
+    return result;
+}
+
+signature* combinePrepared(const preparedPublicKey *ppks[], const signature *signs[], int nkeys){
+    const Zp **t=pfecMalloc(nkeys*sizeof(Zp*));
+    signature *result;
+    for(int i=0;i<nkeys;i++)
+        t[i]=ppks[i]->hash;
+    result=combineHashed(signs,t,nkeys);
+    pfecFree(t);
     return result;
 }
 
 
-int verify(const publicKey *pk, const signature* sign, const Zp *epoch, const Zp *attributes[]){
+//Computes X * (Y_m')^m' * (Y_epoch)^epoch * Prod (Y_i)^m_i, the element paired with sigma1 in verification.
+//With a prepared key (ppk!=NULL) the fixed-base tables are used; every input is public, so in variable time
+static void verificationElement(g1_t *el2, const publicKey *pk, const preparedPublicKey *ppk, const Zp *mprime, 
+        const Zp *epoch, const Zp *attributes[]){
+    zp_t scalars[MAXATTR+2];
+    g1_t vx;
+    zp_load(&scalars[0],mprime);
+    zp_load(&scalars[1],epoch);
+    for(int i=0;i<pk->n;i++)
+        zp_load(&scalars[2+i],attributes[i]);
+    if(ppk!=NULL){
+        const G1Table *tables[MAXATTR+2];
+        tables[0]=ppk->vy_m;
+        tables[1]=ppk->vy_epoch;
+        for(int i=0;i<pk->n;i++)
+            tables[2+i]=ppk->vy[i];
+        g1_table_muln_vartime_into(el2,tables,scalars,pk->n+2);
+    }
+    else{
+        const G1 *bases[MAXATTR];
+        g1_t aux;
+        for(int i=0;i<pk->n;i++)
+            bases[i]=pk->vy[i];
+        g1_muln_into(el2,bases,scalars+2,pk->n);
+        g1_load(&aux,pk->vy_m);
+        g1_mul_into(&aux,&aux,&scalars[0]);
+        g1_add_into(el2,el2,&aux);
+        g1_load(&aux,pk->vy_epoch);
+        g1_mul_into(&aux,&aux,&scalars[1]);
+        g1_add_into(el2,el2,&aux);
+    }
+    g1_load(&vx,pk->vx);
+    g1_add_into(el2,el2,&vx);
+}
+
+static int verifyInternal(const publicKey *pk, const preparedPublicKey *ppk, const signature* sign, const Zp *epoch, 
+        const Zp *attributes[]){
     //Error handling: Check number of attributes
-    G1 *el2, *aux, *generator;
-    G1 **auxArray=malloc(pk->n*sizeof(G1*));
-    G3 *lh, *rh;
-    int result;
+    g1_t el2, generator;
+    g2_t sigma1, sigma2;
+    g3_t lh, rh;
     //Check sigma1!=1G
     if(g2IsIdentity(sign->sigma1))
         return 0;
     //Obtain X * (Y_m')^m'* Prod (Y_i)^m_i
-    el2=g1Copy(pk->vx);
-    aux=g1Copy(pk->vy_m);
-    g1Mul(aux,sign->mprime);
-    g1Add(el2,aux);
-    g1CopyValue(aux,pk->vy_epoch);
-    g1Mul(aux,epoch);
-    g1Add(el2,aux);
-    for(int i=0;i<pk->n;i++){
-        auxArray[i]=pk->vy[i];
-    }
-    g1Free(aux);
-    aux=g1Muln(auxArray,attributes,pk->n);
-    g1Add(el2,aux);
+    verificationElement(&el2,pk,ppk,sign->mprime,epoch,attributes);
     //Check pairing condition e(sigma1, X * (Y_m')^m'* Prod (Y_i)^m_i )=e(sigma2,Group1generator)
+    g1_generator_into(&generator);
+    g2_load(&sigma1,sign->sigma1);
+    g2_load(&sigma2,sign->sigma2);
+    pair_into(&lh,&el2,&sigma1);
+    pair_into(&rh,&generator,&sigma2);
+    return g3_equals(&lh,&rh);
+}
+
+int verify(const publicKey *pk, const signature* sign, const Zp *epoch, const Zp *attributes[]){
+    return verifyInternal(pk,NULL,sign,epoch,attributes);
+}
+
+int verifyPrepared(const preparedPublicKey *ppk, const signature* sign, const Zp *epoch, const Zp *attributes[]){
+    return verifyInternal(ppk->pk,ppk,sign,epoch,attributes);
+}
+
+//Random (odd, so never zero) exponent of BATCHEXPBYTES bytes for the linear combination of batch verification
+static Zp* batchExponent(ranGen *rng){
+    int size=zpByteSize();
+    char *bytes=pfecMalloc(size*sizeof(char));
+    char *ran=rgGenBytes(rng,BATCHEXPBYTES);
+    Zp *res;
+    memset(bytes,0,size);
+    for(int i=0;i<BATCHEXPBYTES;i++)
+        bytes[size-BATCHEXPBYTES+i]=ran[i];
+    bytes[size-1]|=1;
+    res=zpFromBytes(bytes);
+    pfecFree(ran);
+    pfecFree(bytes);
+    return res;
+}
+
+//Check Prod e([delta_i]el2_i, sigma1_i) * e(-g, Sum [delta_i]sigma2_i) = 1 for the signatures in idx with a single
+//Miller loop and final exponentiation. If it fails and results are requested, bisect to locate the invalid signatures
+static int batchCheck(G1 *el2[], const signature *signs[], Zp *delta[], const int idx[], int m, int results[]){
+    const G1 **el1Pair=pfecMalloc((m+1)*sizeof(G1*));
+    const G2 **el2Pair=pfecMalloc((m+1)*sizeof(G2*));
+    G1 **scaled=pfecMalloc(m*sizeof(G1*));
+    const G2 **sigma2=pfecMalloc(m*sizeof(G2*));
+    const Zp **deltas=pfecMalloc(m*sizeof(Zp*));
+    G1 *negGenerator, *generator;
+    G2 *sum;
+    G3 *pairRes, *one;
+    int result;
+    for(int k=0;k<m;k++){
+        scaled[k]=g1Copy(el2[idx[k]]);
+        g1Mul(scaled[k],delta[idx[k]]);
+        el1Pair[k]=scaled[k];
+        el2Pair[k]=signs[idx[k]]->sigma1;
+        sigma2[k]=signs[idx[k]]->sigma2;
+        deltas[k]=delta[idx[k]];
+    }
+    sum=g2Muln(sigma2,deltas,m);
+    negGenerator=g1Identity();
     generator=g1Generator();
-    lh=pair(el2, sign->sigma1);
-    rh=pair(generator, sign->sigma2);
-    result=g3equals(lh,rh);
-    g1Free(aux);
-    g1Free(el2);
+    g1Sub(negGenerator,generator);
+    el1Pair[m]=negGenerator;
+    el2Pair[m]=sum;
+    pairRes=multipair(el1Pair,el2Pair,m+1);
+    one=g3One();
+    result=g3equals(pairRes,one);
+    for(int k=0;k<m;k++)
+        g1Free(scaled[k]);
+    pfecFree(scaled);
+    pfecFree(el1Pair);
+    pfecFree(el2Pair);
+    pfecFree(sigma2);
+    pfecFree(deltas);
+    g1Free(negGenerator);
     g1Free(generator);
-    g3Free(lh);
-    g3Free(rh);
-    free(auxArray);
+    g2Free(sum);
+    g3Free(pairRes);
+    g3Free(one);
+    if(result){
+        if(results!=NULL)
+            for(int k=0;k<m;k++)
+                results[idx[k]]=1;
+        return 1;
+    }
+    if(results==NULL)
+        return 0;
+    if(m==1){
+        results[idx[0]]=0;
+        return 0;
+    }
+    batchCheck(el2,signs,delta,idx,m/2,results);
+    batchCheck(el2,signs,delta,idx+m/2,m-m/2,results);
+    return 0;
+}
+
+static int verifyBatchInternal(dpabcContext *ctx, const publicKey *pk, const preparedPublicKey *ppk, const signature *signs[], 
+        const Zp *epochs[], const Zp **attributes[], int n, int results[]){
+    //Error handling: Check number of attributes
+    preparedPublicKey *ownPpk=NULL;
+    if(ppk==NULL && n>=PREPAREBATCHSIZE)
+        ppk=ownPpk=dpabcPkPrepare(pk);
+    G1 **el2=pfecMalloc(n*sizeof(G1*));
+    Zp **delta=pfecMalloc(n*sizeof(Zp*));
+    int *idx=pfecMalloc(n*sizeof(int));
+    g1_t aux;
+    int m=0;
+    int result=1;
+    for(int i=0;i<n;i++){
+        //Check sigma1!=1G, those signatures are rejected without entering the batch
+        if(g2IsIdentity(signs[i]->sigma1)){
+            if(results!=NULL)
+                results[i]=0;
+            result=0;
+            el2[i]=NULL;
+            delta[i]=NULL;
+            continue;
+        }
+        verificationElement(&aux,pk,ppk,signs[i]->mprime,epochs[i],attributes[i]);
+        el2[i]=g1_new(&aux);
+        delta[i]=batchExponent(ctx->rng);
+        idx[m++]=i;
+    }
+    if(m>0 && !batchCheck(el2,signs,delta,idx,m,results))
+        result=0;
+    for(int i=0;i<n;i++){
+        if(el2[i]!=NULL){
+            g1Free(el2[i]);
+            zpFree(delta[i]);
+        }
+    }
+    pfecFree(el2);
+    pfecFree(delta);
+    pfecFree(idx);
+    if(ownPpk!=NULL)
+        dpabcPreparedPkFree(ownPpk);
     return result;
 }
 
+int verifyBatch(dpabcContext *ctx, const publicKey *pk, const signature *signs[], const Zp *epochs[], const Zp **attributes[], int n,
+        int results[]){
+    return verifyBatchInternal(ctx,pk,NULL,signs,epochs,attributes,n,results);
+}
+
+int verifyBatchPrepared(dpabcContext *ctx, const preparedPublicKey *ppk, const signature *signs[], const Zp *epochs[], 
+        const Zp **attributes[], int n, int results[]){
+    return verifyBatchInternal(ctx,ppk->pk,ppk,signs,epochs,attributes,n,results);
+}
+
 void computeHidden(int hidden[],const int *indexReveal,int nIndexReveal,int n,int nhidden){
     int k,i,h;
         k=i=h=0;
@@ -213,179 +440,368 @@ void computeHidden(int hidden[],const int *indexReveal,int nIndexReveal,int n,in
             hidden[h++]=i++;
 }
 
-zkToken* presentZkToken(const publicKey * pk, const signature *sign, const Zp *epoch, const Zp *attributes[], 
-        const int indexReveal[], int nIndexReveal, const char *message, int messageSize, char * seed, size_t seed_sz){
-    if(rng==NULL){
-        //int seedLength=128;
-        //char * newSeed=malloc(seedLength*sizeof(char));
-        //createSeed(newSeed,seedLength);
-        seedRng(seed,seed_sz);
+//Message independent part of a presentation
+typedef struct {
+    g2_t sigma1;     // sigma1^r
+    g2_t sigma2;     // (sigma2*sigma1^t)^r
+    zp_t t;
+    zp_hash_t state; // Hash2 state with everything but the message absorbed
+} presentCommitment;
+
+struct presentationPoolImpl{
+    int count;               // Commitments left
+    int nhidden;
+    zp_t mprime;
+    zp_t *hiddenAttr;        // Hidden attributes, in ascendent order of their indexes
+    presentCommitment *com;
+    zp_t *rand;              // Blinding exponents, nhidden+2 per commitment
+};
+
+//Randomizes the signature, draws the blinding exponents rand (for t, m' and the hidden attributes) and computes the 
+//pairing e([rand_0]g+[rand_1]Y_m'+Sum [rand_2+j]Y_hidden_j, sigma1^r). None of it depends on the message
+static void presentCommit(dpabcContext *ctx, const publicKey * pk, const preparedPublicKey *ppk, const signature *sign, 
+        const int hidden[], int nhidden, presentCommitment *com, zp_t rand[]){
+    zp_t r;
+    g1_t auxG1, aux2G1;
+    g2_t auxG2;
+    g3_t pairRes;
+    zp_hash_t prefix;
+    const zp_hash_t *pkPrefix;
+    //Generate random Zp elements and sigma1', sigma2'
+    zp_random_into(&r,ctx->rng);
+    zp_random_into(&com->t,ctx->rng);
+    g2_load(&auxG2,sign->sigma1);
+    g2_mul_into(&com->sigma1,&auxG2,&r); //sigma1^r
+    g2_mul_into(&auxG2,&auxG2,&com->t); //(sigma2*sigma1^t)^r
+    g2_load(&com->sigma2,sign->sigma2);
+    g2_add_into(&com->sigma2,&com->sigma2,&auxG2);
+    g2_mul_into(&com->sigma2,&com->sigma2,&r);
+    //Generate random exponents for t, m' and hidden attributes
+    for(int j=0;j<nhidden+2;j++)
+        zp_random_into(&rand[j],ctx->rng);
+    if(ppk!=NULL){
+        //Random exponents are secret, so constant time multiplication with the fixed-base tables
+        const G1Table *tables[MAXATTR+2];
+        tables[0]=ppk->gen;
+        tables[1]=ppk->vy_m;
+        for(int j=0;j<nhidden;j++)
+            tables[2+j]=ppk->vy[hidden[j]];
+        g1_table_muln_into(&auxG1,tables,rand,nhidden+2);
+        pkPrefix=&ppk->hash2;
+    }
+    else{
+        const G1 *bases[MAXATTR+1];
+        g1_generator_into(&aux2G1);
+        g1_mul_into(&auxG1,&aux2G1,&rand[0]);
+        bases[0]=pk->vy_m;
+        for(int j=0;j<nhidden;j++)
+            bases[1+j]=pk->vy[hidden[j]];
+        g1_muln_into(&aux2G1,bases,rand+1,nhidden+1);
+        g1_add_into(&auxG1,&auxG1,&aux2G1);
+        hash2Prefix(pk,&prefix);
+        pkPrefix=&prefix;
     }
-    //Error handling: Check random generator ready
+    pair_into(&pairRes,&auxG1,&com->sigma1);
+    hash2Commit(pkPrefix,&com->sigma1,&com->sigma2,&pairRes,&com->state);
+}
+
+//Token for a message from a commitment: c=Hash2(...,message) and v_i=rand_i-c*i for t, m' and the hidden attributes
+static zkToken* presentRespond(const presentCommitment *com, const zp_t rand[], const zp_t *mprime, const zp_t hiddenAttr[],
+        int nhidden, const char *message, int messageSize){
+    zp_t c, aux, v;
+    zkToken  *token=pfecMalloc(sizeof(zkToken)+nhidden*sizeof(Zp*));
+    token->n=nhidden;
+    hash2Message(message,messageSize,&com->state,&c);
+    zp_mul_into(&aux,&c,&com->t);
+    zp_sub_into(&v,&rand[0],&aux);
+    token->v_t=zp_new(&v);
+    zp_mul_into(&aux,&c,mprime);
+    zp_sub_into(&v,&rand[1],&aux);
+    token->v_mprime=zp_new(&v);
+    for(int j=0;j<nhidden;j++){
+        zp_mul_into(&aux,&c,&hiddenAttr[j]);
+        zp_sub_into(&v,&rand[2+j],&aux);
+        token->v_mj[j]=zp_new(&v);
+    }
+    token->sigma1=g2_new(&com->sigma1);
+    token->sigma2=g2_new(&com->sigma2);
+    token->c=zp_new(&c);
+    return token;
+}
+
+static zkToken* presentZkTokenInternal(dpabcContext *ctx, const publicKey * pk, const preparedPublicKey *ppk, 
+        const signature *sign, const Zp *epoch, const Zp *attributes[], const int indexReveal[], int nIndexReveal, 
+        const char *message, int messageSize){
     //Error handling: Check number of attributes
     //Error handling: Consistent and ordered revealed attributes
-    Zp *r,*t, *auxZp;
     int nhidden=pk->n-nIndexReveal;
-    G2 *auxG2;
-    G1 *auxG1, *aux2G1;
-    G1** auxArray;
-    if(nhidden>0)
-        auxArray=malloc(nhidden*sizeof(G1*));
-    G3 *pairRes;
-    zkToken  *token=malloc(sizeof(zkToken)+nhidden*sizeof(Zp*));
-    token->n=nhidden;
+    int hidden[MAXATTR];
+    zp_t rand[MAXATTR+2]; //Random exponents for t, m' and hidden attributes
+    zp_t mprime, hiddenAttr[MAXATTR];
+    presentCommitment com;
+    zkToken *token;
     //Hidden attributes
-    int *hidden;
-    if(nhidden>0){
-        hidden=malloc(nhidden*sizeof(int));
-        computeHidden(hidden,indexReveal,nIndexReveal,pk->n,nhidden);
-    }
-    //Generate random Zp elements and sigma1', sigma2'
-    r=zpRandom(rng);
-    t=zpRandom(rng);
-    token->sigma1=g2Copy(sign->sigma1); //sigma1^r
-    g2Mul(token->sigma1,r);
-    token->sigma2=g2Copy(sign->sigma2); //(sigma2*sigma1^t)^r
-    auxG2=g2Copy(sign->sigma1);
-    g2Mul(auxG2,t);
-    g2Add(token->sigma2,auxG2);
-    g2Mul(token->sigma2,r);
-    //Generate random exponents for t, m' and hidden attributes
-    token->v_t=zpRandom(rng);
-    token->v_mprime=zpRandom(rng);
+    computeHidden(hidden,indexReveal,nIndexReveal,pk->n,nhidden);
+    presentCommit(ctx,pk,ppk,sign,hidden,nhidden,&com,rand);
+    zp_load(&mprime,sign->mprime);
     for(int j=0;j<nhidden;j++)
-        token->v_mj[j]=zpRandom(rng);
-    //Calculate c
-    auxG1=g1Generator();
-    g1Mul(auxG1,token->v_t);
-    aux2G1=g1Copy(pk->vy_m);
-    g1Mul(aux2G1,token->v_mprime);
-    g1Add(auxG1,aux2G1);
-    if(nhidden>0){
-        for(int j=0;j<nhidden;j++){
-            auxArray[j]=pk->vy[hidden[j]];
-        }
-        g1Free(aux2G1);
-        aux2G1=g1Muln(auxArray,token->v_mj,nhidden);
-        g1Add(auxG1,aux2G1);
-    }
-    pairRes=pair(auxG1,token->sigma1);
-    hash2(message,messageSize,pk,token->sigma1,token->sigma2,pairRes, &token->c); 
-    //Calculate v_i= ran_i - c * i
-    auxZp=zpCopy(token->c);
-    zpMul(auxZp,t);
-    zpSub(token->v_t,auxZp);
-    zpCopyValue(auxZp,token->c);
-    zpMul(auxZp,sign->mprime);
-    zpSub(token->v_mprime,auxZp);
-    for(int j=0;j<nhidden;j++){
-        zpCopyValue(auxZp,token->c); 
-        zpMul(auxZp,attributes[hidden[j]]);
-        zpSub(token->v_mj[j],auxZp);
-    }
-    zpFree(t);
-    zpFree(r);
-    zpFree(auxZp);
-    g1Free(auxG1);
-    g2Free(auxG2); 
-    g1Free(aux2G1);
-    g3Free(pairRes);
-    if(nhidden>0){
-        free(hidden);
-        free(auxArray);
+        zp_load(&hiddenAttr[j],attributes[hidden[j]]);
+    token=presentRespond(&com,rand,&mprime,hiddenAttr,nhidden,message,messageSize);
+    memset(rand,0,(nhidden+2)*sizeof(zp_t));
+    return token;
+}
+
+zkToken* presentZkToken(dpabcContext *ctx, const publicKey * pk, const signature *sign, const Zp *epoch, const Zp *attributes[], 
+        const int indexReveal[], int nIndexReveal, const char *message, int messageSize){
+    return presentZkTokenInternal(ctx,pk,NULL,sign,epoch,attributes,indexReveal,nIndexReveal,message,messageSize);
+}
+
+zkToken* presentZkTokenPrepared(dpabcContext *ctx, const preparedPublicKey * ppk, const signature *sign, const Zp *epoch, 
+        const Zp *attributes[], const int indexReveal[], int nIndexReveal, const char *message, int messageSize){
+    return presentZkTokenInternal(ctx,ppk->pk,ppk,sign,epoch,attributes,indexReveal,nIndexReveal,message,messageSize);
+}
+
+static presentationPool* presentPrecomputeInternal(dpabcContext *ctx, const publicKey * pk, const preparedPublicKey *ppk, 
+        const signature *sign, const Zp *attributes[], const int indexReveal[], int nIndexReveal, int count){
+    //Error handling: Consistent and ordered revealed attributes
+    int nhidden=pk->n-nIndexReveal;
+    int hidden[MAXATTR];
+    presentationPool *pool;
+    if(count<=0 || (size_t)count>SIZE_MAX/sizeof(presentCommitment) || (size_t)count>SIZE_MAX/((nhidden+2)*sizeof(zp_t)))
+        return NULL;
+    pool=pfecMalloc(sizeof(presentationPool));
+    if(pool==NULL)
+        return NULL;
+    computeHidden(hidden,indexReveal,nIndexReveal,pk->n,nhidden);
+    pool->count=count;
+    pool->nhidden=nhidden;
+    pool->hiddenAttr=pfecMalloc(nhidden*sizeof(zp_t));
+    pool->com=pfecMalloc(count*sizeof(presentCommitment));
+    pool->rand=pfecMalloc(count*(nhidden+2)*sizeof(zp_t));
+    if((nhidden>0 && pool->hiddenAttr==NULL) || pool->com==NULL || pool->rand==NULL){
+        pfecFree(pool->hiddenAttr);
+        pfecFree(pool->com);
+        pfecFree(pool->rand);
+        pfecFree(pool);
+        return NULL;
     }
+    zp_load(&pool->mprime,sign->mprime);
+    for(int j=0;j<nhidden;j++)
+        zp_load(&pool->hiddenAttr[j],attributes[hidden[j]]);
+    for(int i=0;i<count;i++)
+        presentCommit(ctx,pk,ppk,sign,hidden,nhidden,&pool->com[i],pool->rand+i*(nhidden+2));
+    return pool;
+}
+
+presentationPool* dpabcPresentPrecompute(dpabcContext *ctx, const publicKey * pk, const signature *sign, const Zp *attributes[], 
+        const int indexReveal[], int nIndexReveal, int count){
+    return presentPrecomputeInternal(ctx,pk,NULL,sign,attributes,indexReveal,nIndexReveal,count);
+}
+
+presentationPool* dpabcPresentPrecomputePrepared(dpabcContext *ctx, const preparedPublicKey * ppk, const signature *sign, 
+        const Zp *attributes[], const int indexReveal[], int nIndexReveal, int count){
+    return presentPrecomputeInternal(ctx,ppk->pk,ppk,sign,attributes,indexReveal,nIndexReveal,count);
+}
+
+int dpabcPresentPoolSize(const presentationPool *pool){
+    return pool->count;
+}
+
+int dpabcPresentPoolHidden(const presentationPool *pool){
+    return pool->nhidden;
+}
+
+zkToken* presentZkTokenOnline(presentationPool *pool, const char *message, int messageSize){
+    zkToken *token;
+    zp_t *rand;
+    if(pool->count==0)
+        return NULL;
+    pool->count--;
+    rand=pool->rand+pool->count*(pool->nhidden+2);
+    token=presentRespond(&pool->com[pool->count],rand,&pool->mprime,pool->hiddenAttr,pool->nhidden,message,messageSize);
+    //A commitment answered twice would reveal the hidden attributes
+    memset(&pool->com[pool->count],0,sizeof(presentCommitment));
+    memset(rand,0,(pool->nhidden+2)*sizeof(zp_t));
     return token;
 }
 
-int verifyZkToken(const zkToken *token, const publicKey * pk, const Zp *epoch, const Zp *revealed[],
-        const int indexReveal[], int nReveal, const char *message, int messageSize){
+void dpabcPresentPoolFree(presentationPool *pool){
+    memset(pool->hiddenAttr,0,pool->nhidden*sizeof(zp_t));
+    memset(pool->com,0,pool->count*sizeof(presentCommitment));
+    memset(pool->rand,0,pool->count*(pool->nhidden+2)*sizeof(zp_t));
+    memset(&pool->mprime,0,sizeof(zp_t));
+    pfecFree(pool->hiddenAttr);
+    pfecFree(pool->com);
+    pfecFree(pool->rand);
+    pfecFree(pool);
+}
+
+//Verification of a token. All the G1 work goes into a single n-multiplication over the public key bases (plus [v_t]g
+//without a prepared key), and [c]g is 
+//moved to the G1 side of the pairing (e(g,[c]sigma2)=e([c]g,sigma2)). With a prepared key (ppk!=NULL) both use the 
+//fixed-base tables; every input is public, so in variable time
+static int zkTokenCheck(const zkToken *token, const publicKey * pk, const preparedPublicKey *ppk, const Zp *epoch, 
+        const Zp *revealed[], const int indexReveal[], int nReveal, const char *message, int messageSize){
     //Error handling: Consistent and ordered revealed/hidden/total attributes
     if(token->n+nReveal!=pk->n)
         return 0;
-    G1 *auxEl, *auxG1;
-    G2 *auxG2;
-    Zp *auxZp, *aux2Zp;
-    G1** auxArray;
-    int *hidden;
-    if(token->n>0) 
-        auxArray=malloc(token->n*sizeof(G1*));
-    //G1 *el1Pair[2];
-    //G2 *el2Pair[2];
-    G3 *pairRes;
-    int result;
     if(g2IsIdentity(token->sigma1) || g2IsIdentity(token->sigma2))
         return 0;
-    //Compute hidden
-    if(token->n>0){
-        hidden=malloc(token->n*sizeof(int));
-        computeHidden(hidden,indexReveal,nReveal,pk->n,token->n);
-    } 
-    //Compute the necessary pairings/operations
-    auxEl=g1Generator();
-    g1Mul(auxEl,token->v_t);
-    auxG1=g1Copy(pk->vy_m);
-    g1Mul(auxG1,token->v_mprime);
-    g1Add(auxEl,auxG1);
-    g1CopyValue(auxG1,pk->vx);
-    g1InvMul(auxG1,token->c);
-    g1Add(auxEl,auxG1);
-    g1CopyValue(auxG1,pk->vy_epoch);
-    auxZp=zpCopy(token->c);
-    zpMul(auxZp,epoch);
-    g1InvMul(auxG1,auxZp);
-    g1Add(auxEl,auxG1);
-    if(token->n>0){
-        for (int j=0;j<token->n;j++){
-            auxArray[j]=pk->vy[hidden[j]];
+    int nbases=pk->n+4;
+    zp_t scalars[MAXATTR+4];
+    zp_t c, tokenC, aux;
+    g1_t auxEl, cGen, generator;
+    g2_t sigma1, sigma2;
+    g3_t pairRes;
+    zp_hash_t prefix;
+    const zp_hash_t *pkPrefix;
+    int h, k;
+    //v_t*g + v_m'*Y_m' - c*X - c*epoch*Y_epoch + Sum_hidden v_mj*Y_j - Sum_revealed c*m_j*Y_j
+    zp_load(&tokenC,token->c);
+    zp_load(&scalars[0],token->v_t);
+    zp_load(&scalars[1],token->v_mprime);
+    zp_neg_into(&scalars[2],&tokenC);
+    zp_load(&aux,epoch);
+    zp_mul_into(&scalars[3],&scalars[2],&aux);
+    h=k=0;
+    for(int j=0;j<pk->n;j++){
+        if(k<nReveal && indexReveal[k]==j){
+            zp_load(&aux,revealed[k++]);
+            zp_mul_into(&scalars[4+j],&scalars[2],&aux);
         }
-        g1Free(auxG1);
-        auxG1=g1Muln(auxArray,token->v_mj,token->n);
-        g1Add(auxEl,auxG1);
+        else
+            zp_load(&scalars[4+j],token->v_mj[h++]);
     }
-    for (int j=0;j<nReveal;j++){
-        g1CopyValue(auxG1,pk->vy[indexReveal[j]]);      //TODO join into one n-multiplication
-        zpCopyValue(auxZp,token->c);
-        zpMul(auxZp,revealed[j]);
-        g1InvMul(auxG1,auxZp);
-        g1Add(auxEl,auxG1);
+    if(ppk!=NULL){
+        const G1Table *tables[MAXATTR+4];
+        tables[0]=ppk->gen;
+        tables[1]=ppk->vy_m;
+        tables[2]=ppk->vx;
+        tables[3]=ppk->vy_epoch;
+        for(int j=0;j<pk->n;j++)
+            tables[4+j]=ppk->vy[j];
+        g1_table_muln_vartime_into(&auxEl,tables,scalars,nbases);
+        g1_table_muln_vartime_into(&cGen,tables,&tokenC,1);
+        pkPrefix=&ppk->hash2;
     }
-    auxG2=g2Copy(token->sigma2);
-    g2Mul(auxG2,token->c);
-    g1Free(auxG1);
-    auxG1=g1Generator(); 
-    /* Using multiPair method
-    el1Pair[0]=auxEl;
-    el1Pair[1]=auxG1;
-    el2Pair[0]=token->sigma1;
-    el2Pair[1]=auxG2;
-    pairRes=multipair(el1Pair,el2Pair,2);
-    */
-    pairRes=doublepair(auxEl,auxG1,token->sigma1,auxG2); //Using doublePair method
-    hash2(message,messageSize,pk,token->sigma1,token->sigma2,pairRes,&aux2Zp);
-    result=zpEquals(token->c,aux2Zp);
-    zpFree(auxZp);
-    zpFree(aux2Zp);
-    g1Free(auxG1);
-    g1Free(auxEl);
-    g2Free(auxG2);
-    g3Free(pairRes);
-    if(token->n>0){
-        free(hidden);
-        free(auxArray);
+    else{
+        const G1 *bases[MAXATTR+3];
+        bases[0]=pk->vy_m;
+        bases[1]=pk->vx;
+        bases[2]=pk->vy_epoch;
+        for(int j=0;j<pk->n;j++)
+            bases[3+j]=pk->vy[j];
+        g1_muln_into(&auxEl,bases,scalars+1,nbases-1);
+        g1_generator_into(&generator);
+        g1_mul_into(&cGen,&generator,&scalars[0]);
+        g1_add_into(&auxEl,&auxEl,&cGen);
+        g1_mul_into(&cGen,&generator,&tokenC);
+        hash2Prefix(pk,&prefix);
+        pkPrefix=&prefix;
     }
-    return result;
+    g2_load(&sigma1,token->sigma1);
+    g2_load(&sigma2,token->sigma2);
+    doublepair_into(&pairRes,&auxEl,&cGen,&sigma1,&sigma2);
+    hash2(message,messageSize,pkPrefix,&sigma1,&sigma2,&pairRes,&c);
+    return zp_equals(&tokenC,&c);
+}
+
+int verifyZkToken(const zkToken *token, const publicKey * pk, const Zp *epoch, const Zp *revealed[],
+        const int indexReveal[], int nReveal, const char *message, int messageSize){
+    return zkTokenCheck(token,pk,NULL,epoch,revealed,indexReveal,nReveal,message,messageSize);
 }
 
+int verifyZkTokenPrepared(const zkToken *token, const preparedPublicKey * ppk, const Zp *epoch, const Zp *revealed[],
+        const int indexReveal[], int nReveal, const char *message, int messageSize){
+    return zkTokenCheck(token,ppk->pk,ppk,epoch,revealed,indexReveal,nReveal,message,messageSize);
+}
 
+typedef struct {
+    const zkToken **tokens;
+    const publicKey *pk;
+    const Zp **epochs;
+    const Zp ***revealed;
+    const int **indexReveal;
+    const int *nReveal;
+    const char **messages;
+    const int *messageSizes;
+    int ntokens;
+    const preparedPublicKey *ppk;
+    int *results;
+    int first;
+    int step;
+} zkTokenBatchJob;
 
+static void *zkTokenBatchWorker(void *arg){
+    zkTokenBatchJob *job=arg;
+    for(int i=job->first;i<job->ntokens;i+=job->step){
+        job->results[i]=zkTokenCheck(job->tokens[i],job->pk,job->ppk,job->epochs[i],job->revealed[i],job->indexReveal[i],
+            job->nReveal[i],job->messages[i],job->messageSizes[i]);
+    }
+    return NULL;
+}
 
-void dpabcFreeStateData(){
-    if(rng!=NULL){
-        rgFree(rng);
-        rng=NULL;
+static int verifyZkTokenBatchInternal(const zkToken *tokens[], const publicKey * pk, const preparedPublicKey *ppk, 
+        const Zp *epochs[], const Zp **revealed[], const int *indexReveal[], const int nReveal[], const char *messages[], 
+        const int messageSizes[], int ntokens, uint8_t bitmap[]){
+    //Error handling: Consistent and ordered revealed/hidden/total attributes
+    preparedPublicKey *ownPpk=NULL;
+    if(ppk==NULL && ntokens>=PREPAREBATCHSIZE)
+        ppk=ownPpk=dpabcPkPrepare(pk);
+    int *results=pfecMalloc(ntokens*sizeof(int));
+    int result=1;
+    zkTokenBatchJob job={tokens,pk,epochs,revealed,indexReveal,nReveal,messages,messageSizes,ntokens,ppk,results,0,1};
+#if DPABC_THREADS>1
+    int nthreads=DPABC_THREADS<ntokens?DPABC_THREADS:ntokens;
+    if(nthreads>1){
+        pthread_t threads[DPABC_THREADS];
+        int started[DPABC_THREADS];
+        zkTokenBatchJob jobs[DPABC_THREADS];
+        for(int t=0;t<nthreads;t++){
+            jobs[t]=job;
+            jobs[t].first=t;
+            jobs[t].step=nthreads;
+        }
+        for(int t=1;t<nthreads;t++){
+            started[t]=pthread_create(&threads[t],NULL,zkTokenBatchWorker,&jobs[t])==0;
+            if(!started[t])
+                zkTokenBatchWorker(&jobs[t]);
+        }
+        zkTokenBatchWorker(&jobs[0]);
+        for(int t=1;t<nthreads;t++){
+            if(started[t])
+                pthread_join(threads[t],NULL);
+        }
     }
+    else
+#endif
+        zkTokenBatchWorker(&job);
+    memset(bitmap,0,DPABC_BITMAP_SIZE(ntokens));
+    for(int i=0;i<ntokens;i++){
+        if(results[i])
+            bitmap[i/8]|=1<<(i%8);
+        else
+            result=0;
+    }
+    pfecFree(results);
+    if(ownPpk!=NULL)
+        dpabcPreparedPkFree(ownPpk);
+    return result;
+}
+
+int verifyZkTokenBatch(const zkToken *tokens[], const publicKey * pk, const Zp *epochs[], const Zp **revealed[],
+        const int *indexReveal[], const int nReveal[], const char *messages[], const int messageSizes[], int ntokens, uint8_t bitmap[]){
+    return verifyZkTokenBatchInternal(tokens,pk,NULL,epochs,revealed,indexReveal,nReveal,messages,messageSizes,ntokens,bitmap);
 }
 
+int verifyZkTokenBatchPrepared(const zkToken *tokens[], const preparedPublicKey * ppk, const Zp *epochs[], const Zp **revealed[],
+        const int *indexReveal[], const int nReveal[], const char *messages[], const int messageSizes[], int ntokens, uint8_t bitmap[]){
+    return verifyZkTokenBatchInternal(tokens,ppk->pk,ppk,epochs,revealed,indexReveal,nReveal,messages,messageSizes,ntokens,
+        bitmap);
+}
+
+
+
 
 
 
@@ -1,10 +1,11 @@
 #include <Dpabc_types.h>
 #include "types_impl.h"
+#include "Dpabc_utils.h"
 #include <stdlib.h>
 
 
 publicKey *dpabcSkToPk(const secretKey *sk){
-    publicKey* res= malloc(sizeof(publicKey)+sk->n*sizeof(G1*));
+    publicKey* res= pfecMalloc(sizeof(publicKey)+sk->n*sizeof(G1*));
     res->vx=g1Generator();
     g1Mul(res->vx,sk->x);
     res->vy_m=g1Generator();
@@ -25,11 +26,15 @@ void dpabcPkFree(publicKey *pk){
     g1Free(pk->vy_m);
     for(int i=0;i<pk->n;i++)
         g1Free(pk->vy[i]);
-    free(pk);
+    pfecFree(pk);
 }
 
 int dpabcPkByteSize(const publicKey *pk){
-    return g1ByteSize()*(pk->n+3)+1; // +1 for array size (uint8)
+    return dpabcPkByteSizeForN(pk->n);
+}
+
+int dpabcPkByteSizeForN(int n){
+    return g1ByteSize()*(n+3)+1; // +1 for array size (uint8)
 }
 
 void dpabcPkToBytes(char *res, const publicKey *pk){
@@ -53,7 +58,7 @@ publicKey * dpabcPkFromBytes(const char *bytes){
     int g1Bytes=g1ByteSize();
     char * aux=bytes;
     uint8_t n=bytes[0];
-    publicKey *res= malloc(sizeof(publicKey)+n*sizeof(G1*));
+    publicKey *res= pfecMalloc(sizeof(publicKey)+n*sizeof(G1*));
     res->n=n;
     aux=aux+1;
     res->vx=g1FromBytes(aux);
@@ -69,6 +74,41 @@ publicKey * dpabcPkFromBytes(const char *bytes){
     return res;
 }
 
+preparedPublicKey *dpabcPkPrepare(const publicKey *pk){
+    preparedPublicKey *res=pfecMalloc(sizeof(preparedPublicKey)+pk->n*sizeof(G1Table*));
+    G1 *generator=g1Generator();
+    res->pk=pk;
+    res->gen=g1TableCompute(generator);
+    res->vx=g1TableCompute(pk->vx);
+    res->vy_m=g1TableCompute(pk->vy_m);
+    res->vy_epoch=g1TableCompute(pk->vy_epoch);
+    for(int i=0;i<pk->n;i++)
+        res->vy[i]=g1TableCompute(pk->vy[i]);
+    res->hash=hashPk(pk);
+    hash2Prefix(pk,&res->hash2);
+    res->nbytes=dpabcPkByteSize(pk);
+    res->bytes=pfecMalloc(res->nbytes);
+    dpabcPkToBytes(res->bytes,pk);
+    g1Free(generator);
+    return res;
+}
+
+Zp *dpabcPkHash(const publicKey *pk){
+    return hashPk(pk);
+}
+
+void dpabcPreparedPkFree(preparedPublicKey *ppk){
+    g1TableFree(ppk->gen);
+    g1TableFree(ppk->vx);
+    g1TableFree(ppk->vy_m);
+    g1TableFree(ppk->vy_epoch);
+    for(int i=0;i<ppk->pk->n;i++)
+        g1TableFree(ppk->vy[i]);
+    zpFree(ppk->hash);
+    pfecFree(ppk->bytes);
+    pfecFree(ppk);
+}
+
 int dpabcPkEquals(const publicKey *pk1, const publicKey *pk2){
     if(pk1->n!=pk2->n)
         return 0;
@@ -86,7 +126,7 @@ void dpabcSkFree(secretKey *sk){
     zpFree(sk->y_m);
     for(int i=0;i<sk->n;i++)
         zpFree(sk->y[i]);
-    free(sk);
+    pfecFree(sk);
 }
 
 
@@ -118,7 +158,7 @@ secretKey * dpabcSkFromBytes(const char *bytes){
     int zpBytes=zpByteSize();
     char * aux=bytes;
     uint8_t n=bytes[0];
-    secretKey *res= malloc(sizeof(secretKey)+n*sizeof(Zp*));
+    secretKey *res= pfecMalloc(sizeof(secretKey)+n*sizeof(Zp*));
     res->n=n;
     aux=aux+1;
     res->x=zpFromBytes(aux);
@@ -138,7 +178,7 @@ void dpabcSignFree(signature *sign){
     zpFree(sign->mprime);
     g2Free(sign->sigma1);
     g2Free(sign->sigma2);
-    free(sign);
+    pfecFree(sign);
 }
 
 int dpabcSignByteSize(){
@@ -158,7 +198,7 @@ void dpabcSignToBytes(char *res, const signature *sig){
 signature * dpabcSignFromBytes(const char *bytes){
     int g2bytes=g2ByteSize();
     char *aux=bytes;
-    signature *res=malloc(sizeof(signature));
+    signature *res=pfecMalloc(sizeof(signature));
     res->sigma1=g2FromBytes(aux);
     aux=aux+g2bytes;
     res->sigma2=g2FromBytes(aux);
@@ -175,13 +215,16 @@ void dpabcZkFree(zkToken *zk){
     zpFree(zk->v_mprime);
     for(int i=0;i<zk->n;i++)
         zpFree(zk->v_mj[i]);
-    free(zk);
+    pfecFree(zk);
 }
 
 
 int dpabcZkByteSize(zkToken *zk){
-    return 2*g2ByteSize()+(3+zk->n)*zpByteSize()+1;
+    return dpabcZkByteSizeForN(zk->n);
+}
 
+int dpabcZkByteSizeForN(int nHidden){
+    return 2*g2ByteSize()+(3+nHidden)*zpByteSize()+1;
 }
 
 void dpabcZkToBytes(char *res, const zkToken *zk){
@@ -211,7 +254,7 @@ zkToken * dpabcZkFromBytes(const char *bytes){
     int zpBytes=zpByteSize();
     char *aux=bytes;
     uint8_t n=bytes[0];
-    zkToken * res=malloc(sizeof(zkToken)+sizeof(Zp*[n]));
+    zkToken * res=pfecMalloc(sizeof(zkToken)+sizeof(Zp*[n]));
     res->n=n;
     aux=aux+1;
     res->sigma1=g2FromBytes(aux);
@@ -229,4 +272,196 @@ zkToken * dpabcZkFromBytes(const char *bytes){
         aux=aux+zpBytes;
     }
     return res;
-}
\ No newline at end of file
+}
+// Compact wire format (DPABC_COMPACT_*)
+
+static char *compactHeader(char *res, int type, int payload){
+    res[0]=DPABC_COMPACT_VERSION;
+    res[1]=type;
+    for(int i=0;i<4;i++)
+        res[2+i]=(payload>>(8*(3-i)))&0xff;
+    return res+DPABC_COMPACT_HEADER_SIZE;
+}
+
+// Payload of bytes (and its length) if the header has the current version, the type and the length of the array
+static const char *compactPayload(const char *bytes, int nbytes, int type, int *payload){
+    const uint8_t *b=(const uint8_t *)bytes;
+    uint32_t len;
+    if(nbytes<DPABC_COMPACT_HEADER_SIZE+1 || b[0]!=DPABC_COMPACT_VERSION || b[1]!=type)
+        return NULL;
+    len=((uint32_t)b[2]<<24)|((uint32_t)b[3]<<16)|((uint32_t)b[4]<<8)|b[5];
+    if(len!=(uint32_t)(nbytes-DPABC_COMPACT_HEADER_SIZE))
+        return NULL;
+    *payload=len;
+    return bytes+DPABC_COMPACT_HEADER_SIZE;
+}
+
+int dpabcPkByteSizeCompact(const publicKey *pk){
+    return DPABC_COMPACT_HEADER_SIZE+1+g1CompressedByteSize()*(pk->n+3);
+}
+
+void dpabcPkToBytesCompact(char *res, const publicKey *pk){
+    int g1Bytes=g1CompressedByteSize();
+    char *aux=compactHeader(res,DPABC_COMPACT_PK,dpabcPkByteSizeCompact(pk)-DPABC_COMPACT_HEADER_SIZE);
+    *aux=pk->n;
+    aux=aux+1;
+    g1ToBytesCompressed(aux,pk->vx);
+    aux=aux+g1Bytes;
+    g1ToBytesCompressed(aux,pk->vy_m);
+    aux=aux+g1Bytes;
+    g1ToBytesCompressed(aux,pk->vy_epoch);
+    aux=aux+g1Bytes;
+    for(int i=0;i<pk->n;i++){
+        g1ToBytesCompressed(aux,pk->vy[i]);
+        aux=aux+g1Bytes;
+    }
+}
+
+publicKey * dpabcPkFromBytesCompact(const char *bytes, int nbytes){
+    int g1Bytes=g1CompressedByteSize();
+    int payload, valid;
+    const char *aux=compactPayload(bytes,nbytes,DPABC_COMPACT_PK,&payload);
+    if(aux==NULL || payload!=1+g1Bytes*((uint8_t)aux[0]+3))
+        return NULL;
+    uint8_t n=aux[0];
+    publicKey *res=pfecMalloc(sizeof(publicKey)+n*sizeof(G1*));
+    res->n=n;
+    aux=aux+1;
+    res->vx=g1FromBytesCompressed(aux);
+    aux=aux+g1Bytes;
+    res->vy_m=g1FromBytesCompressed(aux);
+    aux=aux+g1Bytes;
+    res->vy_epoch=g1FromBytesCompressed(aux);
+    aux=aux+g1Bytes;
+    valid=res->vx!=NULL && res->vy_m!=NULL && res->vy_epoch!=NULL;
+    for(int i=0;i<res->n;i++){
+        res->vy[i]=g1FromBytesCompressed(aux);
+        aux=aux+g1Bytes;
+        valid&=res->vy[i]!=NULL;
+    }
+    if(valid)
+        return res;
+    if(res->vx!=NULL)
+        g1Free(res->vx);
+    if(res->vy_m!=NULL)
+        g1Free(res->vy_m);
+    if(res->vy_epoch!=NULL)
+        g1Free(res->vy_epoch);
+    for(int i=0;i<res->n;i++){
+        if(res->vy[i]!=NULL)
+            g1Free(res->vy[i]);
+    }
+    pfecFree(res);
+    return NULL;
+}
+
+int dpabcSignByteSizeCompact(){
+    return DPABC_COMPACT_HEADER_SIZE+zpCompactByteSize()+g2CompressedByteSize()*2;
+}
+
+void dpabcSignToBytesCompact(char *res, const signature *sig){
+    int g2bytes=g2CompressedByteSize();
+    char *aux=compactHeader(res,DPABC_COMPACT_SIGN,dpabcSignByteSizeCompact()-DPABC_COMPACT_HEADER_SIZE);
+    g2ToBytesCompressed(aux,sig->sigma1);
+    aux=aux+g2bytes;
+    g2ToBytesCompressed(aux,sig->sigma2);
+    aux=aux+g2bytes;
+    zpToBytesCompact(aux,sig->mprime);
+}
+
+signature * dpabcSignFromBytesCompact(const char *bytes, int nbytes){
+    int g2bytes=g2CompressedByteSize();
+    int payload;
+    const char *aux=compactPayload(bytes,nbytes,DPABC_COMPACT_SIGN,&payload);
+    if(aux==NULL || payload!=dpabcSignByteSizeCompact()-DPABC_COMPACT_HEADER_SIZE)
+        return NULL;
+    signature *res=pfecMalloc(sizeof(signature));
+    res->sigma1=g2FromBytesCompressed(aux);
+    aux=aux+g2bytes;
+    res->sigma2=g2FromBytesCompressed(aux);
+    aux=aux+g2bytes;
+    res->mprime=zpFromBytesCompact(aux);
+    if(res->sigma1!=NULL && res->sigma2!=NULL && res->mprime!=NULL)
+        return res;
+    if(res->sigma1!=NULL)
+        g2Free(res->sigma1);
+    if(res->sigma2!=NULL)
+        g2Free(res->sigma2);
+    if(res->mprime!=NULL)
+        zpFree(res->mprime);
+    pfecFree(res);
+    return NULL;
+}
+
+int dpabcZkByteSizeCompact(const zkToken *zk){
+    return DPABC_COMPACT_HEADER_SIZE+1+2*g2CompressedByteSize()+(3+zk->n)*zpCompactByteSize();
+}
+
+void dpabcZkToBytesCompact(char *res, const zkToken *zk){
+    int g2bytes=g2CompressedByteSize();
+    int zpBytes=zpCompactByteSize();
+    char *aux=compactHeader(res,DPABC_COMPACT_ZK,dpabcZkByteSizeCompact(zk)-DPABC_COMPACT_HEADER_SIZE);
+    *aux=zk->n;
+    aux=aux+1;
+    g2ToBytesCompressed(aux,zk->sigma1);
+    aux=aux+g2bytes;
+    g2ToBytesCompressed(aux,zk->sigma2);
+    aux=aux+g2bytes;
+    zpToBytesCompact(aux,zk->c);
+    aux=aux+zpBytes;
+    zpToBytesCompact(aux,zk->v_t);
+    aux=aux+zpBytes;
+    zpToBytesCompact(aux,zk->v_mprime);
+    aux=aux+zpBytes;
+    for(int i=0;i<zk->n;i++){
+        zpToBytesCompact(aux,zk->v_mj[i]);
+        aux=aux+zpBytes;
+    }
+}
+
+zkToken * dpabcZkFromBytesCompact(const char *bytes, int nbytes){
+    int g2bytes=g2CompressedByteSize();
+    int zpBytes=zpCompactByteSize();
+    int payload, valid;
+    const char *aux=compactPayload(bytes,nbytes,DPABC_COMPACT_ZK,&payload);
+    if(aux==NULL || payload!=1+2*g2bytes+(3+(uint8_t)aux[0])*zpBytes)
+        return NULL;
+    uint8_t n=aux[0];
+    zkToken * res=pfecMalloc(sizeof(zkToken)+n*sizeof(Zp*));
+    res->n=n;
+    aux=aux+1;
+    res->sigma1=g2FromBytesCompressed(aux);
+    aux=aux+g2bytes;
+    res->sigma2=g2FromBytesCompressed(aux);
+    aux=aux+g2bytes;
+    res->c=zpFromBytesCompact(aux);
+    aux=aux+zpBytes;
+    res->v_t=zpFromBytesCompact(aux);
+    aux=aux+zpBytes;
+    res->v_mprime=zpFromBytesCompact(aux);
+    aux=aux+zpBytes;
+    valid=res->sigma1!=NULL && res->sigma2!=NULL && res->c!=NULL && res->v_t!=NULL && res->v_mprime!=NULL;
+    for(int i=0;i<res->n;i++){
+        res->v_mj[i]=zpFromBytesCompact(aux);
+        aux=aux+zpBytes;
+        valid&=res->v_mj[i]!=NULL;
+    }
+    if(valid)
+        return res;
+    if(res->sigma1!=NULL)
+        g2Free(res->sigma1);
+    if(res->sigma2!=NULL)
+        g2Free(res->sigma2);
+    if(res->c!=NULL)
+        zpFree(res->c);
+    if(res->v_t!=NULL)
+        zpFree(res->v_t);
+    if(res->v_mprime!=NULL)
+        zpFree(res->v_mprime);
+    for(int i=0;i<res->n;i++){
+        if(res->v_mj[i]!=NULL)
+            zpFree(res->v_mj[i]);
+    }
+    pfecFree(res);
+    return NULL;
+}
@@ -3,38 +3,64 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define HASHBUFFERSIZE 2048 // Stack buffer for hash inputs, bigger inputs use the heap (enough for sigma1|sigma2|g3El in BLS12-381 instantiations)
 
-void hash0(const Zp *m[], int mSize, Zp ** z, G2 ** g){
+//Stack buffer if the input fits in it, heap otherwise (release with hashBufferFree)
+static char *hashBuffer(char *stackBuffer, int nBytes){
+    return nBytes<=HASHBUFFERSIZE?stackBuffer:pfecMalloc(nBytes*sizeof(char));
+}
+
+static void hashBufferFree(char *stackBuffer, char *bytes){
+    if(bytes!=stackBuffer)
+        pfecFree(bytes);
+}
+
+void hash0(const Zp *m[], int mSize, zp_t * z, g2_t * g){
     int TAG_length=20;
     int zpBytes=zpByteSize();
     int nBytes=mSize*zpBytes;
-    char *bytes=malloc((nBytes+TAG_length)*sizeof(char));
+    char buffer[HASHBUFFERSIZE];
+    char *bytes=hashBuffer(buffer,nBytes+TAG_length);
+    zp_hash_t h;
     for(int j=0;j<mSize;j++){
         zpToBytes(bytes+TAG_length+(zpBytes*j),m[j]);
     }
     memcpy(bytes,"PABC-PSMS-V01-ENCZP0",TAG_length); // Domain separation See https://datatracker.ietf.org/doc/draft-irtf-cfrg-hash-to-curve/
-    *z=hashToZp(bytes,nBytes+TAG_length);
+    zp_hash_init(&h);
+    zp_hash_process(&h,bytes,nBytes+TAG_length);
+    zp_hash_result_into(z,&h,NULL,NULL,0);
     memcpy(bytes,"PABC-PSMS-V01-ENCEC0",TAG_length);
-    *g=hashToG2(bytes,nBytes+TAG_length);
-    free(bytes);
+    g2_hash_into(g,bytes,nBytes+TAG_length);
+    hashBufferFree(buffer,bytes);
+}
+
+//Absorbs X|Y_m'|Y_epoch|Y_1..Y_n into the hash state, serializing one element at a time
+static void hashPkElements(zp_hash_t *h, const publicKey * pk){
+    int g1Bytes=g1ByteSize();
+    char buffer[HASHBUFFERSIZE];
+    char *bytes=hashBuffer(buffer,g1Bytes);
+    g1ToBytes(bytes,pk->vx);
+    zp_hash_process(h,bytes,g1Bytes);
+    g1ToBytes(bytes,pk->vy_m);
+    zp_hash_process(h,bytes,g1Bytes);
+    g1ToBytes(bytes,pk->vy_epoch);
+    zp_hash_process(h,bytes,g1Bytes);
+    for(int i=0;i<pk->n;i++){
+        g1ToBytes(bytes,pk->vy[i]);
+        zp_hash_process(h,bytes,g1Bytes);
+    }
+    hashBufferFree(buffer,bytes);
 }
 
 Zp *hashPk(const publicKey * pk){
     int TAG_length=20;
-    Zp * res;
-    int g1Bytes=g1ByteSize();
-    int nBytes=g1Bytes*(pk->n+3);
-    char *bytes=malloc((nBytes+TAG_length)*sizeof(char));
-    int k=0;
-    g1ToBytes(bytes+TAG_length+(g1Bytes*k++),pk->vx);
-    g1ToBytes(bytes+TAG_length+(g1Bytes*k++),pk->vy_m);
-    g1ToBytes(bytes+TAG_length+(g1Bytes*k++),pk->vy_epoch);
-    for(int i=0;i<pk->n;i++)
-        g1ToBytes(bytes+TAG_length+(g1Bytes*k++),pk->vy[i]);
-    memcpy(bytes,"PABC-PSMS-V01-ENCZP1",TAG_length);
-    res=hashToZp(bytes,nBytes+TAG_length);
-    free(bytes);
-    return res;
+    zp_hash_t h;
+    zp_t res;
+    zp_hash_init(&h);
+    zp_hash_process(&h,"PABC-PSMS-V01-ENCZP1",TAG_length);
+    hashPkElements(&h,pk);
+    zp_hash_result_into(&res,&h,NULL,NULL,0);
+    return zp_new(&res);
 }
 
 
@@ -44,37 +70,34 @@ void hash1(const publicKey *pks[], int nkeys,Zp *t[]){
 }
 
 
-void hash2(const char * m, int mLength, const publicKey * pk, const G2 * sigma1, const G2 *sigma2, const G3 * g3El, Zp ** result){
+void hash2Prefix(const publicKey * pk, zp_hash_t *prefix){
     int TAG_length=20;
-    int g1Bytes=g1ByteSize();
+    zp_hash_init(prefix);
+    zp_hash_process(prefix,"PABC-PSMS-V01-ENCZP2",TAG_length);
+    hashPkElements(prefix,pk);
+}
+
+void hash2Commit(const zp_hash_t * prefix, const g2_t * sigma1, const g2_t *sigma2, const g3_t * g3El, zp_hash_t *state){
     int g2Bytes=g2ByteSize();
     int g3Bytes=g3ByteSize();
-    int nBytes=mLength+g1Bytes*(pk->n+3)+g2Bytes*2+g3Bytes;
-    char *bytes=malloc((nBytes+TAG_length)*sizeof(char));
-    char * aux;
-    aux=bytes+TAG_length;
-    g1ToBytes(aux,pk->vx);
-    aux=aux+g1Bytes;
-    g1ToBytes(aux,pk->vy_m);
-    aux=aux+g1Bytes;
-    g1ToBytes(aux,pk->vy_epoch);
-    aux=aux+g1Bytes;
-    for(int i=0;i<pk->n;i++){
-        g1ToBytes(aux,pk->vy[i]);
-        aux=aux+g1Bytes;
-    }
-    g2ToBytes(aux,sigma1);
-    aux=aux+g2Bytes;
-    g2ToBytes(aux,sigma2);
-    aux=aux+g2Bytes;
-    g3ToBytes(aux,g3El);
-    aux=aux+g3Bytes;
-    memcpy(aux,m,mLength);
-    memcpy(bytes,"PABC-PSMS-V01-ENCZP2",TAG_length);
-    *result=hashToZp(bytes,nBytes+TAG_length);
-    free(bytes);
+    int nBytes=g2Bytes*2+g3Bytes;
+    char buffer[HASHBUFFERSIZE];
+    char *bytes=hashBuffer(buffer,nBytes);
+    g2_to_bytes(bytes,sigma1);
+    g2_to_bytes(bytes+g2Bytes,sigma2);
+    g3_to_bytes(bytes+2*g2Bytes,g3El);
+    *state=*prefix;
+    zp_hash_process(state,bytes,nBytes);
+    hashBufferFree(buffer,bytes);
 }
 
+void hash2Message(const char * m, int mLength, const zp_hash_t *state, zp_t * result){
+    zp_hash_result_into(result,state,&m,&mLength,1);
+}
 
-        
-
+void hash2(const char * m, int mLength, const zp_hash_t * prefix, const g2_t * sigma1, const g2_t *sigma2, const g3_t * g3El, 
+        zp_t * result){
+    zp_hash_t state;
+    hash2Commit(prefix,sigma1,sigma2,g3El,&state);
+    hash2Message(m,mLength,&state,result);
+}
@@ -2,6 +2,7 @@
 #define UTILSPSMS_H
 
 #include <Dpabc_types.h>
+#include <values.h>
 
 /**
  * @brief Hash0 in PSMS scheme
@@ -11,7 +12,15 @@
  * @param z Resulting Zp element
  * @param g Resulting G2 element
  */
-void hash0(const Zp *m[], int mSize, Zp ** z, G2 ** g);
+void hash0(const Zp *m[], int mSize, zp_t * z, g2_t * g);
+
+/**
+ * @brief Hash of a public key, used for the exponents of Hash1
+ * 
+ * @param pk Public key
+ * @return Result of hash
+ */
+Zp *hashPk(const publicKey * pk);
 
 /**
  * @brief Hash1 in PSMS scheme
@@ -23,16 +32,48 @@ void hash0(const Zp *m[], int mSize, Zp ** z, G2 ** g);
 void hash1(const publicKey *pks[], int nkeys,Zp *t[]);
 
 /**
- * @brief Hash2 in PSMS scheme
+ * @brief Hash state with the fixed prefix of Hash2 (tag and public key) already absorbed
+ * 
+ * @param pk Public key
+ * @param prefix Resulting hash state
+ */
+void hash2Prefix(const publicKey * pk, zp_hash_t *prefix);
+
+/**
+ * @brief First part of Hash2: absorbs the elements of the presentation into a copy of the prefix state, so only the
+ * message is left (see hash2Message)
+ * 
+ * @param prefix Hash2 prefix state of the public key
+ * @param sigma1 Sigma1 from signature
+ * @param sigma2 Sigma2 from signature
+ * @param g3El G3 element, product/pairing result from scheme
+ * @param state Resulting hash state
+ */
+void hash2Commit(const zp_hash_t * prefix, const g2_t * sigma1, const g2_t *sigma2, const g3_t * g3El, zp_hash_t *state);
+
+/**
+ * @brief Last part of Hash2: absorbs the message into a copy of the state given by hash2Commit, which is not modified
  * 
  * @param m Message signed
  * @param mLength Message size
- * @param pk Public key
+ * @param state Hash state from hash2Commit
+ * @param result Result of hash
+ */
+void hash2Message(const char * m, int mLength, const zp_hash_t *state, zp_t * result);
+
+/**
+ * @brief Hash2 in PSMS scheme, continuing from the prefix state of the public key (see hash2Prefix), which is not modified. 
+ * No heap memory is used (for usual sizes)
+ * 
+ * @param m Message signed
+ * @param mLength Message size
+ * @param prefix Hash2 prefix state of the public key
  * @param sigma1 Sigma1 from signature
  * @param sigma2 Sigma2 from signature
  * @param g3El G3 element, product/pairing result from scheme
  * @param result Result of hash
  */
-void hash2(const char * m, int mLength, const publicKey * pk, const G2 * sigma1, const G2 *sigma2, const G3 * g3El, Zp ** result);
+void hash2(const char * m, int mLength, const zp_hash_t * prefix, const g2_t * sigma1, const g2_t *sigma2, const g3_t * g3El, 
+        zp_t * result);
 
 #endif
\ No newline at end of file
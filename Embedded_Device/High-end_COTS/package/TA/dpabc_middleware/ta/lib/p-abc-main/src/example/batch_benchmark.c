@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Zp.h>
+#include <Dpabc.h>
+#include <time.h>
+
+// Compares verifying n signatures/zero-knowledge tokens one by one (with plain and prepared public key) against verifyBatch/verifyZkTokenBatch
+int main(int argc, char *argv[]) {
+	int nattr=10;
+	int nsigns=argc>1?atoi(argv[1]):64;
+	char * seed="SeedForBatchBenchmarkBinary";
+	int seedLength=27;
+	Zp ***attributes=malloc(nsigns*sizeof(Zp**));
+	Zp **epochs=malloc(nsigns*sizeof(Zp*));
+	ranGen * rng=rgInit(seed,seedLength);
+	publicKey *pk;
+	secretKey *sk;
+	preparedPublicKey *ppk;
+	signature **signs=malloc(nsigns*sizeof(signature*));
+	int *results=malloc(nsigns*sizeof(int));
+	zkToken **tokens=malloc(nsigns*sizeof(zkToken*));
+	Zp ***revealed=malloc(nsigns*sizeof(Zp**));
+	const int **indexRevealArray=malloc(nsigns*sizeof(int*));
+	int *nRevealArray=malloc(nsigns*sizeof(int));
+	const char **msgs=malloc(nsigns*sizeof(char*));
+	int *msgLengths=malloc(nsigns*sizeof(int));
+	uint8_t *bitmap=malloc(DPABC_BITMAP_SIZE(nsigns));
+	int nIndexReveal=2;
+	int indexReveal[]={0,2};
+	char * msg="signedMessage";
+	int msgLength=13;
+	int valid=1;
+	printf("Starting nattr %d, nsigns %d\n",nattr,nsigns);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	keyGen(ctx,&sk,&pk);
+	for(int i=0;i<nsigns;i++){
+		attributes[i]=malloc(nattr*sizeof(Zp*));
+		for(int j=0;j<nattr;j++)
+			attributes[i][j]=zpRandom(rng);
+		epochs[i]=zpFromInt(12034);
+		signs[i]=sign(sk,epochs[i],(const Zp **)attributes[i]);
+	}
+	clock_t start_time = clock();
+	for(int i=0;i<nsigns;i++)
+		valid&=verify(pk,signs[i],epochs[i],(const Zp **)attributes[i]);
+	clock_t current_time = clock();
+	printf("Individual verification result: %d\n",valid);
+	printf("verf x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	ppk=dpabcPkPrepare(pk);
+	current_time = clock();
+	printf("prepare %lf\n",(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	for(int i=0;i<nsigns;i++)
+		valid&=verifyPrepared(ppk,signs[i],epochs[i],(const Zp **)attributes[i]);
+	current_time = clock();
+	printf("Individual prepared verification result: %d\n",valid);
+	printf("verfprepared x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	valid=verifyBatch(ctx,pk,(const signature **)signs,(const Zp **)epochs,(const Zp ***)attributes,nsigns,results);
+	current_time = clock();
+	printf("Batch verification result: %d\n",valid);
+	printf("verfbatch x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	//One invalid signature, so the batch is bisected
+	zpAdd(epochs[nsigns/2],epochs[0]);
+	start_time=clock();
+	valid=verifyBatch(ctx,pk,(const signature **)signs,(const Zp **)epochs,(const Zp ***)attributes,nsigns,results);
+	current_time = clock();
+	printf("Batch verification result (one invalid): %d, invalid found: %d\n",valid,!results[nsigns/2]);
+	printf("verfbatchbisect x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	//Zero-knowledge tokens, built from the valid signatures
+	zpSub(epochs[nsigns/2],epochs[0]);
+	start_time=clock();
+	for(int i=0;i<nsigns;i++){
+		tokens[i]=presentZkToken(ctx,pk,signs[i],epochs[i],(const Zp **)attributes[i],indexReveal,nIndexReveal,msg,msgLength);
+		revealed[i]=malloc(nIndexReveal*sizeof(Zp*));
+		for(int j=0;j<nIndexReveal;j++)
+			revealed[i][j]=attributes[i][indexReveal[j]];
+		indexRevealArray[i]=indexReveal;
+		nRevealArray[i]=nIndexReveal;
+		msgs[i]=msg;
+		msgLengths[i]=msgLength;
+	}
+	current_time = clock();
+	printf("zkpresent x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	for(int i=0;i<nsigns;i++){
+		dpabcZkFree(tokens[i]);
+		tokens[i]=presentZkTokenPrepared(ctx,ppk,signs[i],epochs[i],(const Zp **)attributes[i],indexReveal,nIndexReveal,msg,msgLength);
+	}
+	current_time = clock();
+	printf("zkpresentprepared x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	//Offline/online split, all presentations of the first signature precomputed
+	start_time=current_time;
+	presentationPool *pool=dpabcPresentPrecomputePrepared(ctx,ppk,signs[0],(const Zp **)attributes[0],indexReveal,nIndexReveal,nsigns);
+	current_time = clock();
+	printf("zkprecompute x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	zkToken **onlineTokens=malloc(nsigns*sizeof(zkToken*));
+	start_time=current_time;
+	for(int i=0;i<nsigns;i++)
+		onlineTokens[i]=presentZkTokenOnline(pool,msg,msgLength);
+	current_time = clock();
+	printf("zkonline x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	valid=1;
+	for(int i=0;i<nsigns;i++){
+		valid&=verifyZkTokenPrepared(onlineTokens[i],ppk,epochs[0],(const Zp **)revealed[0],indexReveal,nIndexReveal,msg,msgLength);
+		dpabcZkFree(onlineTokens[i]);
+	}
+	free(onlineTokens);
+	printf("Online zk token verification result: %d\n",valid);
+	dpabcPresentPoolFree(pool);
+	valid=1;
+	start_time=clock();
+	for(int i=0;i<nsigns;i++)
+		valid&=verifyZkToken(tokens[i],pk,epochs[i],(const Zp **)revealed[i],indexReveal,nIndexReveal,msg,msgLength);
+	current_time = clock();
+	printf("Individual zk verification result: %d\n",valid);
+	printf("zkverf x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	for(int i=0;i<nsigns;i++)
+		valid&=verifyZkTokenPrepared(tokens[i],ppk,epochs[i],(const Zp **)revealed[i],indexReveal,nIndexReveal,msg,msgLength);
+	current_time = clock();
+	printf("Individual prepared zk verification result: %d\n",valid);
+	printf("zkverfprepared x%d %lf\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	valid=verifyZkTokenBatch((const zkToken **)tokens,pk,(const Zp **)epochs,(const Zp ***)revealed,indexRevealArray,nRevealArray,msgs,msgLengths,nsigns,bitmap);
+	current_time = clock();
+	printf("Batch zk verification result: %d\n",valid);
+	printf("zkverfbatch x%d %lf (cpu time of all threads)\n",nsigns,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	for(int i=0;i<nsigns;i++){
+		dpabcZkFree(tokens[i]);
+		free(revealed[i]);
+		for(int j=0;j<nattr;j++)
+			zpFree(attributes[i][j]);
+		free(attributes[i]);
+		zpFree(epochs[i]);
+		dpabcSignFree(signs[i]);
+	}
+	dpabcPreparedPkFree(ppk);
+	dpabcPkFree(pk);
+	dpabcSkFree(sk);
+	rgFree(rng);
+	free(attributes);
+	free(epochs);
+	free(signs);
+	free(results);
+	free(tokens);
+	free(revealed);
+	free(indexRevealArray);
+	free(nRevealArray);
+	free(msgs);
+	free(msgLengths);
+	free(bitmap);
+	dpabcContextFree(ctx);
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Zp.h>
+#include <Dpabc.h>
+#include <time.h>
+
+// Compares size and (de)serialization time of the plain encoding (dpabc*ToBytes) against the compact one (dpabc*ToBytesCompact)
+int main(int argc, char *argv[]) {
+	int reps=argc>1?atoi(argv[1]):100;
+	int nattrs[]={1,10,30};
+	char * seed="SeedForCompactBenchmarkBinary";
+	int seedLength=29;
+	char * msg="signedMessage";
+	int msgLength=13;
+	int indexReveal[]={0};
+	int valid=1;
+	for(int a=0;a<3;a++){
+		int nattr=nattrs[a];
+		ranGen * rng=rgInit(seed,seedLength);
+		Zp **attributes=malloc(nattr*sizeof(Zp*));
+		Zp *epoch=zpFromInt(12034);
+		publicKey *pk, *pkAux;
+		secretKey *sk;
+		signature *sig, *sigAux;
+		zkToken *token, *tokenAux;
+		dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+		keyGen(ctx,&sk,&pk);
+		for(int j=0;j<nattr;j++)
+			attributes[j]=zpRandom(rng);
+		sig=sign(sk,epoch,(const Zp **)attributes);
+		token=presentZkToken(ctx,pk,sig,epoch,(const Zp **)attributes,indexReveal,1,msg,msgLength);
+		int sizes[]={dpabcPkByteSize(pk),dpabcPkByteSizeCompact(pk),dpabcSignByteSize(),dpabcSignByteSizeCompact(),dpabcZkByteSize(token),dpabcZkByteSizeCompact(token)};
+		char *pkBytes=malloc(sizes[0]), *pkCompact=malloc(sizes[1]);
+		char *sigBytes=malloc(sizes[2]), *sigCompact=malloc(sizes[3]);
+		char *zkBytes=malloc(sizes[4]), *zkCompact=malloc(sizes[5]);
+		printf("nattr %d, reps %d\n",nattr,reps);
+		printf("pk bytes %d compact %d\n",sizes[0],sizes[1]);
+		printf("sign bytes %d compact %d\n",sizes[2],sizes[3]);
+		printf("zk bytes %d compact %d\n",sizes[4],sizes[5]);
+		clock_t start_time = clock();
+		for(int i=0;i<reps;i++){
+			dpabcPkToBytes(pkBytes,pk);
+			dpabcSignToBytes(sigBytes,sig);
+			dpabcZkToBytes(zkBytes,token);
+		}
+		clock_t current_time = clock();
+		printf("tobytes x%d %lf\n",reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+		start_time=current_time;
+		for(int i=0;i<reps;i++){
+			dpabcPkToBytesCompact(pkCompact,pk);
+			dpabcSignToBytesCompact(sigCompact,sig);
+			dpabcZkToBytesCompact(zkCompact,token);
+		}
+		current_time = clock();
+		printf("tobytescompact x%d %lf\n",reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+		start_time=current_time;
+		for(int i=0;i<reps;i++){
+			pkAux=dpabcPkFromBytes(pkBytes);
+			sigAux=dpabcSignFromBytes(sigBytes);
+			tokenAux=dpabcZkFromBytes(zkBytes);
+			dpabcPkFree(pkAux);
+			dpabcSignFree(sigAux);
+			dpabcZkFree(tokenAux);
+		}
+		current_time = clock();
+		printf("frombytes x%d %lf\n",reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+		start_time=current_time;
+		for(int i=0;i<reps;i++){
+			pkAux=dpabcPkFromBytesCompact(pkCompact,sizes[1]);
+			sigAux=dpabcSignFromBytesCompact(sigCompact,sizes[3]);
+			tokenAux=dpabcZkFromBytesCompact(zkCompact,sizes[5]);
+			valid&=pkAux!=NULL && sigAux!=NULL && tokenAux!=NULL;
+			dpabcPkFree(pkAux);
+			dpabcSignFree(sigAux);
+			dpabcZkFree(tokenAux);
+		}
+		current_time = clock();
+		printf("frombytescompact x%d %lf\n",reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+		for(int j=0;j<nattr;j++)
+			zpFree(attributes[j]);
+		free(attributes);
+		free(pkBytes);
+		free(pkCompact);
+		free(sigBytes);
+		free(sigCompact);
+		free(zkBytes);
+		free(zkCompact);
+		zpFree(epoch);
+		dpabcZkFree(token);
+		dpabcSignFree(sig);
+		dpabcPkFree(pk);
+		dpabcSkFree(sk);
+		rgFree(rng);
+		dpabcContextFree(ctx);
+	}
+	printf("Compact decoding result: %d\n",valid);
+	return 0;
+}
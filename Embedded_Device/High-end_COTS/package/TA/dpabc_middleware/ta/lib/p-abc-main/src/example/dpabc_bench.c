@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <Zp.h>
+#include <Dpabc.h>
+
+// Sweeps the number of attributes, signers and revealed attributes over the dp-ABC operations, reporting
+// latency percentiles and allocations per operation as JSON or CSV, to track regressions between builds
+// Usage: dpabc_bench [-r reps] [-w warmup] [-a nattr,...] [-k nkeys,...] [-v reveal ratio,...] [-f json|csv] [-o file]
+
+#ifndef DPABC_BENCH_INSTANTIATION
+#define DPABC_BENCH_INSTANTIATION "unknown"
+#endif
+
+#define MAXSWEEP 32
+
+typedef struct {
+	size_t allocs;
+	size_t bytes;
+} allocCounter;
+
+// Inputs of the operations for the current point of the sweep
+typedef struct {
+	dpabcContext *ctx;
+	int nattr;
+	int nkeys;
+	secretKey **sks;
+	publicKey **pks;
+	signature **signs;
+	Zp **attributes;
+	Zp **revealed;
+	Zp *epoch;
+	int *indexReveal;
+	int nReveal;
+	zkToken *token;
+	int valid;
+} benchState;
+
+typedef struct {
+	FILE *out;
+	int json;
+	int rows;
+	int reps;
+	int warmup;
+	double *samples;
+	allocCounter counter;
+} bench;
+
+static const char *msg="benchmarkMessage";
+static const int msgLength=16;
+
+static void *countingAlloc(void *ctx, size_t size){
+	allocCounter *c=ctx;
+	c->allocs++;
+	c->bytes+=size;
+	return malloc(size);
+}
+
+static void countingRelease(void *ctx, void *ptr){
+	(void)ctx;
+	free(ptr);
+}
+
+static double now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1e6+ts.tv_nsec/1e3;
+}
+
+static int compareDouble(const void *a, const void *b){
+	double x=*(const double *)a, y=*(const double *)b;
+	return (x>y)-(x<y);
+}
+
+// Nearest rank percentile of sorted samples
+static double percentile(const double *sorted, int n, int p){
+	int rank=(p*n+99)/100;
+	return sorted[rank>0?rank-1:0];
+}
+
+static int parseList(const char *arg, double *values){
+	char *copy=strdup(arg), *save=NULL;
+	int n=0;
+	for(char *tok=strtok_r(copy,",",&save);tok!=NULL && n<MAXSWEEP;tok=strtok_r(NULL,",",&save))
+		values[n++]=atof(tok);
+	free(copy);
+	return n;
+}
+
+static void *opKeyGen(benchState *s){
+	secretKey *sk;
+	publicKey *pk;
+	keyGen(s->ctx,&sk,&pk);
+	dpabcPkFree(pk);
+	return sk;
+}
+
+static void *opSign(benchState *s){
+	return sign(s->sks[0],s->epoch,(const Zp **)s->attributes);
+}
+
+static void *opKeyAggr(benchState *s){
+	return keyAggr((const publicKey **)s->pks,s->nkeys);
+}
+
+static void *opCombine(benchState *s){
+	return combine((const publicKey **)s->pks,(const signature **)s->signs,s->nkeys);
+}
+
+static void *opVerify(benchState *s){
+	s->valid&=verify(s->pks[0],s->signs[0],s->epoch,(const Zp **)s->attributes);
+	return NULL;
+}
+
+static void *opPresent(benchState *s){
+	return presentZkToken(s->ctx,s->pks[0],s->signs[0],s->epoch,(const Zp **)s->attributes,s->indexReveal,s->nReveal,msg,msgLength);
+}
+
+static void *opVerifyZk(benchState *s){
+	s->valid&=verifyZkToken(s->token,s->pks[0],s->epoch,(const Zp **)s->revealed,s->indexReveal,s->nReveal,msg,msgLength);
+	return NULL;
+}
+
+static void releaseSk(void *p){ dpabcSkFree(p); }
+static void releasePk(void *p){ dpabcPkFree(p); }
+static void releaseSign(void *p){ dpabcSignFree(p); }
+static void releaseZk(void *p){ dpabcZkFree(p); }
+static void releaseNone(void *p){ (void)p; }
+
+// Runs warmup+reps times the operation (releasing its result out of the timed section) and writes one row
+static void run(bench *b, const char *name, benchState *s, void *(*op)(benchState *), void (*release)(void *)){
+	double mean=0;
+	size_t allocs=0, bytes=0;
+	for(int i=0;i<b->warmup;i++)
+		release(op(s));
+	for(int i=0;i<b->reps;i++){
+		size_t a0=b->counter.allocs, b0=b->counter.bytes;
+		double start=now();
+		void *res=op(s);
+		b->samples[i]=now()-start;
+		allocs+=b->counter.allocs-a0;
+		bytes+=b->counter.bytes-b0;
+		release(res);
+		mean+=b->samples[i];
+	}
+	mean/=b->reps;
+	qsort(b->samples,b->reps,sizeof(double),compareDouble);
+	if(b->json)
+		fprintf(b->out,"%s  {\"instantiation\": \"%s\", \"op\": \"%s\", \"nattr\": %d, \"nkeys\": %d, \"nreveal\": %d, \"reps\": %d, "
+			"\"mean_us\": %.1f, \"min_us\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, "
+			"\"allocs\": %zu, \"alloc_bytes\": %zu}",
+			b->rows?",\n":"",DPABC_BENCH_INSTANTIATION,name,s->nattr,s->nkeys,s->nReveal,b->reps,
+			mean,b->samples[0],percentile(b->samples,b->reps,50),percentile(b->samples,b->reps,90),
+			percentile(b->samples,b->reps,99),b->samples[b->reps-1],allocs/b->reps,bytes/b->reps);
+	else
+		fprintf(b->out,"%s,%s,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%zu,%zu\n",
+			DPABC_BENCH_INSTANTIATION,name,s->nattr,s->nkeys,s->nReveal,b->reps,
+			mean,b->samples[0],percentile(b->samples,b->reps,50),percentile(b->samples,b->reps,90),
+			percentile(b->samples,b->reps,99),b->samples[b->reps-1],allocs/b->reps,bytes/b->reps);
+	fflush(b->out);
+	b->rows++;
+}
+
+int main(int argc, char *argv[]) {
+	double nattrs[MAXSWEEP]={1,2,4,8,16,32,64,128,256};
+	double nkeys[MAXSWEEP]={1,2,4,8};
+	double ratios[MAXSWEEP]={0,0.25,0.5,1};
+	int nnattrs=9, nnkeys=4, nratios=4;
+	char *seed="SeedForDpabcBenchBinary";
+	int seedLength=23;
+	const char *output=NULL;
+	bench b={.out=stdout,.json=1,.rows=0,.reps=10,.warmup=2};
+	pfecAllocator counting={countingAlloc,countingRelease,&b.counter};
+	int opt, maxKeys=1;
+
+	while((opt=getopt(argc,argv,"r:w:a:k:v:f:o:"))!=-1){
+		switch(opt){
+		case 'r': b.reps=atoi(optarg); break;
+		case 'w': b.warmup=atoi(optarg); break;
+		case 'a': nnattrs=parseList(optarg,nattrs); break;
+		case 'k': nnkeys=parseList(optarg,nkeys); break;
+		case 'v': nratios=parseList(optarg,ratios); break;
+		case 'f': b.json=strcmp(optarg,"csv")!=0; break;
+		case 'o': output=optarg; break;
+		default:
+			fprintf(stderr,"Usage: %s [-r reps] [-w warmup] [-a nattr,...] [-k nkeys,...] [-v reveal ratio,...] [-f json|csv] [-o file]\n",argv[0]);
+			return 1;
+		}
+	}
+	if(b.reps<1 || b.warmup<0 || nnattrs<1 || nnkeys<1 || nratios<1){
+		fprintf(stderr,"Invalid sweep\n");
+		return 1;
+	}
+	if(output!=NULL && (b.out=fopen(output,"w"))==NULL){
+		perror(output);
+		return 1;
+	}
+	for(int i=0;i<nnkeys;i++)
+		if((int)nkeys[i]>maxKeys)
+			maxKeys=(int)nkeys[i];
+	b.samples=malloc(b.reps*sizeof(double));
+	pfecSetAllocator(&counting);
+
+	if(b.json)
+		fprintf(b.out,"[\n");
+	else
+		fprintf(b.out,"instantiation,op,nattr,nkeys,nreveal,reps,mean_us,min_us,p50_us,p90_us,p99_us,max_us,allocs,alloc_bytes\n");
+
+	for(int a=0;a<nnattrs;a++){
+		benchState s={0};
+		ranGen *rng;
+		s.nattr=(int)nattrs[a];
+		if(s.nattr<1)
+			continue;
+		s.ctx=dpabcContextNew(s.nattr,seed,seedLength);
+		rng=rgInit(seed,seedLength);
+		s.sks=malloc(maxKeys*sizeof(secretKey*));
+		s.pks=malloc(maxKeys*sizeof(publicKey*));
+		s.signs=malloc(maxKeys*sizeof(signature*));
+		s.attributes=malloc(s.nattr*sizeof(Zp*));
+		s.revealed=malloc(s.nattr*sizeof(Zp*));
+		s.indexReveal=malloc(s.nattr*sizeof(int));
+		s.valid=1;
+		for(int i=0;i<s.nattr;i++)
+			s.attributes[i]=zpRandom(rng);
+		s.epoch=zpFromInt(12034);
+		for(int i=0;i<maxKeys;i++){
+			keyGen(s.ctx,&s.sks[i],&s.pks[i]);
+			s.signs[i]=sign(s.sks[i],s.epoch,(const Zp **)s.attributes);
+		}
+
+		s.nkeys=1;
+		run(&b,"keyGen",&s,opKeyGen,releaseSk);
+		run(&b,"sign",&s,opSign,releaseSign);
+		run(&b,"verify",&s,opVerify,releaseNone);
+		for(int k=0;k<nnkeys;k++){
+			s.nkeys=(int)nkeys[k];
+			if(s.nkeys<1)
+				continue;
+			run(&b,"keyAggr",&s,opKeyAggr,releasePk);
+			run(&b,"combine",&s,opCombine,releaseSign);
+		}
+		s.nkeys=1;
+		for(int r=0;r<nratios;r++){
+			s.nReveal=(int)(ratios[r]*s.nattr+0.5);
+			if(s.nReveal<0 || s.nReveal>s.nattr)
+				continue;
+			for(int i=0;i<s.nReveal;i++){
+				s.indexReveal[i]=i;
+				s.revealed[i]=s.attributes[i];
+			}
+			run(&b,"presentZkToken",&s,opPresent,releaseZk);
+			s.token=opPresent(&s);
+			run(&b,"verifyZkToken",&s,opVerifyZk,releaseNone);
+			dpabcZkFree(s.token);
+		}
+
+		if(!s.valid){
+			fprintf(stderr,"Verification failed for nattr %d\n",s.nattr);
+			return 1;
+		}
+		for(int i=0;i<maxKeys;i++){
+			dpabcSignFree(s.signs[i]);
+			dpabcPkFree(s.pks[i]);
+			dpabcSkFree(s.sks[i]);
+		}
+		for(int i=0;i<s.nattr;i++)
+			zpFree(s.attributes[i]);
+		zpFree(s.epoch);
+		free(s.sks);
+		free(s.pks);
+		free(s.signs);
+		free(s.attributes);
+		free(s.revealed);
+		free(s.indexReveal);
+		rgFree(rng);
+		dpabcContextFree(s.ctx);
+	}
+
+	if(b.json)
+		fprintf(b.out,"\n]\n");
+	pfecSetAllocator(NULL);
+	free(b.samples);
+	if(b.out!=stdout)
+		fclose(b.out);
+	return 0;
+}
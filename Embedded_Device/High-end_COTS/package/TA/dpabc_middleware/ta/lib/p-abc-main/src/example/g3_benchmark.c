@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Zp.h>
+#include <pair.h>
+#include <time.h>
+
+// Compares GT exponentiation with g3Exp (generic FP12 pow) against g3ExpCyclotomic, and n exponentiations against g3MultiExp
+int main(int argc, char *argv[]) {
+	int reps=argc>1?atoi(argv[1]):50;
+	int ns[]={2,4,8,16};
+	char * seed="SeedForG3BenchmarkBinary";
+	int seedLength=24;
+	ranGen * rng=rgInit(seed,seedLength);
+	G1 *g1=g1Generator();
+	G2 *g2=g2Generator();
+	Zp *exps[16];
+	G3 *bases[16];
+	G3 *res1, *res2;
+	int valid=1;
+	for(int i=0;i<16;i++){
+		exps[i]=zpRandom(rng);
+		g1Mul(g1,exps[i]);
+		bases[i]=pair(g1,g2);
+	}
+	res1=pair(g1,g2);
+	res2=pair(g1,g2);
+	clock_t start_time = clock();
+	for(int i=0;i<reps;i++)
+		g3Exp(res1,exps[i%16]);
+	clock_t current_time = clock();
+	printf("g3Exp x%d %lf\n",reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	start_time=current_time;
+	for(int i=0;i<reps;i++)
+		g3ExpCyclotomic(res2,exps[i%16]);
+	current_time = clock();
+	printf("g3ExpCyclotomic x%d %lf\n",reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+	valid&=g3equals(res1,res2);
+	g3Free(res1);
+	g3Free(res2);
+	for(int k=0;k<4;k++){
+		int n=ns[k];
+		G3 *aux;
+		res1=NULL;
+		start_time=clock();
+		for(int i=0;i<reps;i++){
+			if(res1!=NULL)
+				g3Free(res1);
+			res1=g3One();
+			for(int j=0;j<n;j++){
+				aux=g3One();
+				g3Mul(aux,bases[j]);
+				g3Exp(aux,exps[j]);
+				g3Mul(res1,aux);
+				g3Free(aux);
+			}
+		}
+		current_time = clock();
+		printf("n=%d g3Exp+g3Mul x%d %lf\n",n,reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+		res2=NULL;
+		start_time=clock();
+		for(int i=0;i<reps;i++){
+			if(res2!=NULL)
+				g3Free(res2);
+			res2=g3MultiExp((const G3 *const *)bases,(const Zp *const *)exps,n);
+		}
+		current_time = clock();
+		printf("n=%d g3MultiExp x%d %lf\n",n,reps,(double)(current_time - start_time) / CLOCKS_PER_SEC);
+		valid&=g3equals(res1,res2);
+		g3Free(res1);
+		g3Free(res2);
+	}
+	printf("Results match: %d\n",valid);
+	for(int i=0;i<16;i++){
+		zpFree(exps[i]);
+		g3Free(bases[i]);
+	}
+	g1Free(g1);
+	g2Free(g2);
+	rgFree(rng);
+	return 0;
+}
@@ -26,8 +26,7 @@ int main() {
 	Zp **revealedAttributes=malloc(nIndexReveal*sizeof(Zp*));
 	Zp *epoch=zpFromInt(12034);
 	printf("Starting nattr %d, nreveal %d, nkeys %d\n",nattr,nIndexReveal,nkeys);
-    changeNattr(nattr);
-	seedRng(seed,seedLength);
+    dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
 	clock_t start_time = clock();
 	for(int i=0;i<nattr;i++)
 		attributes[i]=zpRandom(rng);
@@ -35,7 +34,7 @@ int main() {
 	printf("attr %lf\n",(double)(current_time - start_time) / CLOCKS_PER_SEC);
 	start_time = current_time;
 	for(int i=0;i<nkeys;i++)
-		keyGen(&(sks[i]),&(pks[i]),seed,seedLength);
+		keyGen(ctx,&(sks[i]),&(pks[i]));
 	current_time = clock();
 	printf("keygen %lf\n",(double)(current_time - start_time) / CLOCKS_PER_SEC);
 	start_time = current_time;
@@ -61,7 +60,7 @@ int main() {
 	current_time = clock();
 	printf("verf %lf\n",(double)(current_time - start_time) / CLOCKS_PER_SEC);
 	start_time=current_time;
-	token=presentZkToken(aggrKey,combinedSignature,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength,seed,seedLength);
+	token=presentZkToken(ctx,aggrKey,combinedSignature,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
 	current_time = clock();
 	printf("zkpresent %lf\n",(double)(current_time - start_time) / CLOCKS_PER_SEC);
 	start_time=current_time;
@@ -90,6 +89,6 @@ int main() {
 	free(sks);
 	free(revealedAttributes);
 	free(partialSigns);
-	dpabcFreeStateData();
+	dpabcContextFree(ctx);
     return 0;
 }
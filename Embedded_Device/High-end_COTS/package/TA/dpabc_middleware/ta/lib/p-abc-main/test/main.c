@@ -1,10 +1,15 @@
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <setjmp.h>
 #include <stddef.h>
 #include <cmocka.h>
 #include <Zp.h>
 #include <Dpabc.h>
+#if DPABC_THREADS>1
+#include <pthread.h>
+#endif
 
 
 
@@ -56,18 +61,17 @@ static void test_simple_complete_flow(void **state)
     int indexReveal[]={0,2};
 	Zp **revealedAttributes=malloc(nIndexReveal*sizeof(Zp*));
 	Zp *epoch=zpFromInt(12034);
-	changeNattr(nattr);
-	seedRng(seed,seedLength);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
 	for(int i=0;i<nattr;i++)
 		attributes[i]=zpRandom(rng);
 	for(int i=0;i<nkeys;i++)
-		keyGen(&sks[i],&pks[i],seed,seedLength);
+		keyGen(ctx,&sks[i],&pks[i]);
 	aggrKey=keyAggr((const publicKey **)pks,nkeys);
 	for(int i=0;i<nkeys;i++)
 		partialSigns[i]=sign(sks[i],epoch,(const Zp **)attributes);
 	combinedSignature=combine((const publicKey **)pks,(const signature **)partialSigns,nkeys);
 	assert_true(verify(aggrKey,combinedSignature,epoch,(const Zp **)attributes));
-	token=presentZkToken(aggrKey,combinedSignature,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength,seed,seedLength);
+	token=presentZkToken(ctx,aggrKey,combinedSignature,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
 	revealedAttributes[0]=zpCopy(attributes[0]);
 	revealedAttributes[1]=zpCopy(attributes[2]);
 	assert_true(verifyZkToken(token,aggrKey,epoch,(const Zp **)revealedAttributes,indexReveal,nIndexReveal,msg,msgLength));
@@ -90,7 +94,7 @@ static void test_simple_complete_flow(void **state)
 	free(sks);
 	free(revealedAttributes);
 	free(partialSigns);
-	dpabcFreeStateData();
+	dpabcContextFree(ctx);
 }
 
 static void test_fraudulent_modifications_flow(void **state)
@@ -117,15 +121,14 @@ static void test_fraudulent_modifications_flow(void **state)
 	Zp **fewerRevealedAttributes=malloc((nIndexReveal-1)*sizeof(Zp*));
 	Zp *epoch=zpFromInt(12034);
 	Zp *modifiedEpoch=zpFromInt(15034);
-	changeNattr(nattr);
-	seedRng(seed,seedLength);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
 	for(int i=0;i<nattr;i++)
 		attributes[i]=zpRandom(rng);
 	for(int i=0;i<nattr;i++)
 		modifiedAttr[i]=zpCopy(attributes[i]);
 	zpAdd(attributes[0],epoch);
 	for(int i=0;i<nkeys;i++)
-		keyGen(&sks[i],&pks[i],seed,seedLength);
+		keyGen(ctx,&sks[i],&pks[i]);
 	aggrKey=keyAggr((const publicKey **)pks,nkeys);
 	for(int i=0;i<nkeys;i++)
 		partialSigns[i]=sign(sks[i],epoch,(const Zp **)attributes);
@@ -133,7 +136,7 @@ static void test_fraudulent_modifications_flow(void **state)
 	assert_true(verify(aggrKey,combinedSignature,epoch,(const Zp **)attributes));
 	assert_false(verify(aggrKey,combinedSignature,modifiedEpoch,(const Zp **)attributes));
 	assert_false(verify(aggrKey,combinedSignature,epoch,(const Zp **)modifiedAttr));
-	token=presentZkToken(aggrKey,combinedSignature,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength,seed,seedLength);
+	token=presentZkToken(ctx,aggrKey,combinedSignature,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
 	revealedAttributes[0]=zpCopy(attributes[0]);
 	revealedAttributes[1]=zpCopy(attributes[2]);
 	modifiedRevealedAttributes[0]=zpCopy(attributes[0]);
@@ -172,7 +175,7 @@ static void test_fraudulent_modifications_flow(void **state)
 	free(modifiedAttr);
 	free(modifiedRevealedAttributes);
 	free(fewerRevealedAttributes);
-	dpabcFreeStateData();
+	dpabcContextFree(ctx);
 }
 
 static void test_flow_with_serialization(void **state)
@@ -198,17 +201,17 @@ static void test_flow_with_serialization(void **state)
     int indexReveal[]={0,2};
 	Zp **revealedAttributes=malloc(nIndexReveal*sizeof(Zp*));
 	Zp *epoch=zpFromInt(12034);
-	changeNattr(nattr);
-	seedRng(seed,seedLength);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
 	for(int i=0;i<nattr;i++)
 		attributes[i]=zpRandom(rng);
 	for(int i=0;i<nkeys;i++)
-		keyGen(&sks[i],&pks[i],seed,seedLength);
+		keyGen(ctx,&sks[i],&pks[i]);
 	aggrKey=keyAggr((const publicKey **)pks,nkeys);
 	char *aggrKeySerial=malloc(dpabcPkByteSize(aggrKey)*sizeof(char));
 	dpabcPkToBytes(aggrKeySerial,aggrKey);
 	aggrKeyRegenerated=dpabcPkFromBytes(aggrKeySerial);
 	assert_true(dpabcPkEquals(aggrKey,aggrKeyRegenerated));
+	assert_int_equal(dpabcPkByteSizeForN(nattr),dpabcPkByteSize(aggrKey));
 	for(int i=0;i<nkeys;i++)
 		partialSigns[i]=sign(sks[i],epoch,(const Zp **)attributes);
 	combinedSignature=combine((const publicKey **)pks,(const signature **)partialSigns,nkeys); 
@@ -216,8 +219,9 @@ static void test_flow_with_serialization(void **state)
 	dpabcSignToBytes(signSerial,combinedSignature);
 	combinedSignatureRegenerated=dpabcSignFromBytes(signSerial);
 	assert_true(verify(aggrKeyRegenerated,combinedSignature,epoch,(const Zp **)attributes));
-	token=presentZkToken(aggrKeyRegenerated,combinedSignatureRegenerated,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength,seed,seedLength);
+	token=presentZkToken(ctx,aggrKeyRegenerated,combinedSignatureRegenerated,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
 	char *tokenSerial=malloc(dpabcZkByteSize(token)*sizeof(char));
+	assert_int_equal(dpabcZkByteSizeForN(nattr-nIndexReveal),dpabcZkByteSize(token));
 	dpabcZkToBytes(tokenSerial,token);
 	tokenRegenerated=dpabcZkFromBytes(tokenSerial);
 	revealedAttributes[0]=zpCopy(attributes[0]);
@@ -248,7 +252,83 @@ static void test_flow_with_serialization(void **state)
 	free(aggrKeySerial);
 	free(signSerial);
 	free(tokenSerial);
-	dpabcFreeStateData();
+	dpabcContextFree(ctx);
+}
+
+static void test_compact_serialization(void **state)
+{
+	int nattr=15;
+    char * seed="SeedForTheTest_test_compact_serialization";
+	char * msg="signedMessage_compact";
+	int msgLength=21;
+	int seedLength=41;
+	Zp **attributes=malloc(nattr*sizeof(Zp*));
+	ranGen * rng=rgInit(seed,seedLength);
+	publicKey *pk, *pkRegenerated;
+	secretKey *sk;
+	signature *sig, *sigRegenerated;
+	zkToken *token, *tokenRegenerated;
+	int nIndexReveal=2;
+    int indexReveal[]={0,2};
+	Zp **revealedAttributes=malloc(nIndexReveal*sizeof(Zp*));
+	Zp *epoch=zpFromInt(12034);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	for(int i=0;i<nattr;i++)
+		attributes[i]=zpRandom(rng);
+	keyGen(ctx,&sk,&pk);
+	int pkSize=dpabcPkByteSizeCompact(pk);
+	assert_true(pkSize<dpabcPkByteSize(pk));
+	char *pkSerial=malloc(pkSize*sizeof(char));
+	dpabcPkToBytesCompact(pkSerial,pk);
+	pkRegenerated=dpabcPkFromBytesCompact(pkSerial,pkSize);
+	assert_non_null(pkRegenerated);
+	assert_true(dpabcPkEquals(pk,pkRegenerated));
+	// Truncated, wrong type or unknown version
+	assert_null(dpabcPkFromBytesCompact(pkSerial,pkSize-1));
+	assert_null(dpabcSignFromBytesCompact(pkSerial,pkSize));
+	pkSerial[0]++;
+	assert_null(dpabcPkFromBytesCompact(pkSerial,pkSize));
+	pkSerial[0]--;
+	sig=sign(sk,epoch,(const Zp **)attributes);
+	int signSize=dpabcSignByteSizeCompact();
+	assert_true(signSize<dpabcSignByteSize());
+	char *signSerial=malloc(signSize*sizeof(char));
+	dpabcSignToBytesCompact(signSerial,sig);
+	sigRegenerated=dpabcSignFromBytesCompact(signSerial,signSize);
+	assert_non_null(sigRegenerated);
+	assert_true(verify(pkRegenerated,sigRegenerated,epoch,(const Zp **)attributes));
+	token=presentZkToken(ctx,pkRegenerated,sigRegenerated,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
+	int tokenSize=dpabcZkByteSizeCompact(token);
+	assert_true(tokenSize<dpabcZkByteSize(token));
+	char *tokenSerial=malloc(tokenSize*sizeof(char));
+	dpabcZkToBytesCompact(tokenSerial,token);
+	tokenRegenerated=dpabcZkFromBytesCompact(tokenSerial,tokenSize);
+	assert_non_null(tokenRegenerated);
+	revealedAttributes[0]=zpCopy(attributes[0]);
+	revealedAttributes[1]=zpCopy(attributes[2]);
+	assert_true(verifyZkToken(tokenRegenerated,pkRegenerated,epoch,(const Zp **)revealedAttributes,indexReveal,nIndexReveal,msg,msgLength));
+	// Out of range scalar in the token
+	memset(tokenSerial+tokenSize-zpCompactByteSize(),0xff,zpCompactByteSize());
+	assert_null(dpabcZkFromBytesCompact(tokenSerial,tokenSize));
+	for(int i=0;i<nattr;i++)
+		zpFree(attributes[i]);
+	for(int i=0;i<nIndexReveal;i++)
+		zpFree(revealedAttributes[i]);
+	zpFree(epoch);
+	dpabcPkFree(pk);
+	dpabcPkFree(pkRegenerated);
+	dpabcSkFree(sk);
+	dpabcSignFree(sig);
+	dpabcSignFree(sigRegenerated);
+	dpabcZkFree(token);
+	dpabcZkFree(tokenRegenerated);
+	rgFree(rng);
+	free(attributes);
+	free(revealedAttributes);
+	free(pkSerial);
+	free(signSerial);
+	free(tokenSerial);
+	dpabcContextFree(ctx);
 }
 
 static void test_public_key(void **state)
@@ -259,15 +339,548 @@ static void test_public_key(void **state)
 	int seedLength=31;
 	secretKey *sk;
 	publicKey *pk, *pk2;
-	changeNattr(nattr);
-	seedRng(seed,seedLength);
-	keyGen(&sk,&pk,seed,seedLength);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	keyGen(ctx,&sk,&pk);
 	pk2=dpabcSkToPk(sk);
 	assert_true(dpabcPkEquals(pk,pk2));
 	dpabcSkFree(sk);
 	dpabcPkFree(pk);
 	dpabcPkFree(pk2);
-	dpabcFreeStateData();
+	dpabcContextFree(ctx);
+}
+
+static void test_batch_verification(void **state)
+{
+	int nattr=3;
+	int nsigns=6;
+    char * seed="SeedForTheTest_test_batch_verification";
+	int seedLength=38;
+	Zp ***attributes=malloc(nsigns*sizeof(Zp**));
+	Zp **epochs=malloc(nsigns*sizeof(Zp*));
+	ranGen * rng=rgInit(seed,seedLength);
+	publicKey *pk;
+	secretKey *sk;
+	signature **signs=malloc(nsigns*sizeof(signature*));
+	int *results=malloc(nsigns*sizeof(int));
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	keyGen(ctx,&sk,&pk);
+	for(int i=0;i<nsigns;i++){
+		attributes[i]=malloc(nattr*sizeof(Zp*));
+		for(int j=0;j<nattr;j++)
+			attributes[i][j]=zpRandom(rng);
+		epochs[i]=zpFromInt(12034+i);
+		signs[i]=sign(sk,epochs[i],(const Zp **)attributes[i]);
+	}
+	assert_true(verifyBatch(ctx,pk,(const signature **)signs,(const Zp **)epochs,(const Zp ***)attributes,nsigns,results));
+	for(int i=0;i<nsigns;i++)
+		assert_int_equal(results[i],1);
+	assert_true(verifyBatch(ctx,pk,(const signature **)signs,(const Zp **)epochs,(const Zp ***)attributes,nsigns,NULL));
+	//Tamper with two signatures (modified epoch and attribute), bisection must find exactly those
+	zpAdd(epochs[1],epochs[0]);
+	zpAdd(attributes[4][2],epochs[0]);
+	assert_false(verifyBatch(ctx,pk,(const signature **)signs,(const Zp **)epochs,(const Zp ***)attributes,nsigns,results));
+	for(int i=0;i<nsigns;i++)
+		assert_int_equal(results[i],verify(pk,signs[i],epochs[i],(const Zp **)attributes[i]));
+	assert_int_equal(results[1],0);
+	assert_int_equal(results[4],0);
+	assert_false(verifyBatch(ctx,pk,(const signature **)signs,(const Zp **)epochs,(const Zp ***)attributes,nsigns,NULL));
+	for(int i=0;i<nsigns;i++){
+		for(int j=0;j<nattr;j++)
+			zpFree(attributes[i][j]);
+		free(attributes[i]);
+		zpFree(epochs[i]);
+		dpabcSignFree(signs[i]);
+	}
+	dpabcPkFree(pk);
+	dpabcSkFree(sk);
+	rgFree(rng);
+	free(attributes);
+	free(epochs);
+	free(signs);
+	free(results);
+	dpabcContextFree(ctx);
+}
+
+static void test_batch_zk_verification(void **state)
+{
+	int nattr=4;
+	int ntokens=5;
+    char * seed="SeedForTheTest_test_batch_zk_verification";
+	int seedLength=41;
+	const char *messages[]={"msg0","message1","m2","msg3","message4"};
+	int messageSizes[]={4,8,2,4,8};
+	int nReveal[]={0,1,2,4,2};
+	int reveal0[]={0};
+	int reveal1[]={2};
+	int reveal2[]={0,3};
+	int reveal3[]={0,1,2,3};
+	int reveal4[]={1,2};
+	const int *indexReveal[]={reveal0,reveal1,reveal2,reveal3,reveal4};
+	Zp **attributes=malloc(nattr*sizeof(Zp*));
+	Zp ***revealed=malloc(ntokens*sizeof(Zp**));
+	Zp **epochs=malloc(ntokens*sizeof(Zp*));
+	zkToken **tokens=malloc(ntokens*sizeof(zkToken*));
+	uint8_t bitmap[DPABC_BITMAP_SIZE(5)];
+	ranGen * rng=rgInit(seed,seedLength);
+	publicKey *pk;
+	secretKey *sk;
+	signature *signature;
+	Zp *epoch=zpFromInt(12034);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	keyGen(ctx,&sk,&pk);
+	for(int i=0;i<nattr;i++)
+		attributes[i]=zpRandom(rng);
+	signature=sign(sk,epoch,(const Zp **)attributes);
+	for(int i=0;i<ntokens;i++){
+		epochs[i]=epoch;
+		tokens[i]=presentZkToken(ctx,pk,signature,epoch,(const Zp **)attributes,indexReveal[i],nReveal[i],messages[i],messageSizes[i]);
+		revealed[i]=malloc(nReveal[i]*sizeof(Zp*));
+		for(int j=0;j<nReveal[i];j++)
+			revealed[i][j]=zpCopy(attributes[indexReveal[i][j]]);
+	}
+	assert_true(verifyZkTokenBatch((const zkToken **)tokens,pk,(const Zp **)epochs,(const Zp ***)revealed,indexReveal,nReveal,messages,messageSizes,ntokens,bitmap));
+	assert_int_equal(bitmap[0],0x1f);
+	//Modified revealed attribute in token 2 and modified message in token 4
+	zpAdd(revealed[2][1],epoch);
+	messageSizes[4]--;
+	assert_false(verifyZkTokenBatch((const zkToken **)tokens,pk,(const Zp **)epochs,(const Zp ***)revealed,indexReveal,nReveal,messages,messageSizes,ntokens,bitmap));
+	assert_int_equal(bitmap[0],0x0b);
+	for(int i=0;i<ntokens;i++){
+		assert_int_equal((bitmap[0]>>i)&1,verifyZkToken(tokens[i],pk,epochs[i],(const Zp **)revealed[i],indexReveal[i],nReveal[i],messages[i],messageSizes[i]));
+		for(int j=0;j<nReveal[i];j++)
+			zpFree(revealed[i][j]);
+		free(revealed[i]);
+		dpabcZkFree(tokens[i]);
+	}
+	for(int i=0;i<nattr;i++)
+		zpFree(attributes[i]);
+	zpFree(epoch);
+	dpabcSignFree(signature);
+	dpabcPkFree(pk);
+	dpabcSkFree(sk);
+	rgFree(rng);
+	free(attributes);
+	free(revealed);
+	free(epochs);
+	free(tokens);
+	dpabcContextFree(ctx);
+}
+
+static void test_prepared_public_key(void **state)
+{
+	int nattr=4;
+	int nkeys=3;
+    char * seed="SeedForTheTest_test_prepared_public_key";
+	int seedLength=39;
+	char * msg="signedMessage_prepared";
+	int msgLength=22;
+	int nIndexReveal=2;
+	int indexReveal[]={1,2};
+	const int *indexRevealArray[]={indexReveal,indexReveal};
+	int nRevealArray[]={2,2};
+	const char *msgs[]={msg,msg};
+	int msgLengths[]={22,22};
+	uint8_t bitmap[DPABC_BITMAP_SIZE(2)];
+	int results[2];
+	Zp **attributes=malloc(nattr*sizeof(Zp*));
+	Zp **revealed=malloc(nIndexReveal*sizeof(Zp*));
+	const Zp **attributesArray[]={NULL,NULL};
+	const Zp **revealedArray[]={NULL,NULL};
+	const Zp *epochs[2];
+	ranGen * rng=rgInit(seed,seedLength);
+	publicKey **pks=malloc(nkeys*sizeof(publicKey*));
+	secretKey **sks=malloc(nkeys*sizeof(secretKey*));
+	preparedPublicKey **ppks=malloc(nkeys*sizeof(preparedPublicKey*));
+	signature **partialSigns=malloc(nkeys*sizeof(signature*));
+	signature *sign1, *sign2;
+	const signature *signs[2];
+	char *signBytes1, *signBytes2;
+	publicKey *aggrKey1, *aggrKey2;
+	preparedPublicKey *aggrPpk;
+	zkToken *token1, *token2;
+	const zkToken *tokens[2];
+	Zp *epoch=zpFromInt(12034);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	for(int i=0;i<nattr;i++)
+		attributes[i]=zpRandom(rng);
+	for(int j=0;j<nIndexReveal;j++)
+		revealed[j]=zpCopy(attributes[indexReveal[j]]);
+	for(int i=0;i<nkeys;i++){
+		keyGen(ctx,&sks[i],&pks[i]);
+		ppks[i]=dpabcPkPrepare(pks[i]);
+		partialSigns[i]=sign(sks[i],epoch,(const Zp **)attributes);
+	}
+	//Aggregation and combination give the same results with prepared keys
+	aggrKey1=keyAggr((const publicKey **)pks,nkeys);
+	aggrKey2=keyAggrPrepared((const preparedPublicKey **)ppks,nkeys);
+	assert_true(dpabcPkEquals(aggrKey1,aggrKey2));
+	sign1=combine((const publicKey **)pks,(const signature **)partialSigns,nkeys);
+	sign2=combinePrepared((const preparedPublicKey **)ppks,(const signature **)partialSigns,nkeys);
+	signBytes1=malloc(dpabcSignByteSize());
+	signBytes2=malloc(dpabcSignByteSize());
+	dpabcSignToBytes(signBytes1,sign1);
+	dpabcSignToBytes(signBytes2,sign2);
+	assert_memory_equal(signBytes1,signBytes2,dpabcSignByteSize());
+	//Verification
+	aggrPpk=dpabcPkPrepare(aggrKey1);
+	assert_true(verifyPrepared(aggrPpk,sign1,epoch,(const Zp **)attributes));
+	assert_false(verifyPrepared(ppks[0],sign1,epoch,(const Zp **)attributes));
+	signs[0]=sign1;
+	signs[1]=sign2;
+	epochs[0]=epochs[1]=epoch;
+	attributesArray[0]=attributesArray[1]=(const Zp **)attributes;
+	assert_true(verifyBatchPrepared(ctx,aggrPpk,signs,epochs,attributesArray,2,results));
+	assert_false(verifyBatchPrepared(ctx,ppks[1],signs,epochs,attributesArray,2,results));
+	assert_int_equal(results[0],0);
+	assert_int_equal(results[1],0);
+	//Tokens presented with and without the prepared key are accepted by both verifications
+	token1=presentZkTokenPrepared(ctx,aggrPpk,sign1,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
+	token2=presentZkToken(ctx,aggrKey1,sign1,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
+	assert_true(verifyZkToken(token1,aggrKey1,epoch,(const Zp **)revealed,indexReveal,nIndexReveal,msg,msgLength));
+	assert_true(verifyZkTokenPrepared(token1,aggrPpk,epoch,(const Zp **)revealed,indexReveal,nIndexReveal,msg,msgLength));
+	assert_true(verifyZkTokenPrepared(token2,aggrPpk,epoch,(const Zp **)revealed,indexReveal,nIndexReveal,msg,msgLength));
+	assert_false(verifyZkTokenPrepared(token2,aggrPpk,epoch,(const Zp **)revealed,indexReveal,nIndexReveal,msg,msgLength-1));
+	tokens[0]=token1;
+	tokens[1]=token2;
+	revealedArray[0]=revealedArray[1]=(const Zp **)revealed;
+	assert_true(verifyZkTokenBatchPrepared(tokens,aggrPpk,epochs,revealedArray,indexRevealArray,nRevealArray,msgs,msgLengths,2,bitmap));
+	assert_int_equal(bitmap[0],0x03);
+	msgLengths[1]--;
+	assert_false(verifyZkTokenBatch(tokens,aggrKey1,epochs,revealedArray,indexRevealArray,nRevealArray,msgs,msgLengths,2,bitmap));
+	assert_int_equal(bitmap[0],0x01);
+	for(int i=0;i<nattr;i++)
+		zpFree(attributes[i]);
+	for(int j=0;j<nIndexReveal;j++)
+		zpFree(revealed[j]);
+	for(int i=0;i<nkeys;i++){
+		dpabcPreparedPkFree(ppks[i]);
+		dpabcPkFree(pks[i]);
+		dpabcSkFree(sks[i]);
+		dpabcSignFree(partialSigns[i]);
+	}
+	zpFree(epoch);
+	dpabcPreparedPkFree(aggrPpk);
+	dpabcPkFree(aggrKey1);
+	dpabcPkFree(aggrKey2);
+	dpabcSignFree(sign1);
+	dpabcSignFree(sign2);
+	free(signBytes1);
+	free(signBytes2);
+	dpabcZkFree(token1);
+	dpabcZkFree(token2);
+	rgFree(rng);
+	free(attributes);
+	free(revealed);
+	free(pks);
+	free(sks);
+	free(ppks);
+	free(partialSigns);
+	dpabcContextFree(ctx);
+}
+
+static void test_combine_hashed(void **state)
+{
+	int nattr=3;
+	int nkeys=3;
+	char * seed="SeedForTheTest_combine_hashed";
+	int seedLength=29;
+	Zp **attributes=malloc(nattr*sizeof(Zp*));
+	ranGen * rng=rgInit(seed,seedLength);
+	publicKey **pks=malloc(nkeys*sizeof(publicKey*));
+	secretKey **sks=malloc(nkeys*sizeof(secretKey*));
+	signature **partialSigns=malloc(nkeys*sizeof(signature*));
+	Zp **t=malloc(nkeys*sizeof(Zp*));
+	signature *sign1, *sign2, *otherSign;
+	char *signBytes1, *signBytes2;
+	publicKey *aggrKey;
+	Zp **otherAttributes=malloc(nattr*sizeof(Zp*));
+	Zp *epoch=zpFromInt(12034);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	for(int i=0;i<nattr;i++){
+		attributes[i]=zpRandom(rng);
+		otherAttributes[i]=zpCopy(attributes[i]);
+	}
+	zpAdd(otherAttributes[0],epoch);
+	for(int i=0;i<nkeys;i++){
+		keyGen(ctx,&sks[i],&pks[i]);
+		partialSigns[i]=sign(sks[i],epoch,(const Zp **)attributes);
+		t[i]=dpabcPkHash(pks[i]);
+	}
+	aggrKey=keyAggr((const publicKey **)pks,nkeys);
+	//Same signature as combine from the hashes of the keys
+	sign1=combine((const publicKey **)pks,(const signature **)partialSigns,nkeys);
+	sign2=combineHashed((const signature **)partialSigns,(const Zp **)t,nkeys);
+	signBytes1=malloc(dpabcSignByteSize());
+	signBytes2=malloc(dpabcSignByteSize());
+	dpabcSignToBytes(signBytes1,sign1);
+	dpabcSignToBytes(signBytes2,sign2);
+	assert_memory_equal(signBytes1,signBytes2,dpabcSignByteSize());
+	assert_true(verify(aggrKey,sign2,epoch,(const Zp **)attributes));
+	//A share over different attributes is rejected
+	otherSign=sign(sks[1],epoch,(const Zp **)otherAttributes);
+	dpabcSignFree(partialSigns[1]);
+	partialSigns[1]=otherSign;
+	assert_null(combineHashed((const signature **)partialSigns,(const Zp **)t,nkeys));
+	for(int i=0;i<nattr;i++){
+		zpFree(attributes[i]);
+		zpFree(otherAttributes[i]);
+	}
+	for(int i=0;i<nkeys;i++){
+		dpabcPkFree(pks[i]);
+		dpabcSkFree(sks[i]);
+		dpabcSignFree(partialSigns[i]);
+		zpFree(t[i]);
+	}
+	zpFree(epoch);
+	dpabcPkFree(aggrKey);
+	dpabcSignFree(sign1);
+	dpabcSignFree(sign2);
+	free(signBytes1);
+	free(signBytes2);
+	rgFree(rng);
+	free(attributes);
+	free(pks);
+	free(sks);
+	free(partialSigns);
+	free(otherAttributes);
+	free(t);
+	dpabcContextFree(ctx);
+}
+
+static void test_present_pool(void **state)
+{
+	int nattr=6;
+	int count=3;
+	char * seed="SeedForTheTest_test_present_pool";
+	int seedLength=32;
+	const char *messages[]={"msg0","message1","m2"};
+	int messageSizes[]={4,8,2};
+	int nIndexReveal=2;
+	int indexReveal[]={1,4};
+	Zp **attributes=malloc(nattr*sizeof(Zp*));
+	Zp **revealedAttributes=malloc(nIndexReveal*sizeof(Zp*));
+	Zp *epoch=zpFromInt(12034);
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	dpabcContext *ctx2;
+	publicKey *pk;
+	secretKey *sk;
+	preparedPublicKey *ppk;
+	signature *sig;
+	presentationPool *pool;
+	zkToken *token, *token2;
+	keyGen(ctx,&sk,&pk);
+	ppk=dpabcPkPrepare(pk);
+	for(int i=0;i<nattr;i++)
+		attributes[i]=zpFromInt(100+i);
+	for(int i=0;i<nIndexReveal;i++)
+		revealedAttributes[i]=attributes[indexReveal[i]];
+	sig=sign(sk,epoch,(const Zp **)attributes);
+	//Each precomputed presentation gives a valid token for any message, until the pool is empty
+	pool=dpabcPresentPrecompute(ctx,pk,sig,(const Zp **)attributes,indexReveal,nIndexReveal,count);
+	for(int i=0;i<count;i++){
+		assert_int_equal(dpabcPresentPoolSize(pool),count-i);
+		token=presentZkTokenOnline(pool,messages[i],messageSizes[i]);
+		assert_non_null(token);
+		assert_int_equal(dpabcZkByteSize(token),dpabcZkByteSizeForN(dpabcPresentPoolHidden(pool)));
+		assert_true(verifyZkToken(token,pk,epoch,(const Zp **)revealedAttributes,indexReveal,nIndexReveal,messages[i],messageSizes[i]));
+		assert_false(verifyZkToken(token,pk,epoch,(const Zp **)revealedAttributes,indexReveal,nIndexReveal,messages[(i+1)%count],messageSizes[(i+1)%count]));
+		dpabcZkFree(token);
+	}
+	assert_int_equal(dpabcPresentPoolSize(pool),0);
+	assert_null(presentZkTokenOnline(pool,messages[0],messageSizes[0]));
+	dpabcPresentPoolFree(pool);
+	//Pools that are empty or cannot be allocated are refused
+	assert_null(dpabcPresentPrecompute(ctx,pk,sig,(const Zp **)attributes,indexReveal,nIndexReveal,0));
+	assert_null(dpabcPresentPrecompute(ctx,pk,sig,(const Zp **)attributes,indexReveal,nIndexReveal,-1));
+	assert_null(dpabcPresentPrecompute(ctx,pk,sig,(const Zp **)attributes,indexReveal,nIndexReveal,INT_MAX));
+	//Same randomness gives the same token as presentZkToken, with and without prepared key
+	dpabcContextFree(ctx);
+	ctx=dpabcContextNew(nattr,seed,seedLength);
+	ctx2=dpabcContextNew(nattr,seed,seedLength);
+	pool=dpabcPresentPrecomputePrepared(ctx2,ppk,sig,(const Zp **)attributes,indexReveal,nIndexReveal,1);
+	token=presentZkTokenOnline(pool,messages[1],messageSizes[1]);
+	dpabcPresentPoolFree(pool);
+	token2=presentZkToken(ctx,pk,sig,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,messages[1],messageSizes[1]);
+	char *bytes=malloc(dpabcZkByteSize(token));
+	char *bytes2=malloc(dpabcZkByteSize(token2));
+	dpabcZkToBytes(bytes,token);
+	dpabcZkToBytes(bytes2,token2);
+	assert_memory_equal(bytes,bytes2,dpabcZkByteSize(token));
+	dpabcZkFree(token);
+	dpabcZkFree(token2);
+	free(bytes);
+	free(bytes2);
+	for(int i=0;i<nattr;i++)
+		zpFree(attributes[i]);
+	zpFree(epoch);
+	dpabcSignFree(sig);
+	dpabcPreparedPkFree(ppk);
+	dpabcPkFree(pk);
+	dpabcSkFree(sk);
+	free(attributes);
+	free(revealedAttributes);
+	dpabcContextFree(ctx);
+	dpabcContextFree(ctx2);
+}
+
+static void test_arena_allocator(void **state)
+{
+	int nattr=5;
+	char * seed="SeedForTheTest_test_arena_allocator_0123";
+	int seedLength=40;
+	char * msg="signedMessage_arena";
+	int msgLength=19;
+	int nIndexReveal=2;
+	int indexReveal[]={1,3};
+	size_t arenaSize=64*1024;
+	char *arenaBuffer=malloc(arenaSize);
+	pfecArena arena;
+	pfecAllocator alloc;
+	size_t highWater;
+	Zp **attributes=malloc(nattr*sizeof(Zp*));
+	Zp **revealedAttributes=malloc(nIndexReveal*sizeof(Zp*));
+	ranGen * rng=rgInit(seed,seedLength);
+	Zp *epoch=zpFromInt(12034);
+	publicKey *pk;
+	secretKey *sk;
+	dpabcContext *ctx=dpabcContextNew(nattr,seed,seedLength);
+	keyGen(ctx,&sk,&pk);
+	for(int i=0;i<nattr;i++)
+		attributes[i]=zpRandom(rng);
+	revealedAttributes[0]=attributes[1];
+	revealedAttributes[1]=attributes[3];
+	dpabcContextFree(ctx);
+	//Same use as a TA command: everything allocated in the command is released before the arena is reset
+	pfecArenaInit(&arena,arenaBuffer,arenaSize);
+	alloc=pfecArenaAllocator(&arena);
+	for(int k=0;k<2;k++){
+		pfecSetAllocator(&alloc);
+		ctx=dpabcContextNew(nattr,seed,seedLength);
+		signature *sig=sign(sk,epoch,(const Zp **)attributes);
+		assert_true(verify(pk,sig,epoch,(const Zp **)attributes));
+		zkToken *token=presentZkToken(ctx,pk,sig,epoch,(const Zp **)attributes,indexReveal,nIndexReveal,msg,msgLength);
+		assert_true(verifyZkToken(token,pk,epoch,(const Zp **)revealedAttributes,indexReveal,nIndexReveal,msg,msgLength));
+		dpabcSignFree(sig);
+		dpabcZkFree(token);
+		dpabcContextFree(ctx);
+		pfecSetAllocator(NULL);
+		pfecArenaReset(&arena);
+		assert_int_equal(arena.nOverflows,0);
+		assert_true(arena.highWater>0 && arena.highWater<=arenaSize);
+		if(k==0)
+			highWater=arena.highWater;
+		else
+			assert_int_equal(arena.highWater,highWater); //Reset gives all the memory back
+	}
+	for(int i=0;i<nattr;i++)
+		zpFree(attributes[i]);
+	zpFree(epoch);
+	dpabcPkFree(pk);
+	dpabcSkFree(sk);
+	rgFree(rng);
+	free(attributes);
+	free(revealedAttributes);
+	free(arenaBuffer);
+}
+
+#define CONTEXTWORKERS 4
+#define CONTEXTROUNDS 2
+
+typedef struct {
+	dpabcContext *ctx;
+	int result;
+} contextWorkerJob;
+
+//Full flow (keys, issuance, batch verification, presentation) with the context of the worker only
+static void *contextWorker(void *arg)
+{
+	contextWorkerJob *job=arg;
+	int nattr=dpabcContextNattr(job->ctx);
+	char *msg="contextWorkerMessage";
+	int msgLength=20;
+	int indexReveal[]={0};
+	int results[CONTEXTROUNDS];
+	job->result=1;
+	for(int k=0;k<CONTEXTROUNDS;k++){
+		publicKey *pk;
+		secretKey *sk;
+		signature *signs[CONTEXTROUNDS];
+		Zp *epochs[CONTEXTROUNDS];
+		const Zp **attributesArray[CONTEXTROUNDS];
+		Zp **attributes=malloc(nattr*sizeof(Zp*));
+		keyGen(job->ctx,&sk,&pk);
+		for(int i=0;i<nattr;i++)
+			attributes[i]=zpFromInt(k*nattr+i);
+		for(int i=0;i<CONTEXTROUNDS;i++){
+			epochs[i]=zpFromInt(12034+i);
+			signs[i]=sign(sk,epochs[i],(const Zp **)attributes);
+			attributesArray[i]=(const Zp **)attributes;
+			job->result&=verify(pk,signs[i],epochs[i],(const Zp **)attributes);
+		}
+		job->result&=verifyBatch(job->ctx,pk,(const signature **)signs,(const Zp **)epochs,attributesArray,CONTEXTROUNDS,results);
+		zkToken *token=presentZkToken(job->ctx,pk,signs[0],epochs[0],(const Zp **)attributes,indexReveal,1,msg,msgLength);
+		job->result&=verifyZkToken(token,pk,epochs[0],(const Zp **)attributes,indexReveal,1,msg,msgLength);
+		dpabcZkFree(token);
+		for(int i=0;i<CONTEXTROUNDS;i++){
+			dpabcSignFree(signs[i]);
+			zpFree(epochs[i]);
+		}
+		for(int i=0;i<nattr;i++)
+			zpFree(attributes[i]);
+		free(attributes);
+		dpabcPkFree(pk);
+		dpabcSkFree(sk);
+	}
+	return NULL;
+}
+
+static void test_context_threads(void **state)
+{
+	char * seed="SeedForTheTest_test_context_threads";
+	int seedLength=35;
+	int nattrs[CONTEXTWORKERS]={1,3,5,8};
+	contextWorkerJob jobs[CONTEXTWORKERS];
+	dpabcContext *ctx=dpabcContextNew(2,seed,seedLength);
+	dpabcContext *ctx2=dpabcContextNew(2,seed,seedLength);
+	dpabcContext *spawned;
+	publicKey *pk, *pk2;
+	secretKey *sk, *sk2;
+	//Same seed gives the same keys, a spawned context gives different ones
+	keyGen(ctx,&sk,&pk);
+	keyGen(ctx2,&sk2,&pk2);
+	assert_true(dpabcPkEquals(pk,pk2));
+	dpabcPkFree(pk2);
+	dpabcSkFree(sk2);
+	spawned=dpabcContextSpawn(ctx2);
+	assert_int_equal(dpabcContextNattr(spawned),2);
+	keyGen(spawned,&sk2,&pk2);
+	assert_false(dpabcPkEquals(pk,pk2));
+	dpabcPkFree(pk);
+	dpabcSkFree(sk);
+	dpabcPkFree(pk2);
+	dpabcSkFree(sk2);
+	dpabcContextFree(spawned);
+	dpabcContextFree(ctx2);
+	//Workers with different credential types, each with its own random stream
+	for(int t=0;t<CONTEXTWORKERS;t++){
+		jobs[t].ctx=dpabcContextSpawn(ctx);
+		dpabcContextSetNattr(jobs[t].ctx,nattrs[t]);
+	}
+#if DPABC_THREADS>1
+	pthread_t threads[CONTEXTWORKERS];
+	for(int t=0;t<CONTEXTWORKERS;t++)
+		assert_int_equal(pthread_create(&threads[t],NULL,contextWorker,&jobs[t]),0);
+	for(int t=0;t<CONTEXTWORKERS;t++)
+		pthread_join(threads[t],NULL);
+#else
+	for(int t=0;t<CONTEXTWORKERS;t++)
+		contextWorker(&jobs[t]);
+#endif
+	for(int t=0;t<CONTEXTWORKERS;t++){
+		assert_true(jobs[t].result);
+		dpabcContextFree(jobs[t].ctx);
+	}
+	dpabcContextFree(ctx);
 }
 
 int main()
@@ -278,7 +891,15 @@ int main()
 		cmocka_unit_test(test_simple_complete_flow),
 		cmocka_unit_test(test_fraudulent_modifications_flow),
 		cmocka_unit_test(test_flow_with_serialization),
-		cmocka_unit_test(test_public_key)
+		cmocka_unit_test(test_compact_serialization),
+		cmocka_unit_test(test_public_key),
+		cmocka_unit_test(test_batch_verification),
+		cmocka_unit_test(test_batch_zk_verification),
+		cmocka_unit_test(test_prepared_public_key),
+		cmocka_unit_test(test_combine_hashed),
+		cmocka_unit_test(test_present_pool),
+		cmocka_unit_test(test_arena_allocator),
+		cmocka_unit_test(test_context_threads)
     };
 	//cmocka_set_message_output(CM_OUTPUT_XML);
 	// Define environment variable CMOCKA_XML_FILE=testresults/libc.xml 
@@ -1,7 +1,9 @@
 global-incdirs-y += include
+global-incdirs-y += ../../common/include
 global-incdirs-y += lib/p-abc-main/include
 global-incdirs-y += lib/p-abc-main/lib/pfecCwrapper/include
 srcs-y += dpabc_ta.c
+srcs-y += ../../common/ta_trace.c
 
 libdirs += ../ 
 
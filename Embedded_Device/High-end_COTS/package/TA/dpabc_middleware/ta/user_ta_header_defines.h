@@ -46,7 +46,18 @@
 /* Provisioned stack size */
 #define TA_STACK_SIZE			(2 * 1024 * 1024)
 
-/* Provisioned heap size for TEE_Malloc() and friends */
+/*
+ * Provisioned heap size for TEE_Malloc() and friends. Each session runs in its
+ * own instance of the TA, whose heap holds (see dpabc_ta.h):
+ *  - the session arena, TA_DPABC_ARENA_SIZE
+ *  - the object cache, TA_DPABC_CACHE_SIZE plus the objects of the running
+ *    command
+ *  - the presentation pool, up to TA_DPABC_MAX_PRECOMPUTE presentations
+ *    (512 KiB with 255 hidden attributes)
+ *  - whatever a command allocates over the arena: batches and combined
+ *    signatures grow with the number of requests sent in one call, see the
+ *    overflows of TA_DPABC_ARENA_STATS
+ */
 #define TA_DATA_SIZE			(2 * 1024 * 1024)
 
 /* The gpd.ta.version property */
@@ -5,6 +5,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 
 #define PSK_SIZE		16
 #define P_RANDOM_SZ		16
@@ -24,6 +26,8 @@
 
 #define AES_BLOCK_SIZE		16
 
+#define STREAM_CHUNK_SIZE	(64 * 1024)	/* Bytes sent to the TA per TA_CIPHER_UPDATE */
+
 // Security api does not provide session information
 // needed by op-tee int it's calls, so it needs to be
 // handeled as a global variable
@@ -484,6 +488,350 @@ int32_t csp_decryptData(char* decryptionKeyID, unsigned char* dataToDecrypt, uin
 	return 2;
 }
 
+static int32_t stream_init(char * keyId, uint32_t mode, uint32_t * handle) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, 
+					 TEEC_VALUE_INPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE);
+
+	op.params[0].tmpref.buffer = keyId;
+	op.params[0].tmpref.size = strlen(keyId);
+
+	op.params[1].value.a = mode;
+
+	res = TEEC_InvokeCommand(&(session), TA_CYPHER_INIT, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("stream init failed: 0x%x / %u\n", res, err_origin);
+		return 1;
+	}
+
+	*handle = op.params[2].value.a;
+	return 0;
+}
+
+static int32_t write_all(int fd, const unsigned char * data, size_t data_sz) {
+
+	ssize_t n;
+
+	while (data_sz) {
+		n = write(fd, data, data_sz);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		data += n;
+		data_sz -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Feeds inFd to an open stream one chunk at a time, through two shared
+ * memory buffers allocated once, then finishes it. The ciphered chunks go to
+ * outFd (-1 for a MAC stream) and the last block (or the MAC) to outFd or,
+ * when given, to final
+ */
+static int32_t stream_run(uint32_t handle, int inFd, int outFd, unsigned char * final) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+	TEEC_SharedMemory in_shm, out_shm;
+	unsigned char last[AES_BLOCK_SIZE];
+	int32_t ret = 0;
+	ssize_t n;
+
+	memset(&in_shm, 0, sizeof(in_shm));
+	memset(&out_shm, 0, sizeof(out_shm));
+
+	in_shm.size = STREAM_CHUNK_SIZE;
+	in_shm.flags = TEEC_MEM_INPUT;
+	/* A chunk can complete the block held back by the TA */
+	out_shm.size = STREAM_CHUNK_SIZE + AES_BLOCK_SIZE;
+	out_shm.flags = TEEC_MEM_OUTPUT;
+
+	if (TEEC_AllocateSharedMemory(&(ctx), &in_shm) != TEEC_SUCCESS) {
+		printf("Failed to allocate stream buffer\n");
+		in_shm.buffer = NULL;
+		ret = 1;
+	} else if (outFd >= 0 && TEEC_AllocateSharedMemory(&(ctx), &out_shm) != TEEC_SUCCESS) {
+		printf("Failed to allocate stream buffer\n");
+		out_shm.buffer = NULL;
+		ret = 1;
+	}
+
+	while (!ret) {
+		n = read(inFd, in_shm.buffer, STREAM_CHUNK_SIZE);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			printf("stream read failed: %s\n", strerror(errno));
+			ret = 1;
+			break;
+		}
+		if (n == 0)
+			break;
+
+		memset(&op, 0, sizeof(op));
+
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, 
+						 TEEC_MEMREF_PARTIAL_INPUT,
+						 outFd >= 0 ? TEEC_MEMREF_PARTIAL_OUTPUT : TEEC_NONE,
+						 TEEC_NONE);
+
+		op.params[0].value.a = handle;
+
+		op.params[1].memref.parent = &in_shm;
+		op.params[1].memref.size = n;
+
+		op.params[2].memref.parent = &out_shm;
+		op.params[2].memref.size = out_shm.size;
+
+		res = TEEC_InvokeCommand(&(session), TA_CIPHER_UPDATE, &op,
+					 &err_origin);
+
+		if (res != TEEC_SUCCESS) {
+			/* The TA has already released the stream */
+			printf("stream update failed: 0x%x / %u\n", res, err_origin);
+			ret = 1;
+			goto out;
+		}
+
+		if (outFd >= 0 && write_all(outFd, out_shm.buffer, op.params[2].memref.size)) {
+			printf("stream write failed: %s\n", strerror(errno));
+			ret = 1;
+		}
+	}
+
+	/* Also on errors, so the TA releases the stream */
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, 
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_NONE,
+					 TEEC_NONE);
+
+	op.params[0].value.a = handle;
+
+	op.params[1].tmpref.buffer = final ? final : last;
+	op.params[1].tmpref.size = AES_BLOCK_SIZE;
+
+	res = TEEC_InvokeCommand(&(session), TA_CIPHER_DO_FINAL, &op,
+				 &err_origin);
+
+	if (ret)
+		goto out;
+
+	if (res != TEEC_SUCCESS) {
+		printf("stream final failed: 0x%x / %u\n", res, err_origin);
+		ret = 1;
+	} else if (!final && write_all(outFd, last, op.params[1].tmpref.size)) {
+		printf("stream write failed: %s\n", strerror(errno));
+		ret = 1;
+	}
+
+out:
+	if (in_shm.buffer)
+		TEEC_ReleaseSharedMemory(&in_shm);
+	if (out_shm.buffer)
+		TEEC_ReleaseSharedMemory(&out_shm);
+
+	return ret;
+}
+
+static int32_t cipher_stream(char * keyId, int inFd, int outFd, uint16_t algo, uint32_t mode) {
+
+	uint32_t handle;
+
+	if (algo != AES_256_CBC) {
+		printf("Algorithm not implemented\n");
+		return 2;
+	}
+
+	for (int i = 0; i < MAX_EDK; i++) {
+
+		if (!strcmp(keyId, edk_ids[i])) {
+
+			if (stream_init(keyId, mode, &handle))
+				return 1;
+
+			printf("Invoking TA to %s stream\n", mode == TA_STREAM_ENCRYPT ? "cipher" : "decode");
+			if (stream_run(handle, inFd, outFd, NULL))
+				return 1;
+			printf("TA %s stream\n", mode == TA_STREAM_ENCRYPT ? "ciphered" : "decoded");
+
+			return 0;
+		}
+	}
+
+	printf("Invalid key id: %s\n", keyId);
+	return 2;
+}
+
+int32_t csp_encryptStream(char* encryptionKeyID, int inFd, int outFd, uint16_t algo) {
+
+	return cipher_stream(encryptionKeyID, inFd, outFd, algo, TA_STREAM_ENCRYPT);
+}
+
+int32_t csp_decryptStream(char* decryptionKeyID, int inFd, int outFd, uint16_t algo) {
+
+	return cipher_stream(decryptionKeyID, inFd, outFd, algo, TA_STREAM_DECRYPT);
+}
+
+int32_t csp_signStream(char* signatureKeyID, int inFd, unsigned char* signature) {
+
+	uint32_t handle;
+	char * keyId;
+
+	if (!strcmp(signatureKeyID, PSK_ID)) {
+		keyId = AK_ID;
+	} else if (!strcmp(signatureKeyID, MSK_ID)) {
+		keyId = MSK_DERIVED_AK_ID;
+	} else {
+		printf("Invalid key id: %s\n", signatureKeyID);
+		return 2;
+	}
+
+	if (stream_init(keyId, TA_STREAM_MAC, &handle))
+		return 1;
+
+	printf("Invoking TA to sign stream\n");
+	if (stream_run(handle, inFd, -1, signature))
+		return 1;
+	printf("TA signed stream\n");
+
+	return 0;
+}
+
+/*
+ * Both GCM commands: the records are packed in one shared memory buffer
+ * (header, AAD and data of each one, see ta_gcm_record) and the TA
+ * processes all of them in place in a single call
+ */
+static int32_t gcm_records(char * keyId, csp_aeadRecord * records, uint16_t recordsNum, uint16_t algo, int encrypt) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+	TEEC_SharedMemory shm;
+	ta_gcm_record header;
+	unsigned char * p;
+	int32_t ret = 0;
+	int i;
+
+	if (algo != AES_256_GCM) {
+		printf("Algorithm not implemented\n");
+		return 2;
+	}
+
+	for (i = 0; i < MAX_EDK; i++) {
+		if (!strcmp(keyId, edk_ids[i]))
+			break;
+	}
+	if (i == MAX_EDK) {
+		printf("Invalid key id: %s\n", keyId);
+		return 2;
+	}
+
+	if (!recordsNum)
+		return 0;
+
+	memset(&shm, 0, sizeof(shm));
+	for (i = 0; i < recordsNum; i++)
+		shm.size += sizeof(ta_gcm_record) + records[i].aadLen + records[i].dataLen;
+	shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+
+	if (TEEC_AllocateSharedMemory(&(ctx), &shm) != TEEC_SUCCESS) {
+		printf("Failed to allocate records buffer\n");
+		return 1;
+	}
+
+	p = shm.buffer;
+	for (i = 0; i < recordsNum; i++) {
+		memset(&header, 0, sizeof(header));
+		header.aad_sz = records[i].aadLen;
+		header.data_sz = records[i].dataLen;
+		if (!encrypt) {
+			memcpy(header.nonce, records[i].nonce, TA_GCM_NONCE_SIZE);
+			memcpy(header.tag, records[i].tag, TA_GCM_TAG_SIZE);
+		}
+
+		memcpy(p, &header, sizeof(header));
+		p += sizeof(header);
+		memcpy(p, records[i].aad, records[i].aadLen);
+		p += records[i].aadLen;
+		memcpy(p, records[i].data, records[i].dataLen);
+		p += records[i].dataLen;
+	}
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, 
+					 TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_PARTIAL_INOUT,
+					 TEEC_NONE);
+
+	op.params[0].tmpref.buffer = keyId;
+	op.params[0].tmpref.size = strlen(keyId);
+
+	op.params[1].value.a = recordsNum;
+
+	op.params[2].memref.parent = &shm;
+	op.params[2].memref.size = shm.size;
+
+	printf("Invoking TA to %s %u records\n", encrypt ? "cipher" : "decode", recordsNum);
+	res = TEEC_InvokeCommand(&(session), encrypt ? TA_AES_256_GCM_ENCRYPT : TA_AES_256_GCM_DECRYPT, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("records %s failed: 0x%x / %u\n", encrypt ? "cipher" : "decode", res, err_origin);
+		TEEC_ReleaseSharedMemory(&shm);
+		return 1;
+	}
+
+	p = shm.buffer;
+	for (i = 0; i < recordsNum; i++) {
+		memcpy(&header, p, sizeof(header));
+		p += sizeof(header) + records[i].aadLen;
+
+		records[i].status = header.status;
+		if (encrypt) {
+			memcpy(records[i].nonce, header.nonce, TA_GCM_NONCE_SIZE);
+			memcpy(records[i].tag, header.tag, TA_GCM_TAG_SIZE);
+		} else if (header.status) {
+			ret = 3;
+		}
+
+		memcpy(records[i].data, p, records[i].dataLen);
+		p += records[i].dataLen;
+	}
+
+	TEEC_ReleaseSharedMemory(&shm);
+
+	printf("TA %s records\n", encrypt ? "ciphered" : "decoded");
+	return ret;
+}
+
+int32_t csp_encryptRecords(char* encryptionKeyID, csp_aeadRecord* records, uint16_t recordsNum, uint16_t algo) {
+
+	return gcm_records(encryptionKeyID, records, recordsNum, algo, 1);
+}
+
+int32_t csp_decryptRecords(char* decryptionKeyID, csp_aeadRecord* records, uint16_t recordsNum, uint16_t algo) {
+
+	return gcm_records(decryptionKeyID, records, recordsNum, algo, 0);
+}
+
 int32_t csp_generateRandom(unsigned char * randomBuffer, uint16_t randomBufferLen) {
 
 	uint32_t err_origin;
@@ -516,6 +864,71 @@ int32_t csp_generateRandom(unsigned char * randomBuffer, uint16_t randomBufferLe
 	return 0;
 }
 
+int32_t csp_traceDrain(ta_trace_event * events, uint16_t maxEvents, uint16_t * eventsNum, uint32_t * dropped) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE,
+					 TEEC_NONE);
+
+	op.params[0].tmpref.buffer = events;
+	op.params[0].tmpref.size = maxEvents * sizeof(ta_trace_event);
+
+	res = TEEC_InvokeCommand(&(session), TA_TRACE_DRAIN, &op,
+				 &err_origin);
+
+	if (res != TEEC_SUCCESS) {
+		printf("traceDrain failed: 0x%x / %u\n", res, err_origin);
+		return 1;
+	}
+
+	*eventsNum = op.params[1].value.a;
+	if (dropped) {
+		*dropped = op.params[1].value.b;
+	}
+
+	return 0;
+}
+
+int32_t csp_commandStats(ta_cmd_stats * stats, uint16_t maxStats, uint16_t * statsNum, uint8_t reset) {
+
+	uint32_t err_origin;
+	TEEC_Result res;
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_NONE,
+					 TEEC_NONE);
+
+	op.params[0].tmpref.buffer = stats;
+	op.params[0].tmpref.size = maxStats * sizeof(ta_cmd_stats);
+	op.params[1].value.a = reset != 0;
+
+	res = TEEC_InvokeCommand(&(session), TA_STATS, &op,
+				 &err_origin);
+
+	if (res == TEEC_ERROR_SHORT_BUFFER) {
+		return 2;
+	}
+	if (res != TEEC_SUCCESS) {
+		printf("commandStats failed: 0x%x / %u\n", res, err_origin);
+		return 1;
+	}
+
+	*statsNum = op.params[0].tmpref.size / sizeof(ta_cmd_stats);
+
+	return 0;
+}
+
 int32_t csp_terminate(void) {
 	/*
 	 * We're done with the TA, close the session and
@@ -14,6 +14,7 @@
 #define AES128		0x0002
 #define AES_256_CBC	0x0003
 #define CMAC		0x0004
+#define AES_256_GCM	0x0005
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,6 +24,7 @@ extern "C" {
 // #include "plf_config.h"
 #include <stdint.h>
 // #include "st_p11.h"
+#include <ta_trace.h>
 
 
 /* Exported functions ------------------------------------------------------- */
@@ -141,6 +143,88 @@ int32_t csp_encryptData(char* encryptionKeyID, unsigned char* dataToEncrypt, uin
 int32_t csp_decryptData(char* decryptionKeyID, unsigned char* dataToDecrypt, uint16_t dataToDecryptLen, unsigned char* decryptedData, uint16_t * decryptedDataLen, uint16_t algo);
 
 
+/**
+  * @brief  Encrypt everything read from a file descriptor
+  * @note   The data is sent to the SE in chunks and ciphered as it arrives, the output is the same as csp_encryptData.
+  * @note   encriptionKeyId admitted values: "EDK".
+  * @note   algo admitted values: AES-256-CBC
+  * @param  encriptionKeyId	- Key ID of the encryption key
+  * @param  inFd		- File descriptor read until its end
+  * @param  outFd		- File descriptor that receives the encrypted data
+  * @param  algo		- The algorithm used to encrypt
+  * @retval return 0 means OK
+  */
+int32_t csp_encryptStream(char* encryptionKeyID, int inFd, int outFd, uint16_t algo);
+
+
+/**
+  * @brief  Decrypt everything read from a file descriptor
+  * @note   The data is sent to the SE in chunks and deciphered as it arrives, the output is the same as csp_decryptData.
+  * @note   decriptionKeyId admitted values: "EDK".
+  * @note   algo admitted values: AES-256-CBC
+  * @param  decriptionKeyId	- Key ID of the decryption key
+  * @param  inFd		- File descriptor read until its end
+  * @param  outFd		- File descriptor that receives the decrypted data
+  * @param  algo		- The algorithm used to encrypt
+  * @retval return 0 means OK
+  */
+int32_t csp_decryptStream(char* decryptionKeyID, int inFd, int outFd, uint16_t algo);
+
+
+/**
+  * @brief  Calculate the signature of everything read from a file descriptor
+  * @note   The data is sent to the SE in chunks, the signature is the same as csp_sign.
+  * @note   signatureKeyID admitted values: "PSK", "MSK".
+  * @param  signatureKeyID    - Key ID of the signature key
+  * @param  inFd              - File descriptor read until its end
+  * @param  signature         - The location that receives the signature
+  * @retval return 0 means OK
+  */
+int32_t csp_signStream(char* signatureKeyID, int inFd, unsigned char* signature);
+
+
+/**
+  * @brief  Record of csp_encryptRecords and csp_decryptRecords
+  */
+typedef struct {
+	unsigned char* aad;		/* Additional data, authenticated but not encrypted */
+	uint16_t aadLen;
+	unsigned char* data;		/* Encrypted or decrypted in place */
+	uint16_t dataLen;
+	unsigned char nonce[12];	/* Set by csp_encryptRecords, read by csp_decryptRecords */
+	unsigned char tag[16];		/* Set by csp_encryptRecords, read by csp_decryptRecords */
+	int32_t status;			/* Set by csp_decryptRecords, 0 means the tag matched */
+} csp_aeadRecord;
+
+
+/**
+  * @brief  Authenticated encryption of several records with a single call to the SE
+  * @note   Every record gets a fresh nonce from a counter kept by the SE, and its tag.
+  * @note   encriptionKeyId admitted values: "EDK".
+  * @note   algo admitted values: AES-256-GCM
+  * @param  encriptionKeyId	- Key ID of the encryption key
+  * @param  records		- Records to encrypt
+  * @param  recordsNum		- Number of records
+  * @param  algo		- The algorithm used to encrypt
+  * @retval return 0 means OK
+  */
+int32_t csp_encryptRecords(char* encryptionKeyID, csp_aeadRecord* records, uint16_t recordsNum, uint16_t algo);
+
+
+/**
+  * @brief  Authenticated decryption of several records with a single call to the SE
+  * @note   The data of a record whose tag does not match is wiped and its status set, the other records are still decrypted.
+  * @note   decriptionKeyId admitted values: "EDK".
+  * @note   algo admitted values: AES-256-GCM
+  * @param  decriptionKeyId	- Key ID of the decryption key
+  * @param  records		- Records to decrypt, with the nonce and tag they were encrypted with
+  * @param  recordsNum		- Number of records
+  * @param  algo		- The algorithm used to encrypt
+  * @retval return 0 means OK, 3 means some record failed authentication
+  */
+int32_t csp_decryptRecords(char* decryptionKeyID, csp_aeadRecord* records, uint16_t recordsNum, uint16_t algo);
+
+
 /**
  * @brief Generate random buffer
  * @param randomBuffer the location to generated random data (needs to be allocated beforehand) 
@@ -149,6 +233,29 @@ int32_t csp_decryptData(char* decryptionKeyID, unsigned char* dataToDecrypt, uin
  */
 int32_t csp_generateRandom(unsigned char * randomBuffer, uint16_t randomBufferLen);
 
+
+/**
+  * @brief  Read the oldest events of the SE trace ring, removing them from it
+  * @note   The ring holds TA_TRACE_RING_SIZE events (see ta_trace.h), drain it until eventsNum comes back 0 to empty it.
+  * @param  events		- The location that receives the events
+  * @param  maxEvents		- Number of events that fit in events
+  * @param  eventsNum		- The location that receives the number of events read
+  * @param  dropped		- The location that receives the number of events overwritten before being read, can be NULL
+  * @retval return 0 means OK
+  */
+int32_t csp_traceDrain(ta_trace_event* events, uint16_t maxEvents, uint16_t* eventsNum, uint32_t* dropped);
+
+
+/**
+  * @brief  Read the calls, errors and latency of every command called so far on the SE
+  * @param  stats		- The location that receives the counters
+  * @param  maxStats		- Number of counters that fit in stats, TA_TRACE_MAX_CMDS is always enough
+  * @param  statsNum		- The location that receives the number of counters read
+  * @param  reset		- Zero the counters after reading them if not 0
+  * @retval return 0 means OK, 2 means stats is too small
+  */
+int32_t csp_commandStats(ta_cmd_stats* stats, uint16_t maxStats, uint16_t* statsNum, uint8_t reset);
+
 /**
  * @brief Reconfigure device
  * @param opcode signle byte operation code indicating the reconfiguration action
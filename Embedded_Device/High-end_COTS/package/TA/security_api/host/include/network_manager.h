@@ -12,20 +12,33 @@
 
 #include <custom_se_pkcs11.h>
 #include <checksum.h>
-
-uint32_t send_bytes(char * addr, uint16_t port, uint8_t * message, size_t message_sz, int * sockfd);
-
-uint32_t send_bytes_socket(int sockfd, uint8_t * message, size_t message_sz);
-
-uint32_t receive_bytes(uint16_t port, char * buffer, size_t * buffer_size, int * sockfd, int * server_socket);
-
-uint32_t receive_bytes_socket(int socketfd, char *buffer, size_t * buffer_size);
-
-uint32_t send_bytes_encrypted_signed(char * key_id, char * addr, uint16_t port, uint8_t * message, size_t message_sz, int * sockfd);
-
-uint32_t close_connection(int socketfd);
-
-uint32_t reset_connection(int * socketfd, int * server_socket, int new_port, char * buffer, size_t * buffer_size);
+#include <transport.h>
+
+/**
+ * @brief Transport shared by the agents, opened on first use so connections
+ * and the listening socket are kept across join requests
+ * @retval NULL if it could not be opened
+ */
+transport * network_transport(void);
+
+/**
+ * @brief Closes the connections of network_transport
+ */
+void network_close(void);
+
+/**
+ * @brief Sends message as one TRANSPORT_FRAME_U32 frame, over the open
+ * connection to addr:port if there is one
+ * @retval 0 means OK
+ */
+uint32_t send_bytes(char * addr, uint16_t port, uint8_t * message, size_t message_sz);
+
+/**
+ * @brief Sends message encrypted with key_id and followed by its CRC, as
+ * send_bytes
+ * @retval 0 means OK
+ */
+uint32_t send_bytes_encrypted_signed(char * key_id, char * addr, uint16_t port, uint8_t * message, size_t message_sz);
 
 uint32_t get_mac(char * mac_address);
 
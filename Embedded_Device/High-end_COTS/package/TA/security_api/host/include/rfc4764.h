@@ -37,6 +37,10 @@
 
 #define	PSK_KEY_ID			"PSK"
 
+#define BOOTSTRAPPING_SERVER_ADDR	"155.54.95.211"
+#define BOOTSTRAPPING_SERVER_PORT	33333
+#define BOOTSTRAPPING_CALLBACK_PORT	4444	/* The server connects back here for the EAP-PSK exchange */
+
 typedef struct  __attribute__((__packed__)) {
 	uint8_t code;
 	uint8_t id;
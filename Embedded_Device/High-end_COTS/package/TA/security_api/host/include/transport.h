@@ -0,0 +1,117 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+/*
+ * Framed TCP transport of the agents. Every socket is non-blocking and
+ * registered (edge-triggered) in one epoll instance; an operation reads or
+ * writes until the socket would block and then runs the event loop until it
+ * is ready again or the timeout expires. Bytes read past the end of a frame
+ * stay in the connection for the next receive.
+ *
+ * Outgoing connections are kept open after transport_release and reused by
+ * the next transport_connect to the same peer (if the peer did not close
+ * them meanwhile), and the listening socket of transport_accept is kept
+ * open across calls.
+ *
+ * The epoll instance points into the transport, it must not be moved once
+ * initialized.
+ */
+
+#define TRANSPORT_TIMEOUT_MS		10000	/* Default timeout of every operation */
+#define TRANSPORT_MAX_FRAME		(64 * 1024)
+#define TRANSPORT_MAX_CONNS		8
+#define TRANSPORT_MAX_IOV		16
+
+typedef enum {
+	TRANSPORT_FRAME_U32,	/* 4 byte big endian length before every frame */
+	TRANSPORT_FRAME_EAP	/* Frames carry their size: EAP packets, sized by the big endian length
+				   (header included) at bytes 2-3, sent as they are */
+} transport_framing;
+
+typedef struct {
+	int fd;
+	transport_framing framing;
+	uint32_t events;		/* Readiness reported by epoll, cleared when the socket would block */
+	int outgoing;			/* Opened by transport_connect, can be reused */
+	int in_use;
+	int broken;			/* An operation failed, closed on release */
+	struct sockaddr_in peer;
+	uint8_t * rx;			/* Received bytes not consumed yet */
+	size_t rx_sz;
+	size_t rx_cap;
+} transport_conn;
+
+typedef struct {
+	int epfd;
+	int timeout_ms;
+	transport_conn * conns[TRANSPORT_MAX_CONNS];
+	int listen_fd;
+	uint16_t listen_port;
+	uint32_t listen_events;
+} transport;
+
+/**
+ * @brief Initializes a transport without connections
+ * @param timeout_ms Timeout of every operation, TRANSPORT_TIMEOUT_MS if 0
+ * @retval 0 means OK
+ */
+int transport_init(transport * t, int timeout_ms);
+
+/**
+ * @brief Closes every connection and the listening socket
+ */
+void transport_close(transport * t);
+
+/**
+ * @brief Connection to addr:port, reusing an idle one to the same peer if
+ * it is still open
+ * @retval NULL on error (errno is set, ETIMEDOUT if it timed out)
+ */
+transport_conn * transport_connect(transport * t, const char * addr, uint16_t port, transport_framing framing);
+
+/**
+ * @brief Listens on port (any address), the socket is kept until another
+ * port is asked for or the transport is closed
+ * @retval 0 means OK
+ */
+int transport_listen(transport * t, uint16_t port);
+
+/**
+ * @brief Waits for the next connection on port, listening on it first if
+ * needed
+ * @retval NULL on error (errno is set, ETIMEDOUT if it timed out)
+ */
+transport_conn * transport_accept(transport * t, uint16_t port, transport_framing framing);
+
+/**
+ * @brief Sends the concatenation of iov as one frame
+ * @retval 0 means OK
+ */
+int transport_send(transport * t, transport_conn * c, const struct iovec * iov, int iovcnt);
+
+/**
+ * @brief Receives the next frame, scattered over iov
+ * @param frame_sz Size of the frame (without the TRANSPORT_FRAME_U32 prefix)
+ * @retval 0 means OK, -1 on error with errno set (EMSGSIZE if the frame did
+ * not fit in iov, it is consumed anyway)
+ */
+int transport_recv(transport * t, transport_conn * c, const struct iovec * iov, int iovcnt, size_t * frame_sz);
+
+/**
+ * @brief Receives exactly sz bytes outside of any frame (fixed size replies)
+ * @retval 0 means OK
+ */
+int transport_recv_exact(transport * t, transport_conn * c, void * buffer, size_t sz);
+
+/**
+ * @brief Gives back a connection, outgoing ones in a clean state are kept
+ * open for transport_connect, the rest are closed
+ */
+void transport_release(transport * t, transport_conn * c);
+
+#endif // TRANSPORT_H
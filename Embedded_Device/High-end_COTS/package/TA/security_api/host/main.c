@@ -1,4 +1,6 @@
 #include "custom_se_pkcs11.h"
+#include <security_api_ta.h>
+#include <tee_client_api.h>
 #include <err.h>
 #include <setjmp.h>
 #include <aceunit.h>
@@ -13,6 +15,9 @@
 #include <checksum.h>
 #include <network_manager.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
 
 extern jmp_buf *AceUnit_env;
 
@@ -58,6 +63,230 @@ void testSecondaryKeyDerivation() {
 	assert(!bsa_sendJoinRequest("MSK", "EDK_01"));
 	// assert(!bsa_sendJoinRequest("MSK", "EDK_07"));
 }
+
+void testStreaming() {
+	unsigned char psk[16] = { 0 };
+	char edk[32] = { 0 };
+	unsigned char data[40000];
+	unsigned char cipherText[40016];
+	unsigned char streamed[40016];
+	unsigned char decoded[40016];
+	unsigned char signature[16], streamedSignature[16];
+	uint16_t decoded_sz;
+	FILE * in = tmpfile(), * out = tmpfile(), * back = tmpfile();
+
+	for (int i = 0; i < sizeof(data); i++) data[i] = i * 7;
+	edk[0] = 'E';
+
+	assert(in && out && back);
+	/* Both fail if already installed (testBootstrapping, previous runs), any key will do */
+	csp_installPSK(psk);
+	store_to_ta("EDK_09", edk, sizeof(edk));
+
+	/* Same output as the one-shot calls */
+	assert(fwrite(data, 1, sizeof(data), in) == sizeof(data));
+	fflush(in);
+	rewind(in);
+	assert(!csp_encryptStream("EDK_09", fileno(in), fileno(out), AES_256_CBC));
+	assert(!csp_encryptData("EDK_09", data, sizeof(data), cipherText, AES_256_CBC));
+	rewind(out);
+	assert(fread(streamed, 1, sizeof(streamed), out) == sizeof(cipherText));
+	assert(!memcmp(streamed, cipherText, sizeof(cipherText)));
+
+	lseek(fileno(in), 0, SEEK_SET);
+	assert(!csp_signStream("PSK", fileno(in), streamedSignature));
+	assert(!csp_sign("PSK", data, sizeof(data), signature));
+	assert(!memcmp(streamedSignature, signature, sizeof(signature)));
+
+	/* And back */
+	lseek(fileno(out), 0, SEEK_SET);
+	assert(!csp_decryptStream("EDK_09", fileno(out), fileno(back), AES_256_CBC));
+	assert(!csp_decryptData("EDK_09", cipherText, sizeof(cipherText), decoded, &decoded_sz, AES_256_CBC));
+	assert(decoded_sz == sizeof(data));
+	rewind(back);
+	assert(fread(streamed, 1, sizeof(streamed), back) == sizeof(data));
+	assert(!memcmp(streamed, data, sizeof(data)));
+
+	fclose(in);
+	fclose(out);
+	fclose(back);
+}
+
+void testSignatureAlgorithmChange() {
+	unsigned char psk[16] = { 0 };
+	unsigned char frame[64] = { 0 };
+	unsigned char cmac[16], hmac[16], again[16];
+	unsigned char cmacAlgorithm = 0x01, hmacAlgorithm = 0x00;
+
+	/* Fails if already installed (testBootstrapping, previous runs) */
+	csp_installPSK(psk);
+
+	assert(!csp_reconfigure(0x01, &cmacAlgorithm, 1));
+	assert(!csp_sign("PSK", frame, sizeof(frame), cmac));
+	assert(!csp_sign("PSK", frame, sizeof(frame), again));
+	assert(!memcmp(cmac, again, sizeof(cmac)));
+
+	/* The TA caches the algorithm and the keyed operation, neither may outlive the change */
+	assert(!csp_reconfigure(0x01, &hmacAlgorithm, 1));
+	assert(!csp_sign("PSK", frame, sizeof(frame), hmac));
+	assert(memcmp(cmac, hmac, sizeof(cmac)));
+
+	assert(!csp_reconfigure(0x01, &cmacAlgorithm, 1));
+	assert(!csp_sign("PSK", frame, sizeof(frame), again));
+	assert(!memcmp(cmac, again, sizeof(cmac)));
+}
+
+void testAlgorithmChangedBySession() {
+	TEEC_Context other_ctx;
+	TEEC_Session other;
+	TEEC_Operation op;
+	TEEC_UUID uuid = TA_SECURITY_API_UUID;
+	uint32_t err_origin;
+	unsigned char frame[64] = { 0 };
+	unsigned char cmac[16], hmac[16], again[16];
+	unsigned char cmacAlgorithm = 0x01, hmacAlgorithm = 0x00;
+
+	assert(!csp_reconfigure(0x01, &hmacAlgorithm, 1));
+	assert(!csp_sign("PSK", frame, sizeof(frame), hmac));
+	assert(!csp_reconfigure(0x01, &cmacAlgorithm, 1));
+	assert(!csp_sign("PSK", frame, sizeof(frame), cmac));
+
+	/* Another client changes the algorithm the session has cached */
+	assert(TEEC_InitializeContext(NULL, &other_ctx) == TEEC_SUCCESS);
+	assert(TEEC_OpenSession(&other_ctx, &other, &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &err_origin) == TEEC_SUCCESS);
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = hmacAlgorithm;
+	assert(TEEC_InvokeCommand(&other, TA_CHANGE_SIGNATURE_ALG, &op, &err_origin) == TEEC_SUCCESS);
+	TEEC_CloseSession(&other);
+	TEEC_FinalizeContext(&other_ctx);
+
+	assert(!csp_sign("PSK", frame, sizeof(frame), again));
+	assert(!memcmp(hmac, again, sizeof(hmac)));
+
+	assert(!csp_reconfigure(0x01, &cmacAlgorithm, 1));
+	assert(!csp_sign("PSK", frame, sizeof(frame), again));
+	assert(!memcmp(cmac, again, sizeof(cmac)));
+}
+
+void testRecords() {
+	char edk[32] = { 0 };
+	unsigned char aad[3][8] = { "frame-0", "frame-1", "" };
+	unsigned char data[3][100];
+	csp_aeadRecord records[3];
+
+	edk[0] = 'E';
+	/* Fails if already installed (testStreaming, previous runs), any key will do */
+	store_to_ta("EDK_09", edk, sizeof(edk));
+
+	for (int i = 0; i < 3; i++) {
+		memset(data[i], 'a' + i, sizeof(data[i]));
+		records[i].aad = aad[i];
+		records[i].aadLen = i == 2 ? 0 : 7;
+		records[i].data = data[i];
+		records[i].dataLen = i == 1 ? 0 : sizeof(data[i]);
+	}
+
+	assert(!csp_encryptRecords("EDK_09", records, 3, AES_256_GCM));
+	assert(memcmp(records[0].nonce, records[1].nonce, 12) && memcmp(records[1].nonce, records[2].nonce, 12));
+	assert(data[0][0] != 'a' || data[0][1] != 'a');
+
+	assert(!csp_decryptRecords("EDK_09", records, 3, AES_256_GCM));
+	for (int i = 0; i < 3; i++) {
+		assert(!records[i].status);
+	}
+	assert(data[0][0] == 'a' && data[2][99] == 'c');
+
+	/* A tampered record fails alone */
+	assert(!csp_encryptRecords("EDK_09", records, 3, AES_256_GCM));
+	aad[0][0] = 'F';
+	assert(csp_decryptRecords("EDK_09", records, 3, AES_256_GCM) == 3);
+	assert(records[0].status && !records[1].status && !records[2].status);
+	assert(data[2][0] == 'c');
+}
+
+void testTransport() {
+	transport t;
+	transport_conn * client, * server, * u32_client, * u32_server;
+	uint8_t header[4] = { 0x01, 0x07, 0x00, 0x0a }, body[6] = "abcdef";
+	uint8_t frame[32], small[4];
+	size_t frame_sz;
+	struct iovec out[] = { { header, 4 }, { body, 6 } };
+	struct iovec in[] = { { frame, 3 }, { frame + 3, sizeof(frame) - 3 } };
+	struct iovec tiny = { small, sizeof(small) };
+	struct iovec ok = { "OK", 2 };
+
+	assert(!transport_init(&t, 200));
+	assert(!transport_listen(&t, 4445));
+
+	/* Self sized frames, back to back in the stream */
+	assert((client = transport_connect(&t, "127.0.0.1", 4445, TRANSPORT_FRAME_EAP)));
+	assert((server = transport_accept(&t, 4445, TRANSPORT_FRAME_EAP)));
+	assert(!transport_send(&t, client, out, 2));
+	assert(!transport_send(&t, client, out, 2));
+	assert(!transport_send(&t, client, &ok, 1));
+	assert(!transport_recv(&t, server, in, 2, &frame_sz) && frame_sz == 10);
+	assert(!memcmp(frame, header, 4) && !memcmp(frame + 4, body, 6));
+	/* Does not fit, consumed anyway */
+	assert(transport_recv(&t, server, &tiny, 1, &frame_sz) && errno == EMSGSIZE && frame_sz == 10);
+	assert(!transport_recv_exact(&t, server, small, 2) && !memcmp(small, "OK", 2));
+	assert(transport_recv_exact(&t, server, small, 1) && errno == ETIMEDOUT);
+
+	/* Length prefixed frames, on a connection of their own */
+	assert((u32_client = transport_connect(&t, "127.0.0.1", 4445, TRANSPORT_FRAME_U32)) != client);
+	assert((u32_server = transport_accept(&t, 4445, TRANSPORT_FRAME_U32)));
+	assert(!transport_send(&t, u32_client, out + 1, 1));
+	assert(!transport_recv(&t, u32_server, in, 2, &frame_sz) && frame_sz == 6);
+	assert(!memcmp(frame, body, 6));
+
+	/* Released connections are reused while the peer keeps them open */
+	transport_release(&t, u32_client);
+	assert(transport_connect(&t, "127.0.0.1", 4445, TRANSPORT_FRAME_U32) == u32_client);
+	transport_release(&t, u32_client);
+	transport_release(&t, u32_server);
+	assert((u32_client = transport_connect(&t, "127.0.0.1", 4445, TRANSPORT_FRAME_U32)));
+	assert((u32_server = transport_accept(&t, 4445, TRANSPORT_FRAME_U32)));
+
+	transport_close(&t);
+}
+
+void testTraceAndStats() {
+	ta_trace_event events[8];
+	ta_cmd_stats stats[TA_TRACE_MAX_CMDS];
+	uint16_t eventsNum, statsNum;
+	unsigned char random[16];
+	int failed = 0, randoms = 0;
+
+	assert(!csp_generateRandom(random, sizeof(random)));
+	assert(!csp_generateRandom(random, sizeof(random)));
+	/* TA_STATS fails with a short buffer, and records it in the ring */
+	assert(csp_commandStats(stats, 1, &statsNum, 0) == 2);
+
+	do {
+		assert(!csp_traceDrain(events, 8, &eventsNum, NULL));
+		for (int i = 0; i < eventsNum; i++) {
+			if (events[i].event == TA_TRACE_EV_CMD_FAILED)
+				failed = events[i].cmd == TA_STATS && events[i].value == TEEC_ERROR_SHORT_BUFFER;
+		}
+	} while (eventsNum > 0);
+	assert(failed);
+
+	assert(!csp_commandStats(stats, TA_TRACE_MAX_CMDS, &statsNum, 1));
+	for (int i = 0; i < statsNum; i++) {
+		assert(stats[i].errors <= stats[i].calls);
+		assert(stats[i].max_ms <= stats[i].total_ms);
+		if (stats[i].cmd == TA_STATS)
+			assert(stats[i].errors > 0);
+		if (stats[i].cmd == TA_GENERATE_RANDOM)
+			randoms = stats[i].calls;
+	}
+	assert(randoms >= 2);
+
+	/* Only the reading call is counted after a reset */
+	assert(!csp_commandStats(stats, TA_TRACE_MAX_CMDS, &statsNum, 0));
+	assert(statsNum == 1 && stats[0].cmd == TA_STATS && stats[0].calls == 1);
+}
+
 //
 // void testSecureComunication() {
 //
@@ -117,9 +346,12 @@ void testSecondaryKeyDerivation() {
 
 // void testNetwork() {
 //
-// 	assert(!send_bytes("192.168.178.63", 6969, mudUrlST, strlen(mudUrlST), 0));
-// 	assert(!send_bytes_encrypted_signed("EDK_01", "192.168.178.63", 6969, mudUrlST, strlen(mudUrlST), 0));
+// 	assert(!send_bytes("192.168.178.63", 6969, mudUrlST, strlen(mudUrlST)));
+// 	assert(!send_bytes_encrypted_signed("EDK_01", "192.168.178.63", 6969, mudUrlST, strlen(mudUrlST)));
 //
 // }
 
-void afterAll() { csp_terminate(); }
+void afterAll() {
+	network_close();
+	csp_terminate();
+}
@@ -3,198 +3,89 @@
 #include <stdio.h>
 #include <unistd.h>
 
-uint32_t send_bytes(char * addr, uint16_t port, uint8_t * message, size_t message_sz, int * sockfd_ptr) {
+static transport net;
+static int net_open = 0;
 
-	int sockfd;
-	struct sockaddr_in server_addr;
+transport * network_transport(void) {
 
-	// Create socket
-	if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		perror("Socket creation failed");
-		return -1;
+	if (!net_open) {
+		if (transport_init(&net, 0))
+			return NULL;
+		net_open = 1;
 	}
 
-	// Configure server address
-	memset(&server_addr, 0, sizeof(server_addr));
-	server_addr.sin_family = AF_INET;
-	server_addr.sin_port = htons(port);
+	return &net;
+}
 
-	// Convert address from text to binary form
-	if (inet_pton(AF_INET, addr, &server_addr.sin_addr) <= 0) {
-		perror("Invalid address or address not supported");
-		close(sockfd);
-	return -1;
-	}
+void network_close(void) {
 
-	// Connect to the server
-	if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-		perror("Connection failed");
-		close(sockfd);
-	return -1;
-	}
+	if (net_open)
+		transport_close(&net);
+	net_open = 0;
+}
 
-	// Send message
-	if (send(sockfd, message, message_sz, 0) < 0) {
-		perror("Send failed");
-		close(sockfd);
-	return -1;
-	}
+static uint32_t send_frame(char * addr, uint16_t port, const struct iovec * iov, int iovcnt) {
 
-	printf("Message sent successfully\n");
+	transport * t = network_transport();
+	transport_conn * conn;
 
-	// Close the socket
-	if (!sockfd) 
-		close(sockfd);
-	else 
-		*sockfd_ptr = sockfd;
-	return 0;
-}
+	if (!t)
+		return -1;
 
-uint32_t send_bytes_socket(int sockfd, uint8_t * message, size_t message_sz) {
+	conn = transport_connect(t, addr, port, TRANSPORT_FRAME_U32);
+	if (!conn)
+		return -1;
 
-	// Send message
-	if (send(sockfd, message, message_sz, 0) < 0) {
-		perror("Send failed");
-		close(sockfd);
-	return -1;
+	if (transport_send(t, conn, iov, iovcnt)) {
+		transport_release(t, conn);
+		return -1;
 	}
 
 	printf("Message sent successfully\n");
 
-	// Close the socket
-	if (!sockfd) 
-		close(sockfd);
+	transport_release(t, conn);
 	return 0;
 }
 
-uint32_t receive_bytes(uint16_t port, char * buffer, size_t * buffer_size, int * sockfd, int * server_socket) {
-
-	struct sockaddr_in server_addr, client_addr;
-        socklen_t addr_size = sizeof(client_addr);
-        ssize_t received_size;
-	int opt = 1;
-        
-	printf("Create socket\n");
-        // Create socket
-        *server_socket = socket(AF_INET, SOCK_STREAM, 0);
-        if (*server_socket == -1) {
-            perror("Socket creation failed");
-            return 1;
-        }
-
-	if (setsockopt(*server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-		perror("setsockopt failed");
-		return 1;
-	}
-	if (setsockopt(*server_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
-		perror("setsockopt failed");
-		return 1;
-	}
-        
-	printf("Configure server address structure\n");
-        // Configure server address structure
-        memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(port);
-        
-	printf("Bind socket to port\n");
-        // Bind socket to port
-        if (bind(*server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-            perror("Bind failed");
-            close(*server_socket);
-            return 2;
-        }
-        
-	printf("Listen for incoming connections\n");
-        // Listen for incoming connections
-        if (listen(*server_socket, 1) == -1) {
-            perror("Listen failed");
-            close(*server_socket);
-            return 3;
-        }
-        
-	printf("Accept a connection\n");
-        // Accept a connection
-        *sockfd = accept(*server_socket, (struct sockaddr *)&client_addr, &addr_size);
-        if (*sockfd == -1) {
-            perror("Accept failed");
-            close(*server_socket);
-            return 4;
-        }
-        
-	printf("Receive data\n");
-        // Receive data
-        received_size = recv(*sockfd, buffer, *buffer_size, 0);
-        if (received_size == -1) {
-            perror("Receive failed");
-            close(*server_socket);
-            close(*sockfd);
-            return 5;
-        }
-        
-	printf("Finished receiving\n");
-	buffer[received_size] = '\0'; // Null-terminate the string
-        // Update buffer size with actual received bytes
-        *buffer_size = (size_t)received_size;
-        
-        return 0;  // Success
-}
-
+uint32_t send_bytes(char * addr, uint16_t port, uint8_t * message, size_t message_sz) {
 
-uint32_t receive_bytes_socket(int socketfd, char *buffer, size_t * buffer_size) {
+	struct iovec iov = { message, message_sz };
 
-	if (!buffer || *buffer_size == 0) {
-	fprintf(stderr, "Invalid buffer or size.\n");
-	return -1;
-	}
-
-	ssize_t bytes_received = recv(socketfd, buffer, *buffer_size, 0);
-	if (bytes_received < 0) {
-		perror("recv");
-		return -1;
-	}
-
-	buffer[bytes_received] = '\0'; // Null-terminate the string
-	*buffer_size = bytes_received;
-	return 0;
+	return send_frame(addr, port, &iov, 1);
 }
 
-uint32_t send_bytes_encrypted_signed(char * key_id, char * addr, uint16_t port, uint8_t * message, size_t message_sz, int * sockfd_ptr) {
+uint32_t send_bytes_encrypted_signed(char * key_id, char * addr, uint16_t port, uint8_t * message, size_t message_sz) {
 
 	uint32_t res;
 	uint16_t crc = 0x0000;
+	uint8_t crc_bytes[2];
 
 	size_t encrypted_message_sz = message_sz + 16 - (message_sz % 16);
-	size_t final_message_sz = encrypted_message_sz + 2;
-	unsigned char * encrypted_message = malloc(final_message_sz);
-	unsigned char * final_message = encrypted_message;
+	unsigned char * encrypted_message = malloc(encrypted_message_sz);
+
+	if (!encrypted_message) {
+		return -1;
+	}
 
 	if ( (res = csp_encryptData(key_id, message, message_sz, encrypted_message, AES_256_CBC)) ) {
 		printf("Error encrypting message: %s\n", message);
+		free(encrypted_message);
 		return res;
 	}
 
 	crc = crc_buypass(encrypted_message, encrypted_message_sz);
 	
-	final_message[encrypted_message_sz] = htons(crc) & 0xFF00;
-	final_message[encrypted_message_sz + 1] = htons(crc) & 0x00FF;
-
-	return send_bytes(addr, port, final_message, final_message_sz, sockfd_ptr);
-}
-
-
-uint32_t close_connection(int socketfd) {
-
-	close(socketfd);
-	return 0;
-}
-
-uint32_t reset_connection(int * socketfd, int * server_socket, int new_port, char * buffer, size_t * buffer_size) {
+	crc_bytes[0] = htons(crc) & 0xFF00;
+	crc_bytes[1] = htons(crc) & 0x00FF;
 
-	close(*socketfd);
+	struct iovec iov[] = {
+		{ encrypted_message, encrypted_message_sz },
+		{ crc_bytes, 2 }
+	};
 
-	return receive_bytes(new_port, buffer, buffer_size, socketfd, server_socket);
+	res = send_frame(addr, port, iov, 2);
+	free(encrypted_message);
+	return res;
 }
 
 uint32_t get_mac(char * mac_address) {
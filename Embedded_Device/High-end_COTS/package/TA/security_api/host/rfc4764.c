@@ -128,9 +128,7 @@ static uint32_t check_header(eap_psk_header header, uint8_t header_id) {
 	return SUCCESS;
 }
 
-static uint8_t * marshal_header(eap_psk_header header) {
-
-	uint8_t * header_bytes = malloc(HEADER_SIZE);
+static void marshal_header(eap_psk_header header, uint8_t header_bytes[HEADER_SIZE]) {
 
 	header_bytes[0] = header.code;
 	header_bytes[1] = header.id;
@@ -139,15 +137,14 @@ static uint8_t * marshal_header(eap_psk_header header) {
 	header_bytes[4] = header.type;
 	header_bytes[5] = header.flags;
 
-	return header_bytes;
-
 }
 
 
-static uint32_t send_second_msg(int sockfd, char * rand_s, char * rand_p, char * cmac, char * id_p, size_t id_p_sz, char * s_cmac, char * psk_id, char ** pchannel, size_t * pchannel_sz) {
+static uint32_t send_second_msg(transport_conn * conn, char * rand_s, char * rand_p, char * cmac, char * id_p, size_t id_p_sz, char * s_cmac, char * psk_id, char ** pchannel, size_t * pchannel_sz) {
 
 	size_t rec_size;
 	char rec_buff[DEFAULT_BUFFER_SZ];
+	uint8_t marshaled_header[HEADER_SIZE];
 	third_message * response;
 	char * conc;
 	char * conc_it;
@@ -163,40 +160,23 @@ static uint32_t send_second_msg(int sockfd, char * rand_s, char * rand_p, char *
 					.type = TYPE_EAP_PSK,
 					.flags = FLAG_SECOND_MESSAGE};
 
-	
-	second_message * message = malloc(second_message_sz);
-
-	if (!message) {
-		return 1;
-	}
-
-	message->header = dummy_header;
-	memcpy(message->rand_s, rand_s, AES128_BLOCK_SIZE);
-	memcpy(message->rand_p, rand_p, AES128_BLOCK_SIZE);
-	memcpy(message->mac_p, cmac, AES128_BLOCK_SIZE);
-	memcpy(message->id_p, id_p, id_p_sz);
 
 	// We can't send the struct directly as the compiler
-	// may introduce padding between fields
-
-	uint8_t * marshaled_header = marshal_header(message->header);
-	uint8_t * marshal_second_message = malloc(second_message_sz - sizeof(eap_psk_header) + HEADER_SIZE);
-
-	uint8_t * msg_idx = marshal_second_message;
-	memcpy(msg_idx, marshaled_header, HEADER_SIZE);
-	msg_idx += HEADER_SIZE;
-	memcpy(msg_idx, message->rand_s, AES128_BLOCK_SIZE);
-	msg_idx += AES128_BLOCK_SIZE;
-	memcpy(msg_idx, message->rand_p, AES128_BLOCK_SIZE);
-	msg_idx += AES128_BLOCK_SIZE;
-	memcpy(msg_idx, message->mac_p, AES128_BLOCK_SIZE);
-	msg_idx += AES128_BLOCK_SIZE;
-	memcpy(msg_idx, message->id_p, id_p_sz);
-
-	res = send_bytes_socket(sockfd, marshal_second_message, second_message_sz - sizeof(eap_psk_header) + HEADER_SIZE);
-	if (res != SUCCESS) {
+	// may introduce padding between fields, the fields are
+	// gathered by the send instead
+
+	marshal_header(dummy_header, marshaled_header);
+	struct iovec message[] = {
+		{ marshaled_header, HEADER_SIZE },
+		{ rand_s, AES128_BLOCK_SIZE },
+		{ rand_p, AES128_BLOCK_SIZE },
+		{ cmac, AES128_BLOCK_SIZE },
+		{ id_p, id_p_sz }
+	};
+
+	if (transport_send(network_transport(), conn, message, 5)) {
 		printf("Error sending identity response\n");
-		return res;
+		return ERROR_GENERIC;
 	}
 
 	// TODO send message to server and wait for response
@@ -224,8 +204,12 @@ static uint32_t send_second_msg(int sockfd, char * rand_s, char * rand_p, char *
 	// following EAP-PSK but for now, for testing pourpuses we'll give ourselves
 	// the response
 	
-	rec_size = DEFAULT_BUFFER_SZ;
-	receive_bytes_socket(sockfd, rec_buff, &rec_size);
+	struct iovec rec_iov = { rec_buff, DEFAULT_BUFFER_SZ };
+
+	if (transport_recv(network_transport(), conn, &rec_iov, 1, &rec_size)) {
+		printf("Error receiving third EAP message\n");
+		return INVALID_SERVER_RESPONSE;
+	}
 	response = (third_message*) rec_buff;
 
 	// Compose MAC input
@@ -262,14 +246,14 @@ static uint32_t send_second_msg(int sockfd, char * rand_s, char * rand_p, char *
 
 exit_error_sign:
 	free(conc);
-	free(message);
 	return res;
 
 }
 
-static uint32_t send_fourth_msg(int sockfd, char * rand_s, char * pchannel, size_t pchannel_sz) {
+static uint32_t send_fourth_msg(transport_conn * conn, char * rand_s, char * pchannel, size_t pchannel_sz) {
 
-	uint32_t res;
+	uint32_t res = SUCCESS;
+	uint8_t marshaled_header[HEADER_SIZE];
 
 	uint16_t fourth_message_sz = sizeof(eap_psk_header) + AES128_BLOCK_SIZE + pchannel_sz;
 	eap_psk_header dummy_header = {.code = 2, 
@@ -278,39 +262,28 @@ static uint32_t send_fourth_msg(int sockfd, char * rand_s, char * pchannel, size
 					.type = TYPE_EAP_PSK,
 					.flags = FLAG_FOURTH_MESSAGE};
 
-	
-	fourth_message * message = malloc(fourth_message_sz);
-
-	if (!message) {
-		return 1;
-	}
-
-	message->header = dummy_header;
-	memcpy(message->rand_s, rand_s, AES128_BLOCK_SIZE);
-	memcpy(message->pchannel, pchannel, pchannel_sz);
 
 	// We can't send the struct directly as the compiler
 	// may introduce padding between fields
 
-	uint8_t * marshaled_header = marshal_header(message->header);
-	uint8_t * marshal_fourth_message = malloc(fourth_message_sz - sizeof(eap_psk_header) + HEADER_SIZE);
+	marshal_header(dummy_header, marshaled_header);
+	struct iovec message[] = {
+		{ marshaled_header, HEADER_SIZE },
+		{ rand_s, AES128_BLOCK_SIZE },
+		{ pchannel, pchannel_sz }
+	};
 
-	uint8_t * msg_idx = marshal_fourth_message;
-	memcpy(msg_idx, marshaled_header, HEADER_SIZE);
-	msg_idx += HEADER_SIZE;
-	memcpy(msg_idx, message->rand_s, AES128_BLOCK_SIZE);
-	msg_idx += AES128_BLOCK_SIZE;
-	memcpy(msg_idx, message->pchannel, pchannel_sz);
-
-	res = send_bytes_socket(sockfd, marshal_fourth_message, fourth_message_sz - sizeof(eap_psk_header) + HEADER_SIZE);
-	if (res != SUCCESS) printf("Error sending fourth message\n");
+	if (transport_send(network_transport(), conn, message, 3)) {
+		printf("Error sending fourth message\n");
+		res = ERROR_GENERIC;
+	}
 
 	free(pchannel);
 
 	return res;
 }
 
-static uint32_t initiate_authentication(int sockfd, char ** rand_s, char ** id_s, size_t * id_s_sz) {
+static uint32_t initiate_authentication(transport_conn * conn, char ** rand_s, char ** id_s, size_t * id_s_sz) {
 
 	uint32_t res;
         size_t rec_size;
@@ -331,11 +304,15 @@ static uint32_t initiate_authentication(int sockfd, char ** rand_s, char ** id_s
         // dummy_first->header = dummy_header;
         // memcpy(dummy_first->id_s, id_s_example, S_ID_SZ);
 
-        rec_size = DEFAULT_BUFFER_SZ;
-        rec_buff = malloc(rec_size);
-        res = receive_bytes_socket(sockfd, rec_buff, &rec_size);
-        if (res != SUCCESS || !rec_size) {
+        rec_buff = malloc(DEFAULT_BUFFER_SZ);
+        if (!rec_buff) {
+                return OUT_OF_MEMORY;
+        }
+        struct iovec rec_iov = { rec_buff, DEFAULT_BUFFER_SZ };
+
+        if (transport_recv(network_transport(), conn, &rec_iov, 1, &rec_size)) {
                 printf("Error receiving authentication message\n");
+                free(rec_buff);
                 return INVALID_SERVER_RESPONSE;
         }
 	printf("Size of received first EAP message: %zd\n", rec_size);
@@ -385,55 +362,59 @@ exit:
 	return res;
 }
 
-static uint32_t send_hello(char * url, size_t url_size, int * sockfd, uint8_t key_code) {
+static uint32_t send_hello(char * url, size_t url_size, uint8_t key_code) {
 
-	uint32_t res;
-	char rec_buff[DEFAULT_BUFFER_SZ] = { 0 };
-	size_t rec_size;
+	transport * net = network_transport();
+	transport_conn * conn;
+	char rec_buff[2];
+	uint8_t hello_header[4];
+	uint32_t res = SUCCESS;
 
-	char * hello_message = malloc(4 + url_size);
-	hello_message[0] = 0x01; // Payload type (hello message)
-	hello_message[1] = key_code; // Bootstrapping type (high end)
-	hello_message[2] = htons(url_size) & 0xFF00;
-	hello_message[3] = (htons(url_size) >> 8) & 0x00FF; // Url size big endian
-	memcpy(hello_message + 4, url, url_size);
+	if (!net) {
+		return ERROR_GENERIC;
+	}
 
-	// res = send_bytes("155.54.95.211", 33333, (uint8_t*)hello_message, 4 + url_size, sockfd);
-	res = send_bytes("155.54.95.211", 33333, (uint8_t*)hello_message, 4 + url_size, sockfd);
-	if (res != SUCCESS) {
+	hello_header[0] = 0x01; // Payload type (hello message)
+	hello_header[1] = key_code; // Bootstrapping type (high end)
+	hello_header[2] = htons(url_size) & 0xFF00;
+	hello_header[3] = (htons(url_size) >> 8) & 0x00FF; // Url size big endian
+	struct iovec hello_message[] = {
+		{ hello_header, 4 },
+		{ url, url_size }
+	};
+
+	// The connection of the previous join request is reused if the server kept it open
+	conn = transport_connect(net, BOOTSTRAPPING_SERVER_ADDR, BOOTSTRAPPING_SERVER_PORT, TRANSPORT_FRAME_EAP);
+	if (!conn || transport_send(net, conn, hello_message, 2)) {
 		printf("Error sending hello message\n");
-		return res;
+		transport_release(net, conn);
+		return ERROR_GENERIC;
 	}
 	
-	rec_size = 2; // OK or KO
-	res = receive_bytes_socket(*sockfd, rec_buff, &rec_size);
-	if (res != SUCCESS || !rec_size) {
+	// OK or KO
+	if (transport_recv_exact(net, conn, rec_buff, 2)) {
 		printf("Error receiving hello response\n");
-		close(*sockfd);
-		if (!rec_size) return INVALID_SERVER_RESPONSE; 
-		return res;
+		res = INVALID_SERVER_RESPONSE;
+	} else if (memcmp(rec_buff, "OK", 2)) {
+		res = INVALID_SERVER_RESPONSE;
 	}
 
-	if (strcmp(rec_buff, "OK")) {
-		close(*sockfd);
-		return INVALID_SERVER_RESPONSE; 
-	}
-
-	return SUCCESS;
+	transport_release(net, conn);
+	return res;
 }
 
-static uint32_t handle_success(int sockfd) {
+static uint32_t handle_success(transport_conn * conn) {
 
 	uint32_t res;
 	char rec_buff[DEFAULT_BUFFER_SZ];
 	char snd_buff[2] = "OK";
-	size_t rec_size = DEFAULT_BUFFER_SZ;
+	size_t rec_size;
+	struct iovec rec_iov = { rec_buff, DEFAULT_BUFFER_SZ };
+	struct iovec snd_iov = { snd_buff, 2 };
 
-	res = receive_bytes_socket(sockfd, rec_buff, &rec_size);
-	if (res != SUCCESS || !rec_size) {
+	if (transport_recv(network_transport(), conn, &rec_iov, 1, &rec_size)) {
 		printf("Error receiving success message\n");
-		if (!rec_size) return INVALID_SERVER_RESPONSE;
-		return res;
+		return INVALID_SERVER_RESPONSE;
 	}
 
 	uint8_t eap_code = rec_buff[0];  // First byte is the EAP code
@@ -449,26 +430,29 @@ static uint32_t handle_success(int sockfd) {
 	}
 
 	// Send the response back to the AA Manager
-	res = send_bytes_socket(sockfd, (uint8_t*)snd_buff, 2);
-	if (res != SUCCESS) {
+	if (transport_send(network_transport(), conn, &snd_iov, 1)) {
 		printf("Error sending identity response\n");
+		return ERROR_GENERIC;
 	}
 
-	return res;
+	return SUCCESS;
 }
 
-static uint32_t handle_id_request(int * sockfd, int * self_socket) {
+static uint32_t handle_id_request(transport_conn ** conn) {
 
+	transport * net = network_transport();
 	uint32_t res;
 	char rec_buff[DEFAULT_BUFFER_SZ];
 	char snd_buff[DEFAULT_BUFFER_SZ];
 	char mac_address[6];
-	size_t rec_size = DEFAULT_BUFFER_SZ;
+	size_t rec_size;
+	struct iovec rec_iov = { rec_buff, DEFAULT_BUFFER_SZ };
 
-	res = reset_connection(sockfd, self_socket, 4444, rec_buff, &rec_size);
-	if (res != SUCCESS || !rec_size) {
+	// The server connects back, the listening socket is kept open between join requests
+	*conn = transport_accept(net, BOOTSTRAPPING_CALLBACK_PORT, TRANSPORT_FRAME_EAP);
+	if (!*conn || transport_recv(net, *conn, &rec_iov, 1, &rec_size)) {
 		printf("Error receiving id request\n");
-		return res;
+		return INVALID_SERVER_RESPONSE;
 	}
 
 	uint8_t eap_code = rec_buff[0];  // First byte is the EAP code
@@ -502,10 +486,11 @@ static uint32_t handle_id_request(int * sockfd, int * self_socket) {
 	printf("Client: EAP-Response length: %d\n", response_length);
 
 	// Send the response back to the AA Manager
-	res = send_bytes_socket(*sockfd, (uint8_t*)snd_buff, response_length);
-	if (res != SUCCESS) {
+	struct iovec snd_iov = { snd_buff, response_length };
+
+	if (transport_send(net, *conn, &snd_iov, 1)) {
 		printf("Error sending identity response\n");
-		return res;
+		return ERROR_GENERIC;
 	}
 
 	return SUCCESS;
@@ -522,8 +507,7 @@ uint32_t join_request(char * url, char * psk_id, char * msk_id) {
 	size_t pchannel_sz;
 	uint8_t bootstrapp_code;
 
-	int serv_sock;
-	int self_sock;
+	transport_conn * serv_conn = NULL;
 	
 	char * id_s;
 	size_t id_s_sz;
@@ -534,21 +518,21 @@ uint32_t join_request(char * url, char * psk_id, char * msk_id) {
 		bootstrapp_code = 0x02; // To generate PSK -> MSK we use primary key derivation in server-side
 	else 
 		bootstrapp_code = 0x03; // To generate MSK -> EDK_N we use secondary key derivation in server-side
-	res = send_hello(url, strlen(url), &serv_sock, bootstrapp_code);
+	res = send_hello(url, strlen(url), bootstrapp_code);
 
 	if (res) {
 		printf("Failed to send hello message\n");
 		return res;
 	}
 
-	res = handle_id_request(&serv_sock, &self_sock);
+	res = handle_id_request(&serv_conn);
 
 	if (res) {
 		printf("Failed handle id request\n");
 		goto close_sock_exit;
 	}
 
-	res = initiate_authentication(serv_sock, &rand_s, &id_s, &id_s_sz);
+	res = initiate_authentication(serv_conn, &rand_s, &id_s, &id_s_sz);
 	DBG_print_block(rand_s);
 
 	if (res) {
@@ -578,7 +562,7 @@ uint32_t join_request(char * url, char * psk_id, char * msk_id) {
 	DBG_print_block(cmac);
 
 
-	res = send_second_msg(serv_sock, rand_s, rand_p, cmac, id_p, id_p_sz, s_cmac, psk_id, &pchannel, &pchannel_sz); 
+	res = send_second_msg(serv_conn, rand_s, rand_p, cmac, id_p, id_p_sz, s_cmac, psk_id, &pchannel, &pchannel_sz); 
 
 	if (res) {
 		printf("Failed key exchange with bootstrapping server: (0x%08x)\n", res);
@@ -606,7 +590,7 @@ uint32_t join_request(char * url, char * psk_id, char * msk_id) {
 		printf("Successfully derived MSK\n");
 	}
 
-	res = send_fourth_msg(serv_sock, rand_s, pchannel, pchannel_sz);
+	res = send_fourth_msg(serv_conn, rand_s, pchannel, pchannel_sz);
 	if (res) {
 		printf("Failed to send fourth EAP message (0x%08x)\n", res);
 		goto close_sock_exit;
@@ -615,11 +599,10 @@ uint32_t join_request(char * url, char * psk_id, char * msk_id) {
 		printf("Successfully sent fourth EAP message\n");
 	}
 
-	res = handle_success(serv_sock);
+	res = handle_success(serv_conn);
 
 close_sock_exit:
-	close(serv_sock);
-	close(self_sock);
+	transport_release(network_transport(), serv_conn);
 	return res;
 
 }
@@ -39,6 +39,7 @@ static int32_t bootstrap(unsigned char * certificate) {
 		return 1;
 	}
 
+	network_close();
 	csp_terminate();
 
 	return 0;
@@ -0,0 +1,485 @@
+#include <transport.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define WATCHED_EVENTS		(EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+#define CLOSED_EVENTS		(EPOLLERR | EPOLLHUP)
+
+#define RX_MIN_CAP		512
+
+static int64_t now_ms(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int watch(transport * t, int fd, uint32_t * events) {
+
+	struct epoll_event ev = { .events = WATCHED_EVENTS, .data.ptr = events };
+
+	return epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Runs the event loop once, adding what epoll reports to the events of every socket */
+static int poll_events(transport * t, int timeout_ms) {
+
+	struct epoll_event ev[TRANSPORT_MAX_CONNS + 1];
+	int n;
+
+	n = epoll_wait(t->epfd, ev, TRANSPORT_MAX_CONNS + 1, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (int i = 0; i < n; i++)
+		*(uint32_t *)ev[i].data.ptr |= ev[i].events;
+
+	return 0;
+}
+
+/* Runs the event loop until one of wanted (or an error or hang up) is reported in events */
+static int wait_for(transport * t, uint32_t * events, uint32_t wanted, int64_t deadline) {
+
+	while (!(*events & (wanted | CLOSED_EVENTS))) {
+		int64_t left = deadline - now_ms();
+
+		if (left <= 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if (poll_events(t, (int)left))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void conn_close(transport * t, transport_conn * c) {
+
+	for (int i = 0; i < TRANSPORT_MAX_CONNS; i++) {
+		if (t->conns[i] == c)
+			t->conns[i] = NULL;
+	}
+	epoll_ctl(t->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c->rx);
+	free(c);
+}
+
+/* Takes ownership of fd */
+static transport_conn * conn_add(transport * t, int fd, transport_framing framing) {
+
+	transport_conn * c;
+	int slot = -1;
+
+	for (int i = 0; i < TRANSPORT_MAX_CONNS && slot < 0; i++) {
+		if (!t->conns[i])
+			slot = i;
+	}
+	/* Full, make room closing an idle connection */
+	for (int i = 0; i < TRANSPORT_MAX_CONNS && slot < 0; i++) {
+		if (!t->conns[i]->in_use) {
+			conn_close(t, t->conns[i]);
+			slot = i;
+		}
+	}
+	if (slot < 0) {
+		close(fd);
+		errno = EMFILE;
+		return NULL;
+	}
+
+	c = calloc(1, sizeof(transport_conn));
+	if (!c) {
+		close(fd);
+		return NULL;
+	}
+	c->fd = fd;
+	c->framing = framing;
+	c->in_use = 1;
+	if (watch(t, fd, &c->events)) {
+		close(fd);
+		free(c);
+		return NULL;
+	}
+
+	t->conns[slot] = c;
+	return c;
+}
+
+int transport_init(transport * t, int timeout_ms) {
+
+	memset(t, 0, sizeof(transport));
+	t->timeout_ms = timeout_ms ? timeout_ms : TRANSPORT_TIMEOUT_MS;
+	t->listen_fd = -1;
+	t->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (t->epfd < 0) {
+		perror("epoll_create1 failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+void transport_close(transport * t) {
+
+	for (int i = 0; i < TRANSPORT_MAX_CONNS; i++) {
+		if (t->conns[i])
+			conn_close(t, t->conns[i]);
+	}
+	if (t->listen_fd >= 0)
+		close(t->listen_fd);
+	t->listen_fd = -1;
+	close(t->epfd);
+	t->epfd = -1;
+}
+
+/* An idle connection can be reused if the peer did not close it nor sent anything meanwhile */
+static int conn_reusable(transport * t, transport_conn * c) {
+
+	if (poll_events(t, 0))
+		return 0;
+	if (c->rx_sz || c->broken || (c->events & (CLOSED_EVENTS | EPOLLRDHUP)))
+		return 0;
+	if (c->events & EPOLLIN) {
+		char byte;
+		ssize_t n = recv(c->fd, &byte, 1, MSG_PEEK);
+
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+			return 0;
+		if (n > 0)
+			return 0;	/* Unexpected data, the stream is out of sync */
+		c->events &= ~EPOLLIN;
+	}
+
+	return 1;
+}
+
+transport_conn * transport_connect(transport * t, const char * addr, uint16_t port, transport_framing framing) {
+
+	struct sockaddr_in peer;
+	transport_conn * c;
+	int64_t deadline = now_ms() + t->timeout_ms;
+	int fd, err = 0;
+	socklen_t err_sz = sizeof(err);
+
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr, &peer.sin_addr) <= 0) {
+		printf("Invalid address or address not supported: %s\n", addr);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	for (int i = 0; i < TRANSPORT_MAX_CONNS; i++) {
+		c = t->conns[i];
+		if (!c || !c->outgoing || c->in_use || c->framing != framing ||
+		    c->peer.sin_addr.s_addr != peer.sin_addr.s_addr || c->peer.sin_port != peer.sin_port)
+			continue;
+		if (conn_reusable(t, c)) {
+			c->in_use = 1;
+			return c;
+		}
+		conn_close(t, c);
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("Socket creation failed");
+		return NULL;
+	}
+	c = conn_add(t, fd, framing);
+	if (!c)
+		return NULL;
+	c->outgoing = 1;
+	c->peer = peer;
+
+	if (connect(fd, (struct sockaddr *)&peer, sizeof(peer)) < 0) {
+		if (errno != EINPROGRESS || wait_for(t, &c->events, EPOLLOUT, deadline))
+			goto err;
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_sz) < 0)
+			goto err;
+		if (err) {
+			errno = err;
+			goto err;
+		}
+	}
+
+	return c;
+
+err:
+	err = errno;
+	perror("Connection failed");
+	conn_close(t, c);
+	errno = err;
+	return NULL;
+}
+
+int transport_listen(transport * t, uint16_t port) {
+
+	struct sockaddr_in server_addr;
+	int opt = 1;
+	int fd;
+
+	if (t->listen_fd >= 0 && t->listen_port == port)
+		return 0;
+	if (t->listen_fd >= 0) {
+		epoll_ctl(t->epfd, EPOLL_CTL_DEL, t->listen_fd, NULL);
+		close(t->listen_fd);
+		t->listen_fd = -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("Socket creation failed");
+		return -1;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+		perror("setsockopt failed");
+		close(fd);
+		return -1;
+	}
+
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = INADDR_ANY;
+	server_addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+		perror("Bind failed");
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, TRANSPORT_MAX_CONNS) < 0) {
+		perror("Listen failed");
+		close(fd);
+		return -1;
+	}
+
+	t->listen_events = 0;
+	if (watch(t, fd, &t->listen_events)) {
+		close(fd);
+		return -1;
+	}
+	t->listen_fd = fd;
+	t->listen_port = port;
+	return 0;
+}
+
+transport_conn * transport_accept(transport * t, uint16_t port, transport_framing framing) {
+
+	int64_t deadline = now_ms() + t->timeout_ms;
+	int fd;
+
+	if (transport_listen(t, port))
+		return NULL;
+
+	for (;;) {
+		fd = accept4(t->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd >= 0)
+			return conn_add(t, fd, framing);
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			perror("Accept failed");
+			return NULL;
+		}
+		t->listen_events &= ~EPOLLIN;
+		if (wait_for(t, &t->listen_events, EPOLLIN, deadline))
+			return NULL;
+	}
+}
+
+int transport_send(transport * t, transport_conn * c, const struct iovec * iov, int iovcnt) {
+
+	struct iovec vec[TRANSPORT_MAX_IOV + 1];
+	struct msghdr msg;
+	uint8_t prefix[4];
+	size_t frame_sz = 0;
+	int64_t deadline = now_ms() + t->timeout_ms;
+	int n = 0;
+
+	if (iovcnt > TRANSPORT_MAX_IOV) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (int i = 0; i < iovcnt; i++)
+		frame_sz += iov[i].iov_len;
+	if (frame_sz > TRANSPORT_MAX_FRAME) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	if (c->framing == TRANSPORT_FRAME_U32) {
+		prefix[0] = frame_sz >> 24;
+		prefix[1] = frame_sz >> 16;
+		prefix[2] = frame_sz >> 8;
+		prefix[3] = frame_sz;
+		vec[n].iov_base = prefix;
+		vec[n++].iov_len = sizeof(prefix);
+	}
+	memcpy(vec + n, iov, iovcnt * sizeof(struct iovec));
+	n += iovcnt;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = vec;
+	msg.msg_iovlen = n;
+
+	while (msg.msg_iovlen) {
+		ssize_t sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				goto err;
+			c->events &= ~EPOLLOUT;
+			if (wait_for(t, &c->events, EPOLLOUT, deadline))
+				goto err;
+			continue;
+		}
+
+		/* Skip what was sent, a partial write leaves the rest for the next round */
+		while (msg.msg_iovlen && (size_t)sent >= msg.msg_iov->iov_len) {
+			sent -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen) {
+			msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + sent;
+			msg.msg_iov->iov_len -= sent;
+		}
+	}
+
+	return 0;
+
+err:
+	perror("Send failed");
+	c->broken = 1;
+	return -1;
+}
+
+/* Reads until at least need bytes are buffered */
+static int fill(transport * t, transport_conn * c, size_t need, int64_t deadline) {
+
+	if (need > c->rx_cap) {
+		size_t cap = c->rx_cap ? c->rx_cap : RX_MIN_CAP;
+		uint8_t * rx;
+
+		while (cap < need)
+			cap *= 2;
+		rx = realloc(c->rx, cap);
+		if (!rx)
+			return -1;
+		c->rx = rx;
+		c->rx_cap = cap;
+	}
+
+	while (c->rx_sz < need) {
+		ssize_t n = recv(c->fd, c->rx + c->rx_sz, c->rx_cap - c->rx_sz, 0);
+
+		if (n > 0) {
+			c->rx_sz += n;
+			continue;
+		}
+		if (n == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		c->events &= ~EPOLLIN;
+		if (wait_for(t, &c->events, EPOLLIN | EPOLLRDHUP, deadline))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void consume(transport_conn * c, size_t sz) {
+
+	c->rx_sz -= sz;
+	memmove(c->rx, c->rx + sz, c->rx_sz);
+}
+
+int transport_recv(transport * t, transport_conn * c, const struct iovec * iov, int iovcnt, size_t * frame_sz) {
+
+	int64_t deadline = now_ms() + t->timeout_ms;
+	size_t header_sz, sz, copied = 0;
+
+	if (c->framing == TRANSPORT_FRAME_U32) {
+		if (fill(t, c, 4, deadline))
+			goto err;
+		header_sz = 4;
+		sz = (size_t)c->rx[0] << 24 | (size_t)c->rx[1] << 16 | (size_t)c->rx[2] << 8 | c->rx[3];
+	} else {
+		if (fill(t, c, 4, deadline))
+			goto err;
+		header_sz = 0;
+		sz = (size_t)c->rx[2] << 8 | c->rx[3];
+		if (sz < 4) {
+			errno = EPROTO;
+			goto err;
+		}
+	}
+	if (sz > TRANSPORT_MAX_FRAME) {
+		errno = EPROTO;
+		goto err;
+	}
+	if (fill(t, c, header_sz + sz, deadline))
+		goto err;
+
+	for (int i = 0; i < iovcnt && copied < sz; i++) {
+		size_t n = sz - copied < iov[i].iov_len ? sz - copied : iov[i].iov_len;
+
+		memcpy(iov[i].iov_base, c->rx + header_sz + copied, n);
+		copied += n;
+	}
+	consume(c, header_sz + sz);
+
+	*frame_sz = sz;
+	if (copied < sz) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	return 0;
+
+err:
+	perror("Receive failed");
+	c->broken = 1;
+	return -1;
+}
+
+int transport_recv_exact(transport * t, transport_conn * c, void * buffer, size_t sz) {
+
+	if (fill(t, c, sz, now_ms() + t->timeout_ms)) {
+		perror("Receive failed");
+		c->broken = 1;
+		return -1;
+	}
+
+	memcpy(buffer, c->rx, sz);
+	consume(c, sz);
+	return 0;
+}
+
+void transport_release(transport * t, transport_conn * c) {
+
+	if (!c)
+		return;
+	if (!c->outgoing || c->broken || c->rx_sz) {
+		conn_close(t, c);
+		return;
+	}
+	c->in_use = 0;
+}
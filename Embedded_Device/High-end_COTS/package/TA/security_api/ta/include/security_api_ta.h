@@ -27,6 +27,7 @@
 #ifndef TA_DPABC_H
 #define TA_DPABC_H
 
+#include <stdint.h>
 
 /*
  * This UUID is generated with uuidgen
@@ -64,6 +65,47 @@
 #define TA_DERIVE_EDK			22
 #define TA_WIPE_BOOTSTRAP		23
 #define TA_CHANGE_SIGNATURE_ALG		24
+#define TA_CIPHER_UPDATE		25
+#define TA_AES_256_GCM_ENCRYPT		26
+#define TA_AES_256_GCM_DECRYPT		27
+#define TA_TRACE_DRAIN			28
+#define TA_STATS			29
+
+/*
+ * Operations of the streaming commands: TA_CYPHER_INIT opens one on the
+ * session, TA_CIPHER_UPDATE feeds it chunk by chunk and TA_CIPHER_DO_FINAL
+ * returns the last block (or the MAC) and releases it
+ */
+#define TA_STREAM_ENCRYPT		1	/* AES-256-CBC, same output as TA_AES_256 */
+#define TA_STREAM_DECRYPT		2	/* AES-256-CBC, same output as TA_AES_DECODE_256 */
+#define TA_STREAM_MAC			3	/* Configured signature algorithm, same output as TA_SIGN */
+
+#define TA_MAX_STREAMS			4	/* Streams open at once on a session */
+
+/*
+ * Records of TA_AES_256_GCM_ENCRYPT/DECRYPT, laid one after another in a
+ * single buffer: every header is followed by aad_sz bytes of additional
+ * data and data_sz bytes of data, which are encrypted or decrypted in place
+ */
+#define TA_GCM_NONCE_SIZE		12
+#define TA_GCM_TAG_SIZE			16
+
+typedef struct {
+	uint32_t aad_sz;
+	uint32_t data_sz;
+	uint32_t status;			/* Set by the TA: 0, or TEE_ERROR_MAC_INVALID if the tag did not match */
+	uint8_t nonce[TA_GCM_NONCE_SIZE];	/* Set by the TA when encrypting, from its counter */
+	uint8_t tag[TA_GCM_TAG_SIZE];		/* Set by the TA when encrypting */
+} ta_gcm_record;
+
+/*
+ * Trace ring and command counters (ta_trace.h). TA_TRACE_DRAIN moves the
+ * oldest events that fit in its output buffer to it, TA_STATS copies the
+ * counters of the commands called so far (and resets them if asked to).
+ * Events of this TA:
+ */
+#define TA_EV_OBJECT_WRITTEN		0x100	/* value: size of the object */
+#define TA_EV_OBJECT_REMOVED		0x101	/* value: 0 */
 
 
 #endif /*TA_DPABC_H*/
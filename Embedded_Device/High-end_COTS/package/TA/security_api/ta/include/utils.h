@@ -3,6 +3,8 @@
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
 
+#include <ta_trace.h>
+
 #define AES128_BLOCK_SIZE		16
 #define AES128_KEY_BYTE_SIZE		16
 #define AES128_KEY_BIT_SIZE		128
@@ -11,14 +13,28 @@
 #define AES256_KEY_BYTE_SIZE		32
 #define AES256_KEY_BIT_SIZE		256
 
+#define AES_GCM_NONCE_SIZE		12
+#define AES_GCM_TAG_SIZE		16
+#define AES_GCM_TAG_BIT_SIZE		128
+
 typedef struct {
 	TEE_OperationHandle op_handle;
 	TEE_ObjectHandle key_handle; 
 } aes_session;
 
-void DBG_print_block(char * block);
+/*
+ * Bumped whenever a persistent object is written or removed, anything read
+ * from storage before is stale once it changes. The TA is single instance,
+ * so it counts the writes of every session
+ */
+extern uint32_t storage_generation;
+
+/* Dumps of key material, only built in with TA_TRACE_LEVEL set to debug */
+#define DBG_print_block(block) \
+	TA_TRACE_HEX(TA_TRACE_DEBUG, #block, block, AES128_BLOCK_SIZE)
 
-void DBG_print_extended_block(char * block, size_t block_sz);
+#define DBG_print_extended_block(block, block_sz) \
+	TA_TRACE_HEX(TA_TRACE_DEBUG, #block, block, block_sz)
 
 TEE_Result AES_128_init(char * key, aes_session * session); 
 
@@ -26,16 +42,33 @@ TEE_Result AES_256_init(char * key, aes_session * session);
 
 TEE_Result AES_decode_256_init(char * key, aes_session * session);
 
+TEE_Result AES_GCM_256_init(char * key, aes_session * session);
+
+TEE_Result AES_GCM_decode_256_init(char * key, aes_session * session);
+
 TEE_Result SHA_256_init(aes_session * session);
 
 TEE_Result AES_CMAC_128_init(char * key, aes_session * session);
 
 TEE_Result AES_HMAC_MD5_init(char * key, aes_session * session);
 
+/* Get an initialized operation ready for a new message, its key is kept */
+TEE_Result AES_128_reset(aes_session * session);
+
+TEE_Result AES_256_reset(aes_session * session);
+
+TEE_Result AES_CMAC_128_reset(aes_session * session);
+
+TEE_Result AES_HMAC_MD5_reset(aes_session * session);
+
+TEE_Result AES_GCM_256_reset(aes_session * session);
+
 TEE_Result AES_128_terminate(aes_session * sess); 
 
 TEE_Result AES_256_terminate(aes_session * sess); 
 
+TEE_Result AES_GCM_256_terminate(aes_session * sess); 
+
 TEE_Result AES_CMAC_128_terminate(aes_session * sess); 
 
 TEE_Result AES_HMAC_MD5_terminate(aes_session * sess); 
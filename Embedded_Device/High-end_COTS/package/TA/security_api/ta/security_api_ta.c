@@ -4,6 +4,7 @@
 #include <tee_internal_api_extensions.h>
 
 #include <utils.h>
+#include <ta_trace.h>
 
 #include <security_api_ta.h>
 
@@ -48,6 +49,56 @@ const int stored_bootstrap_elements_sz[] = {
 					MSK_DERIVED_KDK_ID_SZ,
 					6,
 					};
+
+/* Streaming operation opened with TA_CYPHER_INIT */
+typedef struct {
+	uint32_t mode;				/* TA_STREAM_*, 0 while the slot is free */
+	uint8_t algo;				/* Signature algorithm of TA_STREAM_MAC */
+	aes_session sess;
+	char pending[AES256_BLOCK_SIZE];	/* Input not ciphered yet: a partial block, or the last block when decrypting */
+	size_t pending_sz;
+} cipher_stream;
+
+#define OP_CACHE_SIZE			8
+#define MAX_OBJECT_ID_SZ		64	/* TEE_OBJECT_ID_MAX_LEN */
+
+/* Operations kept by the cache, one per key and kind */
+#define OP_AES_128			1	/* AES-128-ECB, key derivation */
+#define OP_AES_256			2	/* AES-256-CBC encode */
+#define OP_AES_DECODE_256		3	/* AES-256-CBC decode */
+#define OP_HMAC_MD5			4
+#define OP_CMAC_128			5
+#define OP_AES_GCM_256			6
+#define OP_AES_GCM_DECODE_256		7
+
+#define GCM_COUNTER_ID			"gcm_nonce_counter"
+#define GCM_COUNTER_ID_SZ		17
+#define GCM_COUNTER_RESERVE		65536	/* Nonces reserved in storage at once */
+
+/* Operation with its key already set, reset before every use */
+typedef struct {
+	uint32_t kind;				/* OP_*, 0 while the entry is free */
+	char key_id[MAX_OBJECT_ID_SZ];
+	size_t key_id_sz;
+	aes_session sess;
+	uint32_t last_use;
+} cached_operation;
+
+typedef struct {
+	cipher_stream streams[TA_MAX_STREAMS];
+	cached_operation ops[OP_CACHE_SIZE];
+	uint32_t clock;				/* Bumped by every lookup, to evict the least recently used entry */
+	uint8_t signature_algorithm;
+	uint8_t has_signature_algorithm;
+	uint32_t generation;			/* storage_generation the cache was filled at */
+	uint64_t gcm_counter;			/* Next GCM nonce counter of the session */
+	uint64_t gcm_counter_end;		/* End of the counters it reserved */
+} session_ctx;
+
+static void stream_release(cipher_stream * stream);
+
+static void invalidate_cache(session_ctx * ctx);
+
 /*
  * Called when the instance of the TA is created. This is the first call in
  * the TA.
@@ -82,14 +133,17 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
 
 	DMSG("has been called");
 
-	/* Unused parameter */
-	(void)&sess_ctx;
+	*sess_ctx = TEE_Malloc(sizeof(session_ctx), TEE_MALLOC_FILL_ZERO);
+	if (!*sess_ctx) {
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
 
 	/*
 	 * The DMSG() macro is non-standard, TEE Internal API doesn't
 	 * specify any means to logging from a TA.
 	 */
 	IMSG("Session created\n");
+	ta_trace_record(TA_TRACE_EV_SESSION_OPEN, 0);
 
 	/* If return value != TEE_SUCCESS the session will not be created. */
 	return TEE_SUCCESS;
@@ -101,11 +155,203 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
  */
 void TA_CloseSessionEntryPoint(void __maybe_unused *sess_ctx)
 {
-	(void)&sess_ctx; /* Unused parameter */
+	session_ctx * ctx = sess_ctx;
+
+	/* Streams the client did not finish */
+	for (int i = 0; i < TA_MAX_STREAMS; i++) {
+		stream_release(&ctx->streams[i]);
+	}
+	invalidate_cache(ctx);
+	TEE_Free(ctx);
+
+	ta_trace_record(TA_TRACE_EV_SESSION_CLOSE, 0);
 	IMSG("Goodbye!\n");
 }
 
 
+static void op_release(cached_operation * op) {
+
+	switch (op->kind) {
+		case OP_AES_128:
+			AES_128_terminate(&op->sess);
+		break;
+		case OP_AES_256:
+		case OP_AES_DECODE_256:
+			AES_256_terminate(&op->sess);
+		break;
+		case OP_AES_GCM_256:
+		case OP_AES_GCM_DECODE_256:
+			AES_GCM_256_terminate(&op->sess);
+		break;
+		case OP_HMAC_MD5:
+			AES_HMAC_MD5_terminate(&op->sess);
+		break;
+		case OP_CMAC_128:
+			AES_CMAC_128_terminate(&op->sess);
+		break;
+		default:
+			return;
+	}
+
+	TEE_MemFill(op, 0, sizeof(cached_operation));
+}
+
+static void invalidate_cache(session_ctx * ctx) {
+
+	for (int i = 0; i < OP_CACHE_SIZE; i++) {
+		op_release(&ctx->ops[i]);
+	}
+	ctx->has_signature_algorithm = 0;
+	ctx->generation = storage_generation;
+}
+
+/* Drops whatever was read from storage if an object changed since */
+static void check_cache(session_ctx * ctx) {
+
+	if (ctx->generation != storage_generation) {
+		invalidate_cache(ctx);
+	}
+}
+
+static TEE_Result get_signature_algorithm(session_ctx * ctx, uint8_t * algo) {
+
+	char algo_buff[4];
+	size_t read_bytes = 4;
+	TEE_Result res;
+
+	check_cache(ctx);
+
+	if (!ctx->has_signature_algorithm) {
+		res = read_raw_object(SIGNATURE_ALGORITHM_ID, SIGNATURE_ALGORITHM_ID_SZ, algo_buff, 4, &read_bytes, TEE_DATA_FLAG_ACCESS_READ);
+
+		if (res != TEE_SUCCESS) {
+			EMSG("Error while reading signature algorithm: 0x%08x", res);
+			return res;
+		}
+
+		ctx->signature_algorithm = (uint8_t)(*algo_buff);
+		ctx->has_signature_algorithm = 1;
+	}
+
+	*algo = ctx->signature_algorithm;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Operation of the given kind keyed with the object key_id, ready for a new
+ * message. Only the first call for a key reads it and sets the operation up,
+ * the next ones reset the cached operation
+ */
+static TEE_Result get_operation(session_ctx * ctx, uint32_t kind, char * key_id, size_t key_id_sz, TEE_OperationHandle * op_handle) {
+
+	cached_operation * op, * victim = &ctx->ops[0];
+	char key[AES256_KEY_BYTE_SIZE];
+	size_t key_sz, read_bytes;
+	TEE_Result res;
+
+	if (key_id_sz > MAX_OBJECT_ID_SZ) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	check_cache(ctx);
+	ctx->clock++;
+
+	for (int i = 0; i < OP_CACHE_SIZE; i++) {
+		op = &ctx->ops[i];
+
+		if (op->kind == kind && op->key_id_sz == key_id_sz && !TEE_MemCompare(op->key_id, key_id, key_id_sz)) {
+			switch (kind) {
+				case OP_AES_128:
+					AES_128_reset(&op->sess);
+				break;
+				case OP_AES_256:
+				case OP_AES_DECODE_256:
+					AES_256_reset(&op->sess);
+				break;
+				case OP_AES_GCM_256:
+				case OP_AES_GCM_DECODE_256:
+					AES_GCM_256_reset(&op->sess);
+				break;
+				case OP_HMAC_MD5:
+					AES_HMAC_MD5_reset(&op->sess);
+				break;
+				default:
+					AES_CMAC_128_reset(&op->sess);
+			}
+			op->last_use = ctx->clock;
+			*op_handle = op->sess.op_handle;
+			return TEE_SUCCESS;
+		}
+
+		/* A free entry, or else the least recently used one */
+		if (victim->kind && (!op->kind || op->last_use < victim->last_use)) {
+			victim = op;
+		}
+	}
+
+	switch (kind) {
+		case OP_AES_256:
+		case OP_AES_DECODE_256:
+		case OP_AES_GCM_256:
+		case OP_AES_GCM_DECODE_256:
+			key_sz = AES256_KEY_BYTE_SIZE;
+		break;
+		default:
+			key_sz = AES128_KEY_BYTE_SIZE;
+	}
+	read_bytes = key_sz;
+	res = read_raw_object(key_id, key_id_sz, key, key_sz, &read_bytes, TEE_DATA_FLAG_ACCESS_READ);
+
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to retreive key: 0x%08x", res);
+		return res;
+	}
+
+	if (read_bytes != key_sz) {
+		EMSG("Invalid size key: %lu\n", read_bytes);
+		TEE_MemFill(key, 0, sizeof(key));
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	op_release(victim);
+
+	switch (kind) {
+		case OP_AES_128:
+			res = AES_128_init(key, &victim->sess);
+		break;
+		case OP_AES_256:
+			res = AES_256_init(key, &victim->sess);
+		break;
+		case OP_AES_DECODE_256:
+			res = AES_decode_256_init(key, &victim->sess);
+		break;
+		case OP_AES_GCM_256:
+			res = AES_GCM_256_init(key, &victim->sess);
+		break;
+		case OP_AES_GCM_DECODE_256:
+			res = AES_GCM_decode_256_init(key, &victim->sess);
+		break;
+		case OP_HMAC_MD5:
+			res = AES_HMAC_MD5_init(key, &victim->sess);
+		break;
+		default:
+			res = AES_CMAC_128_init(key, &victim->sess);
+	}
+	TEE_MemFill(key, 0, sizeof(key));
+
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+
+	victim->kind = kind;
+	TEE_MemMove(victim->key_id, key_id, key_id_sz);
+	victim->key_id_sz = key_id_sz;
+	victim->last_use = ctx->clock;
+	*op_handle = victim->sess.op_handle;
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result key_setup(char * psk, char * ak_id, size_t ak_id_sz, char * kdk_id, size_t kdk_id_sz) {
 
 	char input_block[AES128_BLOCK_SIZE] = { 0 };
@@ -329,11 +575,10 @@ static TEE_Result reduce_and_install_edk(char * key, unsigned char session) {
 }
 
 // A value of session equal to 0 indicates the generation of the original MSK
-static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_id_sz, unsigned char session) {
+static TEE_Result derive_session_keys(session_ctx * ctx, char * rand_p, char * kdk_id, size_t kdk_id_sz, unsigned char session) {
 
 	TEE_Result res;
-	aes_session aes_sess;
-	char kdk[AES128_KEY_BYTE_SIZE];
+	TEE_OperationHandle op;
 
 	char tek[AES128_BLOCK_SIZE];
 	char key[AES128_BLOCK_SIZE * 4];
@@ -341,20 +586,10 @@ static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_i
 	char inter_block[AES128_BLOCK_SIZE];
 	char inter_block_b[AES128_BLOCK_SIZE];
 
-	uint32_t flags =  TEE_DATA_FLAG_ACCESS_READ;
-
 	size_t dst_sz;
 
 
-	size_t read_bytes = AES128_KEY_BYTE_SIZE;
-	res = read_raw_object(kdk_id, kdk_id_sz, kdk, AES128_KEY_BYTE_SIZE, &read_bytes, flags);
-
-	if (res != TEE_SUCCESS || read_bytes != AES128_KEY_BYTE_SIZE) {
-		EMSG("Failed to retreive KDK: 0x%08x", res);
-		return res;
-	}
-
-	res = AES_128_init(kdk, &aes_sess);
+	res = get_operation(ctx, OP_AES_128, kdk_id, kdk_id_sz, &op);
 
 	if (res != TEE_SUCCESS) {
 		EMSG("AES init failed: 0x%08x", res);
@@ -362,7 +597,7 @@ static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_i
 	} 
 
 	dst_sz = AES128_BLOCK_SIZE;
-	res = AES_128_cipher(aes_sess.op_handle, rand_p, AES128_BLOCK_SIZE, inter_block, &dst_sz);
+	res = AES_128_cipher(op, rand_p, AES128_BLOCK_SIZE, inter_block, &dst_sz);
 
 	if (res != TEE_SUCCESS) {
 		EMSG("AES cipher failed: 0x%08x", res);
@@ -373,7 +608,7 @@ static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_i
 	inter_block_b[AES128_BLOCK_SIZE-1] ^= 0x01;
 	
 	dst_sz = AES128_BLOCK_SIZE;
-	res = AES_128_cipher(aes_sess.op_handle, inter_block_b, AES128_BLOCK_SIZE, tek, &dst_sz);
+	res = AES_128_cipher(op, inter_block_b, AES128_BLOCK_SIZE, tek, &dst_sz);
 
 	if (res != TEE_SUCCESS) {
 		EMSG("AES cipher failed: 0x%08x", res);
@@ -385,7 +620,7 @@ static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_i
 		inter_block_b[AES128_BLOCK_SIZE-1] ^= (0x02 + i);
 
 		dst_sz = AES128_BLOCK_SIZE;
-		res = AES_128_cipher(aes_sess.op_handle, inter_block_b, AES128_BLOCK_SIZE, key + AES128_BLOCK_SIZE * i, &dst_sz);
+		res = AES_128_cipher(op, inter_block_b, AES128_BLOCK_SIZE, key + AES128_BLOCK_SIZE * i, &dst_sz);
 
 		if (res != TEE_SUCCESS) {
 			EMSG("AES cipher failed: 0x%08x", res);
@@ -398,7 +633,7 @@ static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_i
 		inter_block_b[AES128_BLOCK_SIZE-1] ^= (0x05 + i);
 
 		dst_sz = AES128_BLOCK_SIZE;
-		res = AES_128_cipher(aes_sess.op_handle, inter_block_b, AES128_BLOCK_SIZE, emsk + AES128_BLOCK_SIZE * i, &dst_sz);
+		res = AES_128_cipher(op, inter_block_b, AES128_BLOCK_SIZE, emsk + AES128_BLOCK_SIZE * i, &dst_sz);
 
 		if (res != TEE_SUCCESS) {
 			EMSG("AES cipher failed: 0x%08x", res);
@@ -406,13 +641,6 @@ static TEE_Result derive_session_keys(char * rand_p, char * kdk_id, size_t kdk_i
 		}
 	}
 
-	res = AES_128_terminate(&aes_sess);
-
-	if (res != TEE_SUCCESS) {
-		EMSG("AES termination failed: 0x%08x", res);
-		return res;
-	} 
-
 	// If we are generating the original MSK, we install its reduced
 	// version for future key derivation
 	if (!session) {
@@ -485,7 +713,7 @@ static TEE_Result installPSK(uint32_t param_types,
 
 }
 
-static TEE_Result deriveMSK(uint32_t param_types,
+static TEE_Result deriveMSK(session_ctx * ctx, uint32_t param_types,
 	TEE_Param params[4])
 {
 
@@ -506,11 +734,11 @@ static TEE_Result deriveMSK(uint32_t param_types,
 
 	TEE_MemMove(rand_p, params[0].memref.buffer, AES128_KEY_BYTE_SIZE);
 
-	return derive_session_keys(rand_p, KDK_ID, KDK_ID_SZ, 0);
+	return derive_session_keys(ctx, rand_p, KDK_ID, KDK_ID_SZ, 0);
 
 }
 
-static TEE_Result deriveEDK(uint32_t param_types,
+static TEE_Result deriveEDK(session_ctx * ctx, uint32_t param_types,
 	TEE_Param params[4])
 {
 
@@ -531,24 +759,15 @@ static TEE_Result deriveEDK(uint32_t param_types,
 
 	TEE_MemMove(rand_p, params[0].memref.buffer, AES128_KEY_BYTE_SIZE);
 
-	return derive_session_keys(rand_p, MSK_DERIVED_KDK_ID, MSK_DERIVED_KDK_ID_SZ, params[1].value.a);
+	return derive_session_keys(ctx, rand_p, MSK_DERIVED_KDK_ID, MSK_DERIVED_KDK_ID_SZ, params[1].value.a);
 
 }
 
-static TEE_Result sign(uint32_t param_types,
+static TEE_Result sign(session_ctx * ctx, uint32_t param_types,
 	TEE_Param params[4])
 {
-	char * keyId;
-	size_t keyId_sz;
-	
-	char * data;
-	size_t data_sz;
-
-	char algo_buff[4];
 	uint8_t algo;
-
-	char key[AES128_BLOCK_SIZE];
-	aes_session sess;
+	TEE_OperationHandle op;
 
 	TEE_Result res;
 
@@ -562,90 +781,45 @@ static TEE_Result sign(uint32_t param_types,
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	uint32_t flags =  TEE_DATA_FLAG_ACCESS_READ;
-	size_t read_bytes = 4;
-	res = read_raw_object(SIGNATURE_ALGORITHM_ID, SIGNATURE_ALGORITHM_ID_SZ, algo_buff, 4, &read_bytes, flags);
-
-	if (res != TEE_SUCCESS) {
-		EMSG("Error while reading signature algorithm: 0x%08x", res);
-		return res;
-	}
-
-	algo = (uint8_t)(*algo_buff);
-
-	keyId_sz = params[0].memref.size;
-	keyId = TEE_Malloc(keyId_sz, TEE_MALLOC_FILL_ZERO);
-	if (!keyId) {
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-	TEE_MemMove(keyId, params[0].memref.buffer, keyId_sz);
-
-
-	data_sz = params[1].memref.size;
-	data = TEE_Malloc(data_sz, TEE_MALLOC_FILL_ZERO);
-	if (!data) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	if (params[2].memref.size != AES128_BLOCK_SIZE) {
+		return TEE_ERROR_BAD_PARAMETERS;
 	}
-	TEE_MemMove(data, params[1].memref.buffer, data_sz);
 
-	read_bytes = AES128_KEY_BYTE_SIZE;
-	res = read_raw_object(keyId, keyId_sz, key, AES128_KEY_BYTE_SIZE, &read_bytes, flags);
-
-	if (res != TEE_SUCCESS || read_bytes != AES128_KEY_BYTE_SIZE) {
-		EMSG("Failed to retreive KDK: 0x%08x", res);
+	res = get_signature_algorithm(ctx, &algo);
+	if (res != TEE_SUCCESS) {
 		return res;
 	}
 
+	/* The key and the operation come from the session cache after the first call */
 	switch (algo) {
 		case 0x00:
-			if (params[2].memref.size != AES128_BLOCK_SIZE) {
-				return TEE_ERROR_BAD_PARAMETERS;
-			}
-
-			IMSG("Calling init");
-
-			res = AES_HMAC_MD5_init(key, &sess);
+			res = get_operation(ctx, OP_HMAC_MD5, params[0].memref.buffer, params[0].memref.size, &op);
 			if (res != TEE_SUCCESS) {
 				EMSG("Failed to initializate HMAC: 0x%08x", res);
 				return res;
 			}
 
-			IMSG("Calling cipher");
-			size_t hmac_sz = AES128_BLOCK_SIZE;
-			res = AES_HMAC_MD5_cipher(sess.op_handle, data, data_sz, params[2].memref.buffer, &params[2].memref.size);
+			res = AES_HMAC_MD5_cipher(op, params[1].memref.buffer, params[1].memref.size, params[2].memref.buffer, &params[2].memref.size);
 			if (res != TEE_SUCCESS) {
 				EMSG("HMAC failed : 0x%08x", res);
 				return res;
 			}
 
-			DMSG("Size of generated HMAC: %ld", hmac_sz);
-
-			AES_HMAC_MD5_terminate(&sess);
-
 			return TEE_SUCCESS;
 		break;
 		case 0x01:
-			if (params[2].memref.size != AES128_BLOCK_SIZE) {
-				return TEE_ERROR_BAD_PARAMETERS;
-			}
-
-			res = AES_CMAC_128_init(key, &sess);
+			res = get_operation(ctx, OP_CMAC_128, params[0].memref.buffer, params[0].memref.size, &op);
 			if (res != TEE_SUCCESS) {
 				EMSG("Failed to initializate AES CMAC: 0x%08x", res);
 				return res;
 			}
 
-			size_t cmac_sz = AES128_BLOCK_SIZE;
-			res = AES_CMAC_128_cipher(sess.op_handle, data, data_sz, params[2].memref.buffer, &params[2].memref.size);
+			res = AES_CMAC_128_cipher(op, params[1].memref.buffer, params[1].memref.size, params[2].memref.buffer, &params[2].memref.size);
 			if (res != TEE_SUCCESS) {
 				EMSG("AES CMAC failed : 0x%08x", res);
 				return res;
 			}
 
-			DMSG("Size of generated CMAC: %ld", cmac_sz);
-
-			AES_CMAC_128_terminate(&sess);
-
 			return TEE_SUCCESS;
 		break;
 		default:
@@ -788,14 +962,11 @@ static TEE_Result retreive(uint32_t param_types,
 	res = read_raw_object(storeId, storeId_sz, params[1].memref.buffer, params[1].memref.size, &retreived_sz, flags); 
 	
 	params[1].memref.size = retreived_sz;
-	printf("retreived cert at sec_api: ");
-	printf("0x");
-	for (uint32_t i = 0; i < params[1].memref.size; i++) printf("%02x ", ((char*)params[1].memref.buffer)[i]);
-	printf("\n");
 
 	if (res != TEE_SUCCESS) {
 		goto exit;
 	}
+	TA_TRACE_HEX(TA_TRACE_DEBUG, "Retreived cert", params[1].memref.buffer, retreived_sz);
 
 exit:
 	TEE_Free(storeId);
@@ -845,20 +1016,16 @@ static TEE_Result change_signature_alg(uint32_t param_types,
 
 }
 
-static TEE_Result api_aes256(uint32_t param_types,
+static TEE_Result api_aes256(session_ctx * ctx, uint32_t param_types,
 	TEE_Param params[4])
 {
-	char * keyId;
-	size_t keyId_sz;
-	
 	char * data;
 	size_t data_sz;
+	size_t full_sz;
+	size_t dst_sz;
 
-	char * padded_data;
-	size_t padded_data_sz;
-
-	char key[AES256_KEY_BYTE_SIZE];
-	aes_session sess;
+	char last_block[AES256_BLOCK_SIZE];
+	TEE_OperationHandle op;
 
 	TEE_Result res;
 
@@ -876,176 +1043,636 @@ static TEE_Result api_aes256(uint32_t param_types,
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	keyId_sz = params[0].memref.size;
-	keyId = TEE_Malloc(keyId_sz, TEE_MALLOC_FILL_ZERO);
-	if (!keyId) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	data = params[1].memref.buffer;
+	data_sz = params[1].memref.size;
+
+	res = get_operation(ctx, OP_AES_256, params[0].memref.buffer, params[0].memref.size, &op);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to initializate AES 256: 0x%08x", res);
+		return res;
 	}
-	TEE_MemMove(keyId, params[0].memref.buffer, keyId_sz);
 
+	// Whole blocks are ciphered from the input, only the last one is
+	// copied to add the ISO9797 M2 Padding
 
-	data_sz = params[1].memref.size;
-	data = TEE_Malloc(data_sz, TEE_MALLOC_FILL_ZERO);
-	if (!data) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	full_sz = data_sz - data_sz % AES256_BLOCK_SIZE;
+	if (full_sz) {
+		dst_sz = full_sz;
+		res = AES_256_cipher(op, data, full_sz, params[2].memref.buffer, &dst_sz);
+		if (res != TEE_SUCCESS) {
+			EMSG("AES 256 failed : 0x%08x", res);
+			return res;
+		}
 	}
-	TEE_MemMove(data, params[1].memref.buffer, data_sz);
 
-	padded_data_sz = data_sz + AES256_BLOCK_SIZE - (data_sz % AES256_BLOCK_SIZE);
-	padded_data = TEE_Malloc(padded_data_sz, TEE_MALLOC_FILL_ZERO);
-	if (!padded_data) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	TEE_MemMove(last_block, data + full_sz, data_sz - full_sz);
+	TEE_MemFill(last_block + data_sz - full_sz, 0x80, 1);
+	TEE_MemFill(last_block + data_sz - full_sz + 1, 0x00, AES256_BLOCK_SIZE - (data_sz - full_sz) - 1);
+
+	dst_sz = AES256_BLOCK_SIZE;
+	res = AES_256_cipher(op, last_block, AES256_BLOCK_SIZE, (char *)params[2].memref.buffer + full_sz, &dst_sz);
+	TEE_MemFill(last_block, 0, sizeof(last_block));
+	if (res != TEE_SUCCESS) {
+		EMSG("AES 256 failed : 0x%08x", res);
+		return res;
 	}
 
-	// ISO9797 M2 Padding
+	DMSG("Size of generated cypher: %d", params[2].memref.size);
 
-	TEE_MemMove(padded_data, data, data_sz);
-	TEE_MemFill(padded_data + data_sz, 0x80, 1);
-	TEE_MemFill(padded_data + data_sz + 1, 0x00, padded_data_sz - data_sz - 1);
+	return TEE_SUCCESS;
+}
 
-	IMSG("Padded message");
-	DBG_print_extended_block(padded_data, padded_data_sz);
+static TEE_Result api_aes_decode_256(session_ctx * ctx, uint32_t param_types,
+	TEE_Param params[4])
+{
+	char * padded_data;
+	size_t padded_data_sz;
+	size_t encoded_data_sz;
 
-	uint32_t flags =  TEE_DATA_FLAG_ACCESS_READ;
-	size_t read_bytes = AES256_KEY_BYTE_SIZE;
-	res = read_raw_object(keyId, keyId_sz, key, AES256_KEY_BYTE_SIZE, &read_bytes, flags);
-	DBG_print_extended_block(key, read_bytes);
+	TEE_OperationHandle op;
 
+	TEE_Result res;
+
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	encoded_data_sz = params[1].memref.size;
+	if (params[2].memref.size < encoded_data_sz) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	res = get_operation(ctx, OP_AES_DECODE_256, params[0].memref.buffer, params[0].memref.size, &op);
 	if (res != TEE_SUCCESS) {
-		EMSG("Failed to retreive key: 0x%08x", res);
+		EMSG("Failed to initializate AES 256 in decode mode: 0x%08x", res);
 		return res;
 	}
 
-	if (read_bytes != AES256_KEY_BYTE_SIZE ) {
-		EMSG("Invalid size key: %lu\n", read_bytes);
+	/* Decoded straight into the output and unpadded there */
+	padded_data = params[2].memref.buffer;
+	padded_data_sz = encoded_data_sz;
+	res = AES_256_cipher(op, params[1].memref.buffer, encoded_data_sz, padded_data, &padded_data_sz);
+	if (res != TEE_SUCCESS) {
+		EMSG("AES 256 failed : 0x%08x", res);
+		return res;
+	}
+
+	if (padded_data_sz != encoded_data_sz) {
+		EMSG("Error in decoded data, size does not match encode data: %lu", padded_data_sz);
 		return TEE_ERROR_BAD_FORMAT;
 	}
 
+	DMSG("padded data size: %lu", padded_data_sz);
 
-	res = AES_256_init(key, &sess);
+	// ISO9797 M2 Padding
+	
+	for (int i = padded_data_sz-1; i >= 0; i--) {
+		if (padded_data[i]) {
+			if (padded_data[i] == (char)0x80) {
+				params[2].memref.size = i;
+				DMSG("After unpadding: %u", i);
+				return TEE_SUCCESS;
+			}
+			else {
+				EMSG("Data decoded with incorrect padding");
+				return TEE_ERROR_BAD_FORMAT;
+			}
+		}
+	}
+
+	return TEE_ERROR_BAD_FORMAT;
+}
+
+
+/*
+ * Makes sure the session holds count unused nonce counters, taking a block
+ * from the counter in storage, which is moved past the block before any of
+ * its counters is used. Reading and writing the counter is not atomic in
+ * itself: it relies on the TA being single instance (without
+ * TA_FLAG_CONCURRENT), so OP-TEE runs one command at a time and two sessions
+ * cannot read the same value. A block is never handed out twice, also across
+ * reboots; what a session leaves of its block when it ends is skipped
+ */
+static TEE_Result reserve_gcm_counters(session_ctx * ctx, uint32_t count) {
+
+	uint64_t counter = 0, end;
+	size_t read_bytes = sizeof(counter);
+	TEE_Result res;
+
+	if (ctx->gcm_counter_end - ctx->gcm_counter >= count) {
+		return TEE_SUCCESS;
+	}
+
+	res = read_raw_object(GCM_COUNTER_ID, GCM_COUNTER_ID_SZ, (char *)&counter, sizeof(counter), &read_bytes, TEE_DATA_FLAG_ACCESS_READ);
+	if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+		counter = 0;
+	} else if (res != TEE_SUCCESS || read_bytes != sizeof(counter)) {
+		EMSG("Failed to read the nonce counter: 0x%08x", res);
+		return res != TEE_SUCCESS ? res : TEE_ERROR_BAD_FORMAT;
+	}
+
+	if (counter > UINT64_MAX - GCM_COUNTER_RESERVE - count) {
+		return TEE_ERROR_OVERFLOW;
+	}
+	end = counter + (count > GCM_COUNTER_RESERVE ? count : GCM_COUNTER_RESERVE);
+
+	uint32_t flags =  TEE_DATA_FLAG_ACCESS_READ |		/* we can later read the oject */
+			  TEE_DATA_FLAG_ACCESS_WRITE |		/* we can later write into the object */
+			  TEE_DATA_FLAG_ACCESS_WRITE_META |	/* we can later destroy or rename the object */
+			  TEE_DATA_FLAG_OVERWRITE;		/* it moves forward on every reservation */
+	res = create_write(flags, GCM_COUNTER_ID, GCM_COUNTER_ID_SZ, (char *)&end, sizeof(end));
 	if (res != TEE_SUCCESS) {
-		EMSG("Failed to initializate AES 256: 0x%08x", res);
+		EMSG("Failed to write the nonce counter: 0x%08x", res);
 		return res;
 	}
 
-	res = AES_256_cipher(sess.op_handle, padded_data, padded_data_sz, params[2].memref.buffer, &params[2].memref.size);
+	ctx->gcm_counter = counter;
+	ctx->gcm_counter_end = end;
+
+	return TEE_SUCCESS;
+}
+
+/* 96 bit nonce: 32 zero bits and the big endian counter */
+static void next_gcm_nonce(session_ctx * ctx, uint8_t * nonce) {
+
+	TEE_MemFill(nonce, 0, AES_GCM_NONCE_SIZE - 8);
+	for (int i = 0; i < 8; i++) {
+		nonce[AES_GCM_NONCE_SIZE - 1 - i] = (uint8_t)(ctx->gcm_counter >> (8 * i));
+	}
+	ctx->gcm_counter++;
+}
+
+/*
+ * AES-256-GCM over params[1].value.a records (ta_gcm_record) in one call.
+ * Each record gets its own nonce and tag, a record whose tag does not match
+ * only fails itself (its status is set and its data wiped). A header that
+ * does not fit in the buffer stops the command there
+ */
+static TEE_Result api_aes256_gcm(session_ctx * ctx, uint32_t param_types,
+	TEE_Param params[4], uint32_t mode)
+{
+	char * records;
+	size_t records_sz;
+	size_t offset = 0;
+	uint32_t count;
+
+	ta_gcm_record record;
+	char * header;
+	char * aad;
+	char * data;
+	size_t data_sz;
+	size_t tag_sz;
+
+	TEE_OperationHandle op;
+
+	TEE_Result res;
+
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INOUT,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	records = params[2].memref.buffer;
+	records_sz = params[2].memref.size;
+	count = params[1].value.a;
+
+	/* Before the operation is taken from the cache, writing the counter invalidates it */
+	if (mode == TEE_MODE_ENCRYPT) {
+		res = reserve_gcm_counters(ctx, count);
+		if (res != TEE_SUCCESS) {
+			return res;
+		}
+	}
+
+	res = get_operation(ctx, mode == TEE_MODE_ENCRYPT ? OP_AES_GCM_256 : OP_AES_GCM_DECODE_256, params[0].memref.buffer, params[0].memref.size, &op);
 	if (res != TEE_SUCCESS) {
-		EMSG("AES 256 failed : 0x%08x", res);
+		EMSG("Failed to initializate AES GCM 256: 0x%08x", res);
 		return res;
 	}
 
-	DMSG("Size of generated cypher: %d", params[2].memref.size);
+	for (uint32_t i = 0; i < count; i++) {
+
+		/* The header is copied, the client could change it while it is used */
+		if (records_sz - offset < sizeof(ta_gcm_record)) {
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+		header = records + offset;
+		TEE_MemMove(&record, header, sizeof(ta_gcm_record));
+		offset += sizeof(ta_gcm_record);
+
+		if (records_sz - offset < record.aad_sz || records_sz - offset - record.aad_sz < record.data_sz) {
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+		aad = records + offset;
+		data = aad + record.aad_sz;
+		offset += record.aad_sz + record.data_sz;
+
+		if (mode == TEE_MODE_ENCRYPT) {
+			next_gcm_nonce(ctx, record.nonce);
+		}
+
+		res = TEE_AEInit(op, record.nonce, AES_GCM_NONCE_SIZE, AES_GCM_TAG_BIT_SIZE, record.aad_sz, record.data_sz);
+		if (res != TEE_SUCCESS) {
+			EMSG("AES GCM init failed : 0x%08x", res);
+			return res;
+		}
+		TEE_AEUpdateAAD(op, aad, record.aad_sz);
+
+		data_sz = record.data_sz;
+		if (mode == TEE_MODE_ENCRYPT) {
+			tag_sz = AES_GCM_TAG_SIZE;
+			res = TEE_AEEncryptFinal(op, data, record.data_sz, data, &data_sz, record.tag, &tag_sz);
+		} else {
+			res = TEE_AEDecryptFinal(op, data, record.data_sz, data, &data_sz, record.tag, AES_GCM_TAG_SIZE);
+		}
+
+		if (res == TEE_ERROR_MAC_INVALID) {
+			EMSG("Record %u failed authentication", i);
+			TEE_MemFill(data, 0, record.data_sz);
+		} else if (res != TEE_SUCCESS) {
+			EMSG("AES GCM failed : 0x%08x", res);
+			return res;
+		}
 
-	AES_256_terminate(&sess);
+		record.status = res;
+		TEE_MemMove(header, &record, sizeof(ta_gcm_record));
+	}
 
 	return TEE_SUCCESS;
 }
 
-static TEE_Result api_aes_decode_256(uint32_t param_types,
+static void stream_release(cipher_stream * stream) {
+
+	switch (stream->mode) {
+		case TA_STREAM_ENCRYPT:
+		case TA_STREAM_DECRYPT:
+			AES_256_terminate(&stream->sess);
+		break;
+		case TA_STREAM_MAC:
+			if (stream->algo == 0x00) {
+				AES_HMAC_MD5_terminate(&stream->sess);
+			} else {
+				AES_CMAC_128_terminate(&stream->sess);
+			}
+		break;
+		default:
+			return;
+	}
+
+	TEE_MemFill(stream, 0, sizeof(cipher_stream));
+}
+
+static cipher_stream * stream_get(session_ctx * ctx, uint32_t handle) {
+
+	if (handle >= TA_MAX_STREAMS || !ctx->streams[handle].mode) {
+		return NULL;
+	}
+	return &ctx->streams[handle];
+}
+
+/*
+ * Opens a stream: reads the key once and keeps the initialized operation in
+ * the session until TA_CIPHER_DO_FINAL
+ */
+static TEE_Result cipher_init(session_ctx * ctx, uint32_t param_types,
 	TEE_Param params[4])
 {
-	char * keyId;
-	size_t keyId_sz;
-	
-	char * encoded_data;
-	size_t encoded_data_sz;
+	char key[AES256_KEY_BYTE_SIZE];
+	size_t key_sz;
 
-	char * padded_data;
-	size_t padded_data_sz;
+	size_t read_bytes;
 
-	char key[AES256_KEY_BYTE_SIZE];
-	aes_session sess;
+	cipher_stream * stream = NULL;
+	uint32_t handle;
 
 	TEE_Result res;
 
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
-				TEE_PARAM_TYPE_MEMREF_INPUT,
-				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
 				TEE_PARAM_TYPE_NONE);
 
 	if (param_types != exp_param_types) {
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	keyId_sz = params[0].memref.size;
-	keyId = TEE_Malloc(keyId_sz, TEE_MALLOC_FILL_ZERO);
-	if (!keyId) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	for (handle = 0; handle < TA_MAX_STREAMS; handle++) {
+		if (!ctx->streams[handle].mode) {
+			stream = &ctx->streams[handle];
+			break;
+		}
 	}
-	TEE_MemMove(keyId, params[0].memref.buffer, keyId_sz);
-
-
-	encoded_data_sz = params[1].memref.size;
-	encoded_data = TEE_Malloc(encoded_data_sz, TEE_MALLOC_FILL_ZERO);
-	if (!encoded_data) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	if (!stream) {
+		EMSG("No free stream in the session");
+		return TEE_ERROR_BUSY;
 	}
-	TEE_MemMove(encoded_data, params[1].memref.buffer, encoded_data_sz);
 
-	padded_data_sz = encoded_data_sz;
-	padded_data = TEE_Malloc(padded_data_sz, TEE_MALLOC_FILL_ZERO);
-	if (!padded_data) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	uint32_t flags =  TEE_DATA_FLAG_ACCESS_READ;
+
+	switch (params[1].value.a) {
+		case TA_STREAM_ENCRYPT:
+		case TA_STREAM_DECRYPT:
+			key_sz = AES256_KEY_BYTE_SIZE;
+		break;
+		case TA_STREAM_MAC:
+			res = get_signature_algorithm(ctx, &stream->algo);
+			if (res != TEE_SUCCESS) {
+				return res;
+			}
+			if (stream->algo != 0x00 && stream->algo != 0x01) {
+				EMSG("Unrecognized alrogithm: 0x%08x", stream->algo);
+				return TEE_ERROR_SIGNATURE_INVALID;
+			}
+			key_sz = AES128_KEY_BYTE_SIZE;
+		break;
+		default:
+			return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	uint32_t flags =  TEE_DATA_FLAG_ACCESS_READ;
-	size_t read_bytes = AES256_KEY_BYTE_SIZE;
-	res = read_raw_object(keyId, keyId_sz, key, AES256_KEY_BYTE_SIZE, &read_bytes, flags);
-	DBG_print_extended_block(key, read_bytes);
+	read_bytes = key_sz;
+	res = read_raw_object(params[0].memref.buffer, params[0].memref.size, key, key_sz, &read_bytes, flags);
 
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to retreive key: 0x%08x", res);
 		return res;
 	}
 
-	if (read_bytes != AES256_KEY_BYTE_SIZE ) {
+	if (read_bytes != key_sz) {
 		EMSG("Invalid size key: %lu\n", read_bytes);
+		TEE_MemFill(key, 0, sizeof(key));
 		return TEE_ERROR_BAD_FORMAT;
 	}
 
+	switch (params[1].value.a) {
+		case TA_STREAM_ENCRYPT:
+			res = AES_256_init(key, &stream->sess);
+		break;
+		case TA_STREAM_DECRYPT:
+			res = AES_decode_256_init(key, &stream->sess);
+		break;
+		default:
+			res = stream->algo == 0x00 ? AES_HMAC_MD5_init(key, &stream->sess) : AES_CMAC_128_init(key, &stream->sess);
+	}
+	TEE_MemFill(key, 0, sizeof(key));
 
-	res = AES_decode_256_init(key, &sess);
 	if (res != TEE_SUCCESS) {
-		EMSG("Failed to initializate AES 256 in decode mode: 0x%08x", res);
+		EMSG("Failed to initializate stream: 0x%08x", res);
 		return res;
 	}
 
-	res = AES_256_cipher(sess.op_handle, encoded_data, encoded_data_sz, padded_data, &padded_data_sz);
-	if (res != TEE_SUCCESS) {
+	stream->mode = params[1].value.a;
+	stream->pending_sz = 0;
+	params[2].value.a = handle;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Ciphers the whole blocks of the chunk straight from the input memref into
+ * the output one, only the few bytes that do not complete a block are kept
+ * in the session
+ */
+static TEE_Result stream_cipher_update(cipher_stream * stream, char * src, size_t src_sz, char * dst, size_t * dst_sz) {
+
+	size_t total_sz = stream->pending_sz + src_sz;
+	size_t out_sz, done = 0, n, block_sz;
+	TEE_Result res;
+
+	if (stream->mode == TA_STREAM_DECRYPT) {
+		/* The last block carries the padding, it is held back for TA_CIPHER_DO_FINAL */
+		out_sz = total_sz ? (total_sz - 1) / AES256_BLOCK_SIZE * AES256_BLOCK_SIZE : 0;
+	} else {
+		out_sz = total_sz / AES256_BLOCK_SIZE * AES256_BLOCK_SIZE;
+	}
+
+	if (*dst_sz < out_sz) {
+		/* Nothing consumed, the client can retry with a bigger buffer */
+		*dst_sz = out_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (stream->pending_sz && out_sz) {
+		n = AES256_BLOCK_SIZE - stream->pending_sz;
+		TEE_MemMove(stream->pending + stream->pending_sz, src, n);
+		block_sz = AES256_BLOCK_SIZE;
+		res = AES_256_cipher(stream->sess.op_handle, stream->pending, AES256_BLOCK_SIZE, dst, &block_sz);
+		if (res != TEE_SUCCESS) {
+			return res;
+		}
+		src += n;
+		src_sz -= n;
+		done = AES256_BLOCK_SIZE;
+		stream->pending_sz = 0;
+	}
+
+	n = out_sz - done;
+	if (n) {
+		block_sz = n;
+		res = AES_256_cipher(stream->sess.op_handle, src, n, dst + done, &block_sz);
+		if (res != TEE_SUCCESS) {
+			return res;
+		}
+		src += n;
+		src_sz -= n;
+	}
+
+	TEE_MemMove(stream->pending + stream->pending_sz, src, src_sz);
+	stream->pending_sz += src_sz;
+	*dst_sz = out_sz;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result cipher_update(session_ctx * ctx, uint32_t param_types,
+	TEE_Param params[4])
+{
+	cipher_stream * stream;
+	size_t dst_sz;
+	TEE_Result res;
+
+	if (TEE_PARAM_TYPE_GET(param_types, 0) != TEE_PARAM_TYPE_VALUE_INPUT ||
+	    TEE_PARAM_TYPE_GET(param_types, 1) != TEE_PARAM_TYPE_MEMREF_INPUT ||
+	    TEE_PARAM_TYPE_GET(param_types, 3) != TEE_PARAM_TYPE_NONE) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	stream = stream_get(ctx, params[0].value.a);
+	if (!stream) {
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	}
+
+	if (stream->mode == TA_STREAM_MAC) {
+		/* Nothing comes back until TA_CIPHER_DO_FINAL */
+		if (TEE_PARAM_TYPE_GET(param_types, 2) != TEE_PARAM_TYPE_NONE) {
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+		TEE_MACUpdate(stream->sess.op_handle, params[1].memref.buffer, params[1].memref.size);
+		return TEE_SUCCESS;
+	}
+
+	if (TEE_PARAM_TYPE_GET(param_types, 2) != TEE_PARAM_TYPE_MEMREF_OUTPUT) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	dst_sz = params[2].memref.size;
+	res = stream_cipher_update(stream, params[1].memref.buffer, params[1].memref.size, params[2].memref.buffer, &dst_sz);
+	params[2].memref.size = dst_sz;
+
+	if (res != TEE_SUCCESS && res != TEE_ERROR_SHORT_BUFFER) {
 		EMSG("AES 256 failed : 0x%08x", res);
-		return res;
+		stream_release(stream);
 	}
 
-	if (padded_data_sz != encoded_data_sz) {
-		EMSG("Error in decoded data, size does not match encode data: %lu", padded_data_sz);
-		return TEE_ERROR_BAD_FORMAT;
+	return res;
+}
+
+/*
+ * Ciphers what is left of the stream (ISO9797 M2 padding, as TA_AES_256 and
+ * TA_AES_DECODE_256 do) or computes the MAC, and releases the stream
+ */
+static TEE_Result cipher_do_final(session_ctx * ctx, uint32_t param_types,
+	TEE_Param params[4])
+{
+	cipher_stream * stream;
+	char block[AES256_BLOCK_SIZE];
+	size_t block_sz = AES256_BLOCK_SIZE;
+	TEE_Result res;
+
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types) {
+		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	IMSG("padded data size: %lu", padded_data_sz);
-	DBG_print_extended_block(padded_data, padded_data_sz);
+	stream = stream_get(ctx, params[0].value.a);
+	if (!stream) {
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	}
 
-	AES_256_terminate(&sess);
+	if (params[1].memref.size < AES256_BLOCK_SIZE) {
+		params[1].memref.size = AES256_BLOCK_SIZE;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
 
-	// ISO9797 M2 Padding
-	
-	for (int i = padded_data_sz-1; i >= 0; i--) {
-		if (padded_data[i]) {
-			if (padded_data[i] == (char)0x80) {
-				TEE_MemMove(params[2].memref.buffer, padded_data, i);
-				params[2].memref.size = i;
-				IMSG("After unpadding: %u", i);
-				DBG_print_extended_block(params[2].memref.buffer, i);
-				return TEE_SUCCESS;
+	switch (stream->mode) {
+		case TA_STREAM_ENCRYPT:
+			// ISO9797 M2 Padding
+			TEE_MemFill(stream->pending + stream->pending_sz, 0x80, 1);
+			TEE_MemFill(stream->pending + stream->pending_sz + 1, 0x00, AES256_BLOCK_SIZE - stream->pending_sz - 1);
+
+			res = AES_256_cipher(stream->sess.op_handle, stream->pending, AES256_BLOCK_SIZE, params[1].memref.buffer, &block_sz);
+			params[1].memref.size = block_sz;
+		break;
+		case TA_STREAM_DECRYPT:
+			if (stream->pending_sz != AES256_BLOCK_SIZE) {
+				EMSG("Encoded data is not a whole number of blocks");
+				res = TEE_ERROR_BAD_FORMAT;
+				break;
 			}
-			else {
+
+			res = AES_256_cipher(stream->sess.op_handle, stream->pending, AES256_BLOCK_SIZE, block, &block_sz);
+			if (res != TEE_SUCCESS) {
+				break;
+			}
+
+			// ISO9797 M2 Padding
+			res = TEE_ERROR_BAD_FORMAT;
+			for (int i = AES256_BLOCK_SIZE - 1; i >= 0; i--) {
+				if (block[i]) {
+					if (block[i] == (char)0x80) {
+						TEE_MemMove(params[1].memref.buffer, block, i);
+						params[1].memref.size = i;
+						res = TEE_SUCCESS;
+					}
+					break;
+				}
+			}
+			if (res != TEE_SUCCESS) {
 				EMSG("Data decoded with incorrect padding");
-				return TEE_ERROR_BAD_FORMAT;
 			}
-		}
+			TEE_MemFill(block, 0, sizeof(block));
+		break;
+		default:
+			if (stream->algo == 0x00) {
+				res = AES_HMAC_MD5_cipher(stream->sess.op_handle, NULL, 0, params[1].memref.buffer, &block_sz);
+			} else {
+				res = AES_CMAC_128_cipher(stream->sess.op_handle, NULL, 0, params[1].memref.buffer, &block_sz);
+			}
+			params[1].memref.size = block_sz;
 	}
 
-	return TEE_ERROR_BAD_FORMAT;
+	stream_release(stream);
+
+	return res;
+}
+
+
+static TEE_Result trace_drain(uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t n;
+
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	n = ta_trace_drain(params[0].memref.buffer,
+			   params[0].memref.size / sizeof(ta_trace_event),
+			   &params[1].value.b);
+	params[0].memref.size = n * sizeof(ta_trace_event);
+	params[1].value.a = n;
+
+	return TEE_SUCCESS;
+}
+
+
+static TEE_Result command_stats(uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t n;
+
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	n = ta_trace_stats(params[0].memref.buffer,
+			   params[0].memref.size / sizeof(ta_cmd_stats));
+	if (n * sizeof(ta_cmd_stats) > params[0].memref.size) {
+		params[0].memref.size = n * sizeof(ta_cmd_stats);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	params[0].memref.size = n * sizeof(ta_cmd_stats);
+
+	if (params[1].value.a)
+		ta_trace_stats_reset();
+
+	return TEE_SUCCESS;
 }
 
 
@@ -1058,32 +1685,70 @@ TEE_Result TA_InvokeCommandEntryPoint(void __maybe_unused *sess_ctx,
 			uint32_t cmd_id,
 			uint32_t param_types, TEE_Param params[4])
 {
+	TEE_Result res;
+
+	ta_trace_cmd_begin(cmd_id);
 
 	switch (cmd_id) {
 		case TA_INSTALL_PSK:
-			return installPSK(param_types, params);
+			res = installPSK(param_types, params);
+			break;
 		case TA_DERIVE_MSK:
-			return deriveMSK(param_types, params);
+			res = deriveMSK(sess_ctx, param_types, params);
+			break;
 		case TA_DERIVE_EDK:
-			return deriveEDK(param_types, params);
+			res = deriveEDK(sess_ctx, param_types, params);
+			break;
 		case TA_SIGN:
-			return sign(param_types, params);
+			res = sign(sess_ctx, param_types, params);
+			break;
 		case TA_GENERATE_RANDOM:
-			return generateRandom(param_types, params);
+			res = generateRandom(param_types, params);
+			break;
 		case TA_STORE:
-			return store(param_types, params);
+			res = store(param_types, params);
+			break;
 		case TA_WIPE_BOOTSTRAP:
-			return wipe_bootstrap(param_types, params);
+			res = wipe_bootstrap(param_types, params);
+			break;
 		case TA_CHANGE_SIGNATURE_ALG:
-			return change_signature_alg(param_types, params);
+			res = change_signature_alg(param_types, params);
+			break;
 		case TA_RETREIVE:
-			return retreive(param_types, params);
+			res = retreive(param_types, params);
+			break;
 		case TA_AES_256:
-			return api_aes256(param_types, params);
+			res = api_aes256(sess_ctx, param_types, params);
+			break;
 		case TA_AES_DECODE_256:
-			return api_aes_decode_256(param_types, params);
+			res = api_aes_decode_256(sess_ctx, param_types, params);
+			break;
+		case TA_AES_256_GCM_ENCRYPT:
+			res = api_aes256_gcm(sess_ctx, param_types, params, TEE_MODE_ENCRYPT);
+			break;
+		case TA_AES_256_GCM_DECRYPT:
+			res = api_aes256_gcm(sess_ctx, param_types, params, TEE_MODE_DECRYPT);
+			break;
+		case TA_CYPHER_INIT:
+			res = cipher_init(sess_ctx, param_types, params);
+			break;
+		case TA_CIPHER_UPDATE:
+			res = cipher_update(sess_ctx, param_types, params);
+			break;
+		case TA_CIPHER_DO_FINAL:
+			res = cipher_do_final(sess_ctx, param_types, params);
+			break;
+		case TA_TRACE_DRAIN:
+			res = trace_drain(param_types, params);
+			break;
+		case TA_STATS:
+			res = command_stats(param_types, params);
+			break;
 		default:
-			return TEE_ERROR_BAD_PARAMETERS;
+			res = TEE_ERROR_BAD_PARAMETERS;
 	}
-}
 
+	ta_trace_cmd_end(res);
+
+	return res;
+}
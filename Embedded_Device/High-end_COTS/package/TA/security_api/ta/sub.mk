@@ -1,10 +1,12 @@
 global-incdirs-y += include
+global-incdirs-y += ../../common/include
 
 # global-incdirs-y += lib/p-abc-main/include
 # global-incdirs-y += lib/p-abc-main/lib/pfecCwrapper/include
 
 srcs-y += security_api_ta.c
 srcs-y += utils.c
+srcs-y += ../../common/ta_trace.c
 
 libdirs += ../
 
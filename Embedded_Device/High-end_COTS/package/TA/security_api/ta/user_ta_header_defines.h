@@ -38,10 +38,16 @@
 #define TA_UUID				TA_SECURITY_API_UUID 
 
 /*
- * TA properties: multi-instance TA, no specific attribute
+ * TA properties: single instance TA serving every session, so that they
+ * share storage_generation (what a session cached from the storage is
+ * dropped when any session writes it) and run one command at a time (the
+ * GCM nonce counter is read and moved forward in two steps). Do not add
+ * TA_FLAG_CONCURRENT
  * TA_FLAG_EXEC_DDR is meaningless but mandated.
  */
-#define TA_FLAGS			TA_FLAG_EXEC_DDR
+#define TA_FLAGS			(TA_FLAG_EXEC_DDR | \
+					 TA_FLAG_SINGLE_INSTANCE | \
+					 TA_FLAG_MULTI_SESSION)
 
 /* Provisioned stack size */
 #define TA_STACK_SIZE			(2 * 1024 * 1024)
@@ -1,17 +1,7 @@
 #include <utils.h>
+#include <security_api_ta.h>
 
-void DBG_print_block(char * block) {
-	printf("0x");
-	for (uint8_t i = 0; i < 16; i++) printf("%02x ", block[i]);
-	printf("\n");
-}
-
-
-void DBG_print_extended_block(char * block, size_t block_sz) {
-	printf("0x");
-	for (size_t i = 0; i < block_sz; i++) printf("%02x ", block[i]);
-	printf("\n");
-}
+uint32_t storage_generation = 0;
 
 TEE_Result SHA_256_init(aes_session *session) {
 	
@@ -118,12 +108,104 @@ TEE_Result AES_decode_256_init(char * key, aes_session * session) {
 	return AES_init(key, session, key_size, algo, 1, mode);
 }
 
+static TEE_Result AES_reset(aes_session * session, char requires_iv) {
+
+	unsigned char iv[AES256_BLOCK_SIZE] = { 0 };
+
+	TEE_ResetOperation(session->op_handle);
+	TEE_CipherInit(session->op_handle, requires_iv ? iv : NULL, requires_iv ? AES256_BLOCK_SIZE : 0);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result AES_128_reset(aes_session * session) { return AES_reset(session, 0); }
+
+TEE_Result AES_256_reset(aes_session * session) { return AES_reset(session, 1); }
+
+/* Keyed operation, TEE_AEInit starts every message with its nonce */
+static TEE_Result AES_AE_init(char * key, aes_session * session, uint32_t key_size, uint32_t algo, uint32_t mode) {
+
+	TEE_Attribute attr;
+	TEE_Result res;
+
+	res = TEE_AllocateOperation(&(session->op_handle),
+				    algo,
+				    mode,
+				    key_size);
+
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate operation");
+		session->op_handle = TEE_HANDLE_NULL;
+		goto err;
+	}
+
+	res = TEE_AllocateTransientObject(TEE_TYPE_AES,
+					  key_size,
+					  &(session->key_handle));
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate transient object");
+		session->key_handle = TEE_HANDLE_NULL;
+		goto err;
+	}
+
+	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_size / 8);
+
+	res = TEE_PopulateTransientObject(session->key_handle, &attr, 1);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_PopulateTransientObject failed, %x", res);
+		goto err;
+	}
+
+	res = TEE_SetOperationKey(session->op_handle, session->key_handle);
+
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_SetOperationKey failed %x", res);
+		goto err;
+	}
+
+	return TEE_SUCCESS;
+
+err:
+	if (session->op_handle != TEE_HANDLE_NULL)
+		TEE_FreeOperation(session->op_handle);
+	session->op_handle = TEE_HANDLE_NULL;
+
+	if (session->key_handle != TEE_HANDLE_NULL)
+		TEE_FreeTransientObject(session->key_handle);
+	session->key_handle = TEE_HANDLE_NULL;
+
+	return res;
+}
+
+TEE_Result AES_GCM_256_init(char * key, aes_session * session) {
+
+	uint32_t key_size = AES256_KEY_BIT_SIZE;		/* AES key size in byte */
+	uint32_t algo = TEE_ALG_AES_GCM;			/* AES flavour */	
+	uint32_t mode = TEE_MODE_ENCRYPT;			/* Encode */
+	return AES_AE_init(key, session, key_size, algo, mode);
+}
+
+TEE_Result AES_GCM_decode_256_init(char * key, aes_session * session) {
+
+	uint32_t key_size = AES256_KEY_BIT_SIZE;		/* AES key size in byte */
+	uint32_t algo = TEE_ALG_AES_GCM;			/* AES flavour */	
+	uint32_t mode = TEE_MODE_DECRYPT;			/* Decode */
+	return AES_AE_init(key, session, key_size, algo, mode);
+}
+
+TEE_Result AES_GCM_256_reset(aes_session * session) {
+
+	TEE_ResetOperation(session->op_handle);
+
+	return TEE_SUCCESS;
+}
+
 TEE_Result AES_MAC_init(char * key, aes_session * session, uint32_t algo, uint32_t mode, size_t key_size, uint32_t object_type) {
 
 	TEE_Attribute attr;
 	TEE_Result res;
 
-	IMSG("Allocate Operation");
+	DMSG("Allocate Operation");
 
 	res = TEE_AllocateOperation(&(session->op_handle),
 				    algo,
@@ -136,7 +218,7 @@ TEE_Result AES_MAC_init(char * key, aes_session * session, uint32_t algo, uint32
 		goto err;
 	}
 
-	IMSG("Allocate Object");
+	DMSG("Allocate Object");
 	res = TEE_AllocateTransientObject(object_type,
 					  key_size,
 					  &(session->key_handle));
@@ -146,17 +228,17 @@ TEE_Result AES_MAC_init(char * key, aes_session * session, uint32_t algo, uint32
 		goto err;
 	}
 
-	IMSG("Init attribute");
+	DMSG("Init attribute");
 	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_size / 8);
 
-	IMSG("Populate");
+	DMSG("Populate");
 	res = TEE_PopulateTransientObject(session->key_handle, &attr, 1);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_PopulateTransientObject failed, %x", res);
 		goto err;
 	}
 
-	IMSG("Set_key");
+	DMSG("Set_key");
 	res = TEE_SetOperationKey(session->op_handle, session->key_handle);
 
 	if (res != TEE_SUCCESS) {
@@ -164,7 +246,7 @@ TEE_Result AES_MAC_init(char * key, aes_session * session, uint32_t algo, uint32
 		goto err;
 	}
 	
-	IMSG("Mac init");
+	DMSG("Mac init");
 	TEE_MACInit(session->op_handle, NULL, 0); //IV not used for aes-ecb
 	return TEE_SUCCESS;
 
@@ -200,6 +282,18 @@ TEE_Result AES_HMAC_MD5_init(char * key, aes_session * session) {
 	return AES_MAC_init(key, session, algo, mode, key_size, object_type);
 }
 
+static TEE_Result AES_MAC_reset(aes_session * session) {
+
+	TEE_ResetOperation(session->op_handle);
+	TEE_MACInit(session->op_handle, NULL, 0);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result AES_CMAC_128_reset(aes_session * session) { return AES_MAC_reset(session); }
+
+TEE_Result AES_HMAC_MD5_reset(aes_session * session) { return AES_MAC_reset(session); }
+
 TEE_Result AES_terminate(aes_session * sess) {
 
 	if (sess->key_handle != TEE_HANDLE_NULL)
@@ -214,6 +308,8 @@ TEE_Result AES_128_terminate(aes_session * sess) { return AES_terminate(sess); }
 
 TEE_Result AES_256_terminate(aes_session * sess) { return AES_terminate(sess); }
 
+TEE_Result AES_GCM_256_terminate(aes_session * sess) { return AES_terminate(sess); }
+
 TEE_Result AES_CMAC_128_terminate(aes_session * sess) {
 	return AES_terminate(sess);
 }
@@ -288,6 +384,8 @@ TEE_Result create_write(uint32_t obj_data_flag, char * obj_id, size_t obj_id_sz,
 	}
 
 
+	storage_generation++;
+
 	res = TEE_WriteObjectData(object, data, data_sz);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_WriteObjectData failed 0x%08x", res);
@@ -296,10 +394,9 @@ TEE_Result create_write(uint32_t obj_data_flag, char * obj_id, size_t obj_id_sz,
 		TEE_CloseObject(object);
 	}
 
-	IMSG("Stored %.*s with size %ld", obj_id_sz, obj_id, data_sz);
-	printf("0x");
-	for (uint32_t i = 0; i < data_sz; i++) printf("%02x ", data[i]);
-	printf("\n");
+	DMSG("Stored %.*s with size %ld", obj_id_sz, obj_id, data_sz);
+	TA_TRACE_HEX(TA_TRACE_DEBUG, "Stored data", data, data_sz);
+	ta_trace_record(TA_EV_OBJECT_WRITTEN, data_sz);
 
 	return TEE_SUCCESS;
 }
@@ -320,12 +417,14 @@ TEE_Result remove_object(uint32_t flags, char * obj_id, size_t obj_id_sz) {
 	}
 
 	res = TEE_CloseAndDeletePersistentObject1(object);
+	storage_generation++;
 
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_DeleteObject failed 0x%08x", res);
 	} 
 
-	IMSG("Deleted %.*s", obj_id_sz, obj_id);
+	DMSG("Deleted %.*s", obj_id_sz, obj_id);
+	ta_trace_record(TA_EV_OBJECT_REMOVED, 0);
 
 	return TEE_SUCCESS;
 }
@@ -376,10 +475,8 @@ TEE_Result read_raw_object(char * obj_id, size_t obj_id_sz, char * data, size_t
 		return res;
 	}
 
-	IMSG("Retreived %.*s with size %ld", obj_id_sz, obj_id, *read_bytes);
-	printf("0x");
-	for (uint32_t i = 0; i < *read_bytes; i++) printf("%02x ", data[i]);
-	printf("\n");
+	DMSG("Retreived %.*s with size %ld", obj_id_sz, obj_id, *read_bytes);
+	TA_TRACE_HEX(TA_TRACE_DEBUG, "Retreived data", data, *read_bytes);
 
 	TEE_CloseObject(object);
 	return res;
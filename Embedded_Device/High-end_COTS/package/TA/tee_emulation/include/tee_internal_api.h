@@ -0,0 +1,294 @@
+#ifndef TEE_INTERNAL_API_H
+#define TEE_INTERNAL_API_H
+
+/*
+ * In-process stand-in for the subset of the GlobalPlatform TEE Internal Core
+ * API used by the dpabc and security_api TAs. Signatures follow the OP-TEE
+ * GP 1.3 variant (size_t lengths), so the TA sources build unchanged on a
+ * plain Linux host.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef __maybe_unused
+#define __maybe_unused __attribute__((unused))
+#endif
+
+typedef uint32_t TEE_Result;
+
+typedef struct {
+	uint32_t timeLow;
+	uint16_t timeMid;
+	uint16_t timeHiAndVersion;
+	uint8_t clockSeqAndNode[8];
+} TEE_UUID;
+
+typedef union {
+	struct {
+		void *buffer;
+		size_t size;
+	} memref;
+	struct {
+		uint32_t a;
+		uint32_t b;
+	} value;
+} TEE_Param;
+
+typedef struct {
+	uint32_t attributeID;
+	union {
+		struct {
+			void *buffer;
+			size_t length;
+		} ref;
+		struct {
+			uint32_t a;
+			uint32_t b;
+		} value;
+	} content;
+} TEE_Attribute;
+
+typedef struct {
+	uint32_t objectType;
+	uint32_t objectSize;
+	uint32_t maxObjectSize;
+	uint32_t objectUsage;
+	size_t dataSize;
+	size_t dataPosition;
+	uint32_t handleFlags;
+} TEE_ObjectInfo;
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t millis;
+} TEE_Time;
+
+typedef uint32_t TEE_ObjectType;
+
+typedef struct __TEE_ObjectHandle *TEE_ObjectHandle;
+typedef struct __TEE_OperationHandle *TEE_OperationHandle;
+
+#define TEE_HANDLE_NULL			0
+
+/* Return codes */
+#define TEE_SUCCESS			0x00000000
+#define TEE_ERROR_GENERIC		0xFFFF0000
+#define TEE_ERROR_ACCESS_DENIED		0xFFFF0001
+#define TEE_ERROR_CANCEL		0xFFFF0002
+#define TEE_ERROR_ACCESS_CONFLICT	0xFFFF0003
+#define TEE_ERROR_EXCESS_DATA		0xFFFF0004
+#define TEE_ERROR_BAD_FORMAT		0xFFFF0005
+#define TEE_ERROR_BAD_PARAMETERS	0xFFFF0006
+#define TEE_ERROR_BAD_STATE		0xFFFF0007
+#define TEE_ERROR_ITEM_NOT_FOUND	0xFFFF0008
+#define TEE_ERROR_NOT_IMPLEMENTED	0xFFFF0009
+#define TEE_ERROR_NOT_SUPPORTED		0xFFFF000A
+#define TEE_ERROR_NO_DATA		0xFFFF000B
+#define TEE_ERROR_OUT_OF_MEMORY		0xFFFF000C
+#define TEE_ERROR_BUSY			0xFFFF000D
+#define TEE_ERROR_COMMUNICATION		0xFFFF000E
+#define TEE_ERROR_SECURITY		0xFFFF000F
+#define TEE_ERROR_SHORT_BUFFER		0xFFFF0010
+#define TEE_ERROR_OVERFLOW		0xFFFF300F
+#define TEE_ERROR_TARGET_DEAD		0xFFFF3024
+#define TEE_ERROR_STORAGE_NO_SPACE	0xFFFF3041
+#define TEE_ERROR_MAC_INVALID		0xFFFF3071
+#define TEE_ERROR_SIGNATURE_INVALID	0xFFFF3072
+
+/* Parameter types */
+#define TEE_PARAM_TYPE_NONE		0
+#define TEE_PARAM_TYPE_VALUE_INPUT	1
+#define TEE_PARAM_TYPE_VALUE_OUTPUT	2
+#define TEE_PARAM_TYPE_VALUE_INOUT	3
+#define TEE_PARAM_TYPE_MEMREF_INPUT	5
+#define TEE_PARAM_TYPE_MEMREF_OUTPUT	6
+#define TEE_PARAM_TYPE_MEMREF_INOUT	7
+
+#define TEE_PARAM_TYPES(t0, t1, t2, t3) \
+	((t0) | ((t1) << 4) | ((t2) << 8) | ((t3) << 12))
+#define TEE_PARAM_TYPE_GET(t, i)	(((t) >> ((i) * 4)) & 0xF)
+
+/* TEE_Malloc hints */
+#define TEE_MALLOC_FILL_ZERO		0x00000000
+#define TEE_MALLOC_NO_FILL		0x00000001
+#define TEE_MALLOC_NO_SHARE		0x00000002
+
+/* Storage */
+#define TEE_STORAGE_PRIVATE		0x00000001
+#define TEE_STORAGE_PRIVATE_REE		0x80000000
+#define TEE_STORAGE_PRIVATE_RPMB	0x80000100
+#define TEE_OBJECT_ID_MAX_LEN		64
+
+#define TEE_DATA_FLAG_ACCESS_READ	0x00000001
+#define TEE_DATA_FLAG_ACCESS_WRITE	0x00000002
+#define TEE_DATA_FLAG_ACCESS_WRITE_META	0x00000004
+#define TEE_DATA_FLAG_SHARE_READ	0x00000010
+#define TEE_DATA_FLAG_SHARE_WRITE	0x00000020
+#define TEE_DATA_FLAG_OVERWRITE		0x00000400
+
+#define TEE_HANDLE_FLAG_PERSISTENT	0x00010000
+#define TEE_HANDLE_FLAG_INITIALIZED	0x00020000
+#define TEE_HANDLE_FLAG_KEY_SET		0x00040000
+
+/* Object types and attributes */
+#define TEE_TYPE_AES			0xA0000010
+#define TEE_TYPE_HMAC_MD5		0xA0000001
+#define TEE_TYPE_HMAC_SHA1		0xA0000002
+#define TEE_TYPE_HMAC_SHA256		0xA0000004
+#define TEE_TYPE_GENERIC_SECRET		0xA0000000
+#define TEE_TYPE_DATA			0xA00000BF
+
+#define TEE_ATTR_SECRET_VALUE		0xC0000000
+
+/* Algorithms and operation modes */
+#define TEE_ALG_AES_ECB_NOPAD		0x10000010
+#define TEE_ALG_AES_CBC_NOPAD		0x10000110
+#define TEE_ALG_AES_CMAC		0x30000610
+#define TEE_ALG_AES_GCM			0x40000810
+#define TEE_ALG_HMAC_MD5		0x30000001
+#define TEE_ALG_HMAC_SHA1		0x30000002
+#define TEE_ALG_HMAC_SHA256		0x30000004
+#define TEE_ALG_MD5			0x50000001
+#define TEE_ALG_SHA1			0x50000002
+#define TEE_ALG_SHA256			0x50000004
+
+#define TEE_MODE_ENCRYPT		0
+#define TEE_MODE_DECRYPT		1
+#define TEE_MODE_SIGN			2
+#define TEE_MODE_VERIFY			3
+#define TEE_MODE_MAC			4
+#define TEE_MODE_DIGEST			5
+#define TEE_MODE_DERIVE			6
+
+/*
+ * Trace macros. Messages at or below CFG_TEE_TA_LOG_LEVEL go to stderr;
+ * the default only keeps errors so benchmarks are not dominated by logging.
+ */
+#ifndef CFG_TEE_TA_LOG_LEVEL
+#define CFG_TEE_TA_LOG_LEVEL		1
+#endif
+
+void tee_emulation_trace(const char *prefix, const char *func, int line,
+			 const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+#define TEE_EMULATION_TRACE(level, prefix, ...) \
+	do { \
+		if ((level) <= CFG_TEE_TA_LOG_LEVEL) \
+			tee_emulation_trace(prefix, __func__, __LINE__, \
+					    __VA_ARGS__); \
+	} while (0)
+
+#define EMSG(...)	TEE_EMULATION_TRACE(1, "E", __VA_ARGS__)
+#define IMSG(...)	TEE_EMULATION_TRACE(2, "I", __VA_ARGS__)
+#define DMSG(...)	TEE_EMULATION_TRACE(3, "D", __VA_ARGS__)
+#define FMSG(...)	TEE_EMULATION_TRACE(4, "F", __VA_ARGS__)
+
+/* TA entry points, implemented by the TA */
+TEE_Result TA_CreateEntryPoint(void);
+void TA_DestroyEntryPoint(void);
+TEE_Result TA_OpenSessionEntryPoint(uint32_t paramTypes, TEE_Param params[4],
+				    void **sessionContext);
+void TA_CloseSessionEntryPoint(void *sessionContext);
+TEE_Result TA_InvokeCommandEntryPoint(void *sessionContext,
+				      uint32_t commandID, uint32_t paramTypes,
+				      TEE_Param params[4]);
+
+/* Panic and memory */
+void TEE_Panic(TEE_Result panicCode) __attribute__((noreturn));
+
+void *TEE_Malloc(size_t size, uint32_t hint);
+void *TEE_Realloc(void *buffer, size_t newSize);
+void TEE_Free(void *buffer);
+void TEE_MemMove(void *dest, const void *src, size_t size);
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2, size_t size);
+void TEE_MemFill(void *buff, uint32_t x, size_t size);
+
+void TEE_GenerateRandom(void *randomBuffer, size_t randomBufferLen);
+
+/* Monotonic time since an arbitrary origin, like OP-TEE's system time */
+void TEE_GetSystemTime(TEE_Time *time);
+
+/* Persistent objects */
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+				    size_t objectIDLen, uint32_t flags,
+				    TEE_ObjectHandle *object);
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID, const void *objectID,
+				      size_t objectIDLen, uint32_t flags,
+				      TEE_ObjectHandle attributes,
+				      const void *initialData,
+				      size_t initialDataLen,
+				      TEE_ObjectHandle *object);
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object);
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+			      size_t size, size_t *count);
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+			       size_t size);
+TEE_Result TEE_GetObjectInfo1(TEE_ObjectHandle objectHandle,
+			      TEE_ObjectInfo *objectInfo);
+void TEE_CloseObject(TEE_ObjectHandle object);
+
+/* Transient objects */
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+				       uint32_t maxObjectSize,
+				       TEE_ObjectHandle *object);
+void TEE_FreeTransientObject(TEE_ObjectHandle object);
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+				       const TEE_Attribute *attrs,
+				       uint32_t attrCount);
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			  const void *buffer, size_t length);
+
+/* Operations */
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+				 uint32_t algorithm, uint32_t mode,
+				 uint32_t maxKeySize);
+void TEE_FreeOperation(TEE_OperationHandle operation);
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			       TEE_ObjectHandle key);
+void TEE_ResetOperation(TEE_OperationHandle operation);
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+		      size_t chunkSize);
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation, const void *chunk,
+			     size_t chunkLen, void *hash, size_t *hashLen);
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+		    size_t IVLen);
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation, const void *srcData,
+			    size_t srcLen, void *destData, size_t *destLen);
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+			     const void *srcData, size_t srcLen,
+			     void *destData, size_t *destLen);
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV, size_t IVLen);
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+		   size_t chunkSize);
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       void *mac, size_t *macLen);
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       const void *mac, size_t macLen);
+
+TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
+		      size_t nonceLen, uint32_t tagLen, size_t AADLen,
+		      size_t payloadLen);
+void TEE_AEUpdateAAD(TEE_OperationHandle operation, const void *AADdata,
+		     size_t AADdataLen);
+TEE_Result TEE_AEUpdate(TEE_OperationHandle operation, const void *srcData,
+			size_t srcLen, void *destData, size_t *destLen);
+TEE_Result TEE_AEEncryptFinal(TEE_OperationHandle operation,
+			      const void *srcData, size_t srcLen,
+			      void *destData, size_t *destLen,
+			      void *tag, size_t *tagLen);
+TEE_Result TEE_AEDecryptFinal(TEE_OperationHandle operation,
+			      const void *srcData, size_t srcLen,
+			      void *destData, size_t *destLen,
+			      void *tag, size_t tagLen);
+
+#endif /* TEE_INTERNAL_API_H */
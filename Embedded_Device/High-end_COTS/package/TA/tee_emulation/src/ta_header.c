@@ -0,0 +1,10 @@
+#include <tee_internal_api.h>
+#include <user_ta_header_defines.h>
+
+#include "tee_emulation.h"
+
+/*
+ * Counterpart of the user_ta_header.c of the OP-TEE dev kit: compiled with
+ * the TA sources so the libteec stand-in knows which UUID it is serving.
+ */
+const TEE_UUID tee_emulation_ta_uuid = TA_UUID;
@@ -0,0 +1,292 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tee_client_api.h>
+
+#include "tee_emulation.h"
+
+/*
+ * The emulated TA behaves as a single instance TA: it is created when the
+ * first session opens, destroyed when the last one closes, and every entry
+ * point runs under one lock, as all the sessions share the globals of the TA
+ * (OP-TEE would run the sessions of a multi instance TA in parallel).
+ */
+static pthread_mutex_t ta_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int ta_sessions;
+
+static void set_origin(uint32_t *returnOrigin, uint32_t origin)
+{
+	if (returnOrigin)
+		*returnOrigin = origin;
+}
+
+static uint32_t memref_direction(uint32_t flags)
+{
+	switch (flags & (TEEC_MEM_INPUT | TEEC_MEM_OUTPUT)) {
+	case TEEC_MEM_INPUT:
+		return TEE_PARAM_TYPE_MEMREF_INPUT;
+	case TEEC_MEM_OUTPUT:
+		return TEE_PARAM_TYPE_MEMREF_OUTPUT;
+	default:
+		return TEE_PARAM_TYPE_MEMREF_INOUT;
+	}
+}
+
+/* Translates the client parameters to the ones seen by the TA */
+static TEEC_Result to_ta_params(TEEC_Operation *operation,
+				uint32_t *param_types, TEE_Param params[4])
+{
+	memset(params, 0, 4 * sizeof(*params));
+	*param_types = 0;
+
+	if (!operation)
+		return TEEC_SUCCESS;
+
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		uint32_t type = TEEC_PARAM_TYPE_GET(operation->paramTypes, i);
+		TEEC_Parameter *p = &operation->params[i];
+		TEEC_SharedMemory *shm = p->memref.parent;
+		uint32_t ta_type;
+
+		switch (type) {
+		case TEEC_NONE:
+			ta_type = TEE_PARAM_TYPE_NONE;
+			break;
+		case TEEC_VALUE_INPUT:
+		case TEEC_VALUE_OUTPUT:
+		case TEEC_VALUE_INOUT:
+			ta_type = type;
+			params[i].value.a = p->value.a;
+			params[i].value.b = p->value.b;
+			break;
+		case TEEC_MEMREF_TEMP_INPUT:
+		case TEEC_MEMREF_TEMP_OUTPUT:
+		case TEEC_MEMREF_TEMP_INOUT:
+			ta_type = type;
+			params[i].memref.buffer = p->tmpref.buffer;
+			params[i].memref.size = p->tmpref.size;
+			break;
+		case TEEC_MEMREF_WHOLE:
+			if (!shm)
+				return TEEC_ERROR_BAD_PARAMETERS;
+			ta_type = memref_direction(shm->flags);
+			params[i].memref.buffer = shm->buffer;
+			params[i].memref.size = shm->size;
+			break;
+		case TEEC_MEMREF_PARTIAL_INPUT:
+		case TEEC_MEMREF_PARTIAL_OUTPUT:
+		case TEEC_MEMREF_PARTIAL_INOUT:
+			ta_type = type - TEEC_MEMREF_PARTIAL_INPUT +
+				  TEE_PARAM_TYPE_MEMREF_INPUT;
+			if (!shm || p->memref.offset > shm->size ||
+			    p->memref.size > shm->size - p->memref.offset ||
+			    (memref_direction(shm->flags) != ta_type &&
+			     memref_direction(shm->flags) !=
+			     TEE_PARAM_TYPE_MEMREF_INOUT))
+				return TEEC_ERROR_BAD_PARAMETERS;
+			params[i].memref.buffer = (uint8_t *)shm->buffer +
+						  p->memref.offset;
+			params[i].memref.size = p->memref.size;
+			break;
+		default:
+			return TEEC_ERROR_BAD_PARAMETERS;
+		}
+
+		*param_types |= ta_type << (4 * i);
+	}
+
+	return TEEC_SUCCESS;
+}
+
+/* Propagates the output values and sizes written by the TA */
+static void from_ta_params(TEEC_Operation *operation, TEE_Param params[4])
+{
+	if (!operation)
+		return;
+
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		TEEC_Parameter *p = &operation->params[i];
+
+		switch (TEEC_PARAM_TYPE_GET(operation->paramTypes, i)) {
+		case TEEC_VALUE_OUTPUT:
+		case TEEC_VALUE_INOUT:
+			p->value.a = params[i].value.a;
+			p->value.b = params[i].value.b;
+			break;
+		case TEEC_MEMREF_TEMP_OUTPUT:
+		case TEEC_MEMREF_TEMP_INOUT:
+			p->tmpref.size = params[i].memref.size;
+			break;
+		case TEEC_MEMREF_WHOLE:
+		case TEEC_MEMREF_PARTIAL_OUTPUT:
+		case TEEC_MEMREF_PARTIAL_INOUT:
+			p->memref.size = params[i].memref.size;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+TEEC_Result TEEC_InitializeContext(const char *name, TEEC_Context *context)
+{
+	(void)name;
+
+	if (!context)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	context->initialized = true;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context *context)
+{
+	if (context)
+		context->initialized = false;
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *context,
+			     TEEC_Session *session,
+			     const TEEC_UUID *destination,
+			     uint32_t connectionMethod,
+			     const void *connectionData,
+			     TEEC_Operation *operation,
+			     uint32_t *returnOrigin)
+{
+	TEE_Param params[4];
+	uint32_t param_types;
+	TEEC_Result res;
+
+	(void)connectionMethod;
+	(void)connectionData;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_API);
+	if (!context || !context->initialized || !session || !destination)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_TEE);
+	if (memcmp(destination, &tee_emulation_ta_uuid, sizeof(*destination)))
+		return TEEC_ERROR_ITEM_NOT_FOUND;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_API);
+	res = to_ta_params(operation, &param_types, params);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_TRUSTED_APP);
+	pthread_mutex_lock(&ta_lock);
+
+	if (!ta_sessions) {
+		tee_emulation_storage_init(&tee_emulation_ta_uuid);
+		res = TA_CreateEntryPoint();
+	}
+	if (res == TEEC_SUCCESS)
+		res = TA_OpenSessionEntryPoint(param_types, params,
+					       &session->ta_session);
+	if (res == TEEC_SUCCESS)
+		ta_sessions++;
+	else if (!ta_sessions)
+		TA_DestroyEntryPoint();
+
+	pthread_mutex_unlock(&ta_lock);
+
+	from_ta_params(operation, params);
+	if (res == TEEC_SUCCESS)
+		session->ctx = context;
+
+	return res;
+}
+
+void TEEC_CloseSession(TEEC_Session *session)
+{
+	if (!session || !session->ctx)
+		return;
+
+	pthread_mutex_lock(&ta_lock);
+
+	TA_CloseSessionEntryPoint(session->ta_session);
+	if (!--ta_sessions)
+		TA_DestroyEntryPoint();
+
+	pthread_mutex_unlock(&ta_lock);
+
+	session->ctx = NULL;
+	session->ta_session = NULL;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session,
+			       uint32_t commandID,
+			       TEEC_Operation *operation,
+			       uint32_t *returnOrigin)
+{
+	TEE_Param params[4];
+	uint32_t param_types;
+	TEEC_Result res;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_API);
+	if (!session || !session->ctx)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	res = to_ta_params(operation, &param_types, params);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	if (operation)
+		operation->session = session;
+
+	pthread_mutex_lock(&ta_lock);
+	res = TA_InvokeCommandEntryPoint(session->ta_session, commandID,
+					 param_types, params);
+	pthread_mutex_unlock(&ta_lock);
+
+	set_origin(returnOrigin, TEEC_ORIGIN_TRUSTED_APP);
+	from_ta_params(operation, params);
+
+	return res;
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *context,
+				      TEEC_SharedMemory *sharedMem)
+{
+	if (!context || !context->initialized || !sharedMem ||
+	    (sharedMem->size && !sharedMem->buffer))
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	sharedMem->buffer_allocated = false;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *context,
+				      TEEC_SharedMemory *sharedMem)
+{
+	if (!context || !context->initialized || !sharedMem)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	/* Zero sized regions still get a valid buffer, as in libteec */
+	sharedMem->buffer = calloc(1, sharedMem->size ? sharedMem->size : 8);
+	if (!sharedMem->buffer)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	sharedMem->buffer_allocated = true;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *sharedMemory)
+{
+	if (!sharedMemory)
+		return;
+
+	if (sharedMemory->buffer_allocated)
+		free(sharedMemory->buffer);
+
+	sharedMemory->buffer = NULL;
+	sharedMemory->size = 0;
+	sharedMemory->buffer_allocated = false;
+}
+
+void TEEC_RequestCancellation(TEEC_Operation *operation)
+{
+	/* Commands run to completion in the calling thread */
+	(void)operation;
+}
@@ -0,0 +1,90 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+
+#include "tee_emulation.h"
+
+void tee_emulation_trace(const char *prefix, const char *func, int line,
+			 const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "%s/TA: %s:%d ", prefix, func, line);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+void TEE_Panic(TEE_Result panicCode)
+{
+	fprintf(stderr, "E/TA: Panic 0x%08" PRIx32 "\n", panicCode);
+	abort();
+}
+
+void *TEE_Malloc(size_t size, uint32_t hint)
+{
+	/* A zero sized allocation still returns a unique pointer */
+	if (size == 0)
+		size = 1;
+
+	if (hint & TEE_MALLOC_NO_FILL)
+		return malloc(size);
+	return calloc(1, size);
+}
+
+void *TEE_Realloc(void *buffer, size_t newSize)
+{
+	return realloc(buffer, newSize ? newSize : 1);
+}
+
+void TEE_Free(void *buffer)
+{
+	free(buffer);
+}
+
+void TEE_MemMove(void *dest, const void *src, size_t size)
+{
+	memmove(dest, src, size);
+}
+
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2, size_t size)
+{
+	int res = memcmp(buffer1, buffer2, size);
+
+	return (res > 0) - (res < 0);
+}
+
+void TEE_MemFill(void *buff, uint32_t x, size_t size)
+{
+	memset(buff, (int)x, size);
+}
+
+void TEE_GenerateRandom(void *randomBuffer, size_t randomBufferLen)
+{
+	uint8_t *buf = randomBuffer;
+
+	while (randomBufferLen) {
+		ssize_t n = getrandom(buf, randomBufferLen, 0);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			TEE_Panic(TEE_ERROR_GENERIC);
+		}
+		buf += n;
+		randomBufferLen -= n;
+	}
+}
+
+void TEE_GetSystemTime(TEE_Time *time)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	time->seconds = (uint32_t)ts.tv_sec;
+	time->millis = (uint32_t)(ts.tv_nsec / 1000000);
+}
@@ -0,0 +1,690 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#include "tee_emulation.h"
+
+#define AES_BLOCK_SIZE	16
+
+struct __TEE_OperationHandle {
+	uint32_t algorithm;
+	uint32_t mode;
+	uint32_t max_key_size;
+	/* Set by TEE_CipherInit/TEE_MACInit, cleared by the final calls */
+	bool active;
+	uint8_t key[TEE_EMULATION_MAX_KEY_SIZE];
+	size_t key_sz;
+	/* Bytes buffered by the cipher until a full block is available */
+	size_t pending;
+	/* Tag size of an authenticated encryption, set by TEE_AEInit */
+	size_t tag_sz;
+	EVP_CIPHER_CTX *cipher;
+	EVP_MAC_CTX *mac;
+	EVP_MD_CTX *md;
+};
+
+static const EVP_MD *digest_of(uint32_t algorithm)
+{
+	switch (algorithm) {
+	case TEE_ALG_MD5:
+	case TEE_ALG_HMAC_MD5:
+		return EVP_md5();
+	case TEE_ALG_SHA1:
+	case TEE_ALG_HMAC_SHA1:
+		return EVP_sha1();
+	case TEE_ALG_SHA256:
+	case TEE_ALG_HMAC_SHA256:
+		return EVP_sha256();
+	default:
+		return NULL;
+	}
+}
+
+/* Key object type expected by a keyed algorithm, 0 for digests */
+static uint32_t key_type_of(uint32_t algorithm)
+{
+	switch (algorithm) {
+	case TEE_ALG_AES_ECB_NOPAD:
+	case TEE_ALG_AES_CBC_NOPAD:
+	case TEE_ALG_AES_CMAC:
+	case TEE_ALG_AES_GCM:
+		return TEE_TYPE_AES;
+	case TEE_ALG_HMAC_MD5:
+		return TEE_TYPE_HMAC_MD5;
+	case TEE_ALG_HMAC_SHA1:
+		return TEE_TYPE_HMAC_SHA1;
+	case TEE_ALG_HMAC_SHA256:
+		return TEE_TYPE_HMAC_SHA256;
+	default:
+		return 0;
+	}
+}
+
+static bool is_aes_key_size(uint32_t bits)
+{
+	return bits == 128 || bits == 192 || bits == 256;
+}
+
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+				       uint32_t maxObjectSize,
+				       TEE_ObjectHandle *object)
+{
+	TEE_ObjectHandle o;
+
+	*object = TEE_HANDLE_NULL;
+
+	switch (objectType) {
+	case TEE_TYPE_AES:
+		if (!is_aes_key_size(maxObjectSize))
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	case TEE_TYPE_HMAC_MD5:
+	case TEE_TYPE_HMAC_SHA1:
+	case TEE_TYPE_HMAC_SHA256:
+	case TEE_TYPE_GENERIC_SECRET:
+		if (!maxObjectSize || maxObjectSize % 8 ||
+		    maxObjectSize > TEE_EMULATION_MAX_KEY_SIZE * 8)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	default:
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+
+	o = calloc(1, sizeof(*o));
+	if (!o)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	o->fd = -1;
+	o->info.objectType = objectType;
+	o->info.maxObjectSize = maxObjectSize;
+	*object = o;
+
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeTransientObject(TEE_ObjectHandle object)
+{
+	if (object == TEE_HANDLE_NULL)
+		return;
+	if (object->fd >= 0)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	OPENSSL_cleanse(object->key, sizeof(object->key));
+	free(object);
+}
+
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+				       const TEE_Attribute *attrs,
+				       uint32_t attrCount)
+{
+	if (object == TEE_HANDLE_NULL || object->fd >= 0 ||
+	    (object->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	for (uint32_t i = 0; i < attrCount; i++) {
+		size_t len = attrs[i].content.ref.length;
+
+		if (attrs[i].attributeID != TEE_ATTR_SECRET_VALUE)
+			TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+		if (len * 8 > object->info.maxObjectSize)
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (object->info.objectType == TEE_TYPE_AES &&
+		    !is_aes_key_size(len * 8))
+			return TEE_ERROR_BAD_PARAMETERS;
+
+		memcpy(object->key, attrs[i].content.ref.buffer, len);
+		object->key_sz = len;
+		object->info.objectSize = len * 8;
+		object->info.handleFlags |= TEE_HANDLE_FLAG_INITIALIZED;
+	}
+
+	return TEE_SUCCESS;
+}
+
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			  const void *buffer, size_t length)
+{
+	attr->attributeID = attributeID;
+	attr->content.ref.buffer = (void *)buffer;
+	attr->content.ref.length = length;
+}
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+				 uint32_t algorithm, uint32_t mode,
+				 uint32_t maxKeySize)
+{
+	TEE_OperationHandle op;
+	bool supported;
+
+	*operation = TEE_HANDLE_NULL;
+
+	switch (algorithm) {
+	case TEE_ALG_AES_ECB_NOPAD:
+	case TEE_ALG_AES_CBC_NOPAD:
+	case TEE_ALG_AES_GCM:
+		supported = (mode == TEE_MODE_ENCRYPT ||
+			     mode == TEE_MODE_DECRYPT) &&
+			    is_aes_key_size(maxKeySize);
+		break;
+	case TEE_ALG_AES_CMAC:
+		supported = mode == TEE_MODE_MAC &&
+			    is_aes_key_size(maxKeySize);
+		break;
+	case TEE_ALG_HMAC_MD5:
+	case TEE_ALG_HMAC_SHA1:
+	case TEE_ALG_HMAC_SHA256:
+		supported = mode == TEE_MODE_MAC && maxKeySize &&
+			    maxKeySize <= TEE_EMULATION_MAX_KEY_SIZE * 8;
+		break;
+	case TEE_ALG_MD5:
+	case TEE_ALG_SHA1:
+	case TEE_ALG_SHA256:
+		supported = mode == TEE_MODE_DIGEST;
+		break;
+	default:
+		supported = false;
+	}
+	if (!supported)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	op = calloc(1, sizeof(*op));
+	if (!op)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	op->algorithm = algorithm;
+	op->mode = mode;
+	op->max_key_size = maxKeySize;
+
+	if (mode == TEE_MODE_DIGEST) {
+		op->md = EVP_MD_CTX_new();
+		if (!op->md ||
+		    !EVP_DigestInit_ex(op->md, digest_of(algorithm), NULL)) {
+			TEE_FreeOperation(op);
+			return TEE_ERROR_OUT_OF_MEMORY;
+		}
+		op->active = true;
+	}
+
+	*operation = op;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeOperation(TEE_OperationHandle operation)
+{
+	if (operation == TEE_HANDLE_NULL)
+		return;
+
+	EVP_CIPHER_CTX_free(operation->cipher);
+	EVP_MAC_CTX_free(operation->mac);
+	EVP_MD_CTX_free(operation->md);
+	OPENSSL_cleanse(operation->key, sizeof(operation->key));
+	free(operation);
+}
+
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			       TEE_ObjectHandle key)
+{
+	if (operation == TEE_HANDLE_NULL || operation->mode == TEE_MODE_DIGEST)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	operation->active = false;
+	OPENSSL_cleanse(operation->key, sizeof(operation->key));
+	operation->key_sz = 0;
+
+	if (key == TEE_HANDLE_NULL)
+		return TEE_SUCCESS;
+
+	if (!(key->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED) ||
+	    (key->info.objectType != key_type_of(operation->algorithm) &&
+	     key->info.objectType != TEE_TYPE_GENERIC_SECRET) ||
+	    key->info.objectSize > operation->max_key_size)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	memcpy(operation->key, key->key, key->key_sz);
+	operation->key_sz = key->key_sz;
+
+	return TEE_SUCCESS;
+}
+
+void TEE_ResetOperation(TEE_OperationHandle operation)
+{
+	if (operation == TEE_HANDLE_NULL)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (operation->mode == TEE_MODE_DIGEST) {
+		if (!EVP_DigestInit_ex(operation->md,
+				       digest_of(operation->algorithm), NULL))
+			TEE_Panic(TEE_ERROR_GENERIC);
+		return;
+	}
+
+	/* The key is kept, TEE_CipherInit/TEE_MACInit start over */
+	operation->active = false;
+	operation->pending = 0;
+}
+
+/* Digests */
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+		      size_t chunkSize)
+{
+	if (operation == TEE_HANDLE_NULL || operation->mode != TEE_MODE_DIGEST)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (!EVP_DigestUpdate(operation->md, chunk, chunkSize))
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation, const void *chunk,
+			     size_t chunkLen, void *hash, size_t *hashLen)
+{
+	size_t sz;
+	unsigned int out_sz;
+
+	if (operation == TEE_HANDLE_NULL || operation->mode != TEE_MODE_DIGEST)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	sz = EVP_MD_CTX_get_size(operation->md);
+	if (*hashLen < sz) {
+		*hashLen = sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (!EVP_DigestUpdate(operation->md, chunk, chunkLen) ||
+	    !EVP_DigestFinal_ex(operation->md, hash, &out_sz) ||
+	    !EVP_DigestInit_ex(operation->md, digest_of(operation->algorithm),
+			       NULL))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	*hashLen = out_sz;
+	return TEE_SUCCESS;
+}
+
+/* Ciphers */
+
+static const EVP_CIPHER *cipher_of(uint32_t algorithm, size_t key_sz)
+{
+	bool cbc = algorithm == TEE_ALG_AES_CBC_NOPAD;
+
+	switch (key_sz) {
+	case 16:
+		return cbc ? EVP_aes_128_cbc() : EVP_aes_128_ecb();
+	case 24:
+		return cbc ? EVP_aes_192_cbc() : EVP_aes_192_ecb();
+	case 32:
+		return cbc ? EVP_aes_256_cbc() : EVP_aes_256_ecb();
+	default:
+		return NULL;
+	}
+}
+
+static void check_cipher(TEE_OperationHandle operation)
+{
+	if (operation == TEE_HANDLE_NULL ||
+	    (operation->mode != TEE_MODE_ENCRYPT &&
+	     operation->mode != TEE_MODE_DECRYPT) ||
+	    !operation->active)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+}
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+		    size_t IVLen)
+{
+	const EVP_CIPHER *cipher;
+
+	if (operation == TEE_HANDLE_NULL ||
+	    (operation->mode != TEE_MODE_ENCRYPT &&
+	     operation->mode != TEE_MODE_DECRYPT))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	cipher = cipher_of(operation->algorithm, operation->key_sz);
+	if (!cipher)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+	if (operation->algorithm == TEE_ALG_AES_CBC_NOPAD &&
+	    (!IV || IVLen != AES_BLOCK_SIZE))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (!operation->cipher)
+		operation->cipher = EVP_CIPHER_CTX_new();
+	if (!operation->cipher ||
+	    !EVP_CipherInit_ex(operation->cipher, cipher, NULL, operation->key,
+			       IV, operation->mode == TEE_MODE_ENCRYPT))
+		TEE_Panic(TEE_ERROR_GENERIC);
+	EVP_CIPHER_CTX_set_padding(operation->cipher, 0);
+
+	operation->pending = 0;
+	operation->active = true;
+}
+
+static TEE_Result cipher_update(TEE_OperationHandle operation,
+				const void *srcData, size_t srcLen,
+				void *destData, size_t *destLen)
+{
+	size_t out_sz = (operation->pending + srcLen) & ~(AES_BLOCK_SIZE - 1);
+	int n;
+
+	if (*destLen < out_sz) {
+		*destLen = out_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (srcLen > INT32_MAX ||
+	    !EVP_CipherUpdate(operation->cipher, destData, &n, srcData,
+			      (int)srcLen))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	operation->pending = (operation->pending + srcLen) % AES_BLOCK_SIZE;
+	*destLen = n;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation, const void *srcData,
+			    size_t srcLen, void *destData, size_t *destLen)
+{
+	check_cipher(operation);
+
+	return cipher_update(operation, srcData, srcLen, destData, destLen);
+}
+
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+			     const void *srcData, size_t srcLen,
+			     void *destData, size_t *destLen)
+{
+	TEE_Result res;
+
+	check_cipher(operation);
+
+	/* NOPAD modes only accept whole blocks */
+	if ((operation->pending + srcLen) % AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = cipher_update(operation, srcData, srcLen, destData, destLen);
+	if (res == TEE_SUCCESS)
+		operation->active = false;
+
+	return res;
+}
+
+/* MACs */
+
+static size_t mac_size(uint32_t algorithm)
+{
+	if (algorithm == TEE_ALG_AES_CMAC)
+		return AES_BLOCK_SIZE;
+	return EVP_MD_get_size(digest_of(algorithm));
+}
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV, size_t IVLen)
+{
+	OSSL_PARAM params[2];
+	EVP_MAC *mac;
+
+	(void)IV;
+	(void)IVLen;
+
+	if (operation == TEE_HANDLE_NULL || operation->mode != TEE_MODE_MAC)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (!operation->key_sz)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+
+	if (operation->algorithm == TEE_ALG_AES_CMAC) {
+		const EVP_CIPHER *cipher = cipher_of(TEE_ALG_AES_CBC_NOPAD,
+						     operation->key_sz);
+
+		params[0] = OSSL_PARAM_construct_utf8_string(
+				OSSL_MAC_PARAM_CIPHER,
+				(char *)EVP_CIPHER_get0_name(cipher), 0);
+	} else {
+		const EVP_MD *md = digest_of(operation->algorithm);
+
+		params[0] = OSSL_PARAM_construct_utf8_string(
+				OSSL_MAC_PARAM_DIGEST,
+				(char *)EVP_MD_get0_name(md), 0);
+	}
+	params[1] = OSSL_PARAM_construct_end();
+
+	if (!operation->mac) {
+		mac = EVP_MAC_fetch(NULL, operation->algorithm ==
+				    TEE_ALG_AES_CMAC ? "CMAC" : "HMAC", NULL);
+		operation->mac = mac ? EVP_MAC_CTX_new(mac) : NULL;
+		EVP_MAC_free(mac);
+	}
+	if (!operation->mac ||
+	    !EVP_MAC_init(operation->mac, operation->key, operation->key_sz,
+			  params))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	operation->active = true;
+}
+
+static void check_mac(TEE_OperationHandle operation)
+{
+	if (operation == TEE_HANDLE_NULL || operation->mode != TEE_MODE_MAC ||
+	    !operation->active)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+}
+
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+		   size_t chunkSize)
+{
+	check_mac(operation);
+
+	if (!EVP_MAC_update(operation->mac, chunk, chunkSize))
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       void *mac, size_t *macLen)
+{
+	size_t sz;
+
+	check_mac(operation);
+
+	sz = mac_size(operation->algorithm);
+	if (*macLen < sz) {
+		*macLen = sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (!EVP_MAC_update(operation->mac, message, messageLen) ||
+	    !EVP_MAC_final(operation->mac, mac, macLen, *macLen))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	operation->active = false;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       const void *mac, size_t macLen)
+{
+	uint8_t computed[EVP_MAX_MD_SIZE];
+	size_t computed_sz = sizeof(computed);
+	TEE_Result res;
+
+	res = TEE_MACComputeFinal(operation, message, messageLen,
+				  computed, &computed_sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (macLen != computed_sz || CRYPTO_memcmp(computed, mac, macLen))
+		return TEE_ERROR_MAC_INVALID;
+
+	return TEE_SUCCESS;
+}
+
+/* Authenticated encryption */
+
+static const EVP_CIPHER *gcm_of(size_t key_sz)
+{
+	switch (key_sz) {
+	case 16:
+		return EVP_aes_128_gcm();
+	case 24:
+		return EVP_aes_192_gcm();
+	case 32:
+		return EVP_aes_256_gcm();
+	default:
+		return NULL;
+	}
+}
+
+static void check_ae(TEE_OperationHandle operation)
+{
+	if (operation == TEE_HANDLE_NULL ||
+	    operation->algorithm != TEE_ALG_AES_GCM || !operation->active)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+}
+
+TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
+		      size_t nonceLen, uint32_t tagLen, size_t AADLen,
+		      size_t payloadLen)
+{
+	const EVP_CIPHER *cipher;
+
+	/* Only needed by CCM */
+	(void)AADLen;
+	(void)payloadLen;
+
+	if (operation == TEE_HANDLE_NULL ||
+	    operation->algorithm != TEE_ALG_AES_GCM ||
+	    !nonce || !nonceLen || nonceLen > INT32_MAX)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	/* GCM tags of 96 to 128 bits */
+	if (tagLen % 8 || tagLen < 96 || tagLen > 128)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	cipher = gcm_of(operation->key_sz);
+	if (!cipher)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+
+	if (!operation->cipher)
+		operation->cipher = EVP_CIPHER_CTX_new();
+	if (!operation->cipher ||
+	    !EVP_CipherInit_ex(operation->cipher, cipher, NULL, NULL, NULL,
+			       operation->mode == TEE_MODE_ENCRYPT) ||
+	    !EVP_CIPHER_CTX_ctrl(operation->cipher, EVP_CTRL_GCM_SET_IVLEN,
+				 (int)nonceLen, NULL) ||
+	    !EVP_CipherInit_ex(operation->cipher, NULL, NULL, operation->key,
+			       nonce, -1))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	operation->tag_sz = tagLen / 8;
+	operation->active = true;
+
+	return TEE_SUCCESS;
+}
+
+void TEE_AEUpdateAAD(TEE_OperationHandle operation, const void *AADdata,
+		     size_t AADdataLen)
+{
+	int n;
+
+	check_ae(operation);
+
+	if (AADdataLen > INT32_MAX ||
+	    !EVP_CipherUpdate(operation->cipher, NULL, &n, AADdata,
+			      (int)AADdataLen))
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+/* GCM is a stream mode, the output is as long as the input */
+static TEE_Result ae_update(TEE_OperationHandle operation,
+			    const void *srcData, size_t srcLen,
+			    void *destData, size_t *destLen)
+{
+	int n;
+
+	if (*destLen < srcLen) {
+		*destLen = srcLen;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (srcLen > INT32_MAX ||
+	    !EVP_CipherUpdate(operation->cipher, destData, &n, srcData,
+			      (int)srcLen))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	*destLen = n;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AEUpdate(TEE_OperationHandle operation, const void *srcData,
+			size_t srcLen, void *destData, size_t *destLen)
+{
+	check_ae(operation);
+
+	return ae_update(operation, srcData, srcLen, destData, destLen);
+}
+
+TEE_Result TEE_AEEncryptFinal(TEE_OperationHandle operation,
+			      const void *srcData, size_t srcLen,
+			      void *destData, size_t *destLen,
+			      void *tag, size_t *tagLen)
+{
+	uint8_t last[AES_BLOCK_SIZE];
+	TEE_Result res;
+	int n;
+
+	check_ae(operation);
+
+	if (operation->mode != TEE_MODE_ENCRYPT)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (*tagLen < operation->tag_sz) {
+		*tagLen = operation->tag_sz;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	res = ae_update(operation, srcData, srcLen, destData, destLen);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!EVP_CipherFinal_ex(operation->cipher, last, &n) ||
+	    !EVP_CIPHER_CTX_ctrl(operation->cipher, EVP_CTRL_GCM_GET_TAG,
+				 (int)operation->tag_sz, tag))
+		TEE_Panic(TEE_ERROR_GENERIC);
+
+	*tagLen = operation->tag_sz;
+	operation->active = false;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AEDecryptFinal(TEE_OperationHandle operation,
+			      const void *srcData, size_t srcLen,
+			      void *destData, size_t *destLen,
+			      void *tag, size_t tagLen)
+{
+	uint8_t last[AES_BLOCK_SIZE];
+	TEE_Result res;
+	int n;
+
+	check_ae(operation);
+
+	if (operation->mode != TEE_MODE_DECRYPT)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	res = ae_update(operation, srcData, srcLen, destData, destLen);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	operation->active = false;
+
+	if (tagLen != operation->tag_sz ||
+	    !EVP_CIPHER_CTX_ctrl(operation->cipher, EVP_CTRL_GCM_SET_TAG,
+				 (int)tagLen, tag) ||
+	    EVP_CipherFinal_ex(operation->cipher, last, &n) <= 0) {
+		/* No unauthenticated plaintext is handed out */
+		OPENSSL_cleanse(destData, *destLen);
+		return TEE_ERROR_MAC_INVALID;
+	}
+
+	return TEE_SUCCESS;
+}
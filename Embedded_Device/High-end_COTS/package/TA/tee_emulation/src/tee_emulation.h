@@ -0,0 +1,37 @@
+#ifndef TEE_EMULATION_H
+#define TEE_EMULATION_H
+
+#include <tee_internal_api.h>
+
+/* Environment variable holding the root directory of the persistent storage */
+#define TEE_EMULATION_STORAGE_ENV	"TEE_EMULATION_STORAGE"
+#define TEE_EMULATION_STORAGE_DEFAULT	"tee_storage"
+
+/* Largest key accepted by the emulated operations, in bytes */
+#define TEE_EMULATION_MAX_KEY_SIZE	64
+
+/*
+ * Object handle shared by persistent data objects (fd != -1) and transient
+ * key objects (fd == -1).
+ */
+struct __TEE_ObjectHandle {
+	TEE_ObjectInfo info;
+	/* Persistent objects */
+	int fd;
+	char *path;
+	/* Transient objects */
+	uint8_t key[TEE_EMULATION_MAX_KEY_SIZE];
+	size_t key_sz;
+};
+
+/* Defined by ta_header.c, which is compiled into every emulated TA */
+extern const TEE_UUID tee_emulation_ta_uuid;
+
+/*
+ * Binds the persistent storage to a TA (objects are kept in
+ * $TEE_EMULATION_STORAGE/<uuid>/), called by the libteec stand-in when the
+ * first session is opened.
+ */
+void tee_emulation_storage_init(const TEE_UUID *uuid);
+
+#endif /* TEE_EMULATION_H */
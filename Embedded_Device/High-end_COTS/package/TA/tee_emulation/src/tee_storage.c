@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tee_emulation.h"
+
+/* Directory of the TA bound by tee_emulation_storage_init(), "" until then */
+static char storage_dir[PATH_MAX];
+
+#define DATA_FLAGS	(TEE_DATA_FLAG_ACCESS_READ | \
+			 TEE_DATA_FLAG_ACCESS_WRITE | \
+			 TEE_DATA_FLAG_ACCESS_WRITE_META | \
+			 TEE_DATA_FLAG_SHARE_READ | \
+			 TEE_DATA_FLAG_SHARE_WRITE)
+
+static int make_dir(const char *path)
+{
+	char tmp[PATH_MAX];
+
+	if (snprintf(tmp, sizeof(tmp), "%s", path) >= (int)sizeof(tmp))
+		return -1;
+
+	for (char *p = tmp + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(tmp, 0700) && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	if (mkdir(tmp, 0700) && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+void tee_emulation_storage_init(const TEE_UUID *uuid)
+{
+	const char *root = getenv(TEE_EMULATION_STORAGE_ENV);
+	int n;
+
+	if (!root || !*root)
+		root = TEE_EMULATION_STORAGE_DEFAULT;
+
+	n = snprintf(storage_dir, sizeof(storage_dir),
+		     "%s/%08" PRIx32 "-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		     root, uuid->timeLow, uuid->timeMid,
+		     uuid->timeHiAndVersion,
+		     uuid->clockSeqAndNode[0], uuid->clockSeqAndNode[1],
+		     uuid->clockSeqAndNode[2], uuid->clockSeqAndNode[3],
+		     uuid->clockSeqAndNode[4], uuid->clockSeqAndNode[5],
+		     uuid->clockSeqAndNode[6], uuid->clockSeqAndNode[7]);
+
+	if (n >= (int)sizeof(storage_dir) || make_dir(storage_dir)) {
+		EMSG("Cannot create storage directory %s", storage_dir);
+		TEE_Panic(TEE_ERROR_STORAGE_NO_SPACE);
+	}
+}
+
+/* Objects are stored in one file each, named after the hex encoded id */
+static TEE_Result object_path(uint32_t storageID, const void *objectID,
+			      size_t objectIDLen, char **path)
+{
+	static const char hex[] = "0123456789abcdef";
+	const uint8_t *id = objectID;
+	size_t dir_sz = strlen(storage_dir);
+	char *p;
+
+	if (!dir_sz)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+
+	if (storageID != TEE_STORAGE_PRIVATE &&
+	    storageID != TEE_STORAGE_PRIVATE_REE &&
+	    storageID != TEE_STORAGE_PRIVATE_RPMB)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	if (!objectIDLen || objectIDLen > TEE_OBJECT_ID_MAX_LEN)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	p = malloc(dir_sz + 1 + 2 * objectIDLen + 1);
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	*path = p;
+	memcpy(p, storage_dir, dir_sz);
+	p += dir_sz;
+	*p++ = '/';
+	for (size_t i = 0; i < objectIDLen; i++) {
+		*p++ = hex[id[i] >> 4];
+		*p++ = hex[id[i] & 0xF];
+	}
+	*p = '\0';
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result open_object(char *path, int oflags, uint32_t flags,
+			      TEE_ObjectHandle *object)
+{
+	TEE_ObjectHandle o;
+	struct stat st;
+	int fd;
+
+	if (flags & TEE_DATA_FLAG_ACCESS_WRITE)
+		oflags |= O_RDWR;
+	else
+		oflags |= O_RDONLY;
+
+	fd = open(path, oflags | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		free(path);
+		if (errno == ENOENT)
+			return TEE_ERROR_ITEM_NOT_FOUND;
+		if (errno == EEXIST)
+			return TEE_ERROR_ACCESS_CONFLICT;
+		return TEE_ERROR_GENERIC;
+	}
+
+	o = calloc(1, sizeof(*o));
+	if (!o || fstat(fd, &st)) {
+		free(o);
+		free(path);
+		close(fd);
+		return o ? TEE_ERROR_GENERIC : TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	o->fd = fd;
+	o->path = path;
+	o->info.objectType = TEE_TYPE_DATA;
+	o->info.dataSize = st.st_size;
+	o->info.handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+			      TEE_HANDLE_FLAG_INITIALIZED |
+			      (flags & DATA_FLAGS);
+	*object = o;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+				    size_t objectIDLen, uint32_t flags,
+				    TEE_ObjectHandle *object)
+{
+	TEE_Result res;
+	char *path;
+
+	if (!object || (flags & ~DATA_FLAGS))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	*object = TEE_HANDLE_NULL;
+
+	res = object_path(storageID, objectID, objectIDLen, &path);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return open_object(path, 0, flags, object);
+}
+
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID, const void *objectID,
+				      size_t objectIDLen, uint32_t flags,
+				      TEE_ObjectHandle attributes,
+				      const void *initialData,
+				      size_t initialDataLen,
+				      TEE_ObjectHandle *object)
+{
+	TEE_ObjectHandle o;
+	TEE_Result res;
+	char *path;
+	int oflags = O_CREAT;
+
+	if (flags & ~(DATA_FLAGS | TEE_DATA_FLAG_OVERWRITE))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (object)
+		*object = TEE_HANDLE_NULL;
+
+	/* Persistent key objects are not used by the emulated TAs */
+	if (attributes != TEE_HANDLE_NULL)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	res = object_path(storageID, objectID, objectIDLen, &path);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	oflags |= (flags & TEE_DATA_FLAG_OVERWRITE) ? O_TRUNC : O_EXCL;
+	res = open_object(path, oflags, flags | TEE_DATA_FLAG_ACCESS_WRITE, &o);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (initialDataLen) {
+		res = TEE_WriteObjectData(o, initialData, initialDataLen);
+		if (res != TEE_SUCCESS) {
+			unlink(o->path);
+			TEE_CloseObject(o);
+			return res;
+		}
+		o->info.dataPosition = 0;
+	}
+
+	o->info.handleFlags &= ~TEE_DATA_FLAG_ACCESS_WRITE;
+	o->info.handleFlags |= flags & TEE_DATA_FLAG_ACCESS_WRITE;
+
+	if (object)
+		*object = o;
+	else
+		TEE_CloseObject(o);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (object == TEE_HANDLE_NULL)
+		return TEE_SUCCESS;
+
+	if (object->fd < 0 ||
+	    !(object->info.handleFlags & TEE_DATA_FLAG_ACCESS_WRITE_META))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (unlink(object->path))
+		res = TEE_ERROR_GENERIC;
+
+	TEE_CloseObject(object);
+	return res;
+}
+
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+			      size_t size, size_t *count)
+{
+	uint8_t *buf = buffer;
+	size_t done = 0;
+
+	if (object == TEE_HANDLE_NULL || object->fd < 0 ||
+	    !(object->info.handleFlags & TEE_DATA_FLAG_ACCESS_READ))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	while (done < size) {
+		ssize_t n = pread(object->fd, buf + done, size - done,
+				  object->info.dataPosition + done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return TEE_ERROR_GENERIC;
+		if (n == 0)
+			break;
+		done += n;
+	}
+
+	object->info.dataPosition += done;
+	*count = done;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+			       size_t size)
+{
+	const uint8_t *buf = buffer;
+	size_t done = 0;
+
+	if (object == TEE_HANDLE_NULL || object->fd < 0 ||
+	    !(object->info.handleFlags & TEE_DATA_FLAG_ACCESS_WRITE))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	while (done < size) {
+		ssize_t n = pwrite(object->fd, buf + done, size - done,
+				   object->info.dataPosition + done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return errno == ENOSPC ? TEE_ERROR_STORAGE_NO_SPACE :
+						 TEE_ERROR_GENERIC;
+		done += n;
+	}
+
+	object->info.dataPosition += done;
+	if (object->info.dataPosition > object->info.dataSize)
+		object->info.dataSize = object->info.dataPosition;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_GetObjectInfo1(TEE_ObjectHandle objectHandle,
+			      TEE_ObjectInfo *objectInfo)
+{
+	if (objectHandle == TEE_HANDLE_NULL || !objectInfo)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	*objectInfo = objectHandle->info;
+	return TEE_SUCCESS;
+}
+
+void TEE_CloseObject(TEE_ObjectHandle object)
+{
+	if (object == TEE_HANDLE_NULL)
+		return;
+
+	if (object->fd >= 0) {
+		close(object->fd);
+		free(object->path);
+		free(object);
+	} else {
+		TEE_FreeTransientObject(object);
+	}
+}